@@ -0,0 +1,46 @@
+set -e
+
+# Compares compile-plus-run latency of the bytecode vm against the LLVM jit
+# usage: scripts/benchmark-vm.sh <path to solar> [runs] [sources...]
+
+SOLAR=${1:-build/src/solar}
+RUNS=${2:-20}
+shift 2 || shift $#
+
+SOURCES=("$@")
+if [ ${#SOURCES[@]} -eq 0 ]
+then
+    SOURCES=(examples/*.sol)
+fi
+
+now() {
+    date +%s%N
+}
+
+# Mean of "time to first instruction" over every run, in milliseconds
+startup() {
+    for _ in $(seq "$RUNS")
+    do
+        "$SOLAR" run "$@" --startup-time 2>&1 >/dev/null | grep "first instruction"
+    done | awk '{ total += $5 } END { printf "%.3f", total / NR }'
+}
+
+# Mean wall time of a whole process, in milliseconds
+wall() {
+    local start end
+    start=$(now)
+    for _ in $(seq "$RUNS")
+    do
+        "$SOLAR" run "$@" >/dev/null || true
+    done
+    end=$(now)
+    awk -v ns=$((end - start)) -v runs="$RUNS" 'BEGIN { printf "%.3f", ns / runs / 1000000 }'
+}
+
+printf "%-45s %12s %12s %12s %12s\n" source "vm start" "jit start" "vm wall" "jit wall"
+for source in "${SOURCES[@]}"
+do
+    printf "%-45s %12s %12s %12s %12s\n" "$source" \
+        "$(startup --vm "$source")" "$(startup "$source")" \
+        "$(wall --vm "$source")" "$(wall "$source")"
+done
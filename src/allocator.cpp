@@ -0,0 +1,85 @@
+#include "memory.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// The global operator new and delete are replaced to count allocations for
+// --mem-report. This file is linked into the solar executable rather than
+// solar_lib, so that programs embedding the compiler keep their own.
+
+static void *allocate(size_t size) {
+  // malloc(0) may return null, which operator new can't
+  auto pointer = std::malloc(size ? size : 1);
+  count_allocation(pointer, size);
+  return pointer;
+}
+
+static void *allocate(size_t size, std::align_val_t alignment) {
+  auto align = static_cast<size_t>(alignment);
+  if (align < sizeof(void *))
+    align = sizeof(void *);
+
+  void *pointer = nullptr;
+  if (posix_memalign(&pointer, align, size ? size : 1) != 0)
+    return nullptr;
+
+  count_allocation(pointer, size);
+  return pointer;
+}
+
+static void deallocate(void *pointer) {
+  count_free(pointer);
+  std::free(pointer);
+}
+
+void *operator new(size_t size) {
+  if (auto pointer = allocate(size))
+    return pointer;
+
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  if (auto pointer = allocate(size, alignment))
+    return pointer;
+
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept { deallocate(pointer); }
+void operator delete[](void *pointer) noexcept { deallocate(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void *pointer, size_t) noexcept {
+  deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+  deallocate(pointer);
+}
@@ -1,5 +1,8 @@
 #include "ast.hpp"
 
+#include <cctype>
+#include <string>
+
 Token ast::Type::Primitive::BOOL{Token::Kind::IDENTIFIER, "bool",
                                  SourcePosition()};
 Token ast::Type::Primitive::INT32{Token::Kind::IDENTIFIER, "i32",
@@ -14,3 +17,49 @@ Token ast::Type::Primitive::FLOAT32{Token::Kind::IDENTIFIER, "f32",
                                     SourcePosition()};
 Token ast::Type::Primitive::FLOAT64{Token::Kind::IDENTIFIER, "f64",
                                     SourcePosition()};
+
+bool ast::Type::is_array(const Token &type) {
+  return type.lexeme.size() > 2 && type.lexeme[0] == '[' &&
+         isdigit(type.lexeme[1]);
+}
+
+bool ast::Type::is_slice(const Token &type) {
+  return type.lexeme.starts_with("[]");
+}
+
+uint64_t ast::Type::array_length(const Token &type) {
+  return std::stoull(type.lexeme.substr(1));
+}
+
+Token ast::Type::element_type(const Token &type) {
+  auto element = type.lexeme.substr(type.lexeme.find(']') + 1);
+  return {Token::Kind::IDENTIFIER, element, type.position};
+}
+
+bool ast::Type::is_vector(const Token &type) {
+  auto separator = type.lexeme.rfind('x');
+  if (separator == std::string::npos)
+    return false;
+
+  auto lane = type.lexeme.substr(0, separator);
+  auto count = type.lexeme.substr(separator + 1);
+  auto known_lane = lane == Primitive::BOOL.lexeme ||
+                    lane == Primitive::INT32.lexeme ||
+                    lane == Primitive::INT64.lexeme ||
+                    lane == Primitive::UINT32.lexeme ||
+                    lane == Primitive::UINT64.lexeme ||
+                    lane == Primitive::FLOAT32.lexeme ||
+                    lane == Primitive::FLOAT64.lexeme;
+
+  return known_lane &&
+         (count == "2" || count == "4" || count == "8" || count == "16");
+}
+
+unsigned ast::Type::lane_count(const Token &type) {
+  return std::stoul(type.lexeme.substr(type.lexeme.rfind('x') + 1));
+}
+
+Token ast::Type::lane_type(const Token &type) {
+  auto lane = type.lexeme.substr(0, type.lexeme.rfind('x'));
+  return {Token::Kind::IDENTIFIER, lane, type.position};
+}
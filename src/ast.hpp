@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <sstream>
 #include <vector>
 
@@ -15,12 +16,19 @@ struct Binop;
 struct Condition;
 struct Call;
 struct StringLiteral;
+struct Index;
+struct ArrayLiteral;
+struct Member;
 struct VariableDeclaration;
 struct FunctionPrototype;
 struct ExpressionStatement;
 struct Block;
 struct Function;
 struct Return;
+struct Assignment;
+struct While;
+struct For;
+struct Struct;
 
 struct Type {
   Token name;
@@ -34,6 +42,20 @@ struct Type {
     static Token FLOAT32;
     static Token FLOAT64;
   };
+
+  // Composite types are spelled out in their token's lexeme: [4]i64 is a
+  // fixed array of four i64s, and []i64 a slice (a pointer and a length)
+  // of any number of them
+  static bool is_array(const Token &);
+  static bool is_slice(const Token &);
+  static uint64_t array_length(const Token &);
+  static Token element_type(const Token &);
+
+  // Vectors are named for their lanes: f32x4 is four f32s operated on
+  // together, and boolx4 the mask comparing two of them produces
+  static bool is_vector(const Token &);
+  static unsigned lane_count(const Token &);
+  static Token lane_type(const Token &);
 };
 
 union Value {
@@ -51,6 +73,7 @@ enum class Operation {
   SUBTRACT,
   MULTIPLY,
   DIVIDE,
+  REMAINDER,
   COMPARE_IS_EQUAL,
   COMPARE_IS_LESS,
   COMPARE_IS_LESS_OR_EQUAL,
@@ -76,6 +99,9 @@ struct ExpressionVisitor {
   virtual void *visit(Condition &) = 0;
   virtual void *visit(Call &) = 0;
   virtual void *visit(StringLiteral &) = 0;
+  virtual void *visit(Index &) = 0;
+  virtual void *visit(ArrayLiteral &) = 0;
+  virtual void *visit(Member &) = 0;
 };
 
 struct Expression : public Node {
@@ -193,6 +219,9 @@ struct Binop : public Expression {
     case Operation::DIVIDE:
       builder << '/';
       break;
+    case Operation::REMAINDER:
+      builder << '%';
+      break;
     case Operation::COMPARE_IS_EQUAL:
       builder << "==";
       break;
@@ -282,12 +311,105 @@ struct Call : public Expression {
   }
 };
 
+// Indexes an array or slice, or with an end, slices it from index up to,
+// but not including, end
+struct Index : public Expression {
+  Expression *target;
+  Expression *index;
+  Expression *end = nullptr;
+
+  Index(const SourcePosition &position, Expression *target, Expression *index)
+      : Expression(position), target(target), index(index) {}
+
+  ~Index() override {
+    delete target;
+    delete index;
+    delete end;
+  }
+
+  void *accept(ExpressionVisitor &visitor) override {
+    return visitor.visit(*this);
+  }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(index " << target->describe() << " " << index->describe();
+    if (end)
+      builder << ".." << end->describe();
+
+    builder << ")";
+    return builder.str();
+  }
+};
+
+// Either lists its elements, [1, 2, 3], or repeats one, [0; 1024]
+struct ArrayLiteral : public Expression {
+  std::vector<Expression *> elements;
+  uint64_t repeat = 0;
+
+  ArrayLiteral(const SourcePosition &position,
+               std::vector<Expression *> elements)
+      : Expression(position), elements(std::move(elements)) {}
+
+  ~ArrayLiteral() override {
+    for (auto element : elements) {
+      delete element;
+    }
+  }
+
+  void *accept(ExpressionVisitor &visitor) override {
+    return visitor.visit(*this);
+  }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(array ";
+    for (const auto &element : elements) {
+      builder << element->describe();
+      if (&element != &elements.back())
+        builder << ", ";
+    }
+
+    if (repeat)
+      builder << "; " << repeat;
+
+    builder << ")";
+    return builder.str();
+  }
+};
+
+// A field of a struct, p.x
+struct Member : public Expression {
+  Expression *target;
+  Token field;
+
+  Member(const SourcePosition &position, Expression *target,
+         const Token &field)
+      : Expression(position), target(target), field(field) {}
+
+  ~Member() override { delete target; }
+
+  void *accept(ExpressionVisitor &visitor) override {
+    return visitor.visit(*this);
+  }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(member " << target->describe() << " " << field.lexeme << ")";
+    return builder.str();
+  }
+};
+
 struct StatementVisitor {
   virtual void visit(VariableDeclaration &) = 0;
   virtual void visit(ExpressionStatement &) = 0;
   virtual void visit(Function &) = 0;
   virtual void visit(Block &) = 0;
   virtual void visit(Return &) = 0;
+  virtual void visit(Assignment &) = 0;
+  virtual void visit(While &) = 0;
+  virtual void visit(For &) = 0;
+  virtual void visit(Struct &) = 0;
 };
 
 struct Statement : public Node {
@@ -296,10 +418,13 @@ struct Statement : public Node {
   virtual void accept(StatementVisitor &) = 0;
 };
 
+// A const variable's initializer is evaluated at compile time, and replaced
+// with the literal value it evaluated to
 struct VariableDeclaration : public Statement {
   Token name;
   Token type;
   Expression *initializer;
+  bool is_const = false;
 
   VariableDeclaration() = delete;
   VariableDeclaration(const SourcePosition &position, const Token &name,
@@ -312,7 +437,8 @@ struct VariableDeclaration : public Statement {
 
   [[nodiscard]] std::string describe() const override {
     std::ostringstream builder;
-    builder << "(var-decl " << type.lexeme << "<" << name.lexeme << "> "
+    builder << (is_const ? "(const-decl " : "(var-decl ") << type.lexeme
+            << "<" << name.lexeme << "> "
             << initializer->describe() << ")";
     return builder.str();
   }
@@ -366,14 +492,74 @@ struct Block : public Statement {
   }
 };
 
+// Written @name or @name(arguments) ahead of what it applies to
+struct Attribute {
+  SourcePosition position;
+  Token name;
+  std::vector<Token> arguments;
+
+  [[nodiscard]] std::string describe() const {
+    std::ostringstream builder;
+    builder << "@" << name.lexeme;
+    if (!arguments.empty()) {
+      builder << "(";
+      for (const auto &argument : arguments) {
+        builder << argument.lexeme;
+        if (&argument != &arguments.back())
+          builder << ", ";
+      }
+      builder << ")";
+    }
+
+    return builder.str();
+  }
+};
+
+inline std::string describe(const std::vector<Attribute> &attributes) {
+  std::ostringstream builder;
+  for (const auto &attribute : attributes)
+    builder << attribute.describe() << " ";
+
+  return builder.str();
+}
+
 struct FunctionPrototype {
   Token name;
   std::vector<Parameter> parameter_list;
   Token return_type;
+  std::vector<Attribute> attributes;
+
+  // Const functions can be called at compile time, from the initializers of
+  // const variables
+  bool is_const = false;
+
+  // Generic functions, func max<T>(a: T, b: T) -> T, are specialized for
+  // each list of type arguments they're called with ahead of code generation
+  std::vector<Token> type_parameters;
+
+  [[nodiscard]] bool has_attribute(const std::string &attribute) const {
+    for (const auto &candidate : attributes) {
+      if (candidate.name.lexeme == attribute)
+        return true;
+    }
+
+    return false;
+  }
 
   [[nodiscard]] std::string describe() const {
     std::ostringstream builder;
-    builder << "(fn-type " << name.lexeme << "(";
+    builder << "(fn-type " << ast::describe(attributes)
+            << (is_const ? "const " : "") << name.lexeme;
+    if (!type_parameters.empty()) {
+      builder << "<";
+      for (const auto &type_parameter : type_parameters) {
+        builder << type_parameter.lexeme;
+        if (&type_parameter != &type_parameters.back())
+          builder << ", ";
+      }
+      builder << ">";
+    }
+    builder << "(";
     for (const auto &parameter : parameter_list) {
       builder << parameter.name.lexeme << ":" << parameter.type.lexeme;
       if (&parameter != &parameter_list.back())
@@ -423,7 +609,214 @@ struct Return : public Statement {
   }
 };
 
+// Assigns to a variable or to an element of an array or slice
+struct Assignment : public Statement {
+  Expression *target;
+  Expression *value;
+
+  Assignment() = delete;
+  Assignment(const SourcePosition &position, Expression *target,
+             Expression *value)
+      : Statement(position), target(target), value(value) {}
+  ~Assignment() override {
+    delete target;
+    delete value;
+  }
+
+  void accept(StatementVisitor &visitor) override { visitor.visit(*this); }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(assign " << target->describe() << " " << value->describe()
+            << ")";
+    return builder.str();
+  }
+};
+
+struct While : public Statement {
+  Expression *condition;
+  Block *body = nullptr;
+
+  // Loop hints, like @unroll(4) and @vectorize(8)
+  std::vector<Attribute> attributes;
+
+  While() = delete;
+  While(const SourcePosition &position, Expression *condition)
+      : Statement(position), condition(condition) {}
+  ~While() override {
+    delete condition;
+    delete body;
+  }
+
+  void accept(StatementVisitor &visitor) override { visitor.visit(*this); }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(" << ast::describe(attributes) << "while "
+            << condition->describe() << " " << body->describe() << ")";
+    return builder.str();
+  }
+};
+
+// Counts its variable from start up to, but not including, end. End is
+// evaluated once, before the first iteration.
+struct For : public Statement {
+  Token variable;
+  Expression *start;
+  Expression *end;
+  Block *body = nullptr;
+
+  // Loop hints, like @unroll(4) and @vectorize(8)
+  std::vector<Attribute> attributes;
+
+  For() = delete;
+  For(const SourcePosition &position, const Token &variable,
+      Expression *start, Expression *end)
+      : Statement(position), variable(variable), start(start), end(end) {}
+  ~For() override {
+    delete start;
+    delete end;
+    delete body;
+  }
+
+  void accept(StatementVisitor &visitor) override { visitor.visit(*this); }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(" << ast::describe(attributes) << "for " << variable.lexeme
+            << " " << start->describe() << ".." << end->describe() << " "
+            << body->describe() << ")";
+    return builder.str();
+  }
+};
+
+// A struct's fields are laid out in order, padded to their alignment, unless
+// attributes ask otherwise: @packed leaves out the padding, @align(64) aligns
+// the struct to a 64 byte boundary, and @soa lays arrays of the struct out
+// as an array for each field
+struct Struct : public Statement {
+  Token name;
+  std::vector<Parameter> fields;
+  std::vector<Attribute> attributes;
+
+  Struct() = delete;
+  Struct(const SourcePosition &position, const Token &name)
+      : Statement(position), name(name) {}
+
+  void accept(StatementVisitor &visitor) override { visitor.visit(*this); }
+
+  [[nodiscard]] bool has_attribute(const std::string &attribute) const {
+    for (const auto &candidate : attributes) {
+      if (candidate.name.lexeme == attribute)
+        return true;
+    }
+
+    return false;
+  }
+
+  [[nodiscard]] std::string describe() const override {
+    std::ostringstream builder;
+    builder << "(struct " << ast::describe(attributes) << name.lexeme << "(";
+    for (const auto &field : fields) {
+      builder << field.name.lexeme << ":" << field.type.lexeme;
+      if (&field != &fields.back())
+        builder << ", ";
+    }
+    builder << "))";
+    return builder.str();
+  }
+};
+
 struct Program {
   std::vector<Statement *> statements;
 };
+
+// Visits every expression and statement below the node it's accepted by.
+// Passes that look at only a few kinds of node override their visits, and
+// call the Walker's to carry on below them.
+struct Walker : public ExpressionVisitor, public StatementVisitor {
+  void *visit(Variable &) override { return nullptr; }
+  void *visit(LiteralValueExpression &) override { return nullptr; }
+  void *visit(StringLiteral &) override { return nullptr; }
+
+  void *visit(Binop &binop) override {
+    binop.left->accept(*this);
+    binop.right->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(Condition &condition) override {
+    condition.condition->accept(*this);
+    condition.then->accept(*this);
+    if (condition.otherwise)
+      condition.otherwise->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(Call &call) override {
+    for (const auto &argument : call.arguments)
+      argument->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(Index &index) override {
+    index.target->accept(*this);
+    index.index->accept(*this);
+    if (index.end)
+      index.end->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(Member &member) override {
+    member.target->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(ArrayLiteral &literal) override {
+    for (const auto &element : literal.elements)
+      element->accept(*this);
+    return nullptr;
+  }
+
+  void visit(VariableDeclaration &declaration) override {
+    if (declaration.initializer)
+      declaration.initializer->accept(*this);
+  }
+
+  void visit(ExpressionStatement &statement) override {
+    statement.expression->accept(*this);
+  }
+
+  void visit(Function &function) override { function.body->accept(*this); }
+
+  void visit(Block &block) override {
+    for (const auto &statement : block.statements) {
+      if (statement)
+        statement->accept(*this);
+    }
+  }
+
+  void visit(Return &ret) override {
+    if (ret.return_value)
+      ret.return_value->accept(*this);
+  }
+
+  void visit(Assignment &assignment) override {
+    assignment.target->accept(*this);
+    assignment.value->accept(*this);
+  }
+
+  void visit(While &loop) override {
+    loop.condition->accept(*this);
+    loop.body->accept(*this);
+  }
+
+  void visit(For &loop) override {
+    loop.start->accept(*this);
+    loop.end->accept(*this);
+    loop.body->accept(*this);
+  }
+
+  void visit(Struct &) override {}
+};
 } // namespace ast
\ No newline at end of file
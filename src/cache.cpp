@@ -0,0 +1,184 @@
+#include "cache.hpp"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+CacheKey &CacheKey::add(StringRef field) {
+  hasher.update(std::to_string(field.size()));
+  hasher.update(":");
+  hasher.update(field);
+  return *this;
+}
+
+std::string CacheKey::digest() { return toHex(hasher.final(), true); }
+
+CompilationCache::CompilationCache(std::filesystem::path directory,
+                                   uint64_t size_limit)
+    : directory(std::move(directory)), size_limit(size_limit) {}
+
+std::filesystem::path CompilationCache::default_directory() {
+  SmallString<128> path;
+  if (!sys::path::cache_directory(path))
+    return std::filesystem::temp_directory_path() / "solar-cache";
+
+  sys::path::append(path, "solar");
+  return path.str().str();
+}
+
+std::string CompilationCache::compiler_identity() {
+  // Like ccache, the executable's size and modification time stand in for
+  // hashing the whole thing
+  auto executable = sys::fs::getMainExecutable(
+      nullptr, reinterpret_cast<void *>(&CompilationCache::compiler_identity));
+
+  std::string identity = "solar llvm-" LLVM_VERSION_STRING;
+
+  sys::fs::file_status status;
+  if (!sys::fs::status(executable, status)) {
+    identity += " " + std::to_string(status.getSize()) + " " +
+                std::to_string(status.getLastModificationTime()
+                                   .time_since_epoch()
+                                   .count());
+  }
+
+  return identity;
+}
+
+// Objects are spread over subdirectories, like git's, to keep each small
+std::filesystem::path CompilationCache::path_for(const std::string &key) const {
+  return directory / key.substr(0, 2) / (key.substr(2) + ".o");
+}
+
+Optional<ObjectBuffer> CompilationCache::lookup(const std::string &key) {
+  auto path = path_for(key);
+  auto buffer = MemoryBuffer::getFile(path.string());
+  if (!buffer) {
+    misses += 1;
+    return None;
+  }
+
+  // The modification time doubles as the last use, which eviction reads
+  std::error_code error;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), error);
+
+  hits += 1;
+  ObjectBuffer object((*buffer)->getBufferStart(),
+                      (*buffer)->getBufferEnd());
+  return object;
+}
+
+Error CompilationCache::store(const std::string &key,
+                             const ObjectBuffer &object) {
+  auto path = path_for(key);
+
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error)
+    return errorCodeToError(error);
+
+  // Another compiler reading the cache never sees a partly written object
+  auto temporary = path;
+  temporary += ".tmp" + std::to_string(sys::Process::getProcessId());
+
+  {
+    raw_fd_ostream file(temporary.string(), error, sys::fs::OF_None);
+    if (error)
+      return errorCodeToError(error);
+
+    file.write(object.data(), object.size());
+    file.close();
+
+    if (file.has_error()) {
+      auto write_error = file.error();
+      file.clear_error();
+      std::filesystem::remove(temporary, error);
+      return errorCodeToError(write_error);
+    }
+  }
+
+  std::filesystem::rename(temporary, path, error);
+  return errorCodeToError(error);
+}
+
+struct CacheEntry {
+  std::filesystem::path path;
+  uint64_t size;
+  std::filesystem::file_time_type last_used;
+};
+
+static std::vector<CacheEntry> list_entries(const std::filesystem::path &dir) {
+  std::vector<CacheEntry> entries;
+
+  std::error_code error;
+  std::filesystem::recursive_directory_iterator iterator(dir, error);
+  for (; !error && iterator != std::filesystem::end(iterator);
+       iterator.increment(error)) {
+    if (!iterator->is_regular_file(error) ||
+        iterator->path().extension() != ".o")
+      continue;
+
+    auto size = iterator->file_size(error);
+    auto last_used = iterator->last_write_time(error);
+    if (!error)
+      entries.push_back({iterator->path(), size, last_used});
+
+    error.clear();
+  }
+
+  return entries;
+}
+
+void CompilationCache::evict() {
+  auto entries = list_entries(directory);
+
+  uint64_t size = 0;
+  for (const auto &entry : entries)
+    size += entry.size;
+
+  if (size <= size_limit)
+    return;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const CacheEntry &left, const CacheEntry &right) {
+              return left.last_used < right.last_used;
+            });
+
+  // Objects another compiler already evicted count as removed all the same
+  for (const auto &entry : entries) {
+    if (size <= size_limit)
+      break;
+
+    std::error_code error;
+    std::filesystem::remove(entry.path, error);
+    size -= entry.size;
+    evictions += 1;
+  }
+}
+
+void CompilationCache::print_stats(raw_ostream &stream) {
+  auto entries = list_entries(directory);
+
+  uint64_t size = 0;
+  for (const auto &entry : entries)
+    size += entry.size;
+
+  auto megabytes = [](uint64_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+  stream << "cache directory: " << directory.string() << "\n";
+  stream << "hits: " << hits << "\n";
+  stream << "misses: " << misses << "\n";
+  stream << "evictions: " << evictions << "\n";
+  stream << "objects: " << entries.size() << "\n";
+  stream << "size: " << format("%.2f", megabytes(size)) << " of "
+         << format("%.2f", megabytes(size_limit)) << " MiB\n";
+}
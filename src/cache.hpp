@@ -0,0 +1,55 @@
+#pragma once
+
+#include "linker.hpp"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Hashes everything that goes into a compiled object. Fields are kept apart,
+// so moving bytes from one field to the next changes the key.
+class CacheKey {
+  llvm::SHA1 hasher;
+
+public:
+  CacheKey &add(llvm::StringRef field);
+  std::string digest();
+};
+
+// Objects compiled earlier, stored in a directory under the key of what went
+// into them. Once the directory grows past its size limit, the least recently
+// used objects are evicted. Several compilers can share a directory, since
+// objects are written under a temporary name and renamed into place.
+class CompilationCache {
+  std::filesystem::path directory;
+  uint64_t size_limit;
+
+  unsigned hits = 0;
+  unsigned misses = 0;
+  unsigned evictions = 0;
+
+  std::filesystem::path path_for(const std::string &key) const;
+
+public:
+  CompilationCache(std::filesystem::path directory, uint64_t size_limit);
+
+  // $XDG_CACHE_HOME/solar, or the platform's equivalent
+  static std::filesystem::path default_directory();
+
+  // Identifies the build of solar doing the compiling, so that objects from
+  // another build are never reused
+  static std::string compiler_identity();
+
+  llvm::Optional<ObjectBuffer> lookup(const std::string &key);
+  llvm::Error store(const std::string &key, const ObjectBuffer &object);
+
+  // Removes the least recently used objects until the cache fits its limit
+  void evict();
+
+  void print_stats(llvm::raw_ostream &);
+};
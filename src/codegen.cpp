@@ -1,26 +1,118 @@
 #include "codegen.hpp"
+#include "format.hpp"
+#include "timing.hpp"
 
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Vectorize.h"
 
 #include <cassert>
 
 using namespace llvm;
 using namespace std;
 
-static Type *llvm_type_for(const Token &type_token, LLVMContext &context) {
-  if (type_token == ast::Type::Primitive::INT64 ||
+// Slices are a pointer to their first element and their length. Named
+// types stand for user defined ones, so a literal struct is always a slice.
+static StructType *slice_type_for(Type *element) {
+  auto &context = element->getContext();
+  return StructType::get(context, {PointerType::getUnqual(element),
+                                   Type::getInt64Ty(context)});
+}
+
+static bool is_slice(Type *type) {
+  auto structure = dyn_cast<StructType>(type);
+  return structure && structure->isLiteral() &&
+         structure->getNumElements() == 2 &&
+         structure->getElementType(0)->isPointerTy() &&
+         structure->getElementType(1)->isIntegerTy(64);
+}
+
+// Arrays and slices of @soa structs are identified structs named for the
+// types they stand for, holding a column for each field. Slices hold a
+// pointer to the first element of each column, then their length.
+static bool is_soa(Type *type) {
+  auto structure = dyn_cast<StructType>(type);
+  return structure && structure->hasName() &&
+         structure->getName().startswith("[");
+}
+
+static bool is_soa_slice(Type *type) {
+  return is_soa(type) && type->getStructName().startswith("[]");
+}
+
+static Type *llvm_type_for(const Token &type_token, LLVMContext &context,
+                           StructDefinitions &structs);
+
+static StructType *soa_type_for(const Token &type_token,
+                                const ast::Struct &structure,
+                                LLVMContext &context,
+                                StructDefinitions &structs) {
+  auto existing = structs.find(type_token.lexeme);
+  if (existing != structs.end())
+    return existing->second.type;
+
+  auto is_array = ast::Type::is_array(type_token);
+  std::vector<Type *> columns;
+  for (const auto &field : structure.fields) {
+    auto type = llvm_type_for(field.type, context, structs);
+    if (is_array)
+      columns.push_back(
+          ArrayType::get(type, ast::Type::array_length(type_token)));
+    else
+      columns.push_back(PointerType::getUnqual(type));
+  }
+
+  if (!is_array)
+    columns.push_back(Type::getInt64Ty(context));
+
+  auto type = StructType::create(context, columns, type_token.lexeme);
+  structs.emplace(type_token.lexeme, StructDefinition{&structure, type});
+  return type;
+}
+
+static Type *llvm_type_for(const Token &type_token, LLVMContext &context,
+                           StructDefinitions &structs) {
+  if (ast::Type::is_array(type_token) || ast::Type::is_slice(type_token)) {
+    auto element = structs.find(ast::Type::element_type(type_token).lexeme);
+    if (element != structs.end() &&
+        element->second.declaration->has_attribute("soa"))
+      return soa_type_for(type_token, *element->second.declaration, context,
+                          structs);
+  }
+
+  if (ast::Type::is_array(type_token)) {
+    return ArrayType::get(
+        llvm_type_for(ast::Type::element_type(type_token), context, structs),
+        ast::Type::array_length(type_token));
+  } else if (ast::Type::is_slice(type_token)) {
+    return slice_type_for(
+        llvm_type_for(ast::Type::element_type(type_token), context, structs));
+  } else if (ast::Type::is_vector(type_token)) {
+    return FixedVectorType::get(
+        llvm_type_for(ast::Type::lane_type(type_token), context, structs),
+        ast::Type::lane_count(type_token));
+  } else if (type_token == ast::Type::Primitive::INT64 ||
       type_token == ast::Type::Primitive::UINT64) {
     return Type::getInt64Ty(context);
   } else if (type_token == ast::Type::Primitive::INT32 ||
@@ -34,10 +126,218 @@ static Type *llvm_type_for(const Token &type_token, LLVMContext &context) {
     return Type::getInt1Ty(context);
   }
 
-  assert(0); // todo: user defined types
+  auto structure = structs.find(type_token.lexeme);
+  if (structure != structs.end())
+    return structure->second.type;
+
+  assert(0); // todo: codegen errors
   return nullptr;
 }
 
+// Whether a pointer may point into the caller's frame. Pointers are only
+// known not to when they come from the caller's own parameters or a global,
+// since one loaded from a local can point at a local array too.
+static bool may_point_to_stack(const Value *pointer) {
+  auto object = getUnderlyingObject(pointer);
+  return !isa<Argument>(object) && !isa<GlobalValue>(object);
+}
+
+// Calls whose callee has the caller's exact signature are guaranteed to reuse
+// the caller's frame (musttail), which makes self recursion run in constant
+// stack space even when no optimizations are run. A call passing a slice of
+// the caller's locals can't be a tail call at all, since the frame is gone by
+// the time the callee reads it.
+static CallInst::TailCallKind tail_call_kind_for(const CallInst *call) {
+  const auto caller = call->getFunction();
+  const auto callee = call->getCalledFunction();
+
+  for (const auto &argument : call->args()) {
+    if (argument->getType()->isPointerTy() && may_point_to_stack(argument))
+      return CallInst::TCK_None;
+  }
+
+  if (callee && callee->getFunctionType() == caller->getFunctionType() &&
+      callee->getCallingConv() == caller->getCallingConv()) {
+    return CallInst::TCK_MustTail;
+  }
+
+  return CallInst::TCK_Tail;
+}
+
+// Integer literals are i64 unless suffixed, so they're converted to the
+// integer type they're stored into or returned as, as are the elements of
+// array literals. Unsigned values and booleans are zero extended.
+static Value *coerce_integer(IRBuilder<> &builder, Value *value, Type *type,
+                             bool is_signed = true) {
+  // Arrays of structs are stored into arrays of @soa structs a column at a
+  // time
+  auto value_array = dyn_cast<ArrayType>(value->getType());
+  if (is_soa(type) && !is_soa_slice(type) && value_array) {
+    Value *result = UndefValue::get(type);
+    for (unsigned field = 0; field < type->getStructNumElements(); ++field) {
+      auto column_type = cast<ArrayType>(type->getStructElementType(field));
+      Value *column = UndefValue::get(column_type);
+      for (unsigned i = 0; i < column_type->getNumElements(); ++i) {
+        auto element = coerce_integer(
+            builder, builder.CreateExtractValue(value, {i, field}),
+            column_type->getElementType(), is_signed);
+        column = builder.CreateInsertValue(column, element, i);
+      }
+
+      result = builder.CreateInsertValue(result, column, field);
+    }
+
+    return result;
+  }
+
+  auto array = dyn_cast<ArrayType>(type);
+  if (array && value_array && array != value_array &&
+      array->getNumElements() == value_array->getNumElements()) {
+    Value *result = UndefValue::get(array);
+    for (unsigned i = 0; i < array->getNumElements(); ++i) {
+      auto element = coerce_integer(
+          builder, builder.CreateExtractValue(value, i),
+          array->getElementType(), is_signed);
+      result = builder.CreateInsertValue(result, element, i);
+    }
+
+    return result;
+  }
+
+  if (value->getType() == type || !value->getType()->isIntegerTy() ||
+      !type->isIntegerTy())
+    return value;
+
+  return builder.CreateIntCast(value, type,
+                               is_signed && !value->getType()->isIntegerTy(1));
+}
+
+// Scalars are converted to a vector's lane type, so that f32x4(0.5) and
+// f32x4(0) don't need their literals suffixed
+static Value *as_lane(IRBuilder<> &builder, Value *value, Type *lane) {
+  if (value->getType()->isFloatingPointTy() && lane->isFloatingPointTy())
+    return builder.CreateFPCast(value, lane);
+
+  if (value->getType()->isIntegerTy() && lane->isFloatingPointTy())
+    return builder.CreateSIToFP(value, lane);
+
+  return coerce_integer(builder, value, lane);
+}
+
+static Value *splat(IRBuilder<> &builder, Value *value, Type *type) {
+  auto vector = cast<FixedVectorType>(type);
+  auto lane = as_lane(builder, value, vector->getElementType());
+  return builder.CreateVectorSplat(vector->getNumElements(), lane);
+}
+
+// Indexes are i64, and negative ones wrap around to fail bounds checks
+static Value *as_index(IRBuilder<> &builder, Value *value, bool is_signed) {
+  return is_signed ? builder.CreateSExtOrTrunc(value, builder.getInt64Ty())
+                   : builder.CreateZExtOrTrunc(value, builder.getInt64Ty());
+}
+
+static bool is_unsigned_type(const Token &type) {
+  auto scalar = ast::Type::is_vector(type) ? ast::Type::lane_type(type) : type;
+  return scalar == ast::Type::Primitive::UINT32 ||
+         scalar == ast::Type::Primitive::UINT64;
+}
+
+// How a function uses its variables, which decides which of its slices can
+// be noalias and which indexes need bounds checks
+class VariableUses : public ast::Walker {
+  // The variable an element or field belongs to, if any
+  static ast::Variable *base_of(ast::Expression *expression) {
+    for (;;) {
+      if (auto index = dynamic_cast<ast::Index *>(expression))
+        expression = index->target;
+      else if (auto member = dynamic_cast<ast::Member *>(expression))
+        expression = member->target;
+      else
+        return dynamic_cast<ast::Variable *>(expression);
+    }
+  }
+
+public:
+  using ast::Walker::visit;
+
+  // Assigned or declared anew
+  std::set<std::string> assigned;
+
+  // Assigned elements of
+  std::set<std::string> written;
+
+  // Used other than by reading an element or their length, so written
+  // through who knows what
+  std::set<std::string> escaped;
+
+  // Functions, by name
+  std::set<std::string> called;
+
+  void *visit(ast::Variable &node) override {
+    escaped.insert(node.name.lexeme);
+    return nullptr;
+  }
+
+  void *visit(ast::Call &node) override {
+    called.insert(node.name.lexeme);
+    for (const auto &argument : node.arguments) {
+      if (node.name.lexeme == "len" && dynamic_cast<ast::Variable *>(argument))
+        continue;
+
+      argument->accept(*this);
+    }
+    return nullptr;
+  }
+
+  void *visit(ast::Index &node) override {
+    // Slicing shares the elements, so it escapes them
+    if (node.end || !dynamic_cast<ast::Variable *>(node.target))
+      node.target->accept(*this);
+
+    node.index->accept(*this);
+    if (node.end)
+      node.end->accept(*this);
+    return nullptr;
+  }
+
+  void visit(ast::VariableDeclaration &node) override {
+    assigned.insert(node.name.lexeme);
+    ast::Walker::visit(node);
+  }
+
+  void visit(ast::Assignment &node) override {
+    if (auto variable = dynamic_cast<ast::Variable *>(node.target)) {
+      assigned.insert(variable->name.lexeme);
+    } else {
+      if (auto variable = base_of(node.target))
+        written.insert(variable->name.lexeme);
+
+      // Only the indexes on the way to the element are read
+      auto target = node.target;
+      for (;;) {
+        if (auto index = dynamic_cast<ast::Index *>(target)) {
+          index->index->accept(*this);
+          target = index->target;
+        } else if (auto member = dynamic_cast<ast::Member *>(target)) {
+          target = member->target;
+        } else {
+          break;
+        }
+      }
+
+      if (!dynamic_cast<ast::Variable *>(target))
+        target->accept(*this);
+    }
+
+    node.value->accept(*this);
+  }
+
+  void visit(ast::For &node) override {
+    assigned.insert(node.variable.lexeme);
+    ast::Walker::visit(node);
+  }
+};
+
 static AllocaInst *create_entry_block_alloca(IRBuilder<> &builder,
                                              Function *function, Type *type,
                                              const Twine &name) {
@@ -46,22 +346,678 @@ static AllocaInst *create_entry_block_alloca(IRBuilder<> &builder,
   return temp_builder.CreateAlloca(type, nullptr, name);
 }
 
-CodeGen::CodeGen() {
-  context = new LLVMContext;
+CodeGen::CodeGen() : CodeGen(new LLVMContext) { owns_context = true; }
+
+CodeGen::CodeGen(LLVMContext *context) : context(context) {
+  // Legacy passes look their dependencies up in the registry,
+  // which is otherwise only populated by the driver
+  auto &registry = *PassRegistry::getPassRegistry();
+  initializeCore(registry);
+  initializeAnalysis(registry);
+  initializeScalarOpts(registry);
+  initializeTransformUtils(registry);
+  initializeInstCombine(registry);
+  initializeVectorization(registry);
+
+  owns_context = false;
   builder = new IRBuilder(*context);
   debug_info_generator = nullptr;
   named_values = new std::unordered_map<string, AllocaInst *>();
 }
 
 CodeGen::~CodeGen() {
-  delete context;
   delete builder;
   delete debug_info_generator;
   delete named_values;
+
+  // Everything above refers to the context, so it goes last
+  if (owns_context)
+    delete context;
+}
+
+// Add printf manually
+// todo(jzb): Add debug info for printf?
+//  really this should be in a standard library eventually
+static void declare_printf(Module *module) {
+  std::vector<Type *> args = {Type::getInt8PtrTy(module->getContext())};
+  auto printf_type =
+      FunctionType::get(Type::getInt32Ty(module->getContext()),
+                        ArrayRef<Type *>(args.data(), args.size()), true);
+
+  auto attributes =
+      AttributeList::get(module->getContext(), 1U, {Attribute::NoAlias});
+  module->getOrInsertFunction("printf", printf_type, attributes);
+}
+
+// print formats into a buffer that's written to stdout when it fills, at the
+// end of each line when stdout is a terminal, and when main returns. The
+// buffer and the routines that format into it are generated into each module
+// that uses them, linkonce so that the modules of a program share them.
+static constexpr uint64_t output_capacity = 4096;
+const char *const output_buffer_name = "solar.output";
+
+// How a conversion is padded to its width
+enum OutputFlags { LEFT_JUSTIFY = 1, ZERO_PAD = 2 };
+
+// The number of characters in the buffer, whether stdout is a terminal (0
+// until it's been asked, then 1 when it is and 2 when it isn't) and the
+// characters themselves
+static GlobalVariable *output_buffer(Module *module) {
+  if (auto buffer = module->getGlobalVariable(output_buffer_name))
+    return buffer;
+
+  auto &context = module->getContext();
+  auto type = StructType::get(
+      Type::getInt64Ty(context), Type::getInt32Ty(context),
+      ArrayType::get(Type::getInt8Ty(context), output_capacity));
+
+  return new GlobalVariable(*module, type, false,
+                            GlobalValue::LinkOnceODRLinkage,
+                            ConstantAggregateZero::get(type),
+                            output_buffer_name);
+}
+
+// The routine, and whether its body still has to be generated, in which
+// case the builder is at its entry
+static std::pair<Function *, bool>
+output_routine(Module *module, IRBuilder<> &builder, StringRef name,
+               Type *result, ArrayRef<Type *> parameters) {
+  if (auto function = module->getFunction(name))
+    return {function, false};
+
+  auto function = Function::Create(FunctionType::get(result, parameters, false),
+                                   GlobalValue::LinkOnceODRLinkage, name,
+                                   module);
+  function->addFnAttr(Attribute::NoUnwind);
+  builder.SetInsertPoint(
+      BasicBlock::Create(module->getContext(), "entry", function));
+  return {function, true};
+}
+
+// Writes all of the characters to stdout, or as many as it will take
+static Function *output_write_through(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i8_pointer = builder.getInt8PtrTy();
+  auto i64 = builder.getInt64Ty();
+  auto [function, undefined] = output_routine(
+      module, builder, "solar.write_through", builder.getVoidTy(),
+      {i8_pointer, i64});
+  if (!undefined)
+    return function;
+
+  auto write = module->getOrInsertFunction(
+      "write", FunctionType::get(i64, {builder.getInt32Ty(), i8_pointer, i64},
+                                 false));
+
+  auto text = function->getArg(0);
+  auto size = function->getArg(1);
+  auto entry = builder.GetInsertBlock();
+  auto loop = BasicBlock::Create(module->getContext(), "loop", function);
+  auto wrote = BasicBlock::Create(module->getContext(), "wrote", function);
+  auto exit = BasicBlock::Create(module->getContext(), "exit", function);
+
+  builder.CreateCondBr(builder.CreateIsNull(size), exit, loop);
+
+  builder.SetInsertPoint(loop);
+  auto offset = builder.CreatePHI(i64, 2, "offset");
+  offset->addIncoming(builder.getInt64(0), entry);
+  auto written = builder.CreateCall(
+      write, {builder.getInt32(1),
+              builder.CreateInBoundsGEP(builder.getInt8Ty(), text, offset),
+              builder.CreateSub(size, offset)});
+  builder.CreateCondBr(
+      builder.CreateICmpSGT(written, builder.getInt64(0)), wrote, exit);
+
+  builder.SetInsertPoint(wrote);
+  auto next = builder.CreateAdd(offset, written);
+  offset->addIncoming(next, wrote);
+  builder.CreateCondBr(builder.CreateICmpULT(next, size), loop, exit);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateRetVoid();
+  return function;
+}
+
+static Function *output_flush(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto [function, undefined] = output_routine(module, builder, "solar.flush",
+                                              builder.getVoidTy(), {});
+  if (!undefined)
+    return function;
+
+  auto buffer = output_buffer(module);
+  auto type = buffer->getValueType();
+  auto length = builder.CreateStructGEP(type, buffer, 0);
+  builder.CreateCall(
+      output_write_through(module),
+      {builder.CreateConstInBoundsGEP2_32(type->getStructElementType(2),
+                                          builder.CreateStructGEP(type, buffer,
+                                                                  2),
+                                          0, 0),
+       builder.CreateLoad(builder.getInt64Ty(), length)});
+  builder.CreateStore(builder.getInt64(0), length);
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Appends the characters to the buffer, or writes them straight through
+// when they wouldn't fit in it
+static Function *output_write(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i64 = builder.getInt64Ty();
+  auto [function, undefined] =
+      output_routine(module, builder, "solar.write", builder.getVoidTy(),
+                     {builder.getInt8PtrTy(), i64});
+  if (!undefined)
+    return function;
+
+  auto &context = module->getContext();
+  auto text = function->getArg(0);
+  auto size = function->getArg(1);
+  auto buffer = output_buffer(module);
+  auto type = buffer->getValueType();
+  auto length_address = builder.CreateStructGEP(type, buffer, 0);
+  auto data = builder.CreateStructGEP(type, buffer, 2);
+
+  auto entry = builder.GetInsertBlock();
+  auto spill = BasicBlock::Create(context, "spill", function);
+  auto through = BasicBlock::Create(context, "through", function);
+  auto copy = BasicBlock::Create(context, "copy", function);
+
+  auto length = builder.CreateLoad(i64, length_address, "length");
+  builder.CreateCondBr(
+      builder.CreateICmpULE(builder.CreateAdd(length, size),
+                            builder.getInt64(output_capacity)),
+      copy, spill);
+
+  builder.SetInsertPoint(spill);
+  builder.CreateCall(output_flush(module));
+  builder.CreateCondBr(
+      builder.CreateICmpULE(size, builder.getInt64(output_capacity)), copy,
+      through);
+
+  builder.SetInsertPoint(through);
+  builder.CreateCall(output_write_through(module), {text, size});
+  builder.CreateRetVoid();
+
+  builder.SetInsertPoint(copy);
+  auto at = builder.CreatePHI(i64, 2, "at");
+  at->addIncoming(length, entry);
+  at->addIncoming(builder.getInt64(0), spill);
+  builder.CreateMemCpy(builder.CreateInBoundsGEP(type->getStructElementType(2),
+                                                 data,
+                                                 {builder.getInt64(0), at}),
+                       MaybeAlign(1), text, MaybeAlign(1), size);
+  builder.CreateStore(builder.CreateAdd(at, size), length_address);
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Appends the character as many times as the count says, when it's positive
+static Function *output_repeat(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i64 = builder.getInt64Ty();
+  auto [function, undefined] =
+      output_routine(module, builder, "solar.repeat", builder.getVoidTy(),
+                     {builder.getInt8Ty(), i64});
+  if (!undefined)
+    return function;
+
+  auto &context = module->getContext();
+  auto character = function->getArg(0);
+  auto count = function->getArg(1);
+  auto buffer = output_buffer(module);
+  auto type = buffer->getValueType();
+  auto length_address = builder.CreateStructGEP(type, buffer, 0);
+  auto data = builder.CreateStructGEP(type, buffer, 2);
+
+  auto entry = builder.GetInsertBlock();
+  auto loop = BasicBlock::Create(context, "loop", function);
+  auto room = BasicBlock::Create(context, "room", function);
+  auto spill = BasicBlock::Create(context, "spill", function);
+  auto fill = BasicBlock::Create(context, "fill", function);
+  auto exit = BasicBlock::Create(context, "exit", function);
+  builder.CreateBr(loop);
+
+  builder.SetInsertPoint(loop);
+  auto remaining = builder.CreatePHI(i64, 2, "remaining");
+  remaining->addIncoming(count, entry);
+  builder.CreateCondBr(builder.CreateICmpSGT(remaining, builder.getInt64(0)),
+                       room, exit);
+
+  builder.SetInsertPoint(room);
+  auto length = builder.CreateLoad(i64, length_address, "length");
+  builder.CreateCondBr(
+      builder.CreateICmpEQ(length, builder.getInt64(output_capacity)), spill,
+      fill);
+
+  builder.SetInsertPoint(spill);
+  builder.CreateCall(output_flush(module));
+  builder.CreateBr(fill);
+
+  builder.SetInsertPoint(fill);
+  auto at = builder.CreatePHI(i64, 2, "at");
+  at->addIncoming(length, room);
+  at->addIncoming(builder.getInt64(0), spill);
+  auto space = builder.CreateSub(builder.getInt64(output_capacity), at);
+  auto filled = builder.CreateSelect(builder.CreateICmpULT(remaining, space),
+                                     remaining, space, "filled");
+  builder.CreateMemSet(builder.CreateInBoundsGEP(type->getStructElementType(2),
+                                                 data,
+                                                 {builder.getInt64(0), at}),
+                       character, filled, MaybeAlign(1));
+  builder.CreateStore(builder.CreateAdd(at, filled), length_address);
+  remaining->addIncoming(builder.CreateSub(remaining, filled), fill);
+  builder.CreateBr(loop);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Appends a formatted number, its sign and the padding its width calls for
+static Function *output_field(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i32 = builder.getInt32Ty();
+  auto i64 = builder.getInt64Ty();
+  auto [function, undefined] = output_routine(
+      module, builder, "solar.field", builder.getVoidTy(),
+      {builder.getInt8PtrTy(), i64, builder.getInt1Ty(), i32, i32});
+  if (!undefined)
+    return function;
+
+  auto text = function->getArg(0);
+  auto size = function->getArg(1);
+  auto negative = function->getArg(2);
+  auto flags = function->getArg(4);
+  auto padding = builder.CreateSub(
+      builder.CreateSub(builder.CreateSExt(function->getArg(3), i64), size),
+      builder.CreateZExt(negative, i64), "padding");
+
+  auto has_flag = [&](OutputFlags flag) {
+    return builder.CreateIsNotNull(
+        builder.CreateAnd(flags, builder.getInt32(flag)));
+  };
+  auto left_justify = has_flag(LEFT_JUSTIFY);
+  auto zero_pad = has_flag(ZERO_PAD);
+  auto zero = builder.getInt64(0);
+
+  auto repeat = output_repeat(module);
+  builder.CreateCall(
+      repeat, {builder.getInt8(' '),
+               builder.CreateSelect(builder.CreateOr(left_justify, zero_pad),
+                                    zero, padding)});
+  builder.CreateCall(repeat,
+                     {builder.getInt8('-'), builder.CreateZExt(negative, i64)});
+  builder.CreateCall(repeat, {builder.getInt8('0'),
+                              builder.CreateSelect(zero_pad, padding, zero)});
+  builder.CreateCall(output_write(module), {text, size});
+  builder.CreateCall(repeat,
+                     {builder.getInt8(' '),
+                      builder.CreateSelect(left_justify, padding, zero)});
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Generates a loop that writes the digits of the value backwards into the
+// characters before the end, at least the minimum number of them, and
+// returns where the first digit is
+static Value *digits_before(IRBuilder<> &builder, Value *characters,
+                            Value *end, Value *value, Value *base,
+                            Value *minimum) {
+  auto function = builder.GetInsertBlock()->getParent();
+  auto &context = function->getContext();
+  auto i64 = builder.getInt64Ty();
+
+  auto entry = builder.GetInsertBlock();
+  auto loop = BasicBlock::Create(context, "digits", function);
+  auto exit = BasicBlock::Create(context, "digits.exit", function);
+  builder.CreateBr(loop);
+
+  builder.SetInsertPoint(loop);
+  auto at = builder.CreatePHI(i64, 2, "at");
+  auto rest = builder.CreatePHI(i64, 2, "rest");
+  auto count = builder.CreatePHI(i64, 2, "count");
+  at->addIncoming(end, entry);
+  rest->addIncoming(value, entry);
+  count->addIncoming(builder.getInt64(0), entry);
+
+  auto digit = builder.CreateTrunc(builder.CreateURem(rest, base),
+                                   builder.getInt8Ty(), "digit");
+  auto character = builder.CreateSelect(
+      builder.CreateICmpULT(digit, builder.getInt8(10)),
+      builder.CreateAdd(digit, builder.getInt8('0')),
+      builder.CreateAdd(digit, builder.getInt8('a' - 10)));
+  auto next = builder.CreateSub(at, builder.getInt64(1));
+  builder.CreateStore(character, builder.CreateInBoundsGEP(
+                                     builder.getInt8Ty(), characters, next));
+
+  auto quotient = builder.CreateUDiv(rest, base);
+  auto counted = builder.CreateAdd(count, builder.getInt64(1));
+  at->addIncoming(next, loop);
+  rest->addIncoming(quotient, loop);
+  count->addIncoming(counted, loop);
+  builder.CreateCondBr(
+      builder.CreateOr(builder.CreateIsNotNull(quotient),
+                       builder.CreateICmpULT(counted, minimum)),
+      loop, exit);
+
+  builder.SetInsertPoint(exit);
+  return next;
+}
+
+// Appends an integer in base 10 or 16, like %d, %u and %x
+static Function *output_integer(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i32 = builder.getInt32Ty();
+  auto i64 = builder.getInt64Ty();
+  auto [function, undefined] =
+      output_routine(module, builder, "solar.print_integer",
+                     builder.getVoidTy(),
+                     {i64, builder.getInt1Ty(), i32, i32, i32});
+  if (!undefined)
+    return function;
+
+  // The most digits a 64 bit integer has, in base 10
+  constexpr uint64_t size = 20;
+  auto characters = create_entry_block_alloca(
+      builder, function, ArrayType::get(builder.getInt8Ty(), size),
+      "characters");
+  auto first = builder.CreateConstInBoundsGEP2_32(
+      characters->getAllocatedType(), characters, 0, 0);
+
+  auto value = function->getArg(0);
+  auto negative = builder.CreateAnd(
+      function->getArg(1), builder.CreateICmpSLT(value, builder.getInt64(0)));
+  auto magnitude = builder.CreateSelect(negative, builder.CreateNeg(value),
+                                        value, "magnitude");
+
+  auto start = digits_before(builder, first, builder.getInt64(size), magnitude,
+                             builder.CreateZExt(function->getArg(2), i64),
+                             builder.getInt64(1));
+  builder.CreateCall(
+      output_field(module),
+      {builder.CreateInBoundsGEP(builder.getInt8Ty(), first, start),
+       builder.CreateSub(builder.getInt64(size), start), negative,
+       function->getArg(3), function->getArg(4)});
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Appends a float with a fixed number of digits after its point, like %f.
+// Digits are exact for values below 2^64 as long as the digits after the
+// point fit in 2^53, and to about 15 significant digits past that, where
+// printf would expand the float's exact binary value.
+static Function *output_float(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto &context = module->getContext();
+  auto i32 = builder.getInt32Ty();
+  auto i64 = builder.getInt64Ty();
+  auto f64 = builder.getDoubleTy();
+  auto [function, undefined] =
+      output_routine(module, builder, "solar.print_float", builder.getVoidTy(),
+                     {f64, i32, i32, i32});
+  if (!undefined)
+    return function;
+
+  auto value = function->getArg(0);
+  auto precision = builder.CreateZExt(function->getArg(1), i64, "precision");
+  auto width = function->getArg(2);
+  auto flags = function->getArg(3);
+
+  // Signs are printed for negative zeros too, but not for NaNs, whose sign
+  // depends on whether they were folded or computed by the CPU
+  auto negative = builder.CreateAnd(
+      builder.CreateICmpSLT(builder.CreateBitCast(value, i64),
+                            builder.getInt64(0)),
+      builder.CreateFCmpORD(value, value), "negative");
+  auto magnitude = builder.CreateUnaryIntrinsic(Intrinsic::fabs, value);
+
+  auto special = BasicBlock::Create(context, "special", function);
+  auto finite = BasicBlock::Create(context, "finite", function);
+  builder.CreateCondBr(
+      builder.CreateFCmpUEQ(magnitude, ConstantFP::getInfinity(f64)), special,
+      finite);
+
+  // Infinities and NaNs are padded with spaces
+  builder.SetInsertPoint(special);
+  auto name = builder.CreateSelect(builder.CreateFCmpUNO(value, value),
+                                   builder.CreateGlobalStringPtr("nan"),
+                                   builder.CreateGlobalStringPtr("inf"));
+  builder.CreateCall(output_field(module),
+                     {name, builder.getInt64(3), negative, width,
+                      builder.CreateAnd(flags, builder.getInt32(~ZERO_PAD))});
+  builder.CreateRetVoid();
+
+  // Values too large for an integer are scaled down, and the digits they
+  // lose are printed as zeros
+  builder.SetInsertPoint(finite);
+  auto scale = BasicBlock::Create(context, "scale", function);
+  auto scaled = BasicBlock::Create(context, "scaled", function);
+  builder.CreateBr(scale);
+
+  builder.SetInsertPoint(scale);
+  auto reduced = builder.CreatePHI(f64, 2, "reduced");
+  auto zeros = builder.CreatePHI(i64, 2, "zeros");
+  reduced->addIncoming(magnitude, finite);
+  zeros->addIncoming(builder.getInt64(0), finite);
+  reduced->addIncoming(builder.CreateFDiv(reduced, ConstantFP::get(f64, 10)),
+                       scale);
+  zeros->addIncoming(builder.CreateAdd(zeros, builder.getInt64(1)), scale);
+  builder.CreateCondBr(
+      builder.CreateFCmpOGE(reduced, ConstantFP::get(f64, 0x1p64)), scale,
+      scaled);
+
+  // Programs are linked without libm, so rounding adds and subtracts 2^52,
+  // past which doubles have no fraction, and truncating converts to an integer
+  // and back
+  auto big = ConstantFP::get(f64, 0x1p52);
+  auto round_to_integer = [&](Value *magnitude) {
+    auto rounded = builder.CreateFSub(builder.CreateFAdd(magnitude, big), big);
+    return builder.CreateSelect(builder.CreateFCmpOLT(magnitude, big), rounded,
+                                magnitude);
+  };
+  auto truncate = [&](Value *magnitude) {
+    return builder.CreateUIToFP(builder.CreateFPToUI(magnitude, i64), f64);
+  };
+
+  // Without digits after the point, rounding to even depends on the
+  // integer's last digit. Scaled values have no fraction left to print.
+  builder.SetInsertPoint(scaled);
+  auto has_point = builder.CreateIsNotNull(precision);
+  auto rounded = builder.CreateSelect(
+      builder.CreateAnd(has_point, builder.CreateIsNull(zeros)), reduced,
+      round_to_integer(reduced));
+  auto whole = builder.CreateFPToUI(rounded, i64, "whole");
+  auto fraction = builder.CreateFSub(rounded, builder.CreateUIToFP(whole, f64));
+
+  std::vector<Constant *> powers;
+  for (auto power = 1.0; powers.size() <= 17; power *= 10)
+    powers.push_back(ConstantFP::get(f64, power));
+  auto powers_type = ArrayType::get(f64, powers.size());
+  auto powers_of_10 = new GlobalVariable(
+      *module, powers_type, true, GlobalValue::PrivateLinkage,
+      ConstantArray::get(powers_type, powers), "solar.powers_of_10");
+  auto power = builder.CreateLoad(
+      f64, builder.CreateInBoundsGEP(powers_type, powers_of_10,
+                                     {builder.getInt64(0), precision}));
+
+  // Splits a double into halves of 26 bits, whose products are exact
+  auto split = [&](Value *number) {
+    auto scaled =
+        builder.CreateFMul(number, ConstantFP::get(f64, 0x1p27 + 1));
+    auto high = builder.CreateFSub(scaled, builder.CreateFSub(scaled, number));
+    return std::make_pair(high, builder.CreateFSub(number, high));
+  };
+
+  // The product is rounded, so when it's halfway between two integers, the
+  // error of that rounding (exact from the halves' products) decides which
+  // way the digits round. Rounding them up can carry into the integer.
+  auto product = builder.CreateFMul(fraction, power);
+  auto [fraction_high, fraction_low] = split(fraction);
+  auto [power_high, power_low] = split(power);
+  auto error = builder.CreateFSub(
+      builder.CreateFMul(fraction_high, power_high), product);
+  error = builder.CreateFAdd(error,
+                             builder.CreateFMul(fraction_high, power_low));
+  error = builder.CreateFAdd(error,
+                             builder.CreateFMul(fraction_low, power_high));
+  error =
+      builder.CreateFAdd(error, builder.CreateFMul(fraction_low, power_low));
+  auto truncated = truncate(product);
+  auto halfway = builder.CreateFCmpOEQ(builder.CreateFSub(product, truncated),
+                                       ConstantFP::get(f64, 0.5));
+  auto zero = ConstantFP::get(f64, 0);
+  auto nearest = builder.CreateSelect(
+      builder.CreateFCmpOGT(error, zero),
+      builder.CreateFAdd(truncated, ConstantFP::get(f64, 1)),
+      builder.CreateSelect(builder.CreateFCmpOLT(error, zero), truncated,
+                           round_to_integer(product)));
+  auto digits = builder.CreateFPToUI(
+      builder.CreateSelect(halfway, nearest, round_to_integer(product)), i64);
+  auto carries =
+      builder.CreateICmpUGE(digits, builder.CreateFPToUI(power, i64));
+  whole = builder.CreateAdd(whole, builder.CreateZExt(carries, i64));
+  digits = builder.CreateSelect(carries, builder.getInt64(0), digits);
+
+  // The integer, the zeros scaling dropped, the point and the digits after it
+  constexpr uint64_t size = 20 + 309 + 1 + 17;
+  auto characters = create_entry_block_alloca(
+      builder, function, ArrayType::get(builder.getInt8Ty(), size),
+      "characters");
+  auto first = builder.CreateConstInBoundsGEP2_32(
+      characters->getAllocatedType(), characters, 0, 0);
+  auto ten = builder.getInt64(10);
+
+  auto point = BasicBlock::Create(context, "point", function);
+  auto integer = BasicBlock::Create(context, "integer", function);
+  auto before_point = builder.GetInsertBlock();
+  auto end = builder.getInt64(size);
+  builder.CreateCondBr(has_point, point, integer);
+
+  builder.SetInsertPoint(point);
+  auto at = digits_before(builder, first, end, digits, ten, precision);
+  at = builder.CreateSub(at, builder.getInt64(1));
+  auto point_address =
+      builder.CreateInBoundsGEP(builder.getInt8Ty(), first, at);
+  builder.CreateStore(builder.getInt8('.'), point_address);
+  auto after_point = builder.GetInsertBlock();
+  builder.CreateBr(integer);
+
+  builder.SetInsertPoint(integer);
+  auto integer_end = builder.CreatePHI(i64, 2, "integer_end");
+  integer_end->addIncoming(end, before_point);
+  integer_end->addIncoming(at, after_point);
+  auto padded = builder.CreateSub(integer_end, zeros);
+  builder.CreateMemSet(
+      builder.CreateInBoundsGEP(builder.getInt8Ty(), first, padded),
+      builder.getInt8('0'), zeros, MaybeAlign(1));
+  auto start =
+      digits_before(builder, first, padded, whole, ten, builder.getInt64(1));
+
+  builder.CreateCall(
+      output_field(module),
+      {builder.CreateInBoundsGEP(builder.getInt8Ty(), first, start),
+       builder.CreateSub(end, start), negative, width, flags});
+  builder.CreateRetVoid();
+  return function;
+}
+
+// Ends a line, which is written out right away when stdout is a terminal
+static Function *output_end_line(Module *module) {
+  IRBuilder<> builder(module->getContext());
+  auto i32 = builder.getInt32Ty();
+  auto [function, undefined] = output_routine(
+      module, builder, "solar.end_line", builder.getVoidTy(), {});
+  if (!undefined)
+    return function;
+
+  auto &context = module->getContext();
+  auto isatty = module->getOrInsertFunction(
+      "isatty", FunctionType::get(i32, {i32}, false));
+
+  auto buffer = output_buffer(module);
+  auto mode_address =
+      builder.CreateStructGEP(buffer->getValueType(), buffer, 1);
+
+  auto entry = builder.GetInsertBlock();
+  auto ask = BasicBlock::Create(context, "ask", function);
+  auto known = BasicBlock::Create(context, "known", function);
+  auto flush = BasicBlock::Create(context, "flush", function);
+  auto exit = BasicBlock::Create(context, "exit", function);
+
+  auto mode = builder.CreateLoad(i32, mode_address, "mode");
+  builder.CreateCondBr(builder.CreateIsNull(mode), ask, known);
+
+  builder.SetInsertPoint(ask);
+  auto is_tty = builder.CreateCall(isatty, {builder.getInt32(1)});
+  auto asked = builder.CreateSelect(builder.CreateIsNotNull(is_tty),
+                                    builder.getInt32(1), builder.getInt32(2));
+  builder.CreateStore(asked, mode_address);
+  builder.CreateBr(known);
+
+  builder.SetInsertPoint(known);
+  auto terminal = builder.CreatePHI(i32, 2, "terminal");
+  terminal->addIncoming(mode, entry);
+  terminal->addIncoming(asked, ask);
+  builder.CreateCondBr(builder.CreateICmpEQ(terminal, builder.getInt32(1)),
+                       flush, exit);
+
+  builder.SetInsertPoint(flush);
+  builder.CreateCall(output_flush(module));
+  builder.CreateBr(exit);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateRetVoid();
+  return function;
+}
+
+bool prints(const ast::Program *program,
+            const std::vector<ast::Program *> &others) {
+  VariableUses uses;
+  for (const auto &statement : program->statements)
+    statement->accept(uses);
+
+  for (const auto &other : others) {
+    if (other == program)
+      continue;
+
+    for (const auto &statement : other->statements)
+      statement->accept(uses);
+  }
+
+  return uses.called.count("print");
+}
+
+// The structs of the program and of the others it's compiled with, which
+// every module lays out the same way
+static std::vector<const ast::Struct *>
+structs_of(const ast::Program *program,
+           const std::vector<ast::Program *> &others) {
+  std::vector<const ast::Struct *> structs;
+  for (const auto &statement : program->statements) {
+    if (auto structure = dynamic_cast<ast::Struct *>(statement))
+      structs.push_back(structure);
+  }
+
+  for (const auto &other : others) {
+    if (other == program)
+      continue;
+
+    for (const auto &statement : other->statements) {
+      if (auto structure = dynamic_cast<ast::Struct *>(statement))
+        structs.push_back(structure);
+    }
+  }
+
+  return structs;
 }
 
 Module *CodeGen::compile_module(const filesystem::path &source_file,
-                                ast::Program *program, bool release) {
+                                ast::Program *program, bool release,
+                                const std::vector<ast::Program *> &others) {
+  PhaseTimer timer("CodeGen", source_file.string());
+  warnings.clear();
 
   auto module = new Module(source_file.c_str(), *context);
 
@@ -69,31 +1025,149 @@ Module *CodeGen::compile_module(const filesystem::path &source_file,
     debug_info_generator = new DebugInfoGenerator(module, builder, source_file);
 
   ExpressionGenerator expressionGenerator(module, builder, debug_info_generator,
-                                          named_values);
+                                          named_values, options);
 
   StatementGenerator statementGenerator(module, builder, debug_info_generator,
                                         expressionGenerator, named_values,
-                                        release);
+                                        options, release);
 
-  // Add printf manually
-  // todo(jzb): Add debug info for printf?
-  //  really this should be in a standard library eventually
-  std::vector<Type *> args = {Type::getInt8PtrTy(module->getContext())};
-  auto printf_type =
-      FunctionType::get(Type::getInt32Ty(module->getContext()),
-                        ArrayRef<Type *>(args.data(), args.size()), true);
+  declare_printf(module);
+  statementGenerator.flushes_output = prints(program, others);
 
-  auto attributes =
-      AttributeList::get(module->getContext(), 1U, {Attribute::NoAlias});
-  module->getOrInsertFunction("printf", printf_type, attributes);
+  expressionGenerator.define_structs(structs_of(program, others));
+  if (debug_info_generator)
+    debug_info_generator->structs = &expressionGenerator.structs;
+
+  // Functions can be called before they're defined, and consts used
+  // before they're declared
+  for (const auto &statement : program->statements) {
+    if (auto function = dynamic_cast<ast::Function *>(statement))
+      statementGenerator.declare(function->prototype);
+    else if (auto constant =
+                 dynamic_cast<ast::VariableDeclaration *>(statement))
+      statementGenerator.define_constant(*constant);
+  }
+
+  for (const auto &other : others) {
+    if (other == program)
+      continue;
+
+    for (const auto &statement : other->statements) {
+      if (auto function = dynamic_cast<ast::Function *>(statement))
+        statementGenerator.declare(function->prototype);
+    }
+  }
+
+  for (const auto &statement : program->statements) {
+    if (!dynamic_cast<ast::VariableDeclaration *>(statement))
+      statement->accept(statementGenerator);
+  }
+
+  if (debug_info_generator)
+    debug_info_generator->finalize();
+
+  statementGenerator.inline_marked_calls();
+
+  return module;
+}
+
+Module *CodeGen::compile_function(const filesystem::path &source_file,
+                                  ast::Program *program,
+                                  ast::Function &function, bool release,
+                                  const std::vector<ast::Program *> &others) {
+  PhaseTimer timer("CodeGen", source_file.string());
+  warnings.clear();
+
+  auto module_name =
+      source_file.string() + ":" + function.prototype.name.lexeme;
+  auto module = new Module(module_name, *context);
+
+  if (!release)
+    debug_info_generator = new DebugInfoGenerator(module, builder, source_file);
+
+  ExpressionGenerator expressionGenerator(module, builder, debug_info_generator,
+                                          named_values, options);
+
+  StatementGenerator statementGenerator(module, builder, debug_info_generator,
+                                        expressionGenerator, named_values,
+                                        options, release);
+
+  declare_printf(module);
+  statementGenerator.flushes_output = prints(program, others);
 
+  expressionGenerator.define_structs(structs_of(program, others));
+  if (debug_info_generator)
+    debug_info_generator->structs = &expressionGenerator.structs;
+
+  // Calls into the rest of the program resolve against declarations, and
+  // every module has its own copy of the consts
   for (const auto &statement : program->statements) {
-    statement->accept(statementGenerator);
+    auto other = dynamic_cast<ast::Function *>(statement);
+    if (other && other != &function)
+      statementGenerator.declare(other->prototype);
+    else if (auto constant =
+                 dynamic_cast<ast::VariableDeclaration *>(statement))
+      statementGenerator.define_constant(*constant);
+  }
+
+  for (const auto &other : others) {
+    if (other == program)
+      continue;
+
+    for (const auto &statement : other->statements) {
+      if (auto function = dynamic_cast<ast::Function *>(statement))
+        statementGenerator.declare(function->prototype);
+    }
   }
 
+  function.accept(statementGenerator);
+
   if (debug_info_generator)
     debug_info_generator->finalize();
 
+  statementGenerator.inline_marked_calls();
+
+  // The rest of the program is only declared, so calls into it that were
+  // marked to be inlined are left as calls
+  std::vector<ast::Program *> sources(others);
+  sources.push_back(program);
+  std::set<std::string> functions;
+  for (const auto &source : sources) {
+    for (const auto &statement : source->statements) {
+      if (auto other = dynamic_cast<ast::Function *>(statement))
+        functions.insert(other->prototype.name.lexeme);
+    }
+  }
+
+  std::set<std::string> not_inlined;
+  for (auto &defined : *module) {
+    for (auto &instruction : instructions(defined)) {
+      auto call = dyn_cast<CallBase>(&instruction);
+      auto callee = call ? call->getCalledFunction() : nullptr;
+      if (!callee || !callee->isDeclaration() ||
+          !call->hasFnAttr(Attribute::AlwaysInline))
+        continue;
+
+      auto name = callee->getName().str();
+      if (functions.count(name) && not_inlined.insert(name).second)
+        warnings.push_back(
+            "[position " + std::to_string(function.position.line) + ":" +
+            std::to_string(function.position.column) +
+            "] Warning: Calls from " + function.prototype.name.lexeme +
+            " to " + name +
+            " aren't inlined, since functions are compiled one at a time");
+    }
+  }
+
+  return module;
+}
+
+Module *CodeGen::compile_output_runtime() {
+  auto module = new Module("solar.output", *context);
+  output_write(module);
+  output_integer(module);
+  output_float(module);
+  output_end_line(module);
   return module;
 }
 
@@ -101,33 +1175,120 @@ StatementGenerator::StatementGenerator(
     Module *module, IRBuilder<> *builder,
     DebugInfoGenerator *debug_info_generator,
     ExpressionGenerator &expressionGenerator,
-    std::unordered_map<std::string, AllocaInst *> *named_values, bool release)
+    std::unordered_map<std::string, AllocaInst *> *named_values,
+    const CodeGenOptions &options, bool release)
     : module(module), builder(builder),
       debug_info_generator(debug_info_generator),
       expressionGenerator(expressionGenerator), named_values(named_values),
+      options(options),
       function_pass_manager(new legacy::FunctionPassManager(module)) {
 
   if (release) {
     // Convert alloca instructions to registers
     function_pass_manager->add(createPromoteMemoryToRegisterPass());
+    // Turns self tail calls into loops
+    function_pass_manager->add(createTailCallEliminationPass());
     function_pass_manager->add(createGVNPass());
     function_pass_manager->add(createReassociatePass());
     function_pass_manager->add(createCFGSimplificationPass());
     function_pass_manager->add(createDeadCodeEliminationPass());
     function_pass_manager->add(createInstructionCombiningPass());
+    // Loops are rotated so their test is at the bottom, and their induction
+    // variables simplified, before they're unrolled and vectorized, which
+    // is where loop hints take effect
+    function_pass_manager->add(createLoopRotatePass());
+    function_pass_manager->add(createLICMPass());
+    function_pass_manager->add(createIndVarSimplifyPass());
+    function_pass_manager->add(createLoopVectorizePass());
+    function_pass_manager->add(createLoopUnrollPass(3));
+    function_pass_manager->add(createInstructionCombiningPass());
+    function_pass_manager->add(createCFGSimplificationPass());
   }
 
   function_pass_manager->doInitialization();
 }
 
+// The constant an evaluated initializer is, or null when it isn't one
+static Constant *constant_for(const ast::Expression &expression, Type *type) {
+  if (auto array = dynamic_cast<const ast::ArrayLiteral *>(&expression)) {
+    auto array_type = dyn_cast<ArrayType>(type);
+    auto count = array->repeat ? array->repeat : array->elements.size();
+    if (!array_type || array_type->getNumElements() != count)
+      return nullptr;
+
+    std::vector<Constant *> elements;
+    for (uint64_t i = 0; i < count; ++i) {
+      auto element = constant_for(*array->elements[array->repeat ? 0 : i],
+                                  array_type->getElementType());
+      if (!element)
+        return nullptr;
+      elements.push_back(element);
+    }
+
+    return ConstantArray::get(array_type, elements);
+  }
+
+  auto literal = dynamic_cast<const ast::LiteralValueExpression *>(&expression);
+  if (!literal)
+    return nullptr;
+
+  const auto &value = literal->value;
+  const auto &literal_type = literal->type.name;
+  if (type->isFloatTy() && literal_type == ast::Type::Primitive::FLOAT32)
+    return ConstantFP::get(type, value.float32);
+  if (type->isDoubleTy() && literal_type == ast::Type::Primitive::FLOAT64)
+    return ConstantFP::get(type, value.float64);
+  if (!type->isIntegerTy())
+    return nullptr;
+
+  if (literal_type == ast::Type::Primitive::BOOL)
+    return ConstantInt::get(type, value.boolean);
+  if (literal_type == ast::Type::Primitive::INT32)
+    return ConstantInt::get(type, value.int32, true);
+  if (literal_type == ast::Type::Primitive::UINT32)
+    return ConstantInt::get(type, value.uint32);
+  if (literal_type == ast::Type::Primitive::INT64 ||
+      literal_type == ast::Type::Primitive::UINT64)
+    return ConstantInt::get(type, value.int64, true);
+
+  return nullptr;
+}
+
+bool StatementGenerator::define_constant(
+    const ast::VariableDeclaration &node) {
+  const auto type = llvm_type_for(node.type, module->getContext(),
+                                  expressionGenerator.structs);
+  auto initializer = constant_for(*node.initializer, type);
+  if (!node.is_const || !initializer)
+    return false;
+
+  auto global =
+      new GlobalVariable(*module, type, true, GlobalValue::PrivateLinkage,
+                         initializer, node.name.lexeme);
+  global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+  const auto &name = node.name.lexeme;
+  named_values->erase(name);
+  expressionGenerator.variable_types.erase(name);
+  expressionGenerator.constants.insert_or_assign(
+      name, ExpressionGenerator::ConstantGlobal{global, node.type});
+  return true;
+}
+
 void StatementGenerator::visit(ast::VariableDeclaration &node) {
-  const auto type = llvm_type_for(node.type, module->getContext());
+  if (define_constant(node))
+    return;
+
+  const auto type = llvm_type_for(node.type, module->getContext(),
+                                  expressionGenerator.structs);
   const auto function = builder->GetInsertBlock()->getParent();
   IRBuilder<> temp_builder(&function->getEntryBlock(),
                            function->getEntryBlock().begin());
   const auto alloca =
       create_entry_block_alloca(*builder, function, type, node.name.lexeme);
   named_values->insert({node.name.lexeme, alloca});
+  expressionGenerator.variable_types.insert_or_assign(node.name.lexeme,
+                                                      node.type);
 
   if (debug_info_generator)
     debug_info_generator->attach_debug_info(node, alloca,
@@ -135,8 +1296,14 @@ void StatementGenerator::visit(ast::VariableDeclaration &node) {
 
   if (node.initializer) {
     const auto value =
-        static_cast<Value *>(node.initializer->accept(expressionGenerator));
-    builder->CreateStore(value, alloca);
+        is_slice(type) || is_soa_slice(type)
+            ? expressionGenerator.as_slice(*node.initializer)
+            : static_cast<Value *>(
+                  node.initializer->accept(expressionGenerator));
+    builder->CreateStore(
+        coerce_integer(*builder, value, type,
+                       !expressionGenerator.is_unsigned(*node.initializer)),
+        alloca);
   } else {
     assert(0); // todo: initializers are required for now?
   }
@@ -155,23 +1322,460 @@ void StatementGenerator::visit(ast::Block &block) {
   }
 }
 
-void StatementGenerator::visit(ast::Function &function) {
+// Declarations get a function's attributes too, so that calls from other
+// files know that it's pure or cold
+static void add_attributes(Function *function,
+                           const ast::FunctionPrototype &prototype) {
+  if (prototype.has_attribute("inline"))
+    function->addFnAttr(Attribute::AlwaysInline);
+  if (prototype.has_attribute("noinline"))
+    function->addFnAttr(Attribute::NoInline);
+
+  // Hot and cold functions are grouped into their own sections, the same
+  // way profile guided optimization lays them out
+  if (prototype.has_attribute("hot")) {
+    function->addFnAttr(Attribute::Hot);
+    function->setSectionPrefix("hot");
+  }
+
+  if (prototype.has_attribute("cold")) {
+    function->addFnAttr(Attribute::Cold);
+    function->setSectionPrefix("unlikely");
+  }
+
+  // A pure function's result depends only on its arguments, so calls to it
+  // can be combined or hoisted. It can only read memory through its slices,
+  // which analysis checks. Nothing proves it returns, so calls whose results
+  // are unused are kept.
+  if (prototype.has_attribute("pure")) {
+    auto reads_slices = false;
+    for (const auto &parameter : prototype.parameter_list)
+      reads_slices |= ast::Type::is_slice(parameter.type);
+
+    if (reads_slices) {
+      function->addFnAttr(Attribute::ReadOnly);
+      function->addFnAttr(Attribute::ArgMemOnly);
+    } else {
+      function->addFnAttr(Attribute::ReadNone);
+    }
+
+    function->addFnAttr(Attribute::NoUnwind);
+  }
+}
+
+// The fast math flags the options and the function's @fastmath allow
+static FastMathFlags fast_math_flags(const CodeGenOptions &options,
+                                     const ast::FunctionPrototype &prototype) {
+  FastMathFlags flags;
+  if (options.fast_math)
+    flags.setFast();
+  if (options.fp_contract)
+    flags.setAllowContract();
+  if (options.no_signed_zeros)
+    flags.setNoSignedZeros();
+  if (options.reassociate)
+    flags.setAllowReassoc();
+
+  for (const auto &attribute : prototype.attributes) {
+    if (attribute.name.lexeme != "fastmath")
+      continue;
+
+    if (attribute.arguments.empty())
+      flags.setFast();
+
+    for (const auto &flag : attribute.arguments) {
+      const auto &name = flag.lexeme;
+      if (name == "reassoc")
+        flags.setAllowReassoc();
+      else if (name == "contract")
+        flags.setAllowContract();
+      else if (name == "nsz")
+        flags.setNoSignedZeros();
+      else if (name == "nnan")
+        flags.setNoNaNs();
+      else if (name == "ninf")
+        flags.setNoInfs();
+      else if (name == "arcp")
+        flags.setAllowReciprocal();
+      else if (name == "afn")
+        flags.setApproxFunc();
+    }
+  }
+
+  return flags;
+}
+
+// The backend reads these rather than the flags on each instruction when it
+// picks instructions for the whole function
+static void add_fast_math_attributes(Function *function, FastMathFlags flags,
+                                     bool flush_denormals) {
+  auto set = [&](StringRef name, bool value) {
+    if (value)
+      function->addFnAttr(name, "true");
+  };
+
+  set("unsafe-fp-math", flags.isFast());
+  set("no-nans-fp-math", flags.noNaNs());
+  set("no-infs-fp-math", flags.noInfs());
+  set("no-signed-zeros-fp-math", flags.noSignedZeros());
+  set("approx-func-fp-math", flags.approxFunc());
+
+  if (flush_denormals) {
+    function->addFnAttr("denormal-fp-math", "preserve-sign,preserve-sign");
+    function->addFnAttr("denormal-fp-math-f32",
+                        "preserve-sign,preserve-sign");
+  }
+}
+
+Function *StatementGenerator::declare(const ast::FunctionPrototype &prototype) {
+  if (auto existing = module->getFunction(prototype.name.lexeme))
+    return existing;
+
+  // Slices are passed as their pointer and their length, so the pointer
+  // can be marked noalias, and slices of @soa structs as a pointer for each
+  // column and their length. Structs are passed and returned as they are,
+  // which puts their fields in registers.
   SmallVector<Type *, 8> argument_types;
-  for (const auto &parameter : function.prototype.parameter_list) {
-    argument_types.push_back(
-        llvm_type_for(parameter.type, module->getContext()));
+  for (const auto &parameter : prototype.parameter_list) {
+    auto type = llvm_type_for(parameter.type, module->getContext(),
+                              expressionGenerator.structs);
+    if (is_slice(type) || is_soa_slice(type)) {
+      for (auto element : cast<StructType>(type)->elements())
+        argument_types.push_back(element);
+    } else {
+      argument_types.push_back(type);
+    }
   }
 
-  auto return_type =
-      llvm_type_for(function.prototype.return_type, module->getContext());
+  auto return_type = llvm_type_for(
+      prototype.return_type, module->getContext(), expressionGenerator.structs);
   if (!return_type) {
     return_type = Type::getVoidTy(module->getContext());
   }
 
   auto type = FunctionType::get(return_type, argument_types, false);
 
-  auto func = Function::Create(type, GlobalValue::LinkageTypes::ExternalLinkage,
-                               function.prototype.name.lexeme, module);
+  auto function =
+      Function::Create(type, GlobalValue::LinkageTypes::ExternalLinkage,
+                       prototype.name.lexeme, module);
+  add_attributes(function, prototype);
+  if (!options.target_cpu.empty())
+    function->addFnAttr("target-cpu", options.target_cpu);
+  if (!options.target_features.empty())
+    function->addFnAttr("target-features", options.target_features);
+  expressionGenerator.return_types.insert_or_assign(prototype.name.lexeme,
+                                                    prototype.return_type);
+
+  return function;
+}
+
+// How @memoize caches a function's results. A single integer argument below
+// the number of entries indexes a table directly, and other arguments are
+// hashed into a table of a bounded size, where new results replace old ones.
+struct Memoization {
+  uint64_t entries = 1024;
+  bool direct = false;
+  bool thread_safe = false;
+};
+
+static Optional<Memoization>
+memoization_of(const ast::FunctionPrototype &prototype) {
+  Optional<Memoization> memoization;
+  for (const auto &attribute : prototype.attributes) {
+    if (attribute.name.lexeme != "memoize")
+      continue;
+
+    memoization.emplace();
+    auto sized = false;
+    for (const auto &argument : attribute.arguments) {
+      if (argument.lexeme == "threadsafe") {
+        memoization->thread_safe = true;
+      } else {
+        memoization->entries = std::stoull(argument.lexeme);
+        sized = true;
+      }
+    }
+
+    const auto &parameters = prototype.parameter_list;
+    auto is_integer = parameters.size() == 1 &&
+                      (parameters[0].type == ast::Type::Primitive::INT32 ||
+                       parameters[0].type == ast::Type::Primitive::INT64 ||
+                       parameters[0].type == ast::Type::Primitive::UINT32 ||
+                       parameters[0].type == ast::Type::Primitive::UINT64);
+    memoization->direct =
+        sized && is_integer && memoization->entries <= (1 << 20);
+
+    // Hash tables are a power of two in size, and no larger than a direct
+    // table can be
+    if (!memoization->direct) {
+      auto entries = std::max<uint64_t>(memoization->entries, 16);
+      memoization->entries = std::min<uint64_t>(PowerOf2Ceil(entries), 1 << 20);
+    }
+  }
+
+  return memoization;
+}
+
+// Scalars are cached as 64 bits
+static Value *to_bits(IRBuilder<> &builder, Value *value) {
+  auto type = value->getType();
+  if (type->isFloatingPointTy())
+    value = builder.CreateBitCast(
+        value, builder.getIntNTy(type->getPrimitiveSizeInBits()));
+
+  return builder.CreateZExt(value, builder.getInt64Ty());
+}
+
+static Value *from_bits(IRBuilder<> &builder, Value *bits, Type *type) {
+  if (!type->isFloatingPointTy())
+    return builder.CreateTrunc(bits, type);
+
+  return builder.CreateBitCast(
+      builder.CreateTrunc(bits,
+                          builder.getIntNTy(type->getPrimitiveSizeInBits())),
+      type);
+}
+
+// Generates the body of a memoized function, which returns the cached result
+// for its arguments, or calls the uncached function and caches what it
+// returns. Thread safe caches are read and written with atomics: an entry of
+// a direct table is published by setting its state, and every entry of a
+// hash table has a sequence number that's odd while it's being written, so
+// that readers can tell when they've read a torn entry (a seqlock).
+static void generate_cache(IRBuilder<> &builder, Function *function,
+                           Function *uncached,
+                           const ast::FunctionPrototype &prototype,
+                           const Memoization &memoization) {
+  auto &context = function->getContext();
+  auto i64 = builder.getInt64Ty();
+  auto thread_safe = memoization.thread_safe;
+
+  builder.SetCurrentDebugLocation(DebugLoc());
+  builder.setFastMathFlags(FastMathFlags());
+  builder.SetInsertPoint(BasicBlock::Create(context, "entry", function));
+
+  std::vector<Value *> arguments;
+  std::vector<Value *> keys;
+  for (auto &argument : function->args()) {
+    arguments.push_back(&argument);
+    keys.push_back(to_bits(builder, &argument));
+  }
+
+  auto load = [&](Value *address, AtomicOrdering ordering) {
+    auto value = builder.CreateAlignedLoad(i64, address, Align(8));
+    if (thread_safe)
+      value->setAtomic(ordering);
+    return value;
+  };
+
+  auto store = [&](Value *value, Value *address, AtomicOrdering ordering) {
+    auto instruction = builder.CreateAlignedStore(value, address, Align(8));
+    if (thread_safe)
+      instruction->setAtomic(ordering);
+  };
+
+  // Calls the function and caches its result in the entry, if the entry's
+  // not in the middle of being written
+  auto compute = [&](Value *entry, Type *entry_type, unsigned value_field) {
+    auto result = builder.CreateCall(uncached, arguments);
+    auto bits = to_bits(builder, result);
+    auto field = [&](unsigned index) {
+      return builder.CreateConstInBoundsGEP2_32(entry_type, entry, 0, index);
+    };
+    auto state = field(0);
+
+    if (!thread_safe || memoization.direct) {
+      for (unsigned i = 0; i < keys.size() && !memoization.direct; ++i)
+        store(keys[i], field(i + 1), AtomicOrdering::Monotonic);
+      store(bits, field(value_field), AtomicOrdering::Monotonic);
+      store(builder.getInt64(2), state, AtomicOrdering::Release);
+      builder.CreateRet(result);
+      return;
+    }
+
+    auto claim = BasicBlock::Create(context, "claim", function);
+    auto write = BasicBlock::Create(context, "write", function);
+    auto done = BasicBlock::Create(context, "done", function);
+
+    auto sequence = load(state, AtomicOrdering::Monotonic);
+    builder.CreateCondBr(
+        builder.CreateTrunc(sequence, builder.getInt1Ty(), "writing"), done,
+        claim);
+
+    builder.SetInsertPoint(claim);
+    auto claimed = builder.CreateAtomicCmpXchg(
+        state, sequence, builder.CreateAdd(sequence, builder.getInt64(1)),
+        MaybeAlign(8),
+        AtomicOrdering::Acquire, AtomicOrdering::Monotonic);
+    builder.CreateCondBr(builder.CreateExtractValue(claimed, 1), write, done);
+
+    // The odd sequence must be visible before any of the fields change, or
+    // a reader could see the old sequence around a torn entry
+    builder.SetInsertPoint(write);
+    builder.CreateFence(AtomicOrdering::Release);
+    for (unsigned i = 0; i < keys.size(); ++i)
+      store(keys[i], field(i + 1), AtomicOrdering::Monotonic);
+    store(bits, field(value_field), AtomicOrdering::Monotonic);
+    store(builder.CreateAdd(sequence, builder.getInt64(2)), state,
+          AtomicOrdering::Release);
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    builder.CreateRet(result);
+  };
+
+  auto module = function->getParent();
+  auto name = function->getName() + ".cache";
+
+  if (memoization.direct) {
+    // Each entry is its state followed by the result
+    auto entry_type = ArrayType::get(i64, 2);
+    auto table_type = ArrayType::get(entry_type, memoization.entries);
+    auto table = new GlobalVariable(*module, table_type, false,
+                                    GlobalValue::InternalLinkage,
+                                    ConstantAggregateZero::get(table_type),
+                                    name);
+
+    auto lookup = BasicBlock::Create(context, "lookup", function);
+    auto hit = BasicBlock::Create(context, "hit", function);
+    auto miss = BasicBlock::Create(context, "miss", function);
+    auto uncacheable = BasicBlock::Create(context, "uncacheable", function);
+
+    // Negative arguments are out of range too
+    auto index = is_unsigned_type(prototype.parameter_list[0].type)
+                     ? builder.CreateZExt(arguments[0], i64)
+                     : builder.CreateSExt(arguments[0], i64);
+    builder.CreateCondBr(
+        builder.CreateICmpULT(index, builder.getInt64(memoization.entries)),
+        lookup, uncacheable);
+
+    builder.SetInsertPoint(lookup);
+    auto entry = builder.CreateInBoundsGEP(
+        table_type, table, {builder.getInt64(0), index}, "entry");
+    auto state = load(builder.CreateConstInBoundsGEP2_32(entry_type, entry,
+                                                         0, 0),
+                      AtomicOrdering::Acquire);
+    builder.CreateCondBr(builder.CreateIsNotNull(state), hit, miss);
+
+    builder.SetInsertPoint(hit);
+    auto bits = load(builder.CreateConstInBoundsGEP2_32(entry_type, entry, 0,
+                                                        1),
+                     AtomicOrdering::Monotonic);
+    builder.CreateRet(from_bits(builder, bits, function->getReturnType()));
+
+    builder.SetInsertPoint(miss);
+    compute(entry, entry_type, 1);
+
+    builder.SetInsertPoint(uncacheable);
+    builder.CreateRet(builder.CreateCall(uncached, arguments));
+    return;
+  }
+
+  // Each entry is its sequence number, the arguments and the result. The
+  // arguments hash to where the entry is looked for first, and a few of the
+  // entries after it are looked at before giving up.
+  auto entry_type = ArrayType::get(i64, keys.size() + 2);
+  auto table_type = ArrayType::get(entry_type, memoization.entries);
+  auto table = new GlobalVariable(*module, table_type, false,
+                                  GlobalValue::InternalLinkage,
+                                  ConstantAggregateZero::get(table_type), name);
+  auto value_field = (unsigned)keys.size() + 1;
+  auto probes = std::min<uint64_t>(memoization.entries, 8);
+
+  Value *hash = builder.getInt64(0);
+  for (const auto &key : keys)
+    hash = builder.CreateMul(builder.CreateXor(hash, key),
+                             builder.getInt64(0x9e3779b97f4a7c15));
+  auto home = builder.CreateLShr(
+      hash, 64 - Log2_64(memoization.entries), "home");
+
+  auto start = builder.GetInsertBlock();
+  auto probe = BasicBlock::Create(context, "probe", function);
+  auto compare = BasicBlock::Create(context, "compare", function);
+  auto hit = BasicBlock::Create(context, "hit", function);
+  auto next = BasicBlock::Create(context, "next", function);
+  auto miss = BasicBlock::Create(context, "miss", function);
+  builder.CreateBr(probe);
+
+  builder.SetInsertPoint(probe);
+  auto probed = builder.CreatePHI(i64, 2, "probed");
+  probed->addIncoming(builder.getInt64(0), start);
+  auto index = builder.CreateAnd(builder.CreateAdd(home, probed),
+                                 builder.getInt64(memoization.entries - 1));
+  auto entry = builder.CreateInBoundsGEP(
+      table_type, table, {builder.getInt64(0), index}, "entry");
+  auto state = builder.CreateConstInBoundsGEP2_32(entry_type, entry, 0, 0);
+  auto sequence = load(state, AtomicOrdering::Acquire);
+  builder.CreateCondBr(builder.CreateIsNull(sequence), miss, compare);
+
+  builder.SetInsertPoint(compare);
+  Value *found = builder.getTrue();
+  for (unsigned i = 0; i < keys.size(); ++i) {
+    auto key = load(builder.CreateConstInBoundsGEP2_32(entry_type, entry, 0,
+                                                       i + 1),
+                    AtomicOrdering::Monotonic);
+    found = builder.CreateAnd(found, builder.CreateICmpEQ(key, keys[i]));
+  }
+
+  auto bits = load(builder.CreateConstInBoundsGEP2_32(entry_type, entry, 0,
+                                                      value_field),
+                   AtomicOrdering::Monotonic);
+  if (thread_safe) {
+    builder.CreateFence(AtomicOrdering::Acquire);
+    auto unchanged = builder.CreateICmpEQ(
+        load(state, AtomicOrdering::Monotonic), sequence);
+    auto settled = builder.CreateNot(
+        builder.CreateTrunc(sequence, builder.getInt1Ty()));
+    found = builder.CreateAnd(found, builder.CreateAnd(unchanged, settled));
+  }
+
+  builder.CreateCondBr(found, hit, next);
+
+  builder.SetInsertPoint(hit);
+  builder.CreateRet(from_bits(builder, bits, function->getReturnType()));
+
+  builder.SetInsertPoint(next);
+  auto following = builder.CreateAdd(probed, builder.getInt64(1));
+  probed->addIncoming(following, next);
+  auto first = builder.CreateInBoundsGEP(table_type, table,
+                                         {builder.getInt64(0), home});
+  builder.CreateCondBr(
+      builder.CreateICmpULT(following, builder.getInt64(probes)), probe,
+      miss);
+
+  // A result goes in the first empty entry, or replaces the first entry
+  // looked at when there isn't one
+  builder.SetInsertPoint(miss);
+  auto replaced = builder.CreatePHI(entry->getType(), 2, "replaced");
+  replaced->addIncoming(entry, probe);
+  replaced->addIncoming(first, next);
+  compute(replaced, entry_type, value_field);
+}
+
+void StatementGenerator::visit(ast::Function &function) {
+  FunctionTimer timer(function.prototype.name.lexeme);
+
+  auto func = declare(function.prototype);
+
+  // A memoized function's body is generated into a function of its own, and
+  // the function itself becomes the cache in front of it. Calls in the body,
+  // including recursive ones, go through the cache. Writing the cache is a
+  // side effect that @pure would let calls be dropped around.
+  Function *cached = nullptr;
+  auto memoization = memoization_of(function.prototype);
+  if (memoization) {
+    cached = func;
+    func = Function::Create(func->getFunctionType(),
+                            GlobalValue::PrivateLinkage,
+                            func->getName() + ".uncached", module);
+    func->copyAttributesFrom(cached);
+    func->setDSOLocal(true);
+    for (auto attribute : {Attribute::ReadNone, Attribute::ReadOnly,
+                           Attribute::ArgMemOnly}) {
+      cached->removeFnAttr(attribute);
+      func->removeFnAttr(attribute);
+    }
+  }
 
   if (debug_info_generator) {
     debug_info_generator->attach_debug_info(function, func);
@@ -183,26 +1787,92 @@ void StatementGenerator::visit(ast::Function &function) {
   // will run past them when breaking on a function)
   builder->SetCurrentDebugLocation(DebugLoc());
 
-  assert(function.prototype.parameter_list.size() == func->arg_size());
-
   auto entry = BasicBlock::Create(module->getContext(), "entry", func);
   builder->SetInsertPoint(entry);
 
+  // Every floating point operation the builder creates in the function
+  // carries the flags
+  auto flags = fast_math_flags(options, function.prototype);
+  builder->setFastMathFlags(flags);
+  add_fast_math_attributes(func, flags, options.flush_denormals);
+
+  VariableUses uses;
+  function.body->accept(uses);
+
+  // Solar's only globals are read only, so a function only writes memory it
+  // didn't allocate through its slices. They can't alias each other when
+  // there's only one, or when none of them are written through.
+  std::vector<Argument *> slice_pointers;
+  unsigned slices = 0;
+  auto slices_written = false;
+
+  // Consts declared in the body go out of scope with it
+  auto outer_constants = expressionGenerator.constants;
+
   named_values->clear();
-  for (auto i = 0; i < function.prototype.parameter_list.size(); ++i) {
-    const auto &parameter = function.prototype.parameter_list[i];
-    const auto &arg = func->getArg(i);
+  expressionGenerator.variable_types.clear();
+  unsigned next_argument = 0;
+  for (const auto &parameter : function.prototype.parameter_list) {
+    auto arg = func->getArg(next_argument++);
+    Value *value = arg;
     arg->setName(parameter.name.lexeme);
 
+    auto type = llvm_type_for(parameter.type, module->getContext(),
+                              expressionGenerator.structs);
+    if (is_slice(type)) {
+      auto length = func->getArg(next_argument++);
+      arg->setName(parameter.name.lexeme + ".data");
+      length->setName(parameter.name.lexeme + ".length");
+
+      slice_pointers.push_back(arg);
+      slices++;
+      slices_written |= uses.written.count(parameter.name.lexeme) ||
+                        uses.escaped.count(parameter.name.lexeme);
+
+      value = builder->CreateInsertValue(
+          builder->CreateInsertValue(UndefValue::get(type), arg, 0), length,
+          1);
+    } else if (is_soa_slice(type)) {
+      // The columns of a slice never overlap each other
+      const auto &fields = expressionGenerator.structs.at(parameter.type.lexeme)
+                               .declaration->fields;
+      value = UndefValue::get(type);
+      for (unsigned i = 0; i <= fields.size(); ++i) {
+        auto column = i == 0 ? arg : func->getArg(next_argument++);
+        if (i < fields.size()) {
+          column->setName(parameter.name.lexeme + "." +
+                          fields[i].name.lexeme);
+          slice_pointers.push_back(column);
+        } else {
+          column->setName(parameter.name.lexeme + ".length");
+        }
+
+        value = builder->CreateInsertValue(value, column, i);
+      }
+
+      slices++;
+      slices_written |= uses.written.count(parameter.name.lexeme) ||
+                        uses.escaped.count(parameter.name.lexeme);
+    }
+
     const auto alloca = create_entry_block_alloca(
-        *builder, func, arg->getType(), arg->getName());
+        *builder, func, value->getType(), parameter.name.lexeme);
 
     if (debug_info_generator)
       debug_info_generator->attach_debug_info(parameter, arg, alloca,
                                               func->getSubprogram());
 
-    builder->CreateStore(arg, alloca);
-    named_values->insert_or_assign(arg->getName().str(), alloca);
+    builder->CreateStore(value, alloca);
+    named_values->insert_or_assign(parameter.name.lexeme, alloca);
+    expressionGenerator.variable_types.insert_or_assign(parameter.name.lexeme,
+                                                        parameter.type);
+  }
+
+  assert(next_argument == func->arg_size());
+
+  if (slices == 1 || !slices_written) {
+    for (auto pointer : slice_pointers)
+      pointer->addAttr(Attribute::NoAlias);
   }
 
   function.body->accept(*this);
@@ -211,35 +1881,379 @@ void StatementGenerator::visit(ast::Function &function) {
     builder->CreateRetVoid();
   }
 
+  // What's left of print's output is written out when main returns, so a
+  // call main returns can't be a musttail call anymore
+  if (flushes_output && function.prototype.name.lexeme == "main") {
+    auto flush = output_flush(module);
+    for (auto &block : *func) {
+      auto ret = dyn_cast<ReturnInst>(block.getTerminator());
+      if (!ret)
+        continue;
+
+      auto call = dyn_cast_or_null<CallInst>(ret->getPrevNode());
+      if (call && call->isMustTailCall())
+        call->setTailCallKind(CallInst::TCK_Tail);
+      CallInst::Create(flush, "", ret);
+    }
+  }
+
   if (debug_info_generator)
     debug_info_generator->lexical_scopes.pop_back();
 
+  // Flattening inlines every call the function makes, once the callees
+  // have bodies, except to callees that are never inlined
+  if (function.prototype.has_attribute("flatten")) {
+    for (auto &instruction : instructions(*func)) {
+      auto call = dyn_cast<CallInst>(&instruction);
+      if (!call || isa<IntrinsicInst>(call) ||
+          call->hasFnAttr(Attribute::NoInline))
+        continue;
+
+      call->addFnAttr(Attribute::AlwaysInline);
+    }
+  }
+
+  expressionGenerator.constants = std::move(outer_constants);
+
   verifyFunction(*func);
 
   function_pass_manager->run(*func);
+
+  if (cached) {
+    generate_cache(*builder, cached, func, function.prototype, *memoization);
+    verifyFunction(*cached);
+    function_pass_manager->run(*cached);
+  }
+}
+
+// @inline and @flatten are honored whether or not anything else inlines,
+// once every function in the module has been generated so that callees
+// defined after their callers have bodies. Callers are optimized again
+// with their callees inlined.
+void StatementGenerator::inline_marked_calls() {
+  std::vector<Function *> callers;
+  for (auto &function : *module) {
+    for (auto &instruction : instructions(function)) {
+      auto call = dyn_cast<CallBase>(&instruction);
+      auto callee = call ? call->getCalledFunction() : nullptr;
+      if (callee && !callee->isDeclaration() && callee != &function &&
+          call->hasFnAttr(Attribute::AlwaysInline)) {
+        callers.push_back(&function);
+        break;
+      }
+    }
+  }
+
+  if (callers.empty())
+    return;
+
+  legacy::PassManager passes;
+  passes.add(createAlwaysInlinerLegacyPass());
+  passes.run(*module);
+
+  for (auto caller : callers)
+    function_pass_manager->run(*caller);
+}
+
+void StatementGenerator::visit(ast::Assignment &assignment) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&assignment);
+
+  auto place = expressionGenerator.place_of(*assignment.target);
+  const auto value =
+      is_slice(place.type) || is_soa_slice(place.type)
+          ? expressionGenerator.as_slice(*assignment.value)
+          : static_cast<Value *>(assignment.value->accept(expressionGenerator));
+  expressionGenerator.store(
+      coerce_integer(*builder, value, place.type,
+                     !expressionGenerator.is_unsigned(*assignment.value)),
+      place);
+}
+
+// Hints become the loop's llvm.loop metadata, which the unroller and
+// vectorizer read off the latch's branch
+static void attach_loop_hints(BranchInst *latch_branch,
+                              const std::vector<ast::Attribute> &hints) {
+  if (hints.empty())
+    return;
+
+  auto &context = latch_branch->getContext();
+  auto hint = [&](StringRef name, Metadata *value = nullptr) {
+    SmallVector<Metadata *, 2> operands{MDString::get(context, name)};
+    if (value)
+      operands.push_back(value);
+    return MDNode::get(context, operands);
+  };
+  auto count = [&](uint32_t count) {
+    return ConstantAsMetadata::get(
+        ConstantInt::get(Type::getInt32Ty(context), count));
+  };
+
+  // The first operand is the loop's own id
+  SmallVector<Metadata *, 4> operands{nullptr};
+  for (const auto &attribute : hints) {
+    auto argument = attribute.arguments.empty()
+                        ? 0
+                        : std::stoul(attribute.arguments[0].lexeme);
+
+    if (attribute.name.lexeme == "unroll") {
+      if (argument == 0)
+        operands.push_back(hint("llvm.loop.unroll.enable"));
+      else if (argument == 1)
+        operands.push_back(hint("llvm.loop.unroll.disable"));
+      else
+        operands.push_back(hint("llvm.loop.unroll.count", count(argument)));
+    } else if (attribute.name.lexeme == "vectorize") {
+      auto enable = ConstantAsMetadata::get(
+          ConstantInt::get(Type::getInt1Ty(context), argument != 1));
+      operands.push_back(hint("llvm.loop.vectorize.enable", enable));
+      if (argument > 0)
+        operands.push_back(
+            hint("llvm.loop.vectorize.width", count(argument)));
+    }
+  }
+
+  auto loop_id = MDNode::getDistinct(context, operands);
+  loop_id->replaceOperandWith(0, loop_id);
+  latch_branch->setMetadata(LLVMContext::MD_loop, loop_id);
+}
+
+// Loops are laid out the way LLVM's loop passes expect them: the block
+// before the loop is its preheader, the header tests the condition, and
+// the latch is the only block that branches back to the header
+void StatementGenerator::visit(ast::While &loop) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&loop);
+
+  auto &context = module->getContext();
+  auto function = builder->GetInsertBlock()->getParent();
+
+  auto header = BasicBlock::Create(context, "while.header", function);
+  auto body = BasicBlock::Create(context, "while.body");
+  auto latch = BasicBlock::Create(context, "while.latch");
+  auto exit = BasicBlock::Create(context, "while.exit");
+
+  builder->CreateBr(header);
+  builder->SetInsertPoint(header);
+
+  auto condition =
+      static_cast<Value *>(loop.condition->accept(expressionGenerator));
+  builder->CreateCondBr(condition, body, exit);
+
+  function->getBasicBlockList().push_back(body);
+  builder->SetInsertPoint(body);
+  loop.body->accept(*this);
+
+  // A return in the body leaves the latch unreachable
+  if (!builder->GetInsertBlock()->getTerminator())
+    builder->CreateBr(latch);
+
+  function->getBasicBlockList().push_back(latch);
+  builder->SetInsertPoint(latch);
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&loop);
+  attach_loop_hints(builder->CreateBr(header), loop.attributes);
+
+  function->getBasicBlockList().push_back(exit);
+  builder->SetInsertPoint(exit);
+}
+
+void StatementGenerator::visit(ast::For &loop) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&loop);
+
+  auto &context = module->getContext();
+  auto function = builder->GetInsertBlock()->getParent();
+
+  // The variable takes the type of the end of the range
+  auto end = static_cast<Value *>(loop.end->accept(expressionGenerator));
+  auto end_type = expressionGenerator.type_of(*loop.end);
+  auto is_unsigned = is_unsigned_type(end_type);
+  auto start = coerce_integer(
+      *builder,
+      static_cast<Value *>(loop.start->accept(expressionGenerator)),
+      end->getType(), !expressionGenerator.is_unsigned(*loop.start));
+  assert(end->getType()->isIntegerTy()); // todo: codegen errors
+
+  auto variable = create_entry_block_alloca(*builder, function, end->getType(),
+                                            loop.variable.lexeme);
+  builder->CreateStore(start, variable);
+
+  // A variable counting up from a non-negative constant to the length of
+  // an array or slice is always in bounds for it, unless the body assigns
+  // to either
+  std::vector<std::pair<std::string, std::string>> proven;
+  auto start_constant = dyn_cast<ConstantInt>(start);
+  if (start_constant && !start_constant->isNegative()) {
+    VariableUses uses;
+    loop.body->accept(uses);
+
+    if (!uses.assigned.count(loop.variable.lexeme)) {
+      auto length_of = dynamic_cast<ast::Call *>(loop.end);
+      auto end_constant = dyn_cast<ConstantInt>(end);
+
+      if (length_of && length_of->name.lexeme == "len" &&
+          length_of->arguments.size() == 1) {
+        auto sequence = dynamic_cast<ast::Variable *>(length_of->arguments[0]);
+        if (sequence && !uses.assigned.count(sequence->name.lexeme))
+          proven.emplace_back(loop.variable.lexeme, sequence->name.lexeme);
+      } else if (end_constant && !end_constant->isNegative()) {
+        // Arrays can't change length, so only their own declaration in the
+        // body could make the bound wrong
+        for (const auto &[name, variable] : *named_values) {
+          // Each column of an array of @soa structs is as long as it is
+          auto type = variable->getAllocatedType();
+          if (is_soa(type) && !is_soa_slice(type))
+            type = type->getStructElementType(0);
+
+          auto array = dyn_cast<ArrayType>(type);
+          if (array && !uses.assigned.count(name) &&
+              end_constant->getZExtValue() <= array->getNumElements())
+            proven.emplace_back(loop.variable.lexeme, name);
+        }
+      }
+    }
+  }
+
+  // Pairs already proven by an enclosing loop stay proven after this one
+  std::vector<std::pair<std::string, std::string>> inserted;
+  for (const auto &pair : proven) {
+    if (expressionGenerator.in_bounds.insert(pair).second)
+      inserted.push_back(pair);
+  }
+
+  // The variable is only in scope for the loop's body
+  auto shadowed = named_values->find(loop.variable.lexeme);
+  auto previous =
+      shadowed == named_values->end() ? nullptr : shadowed->second;
+  named_values->insert_or_assign(loop.variable.lexeme, variable);
+
+  auto &types = expressionGenerator.variable_types;
+  auto shadowed_type = types.find(loop.variable.lexeme);
+  auto had_type = shadowed_type != types.end();
+  auto previous_type = had_type ? shadowed_type->second : Token();
+  types.insert_or_assign(loop.variable.lexeme, end_type);
+
+  auto header = BasicBlock::Create(context, "for.header", function);
+  auto body = BasicBlock::Create(context, "for.body");
+  auto latch = BasicBlock::Create(context, "for.latch");
+  auto exit = BasicBlock::Create(context, "for.exit");
+
+  builder->CreateBr(header);
+  builder->SetInsertPoint(header);
+
+  auto current =
+      builder->CreateLoad(end->getType(), variable, loop.variable.lexeme);
+  auto in_range = is_unsigned ? builder->CreateICmpULT(current, end)
+                              : builder->CreateICmpSLT(current, end);
+  builder->CreateCondBr(in_range, body, exit);
+
+  function->getBasicBlockList().push_back(body);
+  builder->SetInsertPoint(body);
+  loop.body->accept(*this);
+
+  if (!builder->GetInsertBlock()->getTerminator())
+    builder->CreateBr(latch);
+
+  // The variable never passes end, so stepping it can't overflow, even
+  // with wrapping arithmetic. Counting up from a non-negative start, it
+  // can't wrap as an unsigned number either.
+  function->getBasicBlockList().push_back(latch);
+  builder->SetInsertPoint(latch);
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&loop);
+  auto value =
+      builder->CreateLoad(end->getType(), variable, loop.variable.lexeme);
+  auto non_negative_start =
+      is_unsigned || (start_constant && !start_constant->isNegative());
+  builder->CreateStore(
+      builder->CreateAdd(value, ConstantInt::get(end->getType(), 1), "",
+                         non_negative_start, !is_unsigned),
+      variable);
+  attach_loop_hints(builder->CreateBr(header), loop.attributes);
+
+  function->getBasicBlockList().push_back(exit);
+  builder->SetInsertPoint(exit);
+
+  if (previous)
+    named_values->insert_or_assign(loop.variable.lexeme, previous);
+  else
+    named_values->erase(loop.variable.lexeme);
+
+  if (had_type)
+    types.insert_or_assign(loop.variable.lexeme, previous_type);
+  else
+    types.erase(loop.variable.lexeme);
+
+  for (const auto &pair : inserted)
+    expressionGenerator.in_bounds.erase(pair);
+}
+
+// Structs are laid out before any function is generated, except for those
+// declared in a function's body
+void StatementGenerator::visit(ast::Struct &structure) {
+  if (!expressionGenerator.structs.count(structure.name.lexeme))
+    expressionGenerator.define_structs({&structure});
 }
 
 void StatementGenerator::visit(ast::Return &return_statement) {
   if (debug_info_generator)
     debug_info_generator->emit_location(&return_statement);
 
-  auto value = static_cast<Value *>(
-      return_statement.return_value->accept(expressionGenerator));
-  builder->CreateRet(value);
+  expressionGenerator.generate_return(*return_statement.return_value);
 }
 
 ExpressionGenerator::ExpressionGenerator(
     Module *module, IRBuilder<> *builder,
     DebugInfoGenerator *debug_info_generator,
-    unordered_map<string, AllocaInst *> *named_values)
-    : module(module), builder(builder),
-      debug_info_generator(debug_info_generator), named_values(named_values) {}
+    unordered_map<string, AllocaInst *> *named_values,
+    const CodeGenOptions &options)
+    : module(module), builder(builder), named_values(named_values),
+      options(options), debug_info_generator(debug_info_generator) {}
+
+void ExpressionGenerator::define_structs(
+    const std::vector<const ast::Struct *> &declarations) {
+  auto &context = module->getContext();
+  std::vector<const ast::Struct *> defined;
+  for (const auto &declaration : declarations) {
+    const auto &name = declaration->name.lexeme;
+    if (structs.count(name))
+      continue;
+
+    structs.emplace(name, StructDefinition{declaration,
+                                           StructType::create(context, name)});
+    defined.push_back(declaration);
+  }
+
+  for (const auto &declaration : defined) {
+    std::vector<Type *> fields;
+    for (const auto &field : declaration->fields)
+      fields.push_back(llvm_type_for(field.type, context, structs));
+
+    // A struct aligned to more than its fields ends in a field of no size
+    // with that alignment, which pads the struct out to a multiple of it
+    // without moving the others. Arrays of the struct put each element at
+    // the start of its own cache line, for example.
+    for (const auto &attribute : declaration->attributes) {
+      if (attribute.name.lexeme != "align" || attribute.arguments.empty())
+        continue;
+
+      auto alignment = std::stoull(attribute.arguments[0].lexeme);
+      fields.push_back(ArrayType::get(
+          FixedVectorType::get(Type::getInt8Ty(context), alignment), 0));
+    }
+
+    structs.at(declaration->name.lexeme)
+        .type->setBody(fields, declaration->has_attribute("packed"));
+  }
+}
 
 void *ExpressionGenerator::visit(ast::LiteralValueExpression &expression) {
   if (debug_info_generator)
     debug_info_generator->emit_location(&expression);
 
-  const auto type = llvm_type_for(expression.type.name, module->getContext());
+  const auto type =
+      llvm_type_for(expression.type.name, module->getContext(), structs);
   const auto size = type->getScalarSizeInBits();
 
   switch (type->getTypeID()) {
@@ -261,75 +2275,64 @@ void *ExpressionGenerator::visit(ast::Binop &binop) {
   if (debug_info_generator)
     debug_info_generator->emit_location(&binop);
 
-  const auto left = static_cast<Value *>(binop.left->accept(*this));
-  const auto right = static_cast<Value *>(binop.right->accept(*this));
+  auto left = static_cast<Value *>(binop.left->accept(*this));
+  auto right = static_cast<Value *>(binop.right->accept(*this));
   const auto operation = binop.operation;
 
-  switch (operation) {
-  case ast::Operation::ADD: {
-    return left->getType()->isFloatingPointTy()
-               ? builder->CreateFAdd(left, right)
-               : builder->CreateAdd(left, right);
-  }
-  case ast::Operation::SUBTRACT: {
-    return left->getType()->isFloatingPointTy()
-               ? builder->CreateFSub(left, right)
-               : builder->CreateSub(left, right);
-  }
-  case ast::Operation::MULTIPLY: {
-    return left->getType()->isFloatingPointTy()
-               ? builder->CreateFMul(left, right)
-               : builder->CreateMul(left, right);
-  }
-  case ast::Operation::DIVIDE: {
-    auto isLeftFloat = left->getType()->isFloatingPointTy();
-    auto isRightFloat = right->getType()->isFloatingPointTy();
-
-    return isLeftFloat || isRightFloat ? builder->CreateFDiv(left, right)
-                                       : builder->CreateSDiv(left, right);
-  }
-  case ast::Operation::COMPARE_IS_EQUAL: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_OEQ
-                         : CmpInst::Predicate::ICMP_EQ;
-
-    return builder->CreateCmp(predicate, left, right);
-  }
-  case ast::Operation::COMPARE_IS_NOT_EQUAL: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_ONE
-                         : CmpInst::Predicate::ICMP_NE;
-
-    return builder->CreateCmp(predicate, left, right);
-  }
-  case ast::Operation::COMPARE_IS_LESS: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_OLT
-                         : CmpInst::Predicate::ICMP_SLT;
-
-    return builder->CreateCmp(predicate, left, right);
-  }
-  case ast::Operation::COMPARE_IS_GREATER: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_OGT
-                         : CmpInst::Predicate::ICMP_SGT;
-
-    return builder->CreateCmp(predicate, left, right);
-  }
-  case ast::Operation::COMPARE_IS_LESS_OR_EQUAL: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_OLE
-                         : CmpInst::Predicate::ICMP_SLE;
-
+  // Vectors operate lane by lane, with scalars on the other side splatted
+  // across every lane
+  if (left->getType()->isVectorTy() && !right->getType()->isVectorTy())
+    right = splat(*builder, right, left->getType());
+  else if (right->getType()->isVectorTy() && !left->getType()->isVectorTy())
+    left = splat(*builder, left, right->getType());
+
+  // Signed arithmetic doesn't overflow unless wrapping is asked for, which
+  // lets LLVM reason about it like it would about an int in C. Unsigned
+  // arithmetic wraps.
+  const auto is_float = left->getType()->isFPOrFPVectorTy() ||
+                        right->getType()->isFPOrFPVectorTy();
+  const auto is_unsigned = is_unsigned_type(operand_type(binop));
+  const auto no_signed_wrap = !is_unsigned && !options.wrapping_arithmetic;
+
+  auto compare = [&](CmpInst::Predicate floating, CmpInst::Predicate signed_,
+                     CmpInst::Predicate unsigned_) {
+    auto predicate = is_float ? floating : is_unsigned ? unsigned_ : signed_;
     return builder->CreateCmp(predicate, left, right);
-  }
-  case ast::Operation::COMPARE_IS_GREATER_OR_EQUAL: {
-    auto predicate = left->getType()->isFloatingPointTy()
-                         ? CmpInst::Predicate::FCMP_OGE
-                         : CmpInst::Predicate::ICMP_SGE;
+  };
 
-    return builder->CreateCmp(predicate, left, right);
-  }
+  switch (operation) {
+  case ast::Operation::ADD:
+    return is_float ? builder->CreateFAdd(left, right)
+                    : builder->CreateAdd(left, right, "", false,
+                                         no_signed_wrap);
+  case ast::Operation::SUBTRACT:
+    return is_float ? builder->CreateFSub(left, right)
+                    : builder->CreateSub(left, right, "", false,
+                                         no_signed_wrap);
+  case ast::Operation::MULTIPLY:
+    return is_float ? builder->CreateFMul(left, right)
+                    : builder->CreateMul(left, right, "", false,
+                                         no_signed_wrap);
+  case ast::Operation::DIVIDE:
+    return is_float      ? builder->CreateFDiv(left, right)
+           : is_unsigned ? builder->CreateUDiv(left, right)
+                         : builder->CreateSDiv(left, right);
+  case ast::Operation::REMAINDER:
+    return is_float      ? builder->CreateFRem(left, right)
+           : is_unsigned ? builder->CreateURem(left, right)
+                         : builder->CreateSRem(left, right);
+  case ast::Operation::COMPARE_IS_EQUAL:
+    return compare(CmpInst::FCMP_OEQ, CmpInst::ICMP_EQ, CmpInst::ICMP_EQ);
+  case ast::Operation::COMPARE_IS_NOT_EQUAL:
+    return compare(CmpInst::FCMP_ONE, CmpInst::ICMP_NE, CmpInst::ICMP_NE);
+  case ast::Operation::COMPARE_IS_LESS:
+    return compare(CmpInst::FCMP_OLT, CmpInst::ICMP_SLT, CmpInst::ICMP_ULT);
+  case ast::Operation::COMPARE_IS_GREATER:
+    return compare(CmpInst::FCMP_OGT, CmpInst::ICMP_SGT, CmpInst::ICMP_UGT);
+  case ast::Operation::COMPARE_IS_LESS_OR_EQUAL:
+    return compare(CmpInst::FCMP_OLE, CmpInst::ICMP_SLE, CmpInst::ICMP_ULE);
+  case ast::Operation::COMPARE_IS_GREATER_OR_EQUAL:
+    return compare(CmpInst::FCMP_OGE, CmpInst::ICMP_SGE, CmpInst::ICMP_UGE);
   default:
     assert(0); // todo: codegen errors
   }
@@ -384,33 +2387,712 @@ void *ExpressionGenerator::visit(ast::Condition &condition) {
   return phi;
 }
 
+void ExpressionGenerator::generate_return(ast::Expression &expression) {
+  auto condition = dynamic_cast<ast::Condition *>(&expression);
+
+  // Each arm of a condition returns on its own rather than merging into a phi,
+  // so the arms stay in tail position.
+  if (condition && condition->otherwise) {
+    if (debug_info_generator)
+      debug_info_generator->emit_location(condition);
+
+    auto if_condition =
+        static_cast<Value *>(condition->condition->accept(*this));
+    assert(if_condition);
+
+    if_condition->setName("if_condition");
+
+    auto function = builder->GetInsertBlock()->getParent();
+
+    auto then_block =
+        BasicBlock::Create(module->getContext(), "then", function);
+    auto otherwise_block =
+        BasicBlock::Create(module->getContext(), "else", function);
+
+    builder->CreateCondBr(if_condition, then_block, otherwise_block);
+
+    builder->SetInsertPoint(then_block);
+    generate_return(*condition->then);
+
+    builder->SetInsertPoint(otherwise_block);
+    generate_return(*condition->otherwise);
+    return;
+  }
+
+  auto value = static_cast<Value *>(expression.accept(*this));
+  assert(value);
+
+  // The call is the last instruction before the ret only when the
+  // whole expression is the call. Builtins, like building a struct, don't
+  // call anything.
+  auto call = dyn_cast<CallInst>(value);
+  if (dynamic_cast<ast::Call *>(&expression) && call)
+    call->setTailCallKind(tail_call_kind_for(call));
+
+  const auto return_type =
+      builder->GetInsertBlock()->getParent()->getReturnType();
+  builder->CreateRet(
+      coerce_integer(*builder, value, return_type, !is_unsigned(expression)));
+}
+
 void *ExpressionGenerator::visit(ast::Call &call) {
   if (debug_info_generator)
     debug_info_generator->emit_location(&call);
 
   auto function = module->getFunction(call.name.lexeme);
 
-  // todo: codegen errors
-  assert(function);
-  assert(function->isVarArg() || function->arg_size() == call.arguments.size());
+  // Builtins are only used when the program doesn't define its own
+  if (!function) {
+    auto result = builtin(call);
+
+    // todo: codegen errors
+    assert(result);
+    return result;
+  }
 
   std::vector<Value *> arguments;
   for (auto const &argument_expression : call.arguments) {
-    arguments.push_back(
-        static_cast<Value *>(argument_expression->accept(*this)));
+    // Slice parameters take a pointer and a length, or a pointer for each
+    // column and a length, the only pointer parameters besides printf's
+    // format
+    auto parameter = arguments.size();
+    auto length = parameter;
+    while (length < function->arg_size() &&
+           function->getArg(length)->getType()->isPointerTy())
+      length++;
+
+    auto takes_slice = length > parameter && length < function->arg_size() &&
+                       function->getArg(length)->getType()->isIntegerTy(64);
+
+    auto argument =
+        takes_slice ? as_slice(*argument_expression)
+                    : static_cast<Value *>(argument_expression->accept(*this));
+
+    auto type = argument->getType();
+    if (takes_slice && (is_slice(type) || is_soa_slice(type))) {
+      for (unsigned i = 0; i < type->getStructNumElements(); ++i)
+        arguments.push_back(builder->CreateExtractValue(argument, i));
+      continue;
+    }
+
+    // Variadic arguments get C's default promotions, so that printf can
+    // print f32s (like vector lanes and reductions) and bools
+    if (arguments.size() < function->arg_size()) {
+      argument = coerce_integer(
+          *builder, argument, function->getArg(arguments.size())->getType(),
+          !is_unsigned(*argument_expression));
+    } else if (argument->getType()->isFloatTy()) {
+      argument = builder->CreateFPExt(argument, builder->getDoubleTy());
+    } else if (argument->getType()->isIntegerTy(1)) {
+      argument = builder->CreateZExt(argument, builder->getInt32Ty());
+    }
+
+    arguments.push_back(argument);
   }
 
+  assert(function->isVarArg() || function->arg_size() == arguments.size());
+
   return builder->CreateCall(function, arguments);
 }
 
+// Functions the compiler provides, or null if there's no such builtin
+Value *ExpressionGenerator::builtin(ast::Call &call) {
+  const auto &name = call.name.lexeme;
+  auto &context = module->getContext();
+
+  std::vector<Value *> arguments;
+  auto generate_arguments = [&]() {
+    for (const auto &argument : call.arguments)
+      arguments.push_back(static_cast<Value *>(argument->accept(*this)));
+  };
+
+  if (name == "len" && call.arguments.size() == 1)
+    return sequence_of(*call.arguments[0]).length;
+
+  if (name == "print")
+    return print(call);
+
+  // Structs are built by calling their name with a value for every field,
+  // which converts like a vector's lanes do
+  auto structure = structs.find(name);
+  if (structure != structs.end() &&
+      structure->second.declaration->name.lexeme == name) {
+    auto type = structure->second.type;
+    generate_arguments();
+
+    // todo: codegen errors
+    assert(arguments.size() == structure->second.declaration->fields.size());
+
+    Value *value = UndefValue::get(type);
+    for (unsigned i = 0; i < arguments.size(); ++i) {
+      auto field = as_lane(*builder, arguments[i], type->getElementType(i));
+      value = builder->CreateInsertValue(value, field, i);
+    }
+
+    return value;
+  }
+
+  // Vectors are built by calling their type, either with a scalar for every
+  // lane or with one for all of them
+  if (ast::Type::is_vector(call.name)) {
+    auto type =
+        cast<FixedVectorType>(llvm_type_for(call.name, context, structs));
+    generate_arguments();
+
+    if (arguments.size() == 1)
+      return splat(*builder, arguments[0], type);
+
+    // todo: codegen errors
+    assert(arguments.size() == type->getNumElements());
+
+    Value *vector = UndefValue::get(type);
+    for (unsigned i = 0; i < arguments.size(); ++i) {
+      auto lane = as_lane(*builder, arguments[i], type->getElementType());
+      vector = builder->CreateInsertElement(vector, lane, i);
+    }
+
+    return vector;
+  }
+
+  // shuffle(a, [lanes]) picks lanes of a, and shuffle(a, b, [lanes]) those
+  // of a followed by b's. The lanes are constant, so the shuffle is a
+  // single instruction.
+  if (name == "shuffle" &&
+      (call.arguments.size() == 2 || call.arguments.size() == 3)) {
+    generate_arguments();
+
+    auto lanes = dyn_cast<Constant>(arguments.back());
+    assert(lanes && lanes->getType()->isArrayTy()); // todo: codegen errors
+
+    std::vector<int> mask;
+    auto count = lanes->getType()->getArrayNumElements();
+    for (unsigned i = 0; i < count; ++i) {
+      auto lane = cast<ConstantInt>(lanes->getAggregateElement(i));
+      mask.push_back((int)lane->getSExtValue());
+    }
+
+    auto first = arguments[0];
+    auto second = arguments.size() == 3 ? arguments[1]
+                                        : UndefValue::get(first->getType());
+    return builder->CreateShuffleVector(first, second, mask);
+  }
+
+  // select(mask, a, b) takes each lane from a where the mask is set and from
+  // b where it isn't
+  if (name == "select" && call.arguments.size() == 3) {
+    generate_arguments();
+    return builder->CreateSelect(arguments[0], arguments[1], arguments[2]);
+  }
+
+  // Horizontal reductions combine the lanes of a vector into a scalar.
+  // Floating point lanes may be added in any order, so they reduce as a
+  // tree rather than one lane at a time.
+  if (name.starts_with("reduce_") && call.arguments.size() == 1) {
+    generate_arguments();
+
+    auto vector = arguments[0];
+    auto lane = cast<FixedVectorType>(vector->getType())->getElementType();
+    auto floating = lane->isFloatingPointTy();
+
+    Value *result = nullptr;
+    if (name == "reduce_add" && floating) {
+      result = builder->CreateFAddReduce(ConstantFP::getNegativeZero(lane),
+                                         vector);
+      cast<Instruction>(result)->setHasAllowReassoc(true);
+    } else if (name == "reduce_add") {
+      result = builder->CreateAddReduce(vector);
+    } else if (name == "reduce_mul" && floating) {
+      result = builder->CreateFMulReduce(ConstantFP::get(lane, 1.0), vector);
+      cast<Instruction>(result)->setHasAllowReassoc(true);
+    } else if (name == "reduce_mul") {
+      result = builder->CreateMulReduce(vector);
+    } else if (name == "reduce_min") {
+      result = floating ? builder->CreateFPMinReduce(vector)
+                        : builder->CreateIntMinReduce(vector, true);
+    } else if (name == "reduce_max") {
+      result = floating ? builder->CreateFPMaxReduce(vector)
+                        : builder->CreateIntMaxReduce(vector, true);
+    } else if (name == "reduce_and" && !floating) {
+      // On masks, whether every lane is set
+      result = builder->CreateAndReduce(vector);
+    } else if (name == "reduce_or" && !floating) {
+      // On masks, whether any lane is set
+      result = builder->CreateOrReduce(vector);
+    }
+
+    return result;
+  }
+
+  return nullptr;
+}
+
+// print's format is parsed here, so that all the program does is format the
+// values of its conversions. The text between them, with the strings printed
+// into it, is written in one go, and a format with a newline ends the line.
+Value *ExpressionGenerator::print(ast::Call &call) {
+  auto format = call.arguments.empty()
+                    ? nullptr
+                    : dynamic_cast<ast::StringLiteral *>(call.arguments[0]);
+  std::vector<FormatSegment> segments;
+
+  // todo: codegen errors
+  assert(format && parse_format(format->value, segments).empty());
+
+  // Like a call's, the arguments are evaluated before anything is printed
+  std::vector<Value *> values(call.arguments.size());
+  for (size_t i = 1; i < call.arguments.size(); ++i) {
+    if (!dynamic_cast<ast::StringLiteral *>(call.arguments[i]))
+      values[i] = static_cast<Value *>(call.arguments[i]->accept(*this));
+  }
+
+  std::string text;
+  auto ends_line = false;
+  Value *result = nullptr;
+  auto write_text = [&]() {
+    ends_line |= text.find('\n') != std::string::npos;
+    result = builder->CreateCall(
+        output_write(module),
+        {builder->CreateGlobalStringPtr(text), builder->getInt64(text.size())});
+    text.clear();
+  };
+
+  size_t next = 1;
+  for (const auto &segment : segments) {
+    text += segment.text;
+    if (!segment.conversion)
+      continue;
+
+    auto argument = call.arguments[next];
+    auto value = values[next++];
+    if (segment.conversion == 's') {
+      const auto &string = static_cast<ast::StringLiteral *>(argument)->value;
+      auto padding = std::string(
+          std::max<size_t>(segment.width, string.size()) - string.size(), ' ');
+      text += segment.left_justify ? string + padding : padding + string;
+      continue;
+    }
+
+    if (!text.empty())
+      write_text();
+
+    auto width = builder->getInt32(segment.width);
+    auto flags = builder->getInt32((segment.left_justify ? LEFT_JUSTIFY : 0) |
+                                   (segment.zero_pad ? ZERO_PAD : 0));
+
+    if (segment.conversion == 'f') {
+      result = builder->CreateCall(
+          output_float(module),
+          {builder->CreateFPExt(value, builder->getDoubleTy()),
+           builder->getInt32(segment.precision), width, flags});
+      continue;
+    }
+
+    auto is_signed = segment.conversion == 'd' || segment.conversion == 'i';
+    auto base = segment.conversion == 'x' ? 16 : 10;
+    result = builder->CreateCall(
+        output_integer(module),
+        {is_signed ? builder->CreateSExt(value, builder->getInt64Ty())
+                   : builder->CreateZExt(value, builder->getInt64Ty()),
+         builder->getInt1(is_signed), builder->getInt32(base), width, flags});
+  }
+
+  if (!text.empty() || !result)
+    write_text();
+
+  if (ends_line)
+    result = builder->CreateCall(output_end_line(module));
+
+  return result;
+}
+
+static Token type_named(const std::string &lexeme,
+                        const SourcePosition &position) {
+  return {Token::Kind::IDENTIFIER, lexeme, position};
+}
+
+Token ExpressionGenerator::type_of_variable(const std::string &name) {
+  auto type = variable_types.find(name);
+  if (type != variable_types.end())
+    return type->second;
+
+  auto constant = constants.find(name);
+  return constant == constants.end() ? Token() : constant->second.type;
+}
+
+bool ExpressionGenerator::type_returned_by(const std::string &name,
+                                           Token &type) {
+  auto return_type = return_types.find(name);
+  if (return_type == return_types.end())
+    return false;
+
+  type = return_type->second;
+  return true;
+}
+
+const ast::Struct *ExpressionGenerator::struct_named(const std::string &name) {
+  auto structure = structs.find(name);
+  return structure == structs.end() ? nullptr : structure->second.declaration;
+}
+
+bool ExpressionGenerator::is_unsigned(ast::Expression &expression) {
+  return is_unsigned_type(type_of(expression));
+}
+
+bool ExpressionGenerator::is_constant(ast::Expression &expression) {
+  auto variable = dynamic_cast<ast::Variable *>(&expression);
+  return variable && !named_values->count(variable->name.lexeme) &&
+         constants.count(variable->name.lexeme);
+}
+
+ExpressionGenerator::Place
+ExpressionGenerator::place_of(ast::Expression &expression) {
+  if (auto variable = dynamic_cast<ast::Variable *>(&expression)) {
+    if (is_constant(*variable)) {
+      auto global = constants.at(variable->name.lexeme).global;
+      return {global, global->getValueType()};
+    }
+
+    auto alloca = named_values->at(variable->name.lexeme);
+    return {alloca, alloca->getAllocatedType()};
+  }
+
+  // Fields are within their struct, except for those of an element of an
+  // array of @soa structs, which are in their column
+  if (auto member = dynamic_cast<ast::Member *>(&expression)) {
+    auto place = place_of(*member->target);
+    auto field = field_index(*member);
+    auto type = place.type->getStructElementType(field);
+    if (!place.fields.empty())
+      return {place.fields[field], type};
+
+    return {builder->CreateStructGEP(place.type, place.address, field,
+                                     member->field.lexeme),
+            type};
+  }
+
+  auto index = dynamic_cast<ast::Index *>(&expression);
+  assert(index && !index->end); // todo: codegen errors
+
+  auto sequence = sequence_of(*index->target);
+  auto position =
+      as_index(*builder, static_cast<Value *>(index->index->accept(*this)),
+               !is_unsigned(*index->index));
+
+  auto target = dynamic_cast<ast::Variable *>(index->target);
+  auto variable = dynamic_cast<ast::Variable *>(index->index);
+  if (!target || !variable ||
+      !in_bounds.count({variable->name.lexeme, target->name.lexeme}))
+    check(builder->CreateICmpULT(position, sequence.length, "in_bounds"));
+
+  if (!sequence.columns.empty()) {
+    Place place{nullptr, sequence.element};
+    for (unsigned i = 0; i < sequence.columns.size(); ++i)
+      place.fields.push_back(builder->CreateInBoundsGEP(
+          sequence.element->getStructElementType(i), sequence.columns[i],
+          position, "element"));
+    return place;
+  }
+
+  auto address = builder->CreateInBoundsGEP(sequence.element, sequence.data,
+                                            position, "element");
+  return {address, sequence.element};
+}
+
+// Elements of arrays of @soa structs are gathered from their columns, and
+// scattered back into them
+Value *ExpressionGenerator::load(const Place &place) {
+  if (place.fields.empty())
+    return builder->CreateLoad(place.type, place.address);
+
+  Value *value = UndefValue::get(place.type);
+  for (unsigned i = 0; i < place.fields.size(); ++i) {
+    auto field = builder->CreateLoad(place.type->getStructElementType(i),
+                                     place.fields[i]);
+    value = builder->CreateInsertValue(value, field, i);
+  }
+
+  return value;
+}
+
+void ExpressionGenerator::store(Value *value, const Place &place) {
+  if (place.fields.empty()) {
+    builder->CreateStore(value, place.address);
+    return;
+  }
+
+  for (unsigned i = 0; i < place.fields.size(); ++i)
+    builder->CreateStore(builder->CreateExtractValue(value, i),
+                         place.fields[i]);
+}
+
+bool ExpressionGenerator::is_place(ast::Expression &expression) {
+  auto index = dynamic_cast<ast::Index *>(&expression);
+  auto member = dynamic_cast<ast::Member *>(&expression);
+  return dynamic_cast<ast::Variable *>(&expression) || (index && !index->end) ||
+         (member && is_place(*member->target));
+}
+
+unsigned ExpressionGenerator::field_index(ast::Member &member) {
+  const auto &structure = structs.at(type_of(*member.target).lexeme);
+  const auto &fields = structure.declaration->fields;
+  for (unsigned i = 0; i < fields.size(); ++i) {
+    if (fields[i].name.lexeme == member.field.lexeme)
+      return i;
+  }
+
+  assert(0); // todo: codegen errors
+  return 0;
+}
+
+// The struct an array or slice of @soa structs holds
+StructType *ExpressionGenerator::soa_element(Type *type) {
+  for (const auto &[name, layout] : structs) {
+    if (layout.type == type)
+      return structs.at(layout.declaration->name.lexeme).type;
+  }
+
+  assert(0); // todo: codegen errors
+  return nullptr;
+}
+
+Value *ExpressionGenerator::soa_slice(StructType *element,
+                                      const std::vector<Value *> &columns,
+                                      Value *length) {
+  Token name;
+  for (const auto &[_, layout] : structs) {
+    if (layout.type == element)
+      name = layout.declaration->name;
+  }
+
+  auto type = llvm_type_for(type_named("[]" + name.lexeme, name.position),
+                            module->getContext(), structs);
+  Value *slice = UndefValue::get(type);
+  for (unsigned i = 0; i < columns.size(); ++i)
+    slice = builder->CreateInsertValue(slice, columns[i], i);
+  return builder->CreateInsertValue(slice, length, columns.size());
+}
+
+ExpressionGenerator::Sequence ExpressionGenerator::sequence_in(Place place) {
+  if (is_soa(place.type)) {
+    Sequence sequence{nullptr, nullptr, soa_element(place.type)};
+    auto columns = place.type->getStructNumElements();
+    if (is_soa_slice(place.type)) {
+      auto slice = builder->CreateLoad(place.type, place.address);
+      for (unsigned i = 0; i + 1 < columns; ++i)
+        sequence.columns.push_back(builder->CreateExtractValue(slice, i));
+      sequence.length =
+          builder->CreateExtractValue(slice, columns - 1, "length");
+      return sequence;
+    }
+
+    auto zero = builder->getInt32(0);
+    for (unsigned i = 0; i < columns; ++i)
+      sequence.columns.push_back(builder->CreateInBoundsGEP(
+          place.type, place.address, {zero, builder->getInt32(i), zero}));
+    sequence.length = builder->getInt64(
+        place.type->getStructElementType(0)->getArrayNumElements());
+    return sequence;
+  }
+
+  if (auto array = dyn_cast<ArrayType>(place.type)) {
+    auto zero = builder->getInt64(0);
+    auto data = builder->CreateInBoundsGEP(array, place.address, {zero, zero});
+    return {data, builder->getInt64(array->getNumElements()),
+            array->getElementType()};
+  }
+
+  // Lanes are laid out in memory like an array's elements, except for a
+  // mask's, which are packed into bits
+  if (auto vector = dyn_cast<FixedVectorType>(place.type)) {
+    auto lane = vector->getElementType();
+    assert(!lane->isIntegerTy(1)); // todo: codegen errors
+
+    auto data = builder->CreatePointerCast(place.address,
+                                           PointerType::getUnqual(lane));
+    return {data, builder->getInt64(vector->getNumElements()), lane};
+  }
+
+  assert(is_slice(place.type)); // todo: codegen errors
+
+  auto slice = builder->CreateLoad(place.type, place.address);
+  auto element = cast<StructType>(place.type)
+                     ->getElementType(0)
+                     ->getPointerElementType();
+  return {builder->CreateExtractValue(slice, 0, "data"),
+          builder->CreateExtractValue(slice, 1, "length"), element};
+}
+
+// Arrays are indexed where they're stored rather than copied out of it.
+// Arrays that aren't stored anywhere, like those returned by calls, are
+// stored to a temporary first.
+ExpressionGenerator::Sequence
+ExpressionGenerator::sequence_of(ast::Expression &expression, bool writable) {
+  auto is_variable = dynamic_cast<ast::Variable *>(&expression) &&
+                     !(writable && is_constant(expression));
+  if (is_variable ||
+      (!dynamic_cast<ast::Variable *>(&expression) && is_place(expression)))
+    return sequence_in(place_of(expression));
+
+  auto value = static_cast<Value *>(expression.accept(*this));
+  auto function = builder->GetInsertBlock()->getParent();
+  auto temporary =
+      create_entry_block_alloca(*builder, function, value->getType(), "");
+  builder->CreateStore(value, temporary);
+  return sequence_in({temporary, value->getType()});
+}
+
+Value *ExpressionGenerator::as_slice(ast::Expression &expression) {
+  auto is_array = [](Type *type) {
+    return isa<ArrayType>(type) || (is_soa(type) && !is_soa_slice(type));
+  };
+
+  // Slices can be written through, so a const is sliced by copying it
+  auto is_variable =
+      dynamic_cast<ast::Variable *>(&expression) && !is_constant(expression);
+  Place place;
+  if (is_variable ||
+      (!dynamic_cast<ast::Variable *>(&expression) && is_place(expression))) {
+    place = place_of(expression);
+    if (!is_array(place.type))
+      return load(place);
+  } else {
+    auto value = static_cast<Value *>(expression.accept(*this));
+    if (!is_array(value->getType()))
+      return value;
+
+    auto function = builder->GetInsertBlock()->getParent();
+    place = {create_entry_block_alloca(*builder, function, value->getType(),
+                                       ""),
+             value->getType()};
+    builder->CreateStore(value, place.address);
+  }
+
+  auto sequence = sequence_in(place);
+  if (!sequence.columns.empty())
+    return soa_slice(cast<StructType>(sequence.element), sequence.columns,
+                     sequence.length);
+
+  auto type = slice_type_for(sequence.element);
+  return builder->CreateInsertValue(
+      builder->CreateInsertValue(UndefValue::get(type), sequence.data, 0),
+      sequence.length, 1);
+}
+
+// Failed checks trap. The branch is weighted so that the trap is laid out
+// out of the way of the code that follows.
+void ExpressionGenerator::check(Value *condition) {
+  if (!options.bounds_checks)
+    return;
+
+  auto constant = dyn_cast<ConstantInt>(condition);
+  if (constant && constant->isOne())
+    return;
+
+  auto &context = module->getContext();
+  auto function = builder->GetInsertBlock()->getParent();
+  auto in_bounds = BasicBlock::Create(context, "bounds.ok", function);
+  auto out_of_bounds = BasicBlock::Create(context, "bounds.fail", function);
+
+  builder->CreateCondBr(condition, in_bounds, out_of_bounds,
+                        MDBuilder(context).createBranchWeights(1 << 20, 1));
+
+  builder->SetInsertPoint(out_of_bounds);
+  builder->CreateCall(Intrinsic::getDeclaration(module, Intrinsic::trap));
+  builder->CreateUnreachable();
+
+  builder->SetInsertPoint(in_bounds);
+}
+
+void *ExpressionGenerator::visit(ast::Index &index) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&index);
+
+  if (!index.end)
+    return load(place_of(index));
+
+  // Slicing shares the elements, from start up to end
+  auto sequence = sequence_of(*index.target, true);
+  auto start =
+      as_index(*builder, static_cast<Value *>(index.index->accept(*this)),
+               !is_unsigned(*index.index));
+  auto end = as_index(*builder, static_cast<Value *>(index.end->accept(*this)),
+                      !is_unsigned(*index.end));
+
+  check(builder->CreateICmpULE(start, end, "in_order"));
+  check(builder->CreateICmpULE(end, sequence.length, "in_bounds"));
+  auto length = builder->CreateSub(end, start, "length");
+
+  if (!sequence.columns.empty()) {
+    auto element = cast<StructType>(sequence.element);
+    std::vector<Value *> columns;
+    for (unsigned i = 0; i < sequence.columns.size(); ++i)
+      columns.push_back(builder->CreateInBoundsGEP(
+          element->getElementType(i), sequence.columns[i], start));
+    return soa_slice(element, columns, length);
+  }
+
+  auto type = slice_type_for(sequence.element);
+  auto data =
+      builder->CreateInBoundsGEP(sequence.element, sequence.data, start);
+  return builder->CreateInsertValue(
+      builder->CreateInsertValue(UndefValue::get(type), data, 0), length, 1);
+}
+
+void *ExpressionGenerator::visit(ast::ArrayLiteral &literal) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&literal);
+
+  // Elements take the type of the first
+  std::vector<Value *> elements;
+  for (const auto &expression : literal.elements) {
+    auto element = static_cast<Value *>(expression->accept(*this));
+    if (!elements.empty())
+      element = coerce_integer(*builder, element, elements[0]->getType());
+    elements.push_back(element);
+  }
+
+  auto count = literal.repeat ? literal.repeat : elements.size();
+  auto type = ArrayType::get(elements[0]->getType(), count);
+
+  if (literal.repeat) {
+    if (auto constant = dyn_cast<Constant>(elements[0])) {
+      return constant->isNullValue()
+                 ? (Value *)ConstantAggregateZero::get(type)
+                 : ConstantArray::get(
+                       type, std::vector<Constant *>(count, constant));
+    }
+
+    elements.resize(count, elements[0]);
+  }
+
+  Value *array = UndefValue::get(type);
+  for (unsigned i = 0; i < count; ++i)
+    array = builder->CreateInsertValue(array, elements[i], i);
+
+  return array;
+}
+
+// Fields of values stored somewhere are read from where they are, so that
+// reading a field of an element doesn't read the rest of it
+void *ExpressionGenerator::visit(ast::Member &member) {
+  if (debug_info_generator)
+    debug_info_generator->emit_location(&member);
+
+  if (is_place(*member.target))
+    return load(place_of(member));
+
+  auto value = static_cast<Value *>(member.target->accept(*this));
+  return builder->CreateExtractValue(value, field_index(member),
+                                     member.field.lexeme);
+}
+
 void *ExpressionGenerator::visit(ast::Variable &variable) {
   if (debug_info_generator)
     debug_info_generator->emit_location(&variable);
 
-  auto value = named_values->at(variable.name.lexeme);
-  assert(value);
-
-  return builder->CreateLoad(value, variable.name.lexeme.c_str());
+  auto place = place_of(variable);
+  return builder->CreateLoad(place.type, place.address,
+                             variable.name.lexeme.c_str());
 }
 
 void *ExpressionGenerator::visit(ast::StringLiteral &literal) {
@@ -480,8 +3162,9 @@ void DebugInfoGenerator::attach_debug_info(const ast::Parameter &parameter,
                                            DISubprogram *subprogram) {
 
   auto arg_debug_info = debug_info_builder->createParameterVariable(
-      subprogram, arg->getName(), arg->getArgNo(), subprogram->getFile(),
-      parameter.position.line, get_type(parameter.type), true);
+      subprogram, parameter.name.lexeme, arg->getArgNo(),
+      subprogram->getFile(), parameter.position.line,
+      get_type(parameter.type), true);
 
   debug_info_builder->insertDeclare(
       alloca, arg_debug_info, debug_info_builder->createExpression(),
@@ -495,7 +3178,7 @@ void DebugInfoGenerator::attach_debug_info(const ast::VariableDeclaration &decl,
                                            DISubprogram *subprogram) {
 
   auto variable_debug_info = debug_info_builder->createAutoVariable(
-      subprogram->getScope(), decl.name.lexeme, subprogram->getFile(),
+      subprogram, decl.name.lexeme, subprogram->getFile(),
       decl.position.line, get_type(decl.type), true);
 
   auto location = DILocation::get(subprogram->getContext(), decl.position.line,
@@ -506,7 +3189,107 @@ void DebugInfoGenerator::attach_debug_info(const ast::VariableDeclaration &decl,
                                     location, ir_builder->GetInsertBlock());
 }
 
-DIBasicType *DebugInfoGenerator::get_type(const Token &type_token) {
+// Types are aligned to their size, up to that of their largest part
+static uint64_t alignment_in_bits(DIType *type) {
+  if (type->getAlignInBits())
+    return type->getAlignInBits();
+
+  if (auto composite = dyn_cast<DICompositeType>(type)) {
+    if (composite->getTag() == dwarf::DW_TAG_array_type &&
+        !(composite->getFlags() & DINode::FlagVector))
+      return alignment_in_bits(composite->getBaseType());
+    if (composite->getTag() == dwarf::DW_TAG_structure_type)
+      return 64;
+  }
+
+  return std::max<uint64_t>(PowerOf2Ceil(type->getSizeInBits()), 8);
+}
+
+DIType *DebugInfoGenerator::get_type(const Token &type_token) {
+  // Arrays and slices of @soa structs are described as their columns
+  auto is_sequence =
+      ast::Type::is_array(type_token) || ast::Type::is_slice(type_token);
+  if (is_sequence && structs && structs->count(type_token.lexeme)) {
+    auto cached = struct_types.find(type_token.lexeme);
+    if (cached != struct_types.end())
+      return cached->second;
+
+    auto is_array = ast::Type::is_array(type_token);
+    auto length = is_array ? ast::Type::array_length(type_token) : 0;
+    auto file = compile_unit->getFile();
+    uint64_t offset = 0;
+    std::vector<Metadata *> columns;
+    const auto &declaration = *structs->at(type_token.lexeme).declaration;
+    for (const auto &field : declaration.fields) {
+      auto element = get_type(field.type);
+      DIType *column;
+      if (is_array)
+        column = debug_info_builder->createArrayType(
+            length * element->getSizeInBits(), alignment_in_bits(element),
+            element,
+            debug_info_builder->getOrCreateArray(
+                {debug_info_builder->getOrCreateSubrange(0, length)}));
+      else
+        column = debug_info_builder->createPointerType(element, 64);
+
+      auto alignment = alignment_in_bits(column);
+      offset = alignTo(offset, alignment);
+      columns.push_back(debug_info_builder->createMemberType(
+          compile_unit, field.name.lexeme, file, field.position.line,
+          column->getSizeInBits(), alignment, offset, DINode::FlagZero,
+          column));
+      offset += column->getSizeInBits();
+    }
+
+    if (!is_array) {
+      offset = alignTo(offset, 64);
+      columns.push_back(debug_info_builder->createMemberType(
+          compile_unit, "length", file, 0, 64, 64, offset, DINode::FlagZero,
+          get_type(ast::Type::Primitive::INT64)));
+      offset += 64;
+    }
+
+    auto type = debug_info_builder->createStructType(
+        compile_unit, type_token.lexeme, file, 0, alignTo(offset, 64), 0,
+        DINode::FlagZero, nullptr,
+        debug_info_builder->getOrCreateArray(columns));
+    struct_types.emplace(type_token.lexeme, type);
+    return type;
+  }
+
+  if (ast::Type::is_array(type_token)) {
+    auto element = get_type(ast::Type::element_type(type_token));
+    auto length = ast::Type::array_length(type_token);
+    auto subscripts = debug_info_builder->getOrCreateArray(
+        {debug_info_builder->getOrCreateSubrange(0, length)});
+    return debug_info_builder->createArrayType(
+        length * element->getSizeInBits(), 0, element, subscripts);
+  }
+
+  if (ast::Type::is_vector(type_token)) {
+    auto lane = get_type(ast::Type::lane_type(type_token));
+    auto count = ast::Type::lane_count(type_token);
+    auto subscripts = debug_info_builder->getOrCreateArray(
+        {debug_info_builder->getOrCreateSubrange(0, count)});
+    return debug_info_builder->createVectorType(
+        count * lane->getSizeInBits(), 0, lane, subscripts);
+  }
+
+  // Slices are described as the pair they're lowered to
+  if (ast::Type::is_slice(type_token)) {
+    auto element = get_type(ast::Type::element_type(type_token));
+    auto data = debug_info_builder->createMemberType(
+        compile_unit, "data", compile_unit->getFile(), 0, 64, 0, 0,
+        DINode::FlagZero, debug_info_builder->createPointerType(element, 64));
+    auto length = debug_info_builder->createMemberType(
+        compile_unit, "length", compile_unit->getFile(), 0, 64, 0, 64,
+        DINode::FlagZero, get_type(ast::Type::Primitive::INT64));
+    return debug_info_builder->createStructType(
+        compile_unit, type_token.lexeme, compile_unit->getFile(), 0, 128, 0,
+        DINode::FlagZero, nullptr,
+        debug_info_builder->getOrCreateArray({data, length}));
+  }
+
   // todo: maybe cache these?
   if (type_token == ast::Type::Primitive::INT64) {
     return debug_info_builder->createBasicType("i64", 64, dwarf::DW_ATE_signed);
@@ -527,8 +3310,46 @@ DIBasicType *DebugInfoGenerator::get_type(const Token &type_token) {
                                                dwarf::DW_ATE_boolean);
   }
 
-  assert(0); // todo: user defined types
-  return nullptr;
+  assert(structs && structs->count(type_token.lexeme)); // todo: codegen errors
+
+  auto cached = struct_types.find(type_token.lexeme);
+  if (cached != struct_types.end())
+    return cached->second;
+
+  // Fields are laid out like a C compiler would, one after another at their
+  // alignment, or at the next byte when the struct is @packed. @align pads
+  // the struct out to a multiple of its alignment.
+  const auto &declaration = *structs->at(type_token.lexeme).declaration;
+  auto packed = declaration.has_attribute("packed");
+  auto file = compile_unit->getFile();
+  uint64_t offset = 0;
+  uint64_t struct_alignment = 8;
+  std::vector<Metadata *> fields;
+  for (const auto &field : declaration.fields) {
+    auto type = get_type(field.type);
+    auto alignment = packed ? 8 : alignment_in_bits(type);
+    auto size = alignTo(type->getSizeInBits(), 8);
+
+    offset = alignTo(offset, alignment);
+    fields.push_back(debug_info_builder->createMemberType(
+        compile_unit, field.name.lexeme, file, field.position.line, size,
+        alignment, offset, DINode::FlagZero, type));
+    offset += size;
+    struct_alignment = std::max(struct_alignment, alignment);
+  }
+
+  for (const auto &attribute : declaration.attributes) {
+    if (attribute.name.lexeme == "align" && !attribute.arguments.empty())
+      struct_alignment = std::max<uint64_t>(
+          struct_alignment, 8 * std::stoull(attribute.arguments[0].lexeme));
+  }
+
+  auto type = debug_info_builder->createStructType(
+      compile_unit, type_token.lexeme, file, declaration.position.line,
+      alignTo(offset, struct_alignment), struct_alignment, DINode::FlagZero,
+      nullptr, debug_info_builder->getOrCreateArray(fields));
+  struct_types.emplace(type_token.lexeme, type);
+  return type;
 }
 
 void DebugInfoGenerator::finalize() const { debug_info_builder->finalize(); }
\ No newline at end of file
@@ -1,25 +1,73 @@
 #pragma once
 
 #include "ast.hpp"
+#include "typer.hpp"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 
 #include <filesystem>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+// Choices about the generated code, and the target it is generated for
+struct CodeGenOptions {
+  // Indexing traps on an index past the end of an array or slice, unless
+  // the index is known to be in bounds
+  bool bounds_checks = true;
+
+  // Signed integer arithmetic wraps on overflow instead of being assumed
+  // not to overflow
+  bool wrapping_arithmetic = false;
+
+  // Floating point operations may be rewritten in ways that change their
+  // results. fast_math allows anything, the others allow fusing multiplies
+  // and adds, ignoring the sign of zero and reassociating. @fastmath allows
+  // them for a single function.
+  bool fast_math = false;
+  bool fp_contract = false;
+  bool no_signed_zeros = false;
+  bool reassociate = false;
+
+  // Code is generated assuming denormal floats are flushed to zero
+  bool flush_denormals = false;
+
+  // The CPU and features functions are generated for, which the function
+  // passes read as well as the backend. Empty leaves them to the target.
+  std::string target_cpu;
+  std::string target_features;
+};
+
+// A struct, and the LLVM type it's laid out as. Arrays and slices of @soa
+// structs have layouts of their own, named like the types they are
+// ([4]Particle), which hold a column for each of the struct's fields.
+struct StructDefinition {
+  const ast::Struct *declaration;
+  llvm::StructType *type;
+};
+
+typedef std::unordered_map<std::string, StructDefinition> StructDefinitions;
+
+// The buffer print writes into, which every module of a program must share
+extern const char *const output_buffer_name;
+
 class DebugInfoGenerator {
 private:
   llvm::DIBuilder *debug_info_builder;
   llvm::IRBuilder<> *ir_builder;
   llvm::DICompileUnit *compile_unit;
+  std::unordered_map<std::string, llvm::DIType *> struct_types;
 
 public:
   std::vector<llvm::DIScope *> lexical_scopes;
 
+  // The structs of the module being generated
+  const StructDefinitions *structs = nullptr;
+
   DebugInfoGenerator() = delete;
   explicit DebugInfoGenerator(llvm::Module *, llvm::IRBuilder<> *,
                               const std::filesystem::path &);
@@ -31,24 +79,87 @@ public:
   void attach_debug_info(const ast::VariableDeclaration &, llvm::AllocaInst *,
                          llvm::DISubprogram *);
 
-  llvm::DIBasicType *get_type(const Token &);
+  llvm::DIType *get_type(const Token &);
   void emit_location(const ast::Node *node);
   void finalize() const;
 };
 
-class ExpressionGenerator : public ast::ExpressionVisitor {
+class ExpressionGenerator : public ast::ExpressionVisitor, public Typer {
 private:
   llvm::Module *module;
   llvm::IRBuilder<> *builder;
   std::unordered_map<std::string, llvm::AllocaInst *> *named_values;
+  const CodeGenOptions &options;
 
   DebugInfoGenerator *debug_info_generator;
 
+  // Where a value lives in memory, and its type. An element of an array of
+  // @soa structs has no address of its own, only one for each field.
+  struct Place {
+    llvm::Value *address = nullptr;
+    llvm::Type *type = nullptr;
+    std::vector<llvm::Value *> fields = {};
+  };
+
+  // An array or slice, by its first element. Arrays of @soa structs start
+  // at the first element of each column instead.
+  struct Sequence {
+    llvm::Value *data = nullptr;
+    llvm::Value *length = nullptr;
+    llvm::Type *element = nullptr;
+    std::vector<llvm::Value *> columns = {};
+  };
+
+  llvm::Value *builtin(ast::Call &);
+  llvm::Value *print(ast::Call &);
+  bool is_constant(ast::Expression &);
+  Sequence sequence_in(Place);
+  // Sequences that may be written through copy the elements of a const
+  Sequence sequence_of(ast::Expression &, bool writable = false);
+  void check(llvm::Value *condition);
+  bool is_place(ast::Expression &);
+  unsigned field_index(ast::Member &);
+  llvm::StructType *soa_element(llvm::Type *);
+  llvm::Value *soa_slice(llvm::StructType *element,
+                         const std::vector<llvm::Value *> &columns,
+                         llvm::Value *length);
+
+  Token type_of_variable(const std::string &name) override;
+  bool type_returned_by(const std::string &name, Token &type) override;
+  const ast::Struct *struct_named(const std::string &name) override;
+
 public:
   explicit ExpressionGenerator(
       llvm::Module *module, llvm::IRBuilder<> *builder,
       DebugInfoGenerator *debug_info_generator,
-      std::unordered_map<std::string, llvm::AllocaInst *> *named_values);
+      std::unordered_map<std::string, llvm::AllocaInst *> *named_values,
+      const CodeGenOptions &options);
+
+  // Pairs of an index variable and the array or slice variable it's known
+  // to be in bounds for, whose checks are left out
+  std::set<std::pair<std::string, std::string>> in_bounds;
+
+  // The declared types of the variables in scope and of what functions
+  // return, which decide whether integers are signed
+  std::unordered_map<std::string, Token> variable_types;
+  std::unordered_map<std::string, Token> return_types;
+
+  // A const variable, as a read only global
+  struct ConstantGlobal {
+    llvm::GlobalVariable *global;
+    Token type;
+  };
+
+  // The const variables in scope, which variables of the same name shadow
+  std::unordered_map<std::string, ConstantGlobal> constants;
+
+  StructDefinitions structs;
+
+  // Lays out the structs, whose fields may be of each other's types
+  // whatever order they're declared in
+  void define_structs(const std::vector<const ast::Struct *> &);
+
+  bool is_unsigned(ast::Expression &);
 
   void *visit(ast::Variable &) override;
   void *visit(ast::LiteralValueExpression &) override;
@@ -56,6 +167,22 @@ public:
   void *visit(ast::Condition &) override;
   void *visit(ast::Call &) override;
   void *visit(ast::StringLiteral &) override;
+  void *visit(ast::Index &) override;
+  void *visit(ast::ArrayLiteral &) override;
+  void *visit(ast::Member &) override;
+
+  // Variables, elements and fields can be assigned to
+  Place place_of(ast::Expression &);
+  llvm::Value *load(const Place &);
+  void store(llvm::Value *, const Place &);
+
+  // Generates the expression, but slices arrays so that they can be used
+  // where slices are expected. Other values are returned as they are.
+  llvm::Value *as_slice(ast::Expression &);
+
+  // Lowers an expression in tail position. Every path through the expression
+  // ends in a ret, so calls in the arms of a condition can become tail calls.
+  void generate_return(ast::Expression &);
 };
 
 class StatementGenerator : public ast::StatementVisitor {
@@ -64,6 +191,7 @@ private:
   llvm::IRBuilder<> *builder;
   ExpressionGenerator &expressionGenerator;
   std::unordered_map<std::string, llvm::AllocaInst *> *named_values;
+  const CodeGenOptions &options;
   llvm::legacy::FunctionPassManager *function_pass_manager;
 
   DebugInfoGenerator *debug_info_generator;
@@ -74,28 +202,72 @@ public:
       DebugInfoGenerator *debug_info_generator,
       ExpressionGenerator &expressionGenerator,
       std::unordered_map<std::string, llvm::AllocaInst *> *named_values,
-      bool release);
+      const CodeGenOptions &options, bool release);
 
   virtual ~StatementGenerator() { delete function_pass_manager; }
 
 public:
+  // Whether main writes out what's left of print's output when it returns
+  bool flushes_output = false;
+
+  llvm::Function *declare(const ast::FunctionPrototype &);
+
+  // Emits a const variable whose initializer has been evaluated, returning
+  // false if it hasn't been
+  bool define_constant(const ast::VariableDeclaration &);
+
+  // Inlines the calls to @inline functions and the calls in @flatten ones
+  void inline_marked_calls();
+
   void visit(ast::VariableDeclaration &) override;
   void visit(ast::ExpressionStatement &) override;
   void visit(ast::Function &) override;
   void visit(ast::Block &) override;
   void visit(ast::Return &) override;
+  void visit(ast::Assignment &) override;
+  void visit(ast::While &) override;
+  void visit(ast::For &) override;
+  void visit(ast::Struct &) override;
 };
 
 class CodeGen {
   llvm::LLVMContext *context;
+  bool owns_context;
   llvm::IRBuilder<> *builder;
   std::unordered_map<std::string, llvm::AllocaInst *> *named_values;
 
   DebugInfoGenerator *debug_info_generator;
 
 public:
+  CodeGenOptions options;
+
+  // What the last compile couldn't do as the program asked, like calls
+  // @inline asked to inline that stayed calls
+  std::vector<std::string> warnings;
+
   CodeGen();
+  // Generates into a context owned by someone else (e.g. a JIT)
+  explicit CodeGen(llvm::LLVMContext *context);
   ~CodeGen();
+  // Functions of the other programs are declared so that calls into them
+  // resolve at link time
   llvm::Module *compile_module(const std::filesystem::path &, ast::Program *,
-                               bool release = false);
-};
\ No newline at end of file
+                               bool release = false,
+                               const std::vector<ast::Program *> &others = {});
+  // Generates a single function of the program, with the rest of the
+  // program's functions, and those of the others, declared so calls to them
+  // resolve at link time. Calls to them can't be inlined, so @inline and
+  // @flatten leave warnings about them.
+  llvm::Module *
+  compile_function(const std::filesystem::path &, ast::Program *,
+                   ast::Function &, bool release = false,
+                   const std::vector<ast::Program *> &others = {});
+  // The routines print's output goes through, and its buffer. Each module
+  // that prints defines its own linkonce copy of them, which the modules of
+  // a JIT that only claims each module's function find here instead.
+  llvm::Module *compile_output_runtime();
+};
+
+// Whether a function of the program, or of the others it's compiled with,
+// prints, in which case main flushes what's left of the output as it returns
+bool prints(const ast::Program *, const std::vector<ast::Program *> &others);
\ No newline at end of file
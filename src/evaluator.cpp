@@ -0,0 +1,913 @@
+#include "evaluator.hpp"
+
+#include "llvm/ADT/Optional.h"
+
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace llvm;
+using ast::Type;
+
+// A value worked out at compile time. Arrays and slices both refer to a range
+// of shared elements, but arrays are copied whenever they're stored. Anything
+// reached through a const variable is read only.
+struct ConstantValue {
+  Token type;
+
+  // Bools and integers are wrapped to their type's width, and f32s are
+  // rounded to floats
+  int64_t integer = 0;
+  double number = 0;
+
+  std::shared_ptr<std::vector<ConstantValue>> elements = nullptr;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+  bool read_only = false;
+};
+
+typedef std::unordered_map<std::string, ConstantValue> Scope;
+
+static bool is_signed(const Token &type) {
+  return type == Type::Primitive::INT32 || type == Type::Primitive::INT64;
+}
+
+static bool is_unsigned(const Token &type) {
+  return type == Type::Primitive::UINT32 || type == Type::Primitive::UINT64;
+}
+
+static bool is_integer(const Token &type) {
+  return is_signed(type) || is_unsigned(type);
+}
+
+static bool is_float(const Token &type) {
+  return type == Type::Primitive::FLOAT32 || type == Type::Primitive::FLOAT64;
+}
+
+static bool is_sequence(const Token &type) {
+  return Type::is_array(type) || Type::is_slice(type);
+}
+
+static Token type_named(const std::string &lexeme) {
+  return {Token::Kind::IDENTIFIER, lexeme, SourcePosition()};
+}
+
+static int64_t wrap(int64_t value, const Token &type) {
+  if (type == Type::Primitive::INT32)
+    return (int32_t)value;
+  if (type == Type::Primitive::UINT32)
+    return (uint32_t)value;
+  if (type == Type::Primitive::BOOL)
+    return value != 0;
+
+  return value;
+}
+
+static double round_to(double value, const Token &type) {
+  return type == Type::Primitive::FLOAT32 ? (float)value : value;
+}
+
+// Runs const functions over the tree. The first thing that can't be
+// evaluated fails the evaluation, and everything after it unwinds.
+class Evaluator : public ast::ExpressionVisitor, public ast::StatementVisitor {
+  const EvaluationLimits &limits;
+  const std::unordered_map<std::string, ast::Function *> &functions;
+  const Scope &constants;
+
+  // The variables of the const function being run
+  Scope locals;
+
+  // The value of the last expression, or of a return
+  ConstantValue result;
+  bool returning = false;
+
+  uint64_t steps = 0;
+  uint64_t memory = 0;
+  unsigned depth = 0;
+
+  [[nodiscard]] bool failed() const { return !error.empty(); }
+
+  void fail(const ast::Node &node, const std::string &message) {
+    if (failed())
+      return;
+
+    error = message;
+    error_position = node.position;
+  }
+
+  bool step(const ast::Node &node) {
+    if (!failed() && ++steps > limits.steps)
+      fail(node, "Took more than " + std::to_string(limits.steps) + " steps");
+
+    return !failed();
+  }
+
+  bool allocate(uint64_t count, const ast::Node &node) {
+    auto limit = limits.memory / sizeof(ConstantValue);
+    if (count > limit || memory + count > limit) {
+      fail(node, "Used more than " + std::to_string(limits.memory) +
+                     " bytes of memory");
+      return false;
+    }
+
+    memory += count;
+    return true;
+  }
+
+  ConstantValue evaluate(ast::Expression &expression) {
+    result = ConstantValue();
+    if (!failed())
+      expression.accept(*this);
+
+    return result;
+  }
+
+  ConstantValue convert(ConstantValue value, const Token &type,
+                        const ast::Node &node) {
+    if (failed() || value.type == type)
+      return value;
+
+    if (is_integer(value.type) && is_integer(type)) {
+      value.integer = wrap(value.integer, type);
+      value.type = type;
+      return value;
+    }
+
+    if (is_float(value.type) && is_float(type)) {
+      value.number = round_to(value.number, type);
+      value.type = type;
+      return value;
+    }
+
+    if (is_sequence(value.type) && is_sequence(type) &&
+        (!Type::is_array(type) || Type::array_length(type) == value.length)) {
+      auto element = Type::element_type(type);
+      if (Type::element_type(value.type) == element) {
+        value.type = type;
+        return value;
+      }
+
+      // Array literals are converted element by element to the type they're
+      // declared with
+      if (Type::is_array(type) && allocate(value.length, node)) {
+        auto elements = std::make_shared<std::vector<ConstantValue>>();
+        for (uint64_t i = 0; i < value.length; ++i) {
+          elements->push_back(convert((*value.elements)[value.offset + i],
+                                      element, node));
+        }
+
+        value.elements = elements;
+        value.offset = 0;
+        value.type = type;
+        return value;
+      }
+    }
+
+    fail(node, "Expected a value of type " + type.lexeme + ", but got " +
+                   (value.type.lexeme.empty() ? "nothing" : value.type.lexeme));
+    return value;
+  }
+
+  // Arrays are values, so they're copied when they're stored
+  ConstantValue copy(const ConstantValue &value, const ast::Node &node) {
+    if (!Type::is_array(value.type) || !allocate(value.length, node))
+      return value;
+
+    auto elements = std::make_shared<std::vector<ConstantValue>>();
+    elements->reserve(value.length);
+    for (uint64_t i = 0; i < value.length; ++i)
+      elements->push_back(copy((*value.elements)[value.offset + i], node));
+
+    ConstantValue array{value.type};
+    array.elements = elements;
+    array.length = value.length;
+    return array;
+  }
+
+  // Only slices keep referring to the elements of a const once they're
+  // stored
+  ConstantValue store(const ConstantValue &value, const Token &type,
+                 const ast::Node &node) {
+    auto stored = copy(convert(value, type, node), node);
+    stored.read_only &= Type::is_slice(stored.type);
+    return stored;
+  }
+
+  uint64_t position_in(const ConstantValue &sequence,
+                       const ConstantValue &index, uint64_t limit,
+                       const ast::Node &node) {
+    if (!is_integer(index.type)) {
+      fail(node, "Expected an integer index");
+      return 0;
+    }
+
+    // Negative indexes are out of bounds, like they are at run time
+    auto position = (uint64_t)index.integer;
+    if (position > limit)
+      fail(node, "Index " + std::to_string(index.integer) +
+                     " is out of bounds for a length of " +
+                     std::to_string(sequence.length));
+
+    return position;
+  }
+
+  ConstantValue *element_of(ast::Index &index, bool &read_only) {
+    auto target = evaluate(*index.target);
+    auto position = evaluate(*index.index);
+    if (failed())
+      return nullptr;
+
+    if (!is_sequence(target.type)) {
+      fail(index, "Only arrays and slices can be indexed at compile time");
+      return nullptr;
+    }
+
+    auto offset = position_in(target, position, target.length - 1, index);
+    if (target.length == 0)
+      fail(index, "Index into an empty slice");
+    if (failed())
+      return nullptr;
+
+    read_only = target.read_only;
+    return &(*target.elements)[target.offset + offset];
+  }
+
+public:
+  std::string error;
+  SourcePosition error_position;
+
+  Evaluator(const EvaluationLimits &limits,
+            const std::unordered_map<std::string, ast::Function *> &functions,
+            const Scope &constants)
+      : limits(limits), functions(functions), constants(constants) {}
+
+  // The value of the expression as the type, unless it can't be evaluated
+  Optional<ConstantValue> value_of(ast::Expression &expression,
+                                   const Token &type) {
+    auto value = store(evaluate(expression), type, expression);
+    if (failed())
+      return None;
+
+    return value;
+  }
+
+  void *visit(ast::Variable &variable) override {
+    if (!step(variable))
+      return nullptr;
+
+    const auto &name = variable.name.lexeme;
+    if (auto local = locals.find(name); local != locals.end()) {
+      result = local->second;
+    } else if (auto constant = constants.find(name);
+               constant != constants.end()) {
+      result = constant->second;
+      result.read_only = true;
+    } else {
+      fail(variable, name + " isn't known at compile time");
+    }
+
+    return nullptr;
+  }
+
+  void *visit(ast::LiteralValueExpression &literal) override {
+    const auto &type = literal.type.name;
+    result = ConstantValue{type};
+
+    if (type == Type::Primitive::FLOAT32)
+      result.number = literal.value.float32;
+    else if (type == Type::Primitive::FLOAT64)
+      result.number = literal.value.float64;
+    else if (type == Type::Primitive::INT32)
+      result.integer = literal.value.int32;
+    else if (type == Type::Primitive::UINT32)
+      result.integer = literal.value.uint32;
+    else if (type == Type::Primitive::BOOL)
+      result.integer = literal.value.boolean;
+    else
+      result.integer = literal.value.int64;
+
+    return nullptr;
+  }
+
+  void *visit(ast::Binop &binop) override {
+    if (!step(binop))
+      return nullptr;
+
+    auto left = evaluate(*binop.left);
+    auto right = evaluate(*binop.right);
+    if (failed())
+      return nullptr;
+
+    // Like in code generation, literals take the type of the other side
+    auto type = dynamic_cast<ast::LiteralValueExpression *>(binop.left)
+                    ? right.type
+                    : left.type;
+
+    auto operation = binop.operation;
+    auto is_equality = operation == ast::Operation::COMPARE_IS_EQUAL ||
+                       operation == ast::Operation::COMPARE_IS_NOT_EQUAL;
+    if (!is_integer(type) && !is_float(type) &&
+        !(type == Type::Primitive::BOOL && is_equality)) {
+      fail(binop, "Unsupported operand types " + left.type.lexeme + " and " +
+                      right.type.lexeme);
+      return nullptr;
+    }
+
+    left = convert(left, type, binop);
+    right = convert(right, type, binop);
+    if (failed())
+      return nullptr;
+
+    ConstantValue value{type};
+    auto compared = [&](bool condition) {
+      value.type = Type::Primitive::BOOL;
+      value.integer = condition;
+    };
+
+    if (is_float(type)) {
+      auto a = left.number;
+      auto b = right.number;
+
+      switch (operation) {
+      case ast::Operation::ADD:
+        value.number = a + b;
+        break;
+      case ast::Operation::SUBTRACT:
+        value.number = a - b;
+        break;
+      case ast::Operation::MULTIPLY:
+        value.number = a * b;
+        break;
+      case ast::Operation::DIVIDE:
+        value.number = a / b;
+        break;
+      case ast::Operation::REMAINDER:
+        value.number = std::fmod(a, b);
+        break;
+      case ast::Operation::COMPARE_IS_EQUAL:
+        compared(a == b);
+        break;
+      case ast::Operation::COMPARE_IS_NOT_EQUAL:
+        compared(a != b);
+        break;
+      case ast::Operation::COMPARE_IS_LESS:
+        compared(a < b);
+        break;
+      case ast::Operation::COMPARE_IS_LESS_OR_EQUAL:
+        compared(a <= b);
+        break;
+      case ast::Operation::COMPARE_IS_GREATER:
+        compared(a > b);
+        break;
+      case ast::Operation::COMPARE_IS_GREATER_OR_EQUAL:
+        compared(a >= b);
+        break;
+      }
+
+      value.number = round_to(value.number, type);
+      result = value;
+      return nullptr;
+    }
+
+    // Integers wrap around, whatever their sign
+    auto a = (uint64_t)left.integer;
+    auto b = (uint64_t)right.integer;
+    auto less = is_signed(type) ? left.integer < right.integer : a < b;
+
+    if ((operation == ast::Operation::DIVIDE ||
+         operation == ast::Operation::REMAINDER) &&
+        b == 0) {
+      fail(binop, "Division by zero");
+      return nullptr;
+    }
+
+    switch (operation) {
+    case ast::Operation::ADD:
+      value.integer = (int64_t)(a + b);
+      break;
+    case ast::Operation::SUBTRACT:
+      value.integer = (int64_t)(a - b);
+      break;
+    case ast::Operation::MULTIPLY:
+      value.integer = (int64_t)(a * b);
+      break;
+    case ast::Operation::DIVIDE:
+      if (!is_signed(type))
+        value.integer = (int64_t)(a / b);
+      else
+        value.integer = right.integer == -1 ? (int64_t)(0 - a)
+                                            : left.integer / right.integer;
+      break;
+    case ast::Operation::REMAINDER:
+      if (!is_signed(type))
+        value.integer = (int64_t)(a % b);
+      else
+        value.integer =
+            right.integer == -1 ? 0 : left.integer % right.integer;
+      break;
+    case ast::Operation::COMPARE_IS_EQUAL:
+      compared(a == b);
+      break;
+    case ast::Operation::COMPARE_IS_NOT_EQUAL:
+      compared(a != b);
+      break;
+    case ast::Operation::COMPARE_IS_LESS:
+      compared(less);
+      break;
+    case ast::Operation::COMPARE_IS_LESS_OR_EQUAL:
+      compared(less || a == b);
+      break;
+    case ast::Operation::COMPARE_IS_GREATER:
+      compared(!less && a != b);
+      break;
+    case ast::Operation::COMPARE_IS_GREATER_OR_EQUAL:
+      compared(!less);
+      break;
+    }
+
+    value.integer = wrap(value.integer, value.type);
+    result = value;
+    return nullptr;
+  }
+
+  void *visit(ast::Condition &condition) override {
+    if (!step(condition))
+      return nullptr;
+
+    auto value = evaluate(*condition.condition);
+    if (!failed() && value.type != Type::Primitive::BOOL)
+      fail(*condition.condition, "Expected a bool condition");
+    if (failed())
+      return nullptr;
+
+    if (value.integer)
+      evaluate(*condition.then);
+    else if (condition.otherwise)
+      evaluate(*condition.otherwise);
+    else
+      result = ConstantValue();
+
+    return nullptr;
+  }
+
+  void *visit(ast::Call &call) override {
+    if (!step(call))
+      return nullptr;
+
+    const auto &name = call.name.lexeme;
+    if (name == "len" && call.arguments.size() == 1) {
+      auto sequence = evaluate(*call.arguments[0]);
+      if (!failed() && !is_sequence(sequence.type))
+        fail(call, "Expected an array or a slice");
+      if (failed())
+        return nullptr;
+
+      result = ConstantValue{Type::Primitive::INT64};
+      result.integer = (int64_t)sequence.length;
+      return nullptr;
+    }
+
+    auto found = functions.find(name);
+    if (found == functions.end()) {
+      fail(call, name + " can't be called at compile time");
+      return nullptr;
+    }
+
+    const auto &function = *found->second;
+    const auto &prototype = function.prototype;
+    if (!prototype.is_const) {
+      fail(call, name + " isn't a const func, so it can't be called at "
+                        "compile time");
+      return nullptr;
+    }
+
+    if (call.arguments.size() != prototype.parameter_list.size()) {
+      fail(call, "Wrong number of arguments to " + name);
+      return nullptr;
+    }
+
+    if (depth == limits.call_depth) {
+      fail(call, "Calls nest more than " + std::to_string(limits.call_depth) +
+                     " deep");
+      return nullptr;
+    }
+
+    Scope frame;
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+      const auto &parameter = prototype.parameter_list[i];
+      auto argument = evaluate(*call.arguments[i]);
+      frame.insert_or_assign(parameter.name.lexeme,
+                             store(argument, parameter.type, call));
+    }
+
+    if (failed())
+      return nullptr;
+
+    std::swap(locals, frame);
+    depth += 1;
+    returning = false;
+    result = ConstantValue();
+
+    function.body->accept(*this);
+
+    depth -= 1;
+    std::swap(locals, frame);
+
+    auto returned = returning;
+    returning = false;
+    if (failed())
+      return nullptr;
+
+    if (prototype.return_type.lexeme == "Void") {
+      result = ConstantValue();
+      return nullptr;
+    }
+
+    if (!returned) {
+      fail(call, name + " ended without returning a value");
+      return nullptr;
+    }
+
+    result = convert(result, prototype.return_type, call);
+    return nullptr;
+  }
+
+  void *visit(ast::StringLiteral &literal) override {
+    fail(literal, "Strings can't be evaluated at compile time");
+    return nullptr;
+  }
+
+  void *visit(ast::Index &index) override {
+    if (!step(index))
+      return nullptr;
+
+    if (!index.end) {
+      bool read_only;
+      if (auto element = element_of(index, read_only)) {
+        result = *element;
+        result.read_only = read_only;
+      }
+
+      return nullptr;
+    }
+
+    auto target = evaluate(*index.target);
+    auto start = evaluate(*index.index);
+    auto end = evaluate(*index.end);
+    if (!failed() && !is_sequence(target.type))
+      fail(index, "Only arrays and slices can be sliced at compile time");
+    if (failed())
+      return nullptr;
+
+    auto first = position_in(target, start, target.length, index);
+    auto last = position_in(target, end, target.length, index);
+    if (!failed() && first > last)
+      fail(index, "A slice can't end before it starts");
+    if (failed())
+      return nullptr;
+
+    result = target;
+    result.type = type_named("[]" + Type::element_type(target.type).lexeme);
+    result.offset += first;
+    result.length = last - first;
+    return nullptr;
+  }
+
+  void *visit(ast::Member &member) override {
+    fail(member, "Structs can't be evaluated at compile time");
+    return nullptr;
+  }
+
+  void *visit(ast::ArrayLiteral &literal) override {
+    if (!step(literal))
+      return nullptr;
+
+    std::vector<ConstantValue> values;
+    for (const auto &element : literal.elements)
+      values.push_back(evaluate(*element));
+
+    if (!failed() && values.empty())
+      fail(literal, "An empty array has no type");
+    if (failed())
+      return nullptr;
+
+    auto count = literal.repeat ? literal.repeat : values.size();
+    if (!allocate(count, literal))
+      return nullptr;
+
+    auto element_type = values.front().type;
+    auto elements = std::make_shared<std::vector<ConstantValue>>();
+    elements->reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      const auto &value = values[literal.repeat ? 0 : i];
+      elements->push_back(copy(convert(value, element_type, literal), literal));
+    }
+
+    if (failed())
+      return nullptr;
+
+    result = ConstantValue{type_named("[" + std::to_string(count) + "]" +
+                                 element_type.lexeme)};
+    result.elements = elements;
+    result.length = count;
+    return nullptr;
+  }
+
+  void visit(ast::VariableDeclaration &declaration) override {
+    if (!step(declaration))
+      return;
+
+    auto value = evaluate(*declaration.initializer);
+    locals.insert_or_assign(declaration.name.lexeme,
+                            store(value, declaration.type, declaration));
+  }
+
+  void visit(ast::ExpressionStatement &statement) override {
+    evaluate(*statement.expression);
+  }
+
+  void visit(ast::Function &function) override {
+    fail(function, "Functions can't be declared at compile time");
+  }
+
+  void visit(ast::Block &block) override {
+    for (const auto &statement : block.statements) {
+      if (failed() || returning)
+        return;
+
+      if (statement)
+        statement->accept(*this);
+    }
+  }
+
+  void visit(ast::Return &ret) override {
+    if (!step(ret))
+      return;
+
+    if (ret.return_value)
+      evaluate(*ret.return_value);
+    else
+      result = ConstantValue();
+
+    returning = !failed();
+  }
+
+  void visit(ast::Assignment &assignment) override {
+    if (!step(assignment))
+      return;
+
+    auto value = evaluate(*assignment.value);
+    if (failed())
+      return;
+
+    if (auto variable = dynamic_cast<ast::Variable *>(assignment.target)) {
+      const auto &name = variable->name.lexeme;
+      auto local = locals.find(name);
+      if (local == locals.end()) {
+        fail(assignment, constants.count(name)
+                             ? name + " is const, so it can't be assigned to"
+                             : name + " isn't known at compile time");
+        return;
+      }
+
+      local->second = store(value, local->second.type, assignment);
+      return;
+    }
+
+    bool read_only;
+    auto index = dynamic_cast<ast::Index *>(assignment.target);
+    auto element = element_of(*index, read_only);
+    if (!element)
+      return;
+
+    if (read_only) {
+      fail(assignment, "Elements of a const can't be assigned to");
+      return;
+    }
+
+    *element = store(value, element->type, assignment);
+  }
+
+  void visit(ast::While &loop) override {
+    while (step(loop)) {
+      auto condition = evaluate(*loop.condition);
+      if (!failed() && condition.type != Type::Primitive::BOOL)
+        fail(*loop.condition, "Expected a bool condition");
+      if (failed() || !condition.integer)
+        return;
+
+      loop.body->accept(*this);
+      if (returning)
+        return;
+    }
+  }
+
+  void visit(ast::For &loop) override {
+    if (!step(loop))
+      return;
+
+    auto start = evaluate(*loop.start);
+    auto end = evaluate(*loop.end);
+    if (!failed() && (!is_integer(start.type) || !is_integer(end.type)))
+      fail(loop, "Expected integer bounds for a range");
+    if (failed())
+      return;
+
+    // The variable takes the type of the end of the range, and is only in
+    // scope for the loop's body
+    const auto &name = loop.variable.lexeme;
+    auto shadowed = locals.find(name);
+    auto previous = shadowed == locals.end()
+                        ? None
+                        : Optional<ConstantValue>(shadowed->second);
+
+    auto variable = convert(start, end.type, loop);
+    auto is_less = [&] {
+      return is_signed(end.type) ? variable.integer < end.integer
+                                 : (uint64_t)variable.integer <
+                                       (uint64_t)end.integer;
+    };
+
+    while (is_less() && step(loop)) {
+      locals.insert_or_assign(name, variable);
+      loop.body->accept(*this);
+      if (failed() || returning)
+        break;
+
+      variable = locals.at(name);
+      variable.integer = wrap(variable.integer + 1, end.type);
+    }
+
+    if (previous)
+      locals.insert_or_assign(name, *previous);
+    else
+      locals.erase(name);
+  }
+
+  void visit(ast::Struct &) override {}
+};
+
+// The literal a value is written as, with repeated elements written once
+static ast::Expression *literal_for(const ConstantValue &value,
+                                    const SourcePosition &position) {
+  if (is_sequence(value.type)) {
+    auto first = value.elements->begin() + value.offset;
+    auto last = first + value.length;
+
+    auto repeated = value.length > 1 && !is_sequence(first->type);
+    for (auto element = first; repeated && element != last; ++element) {
+      repeated = element->integer == first->integer &&
+                 (element->number == first->number ||
+                  (std::isnan(element->number) && std::isnan(first->number)));
+    }
+
+    std::vector<ast::Expression *> elements;
+    for (auto element = first; element != (repeated ? first + 1 : last);
+         ++element)
+      elements.push_back(literal_for(*element, position));
+
+    auto literal = new ast::ArrayLiteral(position, std::move(elements));
+    if (repeated)
+      literal->repeat = value.length;
+
+    return literal;
+  }
+
+  ast::Value literal{};
+  if (value.type == Type::Primitive::FLOAT32)
+    literal.float32 = (float)value.number;
+  else if (value.type == Type::Primitive::FLOAT64)
+    literal.float64 = value.number;
+  else if (value.type == Type::Primitive::INT32)
+    literal.int32 = (int32_t)value.integer;
+  else if (value.type == Type::Primitive::UINT32)
+    literal.uint32 = (uint32_t)value.integer;
+  else if (value.type == Type::Primitive::BOOL)
+    literal.boolean = value.integer;
+  else
+    literal.int64 = value.integer;
+
+  return new ast::LiteralValueExpression(position, Type{value.type}, literal);
+}
+
+// Walks the program in order, evaluating each const variable with the const
+// variables in scope ahead of it. Parameters and other variables shadow the
+// const variables they share a name with.
+class ConstantFinder : public ast::StatementVisitor {
+  const EvaluationLimits &limits;
+  std::unordered_map<std::string, ast::Function *> functions;
+  Scope constants;
+
+  void error(const SourcePosition &position, const std::string &message) {
+    std::ostringstream builder;
+    builder << "[position " << position.line << ':' << position.column
+            << "] Error: " << message << std::endl;
+
+    errors.emplace_back(builder.str());
+  }
+
+public:
+  std::vector<std::string> errors;
+
+  ConstantFinder(const EvaluationLimits &limits, const ast::Program &program)
+      : limits(limits) {
+    for (const auto &statement : program.statements) {
+      if (auto function = dynamic_cast<ast::Function *>(statement))
+        functions.emplace(function->prototype.name.lexeme, function);
+    }
+  }
+
+  void visit(ast::VariableDeclaration &declaration) override {
+    const auto &name = declaration.name.lexeme;
+    constants.erase(name);
+    if (!declaration.is_const)
+      return;
+
+    if (Type::is_slice(declaration.type)) {
+      error(declaration.position, "Const variables can't be slices");
+      return;
+    }
+
+    Evaluator evaluator(limits, functions, constants);
+    auto value = evaluator.value_of(*declaration.initializer, declaration.type);
+    if (!value) {
+      error(evaluator.error_position,
+            evaluator.error + ", evaluating const " + name);
+      return;
+    }
+
+    auto position = declaration.initializer->position;
+    delete declaration.initializer;
+    declaration.initializer = literal_for(*value, position);
+
+    constants.emplace(name, std::move(*value));
+  }
+
+  void visit(ast::ExpressionStatement &) override {}
+
+  void visit(ast::Function &function) override {
+    auto outer = constants;
+    for (const auto &parameter : function.prototype.parameter_list)
+      constants.erase(parameter.name.lexeme);
+
+    function.body->accept(*this);
+    constants = std::move(outer);
+  }
+
+  void visit(ast::Block &block) override {
+    for (const auto &statement : block.statements) {
+      if (statement)
+        statement->accept(*this);
+    }
+  }
+
+  void visit(ast::Return &) override {}
+
+  void visit(ast::Assignment &assignment) override {
+    auto target = assignment.target;
+    for (;;) {
+      if (auto index = dynamic_cast<ast::Index *>(target))
+        target = index->target;
+      else if (auto member = dynamic_cast<ast::Member *>(target))
+        target = member->target;
+      else
+        break;
+    }
+
+    auto variable = dynamic_cast<ast::Variable *>(target);
+    if (variable && constants.count(variable->name.lexeme))
+      error(assignment.position, variable->name.lexeme +
+                                     " is const, so it can't be assigned to");
+  }
+
+  void visit(ast::While &loop) override { loop.body->accept(*this); }
+
+  void visit(ast::For &loop) override {
+    auto outer = constants;
+    constants.erase(loop.variable.lexeme);
+    loop.body->accept(*this);
+    constants = std::move(outer);
+  }
+
+  void visit(ast::Struct &) override {}
+};
+
+Error evaluate_constants(ast::Program &program,
+                         const EvaluationLimits &limits) {
+  ConstantFinder finder(limits, program);
+  for (const auto &statement : program.statements) {
+    if (statement)
+      statement->accept(finder);
+  }
+
+  if (finder.errors.empty())
+    return Error::success();
+
+  std::ostringstream message;
+  for (const auto &error : finder.errors)
+    message << error;
+
+  return make_error<StringError>(message.str(), inconvertibleErrorCode());
+}
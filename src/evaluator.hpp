@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ast.hpp"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+
+// How much work a single const variable's initializer may take, so a runaway
+// loop or recursion is a compile error rather than a hung compiler
+struct EvaluationLimits {
+  uint64_t steps = 10'000'000;
+  // In bytes of array elements
+  uint64_t memory = 64 << 20;
+  unsigned call_depth = 512;
+};
+
+// Evaluates the initializer of every const variable in the program, calling
+// const functions on a tree walking interpreter, and replaces it with the
+// literal value it evaluated to. Code generation then emits the value as a
+// constant. Const variables can use the const variables declared ahead of
+// them, but not the parameters or other variables of the function they're
+// in, and nothing can assign to them.
+llvm::Error evaluate_constants(ast::Program &,
+                               const EvaluationLimits &limits = {});
@@ -0,0 +1,354 @@
+#include "format.hpp"
+#include "typer.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+using namespace llvm;
+using ast::Type;
+
+// Widths past this are almost certainly mistakes
+static constexpr unsigned max_width = 1024;
+
+// A double has at most 17 significant digits
+static constexpr unsigned max_precision = 17;
+
+std::string parse_format(const std::string &format,
+                         std::vector<FormatSegment> &segments) {
+  FormatSegment segment;
+  for (size_t i = 0; i < format.size();) {
+    if (format[i] != '%') {
+      segment.text.push_back(format[i++]);
+      continue;
+    }
+
+    if (++i < format.size() && format[i] == '%') {
+      segment.text.push_back(format[i++]);
+      continue;
+    }
+
+    for (; i < format.size() && strchr("-0", format[i]); ++i) {
+      segment.left_justify |= format[i] == '-';
+      segment.zero_pad |= format[i] == '0';
+    }
+
+    for (; i < format.size() && isdigit(format[i]); ++i) {
+      segment.width = segment.width * 10 + (format[i] - '0');
+      if (segment.width > max_width)
+        return "A width can be at most " + std::to_string(max_width);
+    }
+
+    auto has_precision = i < format.size() && format[i] == '.';
+    if (has_precision) {
+      segment.precision = 0;
+      for (++i; i < format.size() && isdigit(format[i]); ++i) {
+        segment.precision = segment.precision * 10 + (format[i] - '0');
+        if (segment.precision > max_precision)
+          return "A precision can be at most " +
+                 std::to_string(max_precision);
+      }
+    }
+
+    if (i == format.size())
+      return "The format ends in the middle of a conversion";
+
+    segment.conversion = format[i++];
+    if (!strchr("diuxfs", segment.conversion))
+      return std::string("%") + segment.conversion +
+             " isn't a conversion print knows";
+
+    if (has_precision && segment.conversion != 'f')
+      return std::string("Only %f takes a precision, not %") +
+             segment.conversion;
+
+    // Like printf, justifying to the left pads with spaces
+    segment.zero_pad &= !segment.left_justify && segment.conversion != 's';
+
+    segments.push_back(std::move(segment));
+    segment = FormatSegment();
+  }
+
+  if (!segment.text.empty())
+    segments.push_back(std::move(segment));
+
+  return "";
+}
+
+// Mirrors output_float in codegen.cpp step for step, down to rounding with
+// 2^52 and splitting products into halves, so both round the same way
+std::string float_digits(double magnitude, unsigned precision) {
+  if (std::isnan(magnitude))
+    return "nan";
+  if (std::isinf(magnitude))
+    return "inf";
+
+  // Values too large for an integer are scaled down, and the digits they
+  // lose are printed as zeros
+  auto reduced = magnitude;
+  size_t zeros = 0;
+  for (; reduced >= 0x1p64; zeros++)
+    reduced /= 10;
+
+  auto round_to_integer = [](double magnitude) {
+    return magnitude < 0x1p52 ? (magnitude + 0x1p52) - 0x1p52 : magnitude;
+  };
+  auto has_point = precision != 0;
+  auto rounded =
+      has_point && zeros == 0 ? reduced : round_to_integer(reduced);
+  auto whole = (uint64_t)rounded;
+  auto fraction = rounded - (double)whole;
+
+  auto power = 1.0;
+  for (unsigned i = 0; i < precision; i++)
+    power *= 10;
+
+  auto split = [](double number) {
+    auto scaled = number * (0x1p27 + 1);
+    auto high = scaled - (scaled - number);
+    return std::make_pair(high, number - high);
+  };
+
+  auto product = fraction * power;
+  auto [fraction_high, fraction_low] = split(fraction);
+  auto [power_high, power_low] = split(power);
+  auto error = fraction_high * power_high - product;
+  error += fraction_high * power_low;
+  error += fraction_low * power_high;
+  error += fraction_low * power_low;
+  auto truncated = (double)(uint64_t)product;
+  auto nearest = error > 0   ? truncated + 1
+                 : error < 0 ? truncated
+                             : round_to_integer(product);
+  auto digits = (uint64_t)(product - truncated == 0.5
+                               ? nearest
+                               : round_to_integer(product));
+  if (digits >= (uint64_t)power) {
+    whole++;
+    digits = 0;
+  }
+
+  auto text = std::to_string(whole) + std::string(zeros, '0');
+  if (has_point) {
+    auto after_point = std::to_string(digits);
+    text += '.' + std::string(precision - after_point.size(), '0') +
+            after_point;
+  }
+
+  return text;
+}
+
+static bool is_signed(const Token &type) {
+  return type == Type::Primitive::INT32 || type == Type::Primitive::INT64;
+}
+
+static bool is_unsigned(const Token &type) {
+  return type == Type::Primitive::UINT32 || type == Type::Primitive::UINT64;
+}
+
+static bool is_float(const Token &type) {
+  return type == Type::Primitive::FLOAT32 || type == Type::Primitive::FLOAT64;
+}
+
+static const char *types_taken_by(char conversion) {
+  switch (conversion) {
+  case 'd':
+  case 'i':
+    return "i32 or i64";
+  case 'u':
+  case 'x':
+    return "u32 or u64";
+  case 'f':
+    return "f32 or f64";
+  default:
+    return "a string literal";
+  }
+}
+
+static bool takes(char conversion, const ast::Expression &argument,
+                  const Token &type) {
+  switch (conversion) {
+  case 'd':
+  case 'i':
+    return is_signed(type);
+  case 'u':
+  case 'x': {
+    auto literal = dynamic_cast<const ast::LiteralValueExpression *>(&argument);
+    if (literal && type == Type::Primitive::INT32)
+      return literal->value.int32 >= 0;
+    if (literal && type == Type::Primitive::INT64)
+      return literal->value.int64 >= 0;
+
+    return is_unsigned(type);
+  }
+  case 'f':
+    return is_float(type);
+  default:
+    return dynamic_cast<const ast::StringLiteral *>(&argument) != nullptr;
+  }
+}
+
+// Walks every function of the program, tracking the type of each variable
+// to check the arguments of the prints it makes
+class PrintChecker : public ast::Walker, public Typer {
+  std::unordered_map<std::string, Token> return_types;
+  std::unordered_map<std::string, Token> constants;
+  std::unordered_map<std::string, const ast::Struct *> structs;
+
+  // Of the function being walked
+  std::unordered_map<std::string, Token> variable_types;
+
+  void error(const SourcePosition &position, const std::string &message) {
+    errors << "[position " << position.line << ':' << position.column
+           << "] Error: " << message << std::endl;
+  }
+
+  Token type_of_variable(const std::string &name) override {
+    auto type = variable_types.find(name);
+    if (type != variable_types.end())
+      return type->second;
+
+    auto constant = constants.find(name);
+    return constant == constants.end() ? Token() : constant->second;
+  }
+
+  bool type_returned_by(const std::string &name, Token &type) override {
+    auto return_type = return_types.find(name);
+    if (return_type == return_types.end())
+      return false;
+
+    type = return_type->second;
+    return true;
+  }
+
+  const ast::Struct *struct_named(const std::string &name) override {
+    auto structure = structs.find(name);
+    return structure == structs.end() ? nullptr : structure->second;
+  }
+
+  void check(ast::Call &print) {
+    auto format = print.arguments.empty()
+                      ? nullptr
+                      : dynamic_cast<ast::StringLiteral *>(print.arguments[0]);
+    if (!format) {
+      error(print.position, "print's format must be a string literal");
+      return;
+    }
+
+    std::vector<FormatSegment> segments;
+    auto problem = parse_format(format->value, segments);
+    if (!problem.empty()) {
+      error(format->position, problem);
+      return;
+    }
+
+    size_t next = 1;
+    for (const auto &segment : segments) {
+      if (!segment.conversion)
+        continue;
+
+      if (next == print.arguments.size()) {
+        error(print.position, std::string("There's no argument for %") +
+                                  segment.conversion);
+        return;
+      }
+
+      auto &argument = *print.arguments[next++];
+      auto type = type_of(argument);
+
+      // What can't be typed here fails code generation instead
+      if (type.lexeme.empty() &&
+          !dynamic_cast<ast::StringLiteral *>(&argument))
+        continue;
+
+      if (!takes(segment.conversion, argument, type)) {
+        auto given = type.lexeme.empty() ? "a string" : type.lexeme;
+        error(argument.position,
+              std::string("%") + segment.conversion + " prints " +
+                  types_taken_by(segment.conversion) + ", not " + given);
+      }
+    }
+
+    if (next < print.arguments.size())
+      error(print.arguments[next]->position,
+            "print has more arguments than its format has conversions");
+  }
+
+public:
+  std::ostringstream errors;
+
+  explicit PrintChecker(const ast::Program &program) {
+    for (const auto &statement : program.statements) {
+      if (auto function = dynamic_cast<ast::Function *>(statement))
+        return_types.emplace(function->prototype.name.lexeme,
+                             function->prototype.return_type);
+      else if (auto constant =
+                   dynamic_cast<ast::VariableDeclaration *>(statement))
+        constants.insert_or_assign(constant->name.lexeme, constant->type);
+      else if (auto structure = dynamic_cast<ast::Struct *>(statement))
+        structs.emplace(structure->name.lexeme, structure);
+    }
+  }
+
+  using ast::Walker::visit;
+
+  void *visit(ast::Call &call) override {
+    // Programs can define a print of their own
+    if (call.name.lexeme == "print" && !return_types.count("print"))
+      check(call);
+
+    return ast::Walker::visit(call);
+  }
+
+  void visit(ast::VariableDeclaration &declaration) override {
+    ast::Walker::visit(declaration);
+    variable_types.insert_or_assign(declaration.name.lexeme,
+                                    declaration.type);
+  }
+
+  void visit(ast::Function &function) override {
+    variable_types.clear();
+    for (const auto &parameter : function.prototype.parameter_list)
+      variable_types.insert_or_assign(parameter.name.lexeme, parameter.type);
+
+    ast::Walker::visit(function);
+  }
+
+  void visit(ast::For &loop) override {
+    loop.start->accept(*this);
+    loop.end->accept(*this);
+
+    // The variable counts in the type of the loop's end
+    auto shadowed = variable_types.find(loop.variable.lexeme);
+    auto previous =
+        shadowed == variable_types.end() ? Token() : shadowed->second;
+    variable_types.insert_or_assign(loop.variable.lexeme, type_of(*loop.end));
+
+    loop.body->accept(*this);
+
+    if (previous.lexeme.empty())
+      variable_types.erase(loop.variable.lexeme);
+    else
+      variable_types.insert_or_assign(loop.variable.lexeme, previous);
+  }
+
+  void visit(ast::Struct &structure) override {
+    structs.emplace(structure.name.lexeme, &structure);
+  }
+};
+
+Error check_prints(const ast::Program &program) {
+  PrintChecker checker(program);
+  for (const auto &statement : program.statements) {
+    if (dynamic_cast<ast::Function *>(statement))
+      statement->accept(checker);
+  }
+
+  auto message = checker.errors.str();
+  if (message.empty())
+    return Error::success();
+
+  return make_error<StringError>(message, inconvertibleErrorCode());
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ast.hpp"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+// A conversion of print's format, and the text in front of it. print's
+// conversions are printf's without length modifiers: %d and %i take signed
+// integers, %u and %x unsigned ones, %f floats and %s strings. A - flag
+// justifies the conversion to the left of its width and a 0 flag pads
+// numbers with zeros. Floats have 6 digits after their point unless the
+// conversion gives a precision, like %.2f.
+struct FormatSegment {
+  std::string text;
+  // Zero for the text after the last conversion
+  char conversion = 0;
+  bool left_justify = false;
+  bool zero_pad = false;
+  unsigned width = 0;
+  unsigned precision = 6;
+};
+
+// Why the format can't be printed, empty when it can
+std::string parse_format(const std::string &format,
+                         std::vector<FormatSegment> &segments);
+
+// The digits %f prints for a float's magnitude, worked out the way compiled
+// code works them out, so programs print the same run either way: exactly for
+// values below 2^64 while the digits after the point fit in 2^53, and to
+// about 15 significant digits past that. Infinities and NaNs are inf and nan.
+std::string float_digits(double magnitude, unsigned precision);
+
+// Checks that every print of the program has a literal format that parses,
+// followed by an argument of a type its conversion takes for each of the
+// format's conversions. Strings are only ever literals, and integer literals
+// are printed by unsigned conversions as they are.
+llvm::Error check_prints(const ast::Program &);
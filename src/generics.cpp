@@ -0,0 +1,667 @@
+#include "generics.hpp"
+#include "typer.hpp"
+
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace llvm;
+using ast::Type;
+
+// What each type parameter of a generic function stands for
+typedef std::unordered_map<std::string, Token> Bindings;
+
+// A generic function that calls itself with ever larger types, like
+// f([x, x]) inside f<T>(x: T), would otherwise be specialized forever
+static constexpr size_t max_specializations = 1024;
+
+static Token type_named(const std::string &lexeme,
+                        const SourcePosition &position) {
+  return {Token::Kind::IDENTIFIER, lexeme, position};
+}
+
+static bool is_composite(const Token &type) {
+  return Type::is_array(type) || Type::is_slice(type);
+}
+
+// Replaces the type parameters in a type with what they're bound to, so T is
+// i32 and []T is []i32
+static Token substitute(const Token &type, const Bindings &bindings) {
+  if (is_composite(type)) {
+    auto element = Type::element_type(type);
+    auto shape =
+        type.lexeme.substr(0, type.lexeme.size() - element.lexeme.size());
+    return type_named(shape + substitute(element, bindings).lexeme,
+                      type.position);
+  }
+
+  auto bound = bindings.find(type.lexeme);
+  return bound == bindings.end()
+             ? type
+             : type_named(bound->second.lexeme, type.position);
+}
+
+static bool mentions(const Token &type, const Token &type_parameter) {
+  if (is_composite(type))
+    return mentions(Type::element_type(type), type_parameter);
+
+  return type.lexeme == type_parameter.lexeme;
+}
+
+// Binds the type parameters in a parameter's type to what the argument's
+// type has in their place, and describes the mismatch when one is already
+// bound to something else
+static std::string unify(const Token &parameter, const Token &argument,
+                         const std::vector<Token> &type_parameters,
+                         Bindings &bindings) {
+  if (argument.lexeme.empty())
+    return "";
+
+  // Arrays are passed to slices
+  if (Type::is_slice(parameter) && is_composite(argument))
+    return unify(Type::element_type(parameter), Type::element_type(argument),
+                 type_parameters, bindings);
+
+  if (Type::is_array(parameter) && Type::is_array(argument) &&
+      Type::array_length(parameter) == Type::array_length(argument))
+    return unify(Type::element_type(parameter), Type::element_type(argument),
+                 type_parameters, bindings);
+
+  for (const auto &type_parameter : type_parameters) {
+    if (type_parameter.lexeme != parameter.lexeme)
+      continue;
+
+    auto [bound, inserted] = bindings.emplace(parameter.lexeme, argument);
+    if (inserted || bound->second.lexeme == argument.lexeme)
+      return "";
+
+    return parameter.lexeme + " is both " + bound->second.lexeme + " and " +
+           argument.lexeme;
+  }
+
+  return "";
+}
+
+// Gives a literal the type it's used as, when it can be converted exactly
+// as written: 2 as an i32 or an f64, and 0.5 as an f32
+static void retype(ast::LiteralValueExpression &literal, const Token &type) {
+  const auto &from = literal.type.name;
+  if (from == type)
+    return;
+
+  ast::Value value{};
+  if (from == Type::Primitive::INT64) {
+    auto integer = literal.value.int64;
+    if (type == Type::Primitive::INT32)
+      value.int32 = (int)integer;
+    else if (type == Type::Primitive::UINT32)
+      value.uint32 = (unsigned int)integer;
+    else if (type == Type::Primitive::UINT64)
+      value.uint64 = (unsigned long long)integer;
+    else if (type == Type::Primitive::FLOAT32)
+      value.float32 = (float)integer;
+    else if (type == Type::Primitive::FLOAT64)
+      value.float64 = (double)integer;
+    else
+      return;
+  } else if (from == Type::Primitive::FLOAT64 &&
+             type == Type::Primitive::FLOAT32) {
+    value.float32 = (float)literal.value.float64;
+  } else {
+    return;
+  }
+
+  literal.type.name = type_named(type.lexeme, from.position);
+  literal.value = value;
+}
+
+// A generic body spells its literals without knowing what T is, so in a
+// specialization they take the type of what they're used as: 0 in
+// var total: T = 0 is an f64 zero in the f64 specialization
+static void adapt(ast::Expression *expression, const Token &type) {
+  if (!expression || type.lexeme.empty())
+    return;
+
+  if (auto literal = dynamic_cast<ast::LiteralValueExpression *>(expression)) {
+    retype(*literal, Type::is_vector(type) && !is_composite(type)
+                         ? Type::lane_type(type)
+                         : type);
+  } else if (auto array = dynamic_cast<ast::ArrayLiteral *>(expression)) {
+    if (is_composite(type)) {
+      for (const auto &element : array->elements)
+        adapt(element, Type::element_type(type));
+    }
+  } else if (auto condition = dynamic_cast<ast::Condition *>(expression)) {
+    adapt(condition->then, type);
+    adapt(condition->otherwise, type);
+  }
+}
+
+static bool is_literal(const ast::Expression *expression) {
+  return dynamic_cast<const ast::LiteralValueExpression *>(expression);
+}
+
+// Copies a generic function, with its type parameters replaced by the types
+// they're bound to
+class Cloner : public ast::ExpressionVisitor, public ast::StatementVisitor {
+  const Bindings &bindings;
+  ast::Statement *cloned = nullptr;
+
+  ast::Expression *clone(ast::Expression *expression) {
+    if (!expression)
+      return nullptr;
+    return static_cast<ast::Expression *>(expression->accept(*this));
+  }
+
+  ast::Block *clone(ast::Block *block) {
+    block->accept(*this);
+    return static_cast<ast::Block *>(cloned);
+  }
+
+  ast::FunctionPrototype clone(const ast::FunctionPrototype &prototype) {
+    auto copy = prototype;
+    for (auto &parameter : copy.parameter_list)
+      parameter.type = substitute(parameter.type, bindings);
+    copy.return_type = substitute(copy.return_type, bindings);
+    return copy;
+  }
+
+public:
+  explicit Cloner(const Bindings &bindings) : bindings(bindings) {}
+
+  ast::Function *clone(ast::Function &function) {
+    function.accept(*this);
+    return static_cast<ast::Function *>(cloned);
+  }
+
+  void *visit(ast::Variable &node) override {
+    return new ast::Variable(node.position, node.name);
+  }
+
+  void *visit(ast::LiteralValueExpression &node) override {
+    return new ast::LiteralValueExpression(node.position, node.type,
+                                           node.value);
+  }
+
+  void *visit(ast::StringLiteral &node) override {
+    return new ast::StringLiteral(node.position, node.value);
+  }
+
+  void *visit(ast::Binop &node) override {
+    return new ast::Binop(node.position, clone(node.left), clone(node.right),
+                          node.operation);
+  }
+
+  void *visit(ast::Condition &node) override {
+    auto condition = new ast::Condition(node.position);
+    condition->condition = clone(node.condition);
+    condition->then = clone(node.then);
+    condition->otherwise = clone(node.otherwise);
+    return condition;
+  }
+
+  void *visit(ast::Call &node) override {
+    std::vector<ast::Expression *> arguments;
+    for (const auto &argument : node.arguments)
+      arguments.push_back(clone(argument));
+    return new ast::Call(node.position, node.name, std::move(arguments));
+  }
+
+  void *visit(ast::Index &node) override {
+    auto index =
+        new ast::Index(node.position, clone(node.target), clone(node.index));
+    index->end = clone(node.end);
+    return index;
+  }
+
+  void *visit(ast::Member &node) override {
+    return new ast::Member(node.position, clone(node.target), node.field);
+  }
+
+  void *visit(ast::ArrayLiteral &node) override {
+    std::vector<ast::Expression *> elements;
+    for (const auto &element : node.elements)
+      elements.push_back(clone(element));
+    auto array = new ast::ArrayLiteral(node.position, std::move(elements));
+    array->repeat = node.repeat;
+    return array;
+  }
+
+  void visit(ast::VariableDeclaration &node) override {
+    auto declaration = new ast::VariableDeclaration(
+        node.position, node.name, substitute(node.type, bindings),
+        clone(node.initializer));
+    declaration->is_const = node.is_const;
+    cloned = declaration;
+  }
+
+  void visit(ast::ExpressionStatement &node) override {
+    cloned = new ast::ExpressionStatement(clone(node.expression));
+  }
+
+  void visit(ast::Function &node) override {
+    auto function = new ast::Function(node.position);
+    function->prototype = clone(node.prototype);
+    function->body = clone(node.body);
+    cloned = function;
+  }
+
+  void visit(ast::Block &node) override {
+    auto block = new ast::Block(node.position);
+    for (const auto &statement : node.statements) {
+      if (!statement)
+        continue;
+      statement->accept(*this);
+      block->statements.push_back(cloned);
+    }
+    cloned = block;
+  }
+
+  void visit(ast::Return &node) override {
+    cloned = new ast::Return(node.position, clone(node.return_value));
+  }
+
+  void visit(ast::Assignment &node) override {
+    cloned = new ast::Assignment(node.position, clone(node.target),
+                                 clone(node.value));
+  }
+
+  void visit(ast::While &node) override {
+    auto loop = new ast::While(node.position, clone(node.condition));
+    loop->body = clone(node.body);
+    loop->attributes = node.attributes;
+    cloned = loop;
+  }
+
+  void visit(ast::For &node) override {
+    auto loop = new ast::For(node.position, node.variable, clone(node.start),
+                             clone(node.end));
+    loop->body = clone(node.body);
+    loop->attributes = node.attributes;
+    cloned = loop;
+  }
+
+  void visit(ast::Struct &node) override { cloned = new ast::Struct(node); }
+};
+
+// Walks the program's concrete functions, and the specializations made for
+// them, tracking the type of each variable to infer the type arguments of
+// the generic functions they call
+class Specializer : public ast::Walker, public Typer {
+  struct Generic {
+    ast::Function *function = nullptr;
+    // Keyed by their type arguments, in the order of the type parameters
+    std::map<std::vector<std::string>, ast::Function *> specializations{};
+    // In the order they were made, which is the order they're emitted in
+    std::vector<ast::Function *> made{};
+  };
+
+  std::unordered_map<std::string, Generic> generics;
+  std::unordered_map<std::string, const ast::FunctionPrototype *> prototypes;
+  std::unordered_map<std::string, Token> constants;
+  std::unordered_map<std::string, const ast::Struct *> structs;
+
+  // Of the function being walked
+  std::unordered_map<std::string, Token> variable_types;
+  Token return_type;
+  bool in_specialization = false;
+
+  // Specializations that haven't been walked for the calls they make
+  std::vector<ast::Function *> pending;
+  std::ostringstream errors;
+
+  void error(const SourcePosition &position, const std::string &message) {
+    errors << "[position " << position.line << ':' << position.column
+           << "] Error: " << message << std::endl;
+  }
+
+  void walk(ast::Function &function, bool specialization) {
+    auto enclosing_types = std::move(variable_types);
+    auto enclosing_return_type = return_type;
+    auto enclosing_specialization = in_specialization;
+
+    variable_types.clear();
+    for (const auto &parameter : function.prototype.parameter_list)
+      variable_types.insert_or_assign(parameter.name.lexeme, parameter.type);
+    return_type = function.prototype.return_type;
+    in_specialization = specialization;
+
+    function.body->accept(*this);
+
+    variable_types = std::move(enclosing_types);
+    return_type = enclosing_return_type;
+    in_specialization = enclosing_specialization;
+  }
+
+  Token type_of_variable(const std::string &name) override {
+    auto type = variable_types.find(name);
+    if (type != variable_types.end())
+      return type->second;
+
+    auto constant = constants.find(name);
+    return constant == constants.end() ? Token() : constant->second;
+  }
+
+  bool type_returned_by(const std::string &name, Token &type) override {
+    auto prototype = prototypes.find(name);
+    if (prototype == prototypes.end())
+      return false;
+
+    type = prototype->second->return_type;
+    return true;
+  }
+
+  const ast::Struct *struct_named(const std::string &name) override {
+    auto structure = structs.find(name);
+    return structure == structs.end() ? nullptr : structure->second;
+  }
+
+  // Makes a literal on one side of an operation the type of the other side
+  void balance(ast::Expression *left, ast::Expression *right) {
+    if (!left || !right)
+      return;
+
+    if (is_literal(left) && !is_literal(right))
+      adapt(left, type_of(*right));
+    else if (is_literal(right) && !is_literal(left))
+      adapt(right, type_of(*left));
+  }
+
+  // The specialization of a generic function for the types of a call's
+  // arguments, made the first time those types are seen
+  ast::Function *specialize(Generic &generic, ast::Call &call) {
+    const auto &prototype = generic.function->prototype;
+    const auto &name = prototype.name.lexeme;
+    const auto &parameters = prototype.parameter_list;
+    auto count = std::min(parameters.size(), call.arguments.size());
+
+    // Literals take the type of what's around them, so they only decide a
+    // type argument that nothing else does
+    Bindings bindings, literal_bindings;
+    for (size_t i = 0; i < count; i++) {
+      auto argument = call.arguments[i];
+      auto conflict = unify(parameters[i].type, type_of(*argument),
+                            prototype.type_parameters,
+                            is_literal(argument) ? literal_bindings : bindings);
+      if (!conflict.empty() && !is_literal(argument)) {
+        error(call.position, "In a call to " + name + ", " + conflict);
+        return nullptr;
+      }
+    }
+    bindings.merge(literal_bindings);
+
+    std::vector<std::string> type_arguments;
+    for (const auto &type_parameter : prototype.type_parameters) {
+      auto bound = bindings.find(type_parameter.lexeme);
+      if (bound == bindings.end()) {
+        error(call.position, "Can't infer " + type_parameter.lexeme +
+                                 " for a call to " + name +
+                                 " from its arguments");
+        return nullptr;
+      }
+      type_arguments.push_back(bound->second.lexeme);
+    }
+
+    auto existing = generic.specializations.find(type_arguments);
+    if (existing != generic.specializations.end())
+      return existing->second;
+
+    if (generic.made.size() == max_specializations) {
+      error(call.position, "More than " + std::to_string(max_specializations) +
+                               " specializations of " + name);
+      return nullptr;
+    }
+
+    std::string specialized_name = name + "<";
+    for (const auto &type_argument : type_arguments) {
+      specialized_name += type_argument;
+      specialized_name += &type_argument == &type_arguments.back() ? ">" : ",";
+    }
+
+    Cloner cloner(bindings);
+    auto specialization = cloner.clone(*generic.function);
+    specialization->prototype.name =
+        type_named(specialized_name, prototype.name.position);
+    specialization->prototype.type_parameters.clear();
+
+    generic.specializations.emplace(type_arguments, specialization);
+    generic.made.push_back(specialization);
+    prototypes.emplace(specialized_name, &specialization->prototype);
+    pending.push_back(specialization);
+    return specialization;
+  }
+
+public:
+  Error run(ast::Program &program) {
+    for (const auto &statement : program.statements) {
+      if (auto constant = dynamic_cast<ast::VariableDeclaration *>(statement))
+        constants.insert_or_assign(constant->name.lexeme, constant->type);
+      if (auto structure = dynamic_cast<ast::Struct *>(statement))
+        structs.insert_or_assign(structure->name.lexeme, structure);
+
+      auto function = dynamic_cast<ast::Function *>(statement);
+      if (!function)
+        continue;
+
+      const auto &prototype = function->prototype;
+      const auto &name = prototype.name.lexeme;
+      if (prototype.type_parameters.empty()) {
+        prototypes.insert_or_assign(name, &prototype);
+        continue;
+      }
+
+      if (!generics.emplace(name, Generic{function}).second)
+        error(function->position,
+              "Generic function " + name + " is defined more than once");
+
+      for (const auto &type_parameter : prototype.type_parameters) {
+        auto inferable = false;
+        for (const auto &parameter : prototype.parameter_list)
+          inferable = inferable || mentions(parameter.type, type_parameter);
+
+        if (!inferable)
+          error(type_parameter.position,
+                type_parameter.lexeme + " of " + name +
+                    " isn't in the type of any of its parameters, so calls "
+                    "can't infer it");
+      }
+    }
+
+    for (const auto &statement : program.statements) {
+      auto function = dynamic_cast<ast::Function *>(statement);
+      if (!function)
+        statement->accept(*this);
+      else if (function->prototype.type_parameters.empty())
+        walk(*function, false);
+    }
+
+    while (!pending.empty()) {
+      auto specialization = pending.back();
+      pending.pop_back();
+      walk(*specialization, true);
+    }
+
+    // Each generic function's specializations take its place
+    std::vector<ast::Statement *> statements;
+    for (const auto &statement : program.statements) {
+      auto function = dynamic_cast<ast::Function *>(statement);
+      if (!function || function->prototype.type_parameters.empty()) {
+        statements.push_back(statement);
+        continue;
+      }
+
+      auto generic = generics.find(function->prototype.name.lexeme);
+      if (generic != generics.end() && generic->second.function == function)
+        statements.insert(statements.end(), generic->second.made.begin(),
+                          generic->second.made.end());
+      delete function;
+    }
+    program.statements = std::move(statements);
+
+    auto message = errors.str();
+    if (message.empty())
+      return Error::success();
+
+    return make_error<StringError>(message, inconvertibleErrorCode());
+  }
+
+  using ast::Walker::visit;
+
+  void *visit(ast::Binop &binop) override {
+    ast::Walker::visit(binop);
+    if (in_specialization)
+      balance(binop.left, binop.right);
+    return nullptr;
+  }
+
+  void *visit(ast::Condition &condition) override {
+    ast::Walker::visit(condition);
+    if (in_specialization)
+      balance(condition.then, condition.otherwise);
+    return nullptr;
+  }
+
+  void *visit(ast::Call &call) override {
+    ast::Walker::visit(call);
+
+    auto generic = generics.find(call.name.lexeme);
+    auto is_generic = generic != generics.end();
+    if (is_generic) {
+      auto specialization = specialize(generic->second, call);
+      if (!specialization)
+        return nullptr;
+
+      call.name = type_named(specialization->prototype.name.lexeme,
+                             call.name.position);
+    }
+
+    // Literal arguments of a specialization were given the type they're
+    // passed as by inference
+    auto prototype = prototypes.find(call.name.lexeme);
+    if ((in_specialization || is_generic) && prototype != prototypes.end()) {
+      const auto &parameters = prototype->second->parameter_list;
+      for (size_t i = 0; i < call.arguments.size() && i < parameters.size();
+           i++)
+        adapt(call.arguments[i], parameters[i].type);
+    }
+
+    return nullptr;
+  }
+
+  void visit(ast::VariableDeclaration &declaration) override {
+    ast::Walker::visit(declaration);
+    if (in_specialization)
+      adapt(declaration.initializer, declaration.type);
+    variable_types.insert_or_assign(declaration.name.lexeme, declaration.type);
+  }
+
+  void visit(ast::Function &function) override {
+    if (!function.prototype.type_parameters.empty()) {
+      error(function.position,
+            "Generic functions can only be declared at the top level");
+      return;
+    }
+
+    walk(function, in_specialization);
+  }
+
+  void visit(ast::Return &ret) override {
+    if (!ret.return_value)
+      return;
+
+    ret.return_value->accept(*this);
+    if (in_specialization)
+      adapt(ret.return_value, return_type);
+  }
+
+  void visit(ast::Assignment &assignment) override {
+    ast::Walker::visit(assignment);
+    if (in_specialization)
+      adapt(assignment.value, type_of(*assignment.target));
+  }
+
+  void visit(ast::For &loop) override {
+    loop.start->accept(*this);
+    loop.end->accept(*this);
+    if (in_specialization)
+      balance(loop.start, loop.end);
+    variable_types.insert_or_assign(loop.variable.lexeme,
+                                    type_of(*loop.end));
+    loop.body->accept(*this);
+  }
+};
+
+Error monomorphize(ast::Program &program) {
+  Specializer specializer;
+  return specializer.run(program);
+}
+
+// Finds the calls a program makes to generic functions of the other programs
+class ForeignGenericCalls : public ast::Walker {
+  const std::unordered_set<std::string> &defined;
+  const std::unordered_set<std::string> &foreign;
+
+public:
+  std::ostringstream errors;
+
+  ForeignGenericCalls(const std::unordered_set<std::string> &defined,
+                      const std::unordered_set<std::string> &foreign)
+      : defined(defined), foreign(foreign) {}
+
+  using ast::Walker::visit;
+
+  void *visit(ast::Call &call) override {
+    ast::Walker::visit(call);
+
+    const auto &name = call.name.lexeme;
+    if (!defined.count(name) && foreign.count(name)) {
+      const auto &position = call.name.position;
+      errors << "[position " << position.line << ':' << position.column
+             << "] Error: Generic function " << name
+             << " is defined in another file, and generic functions are only "
+                "specialized for calls from their own file"
+             << std::endl;
+    }
+    return nullptr;
+  }
+};
+
+Error check_generic_calls(const std::vector<ast::Program *> &programs) {
+  // Concrete functions are called across files the usual way
+  std::unordered_set<std::string> concrete;
+  for (const auto &program : programs) {
+    for (const auto &statement : program->statements) {
+      auto function = dynamic_cast<ast::Function *>(statement);
+      if (function && function->prototype.type_parameters.empty())
+        concrete.insert(function->prototype.name.lexeme);
+    }
+  }
+
+  std::string message;
+  for (const auto &program : programs) {
+    auto defined = concrete;
+    std::unordered_set<std::string> foreign;
+    for (const auto &other : programs) {
+      for (const auto &statement : other->statements) {
+        auto function = dynamic_cast<ast::Function *>(statement);
+        if (!function || function->prototype.type_parameters.empty())
+          continue;
+
+        const auto &name = function->prototype.name.lexeme;
+        (other == program ? defined : foreign).insert(name);
+      }
+    }
+
+    ForeignGenericCalls finder(defined, foreign);
+    for (const auto &statement : program->statements)
+      statement->accept(finder);
+    message += finder.errors.str();
+  }
+
+  if (message.empty())
+    return Error::success();
+
+  return make_error<StringError>(message, inconvertibleErrorCode());
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast.hpp"
+#include "llvm/Support/Error.h"
+
+#include <vector>
+
+// Replaces each generic function of the program, func max<T>(a: T, b: T) ->
+// T, with a specialization for every distinct list of type arguments it's
+// called with. Type arguments are inferred from the types of a call's
+// arguments, and the call is renamed to the specialization it uses,
+// max<i32>, so later passes and code generation only see concrete functions.
+// A specialization is made once, however many calls use it, and generic
+// functions that are never called aren't compiled at all.
+llvm::Error monomorphize(ast::Program &);
+
+// Reports calls from one program to a generic function of another. Each
+// program's generic functions are only specialized for its own calls, so this
+// runs before any of the programs is monomorphized.
+llvm::Error check_generic_calls(const std::vector<ast::Program *> &);
@@ -0,0 +1,250 @@
+#include "incremental.hpp"
+
+#include "cache.hpp"
+
+#include <set>
+
+Signatures collect_signatures(const std::vector<ast::Program *> &programs) {
+  Signatures signatures;
+  for (const auto &program : programs) {
+    for (const auto &statement : program->statements) {
+      if (auto function = dynamic_cast<ast::Function *>(statement))
+        signatures.emplace(function->prototype.name.lexeme,
+                           &function->prototype);
+    }
+  }
+
+  return signatures;
+}
+
+Declarations collect_declarations(const ast::Program &program,
+                                  const std::vector<ast::Program *> &others) {
+  Declarations declarations;
+  for (const auto &statement : program.statements) {
+    if (dynamic_cast<ast::VariableDeclaration *>(statement) ||
+        dynamic_cast<ast::Struct *>(statement))
+      declarations.push_back(statement);
+  }
+
+  for (const auto &other : others) {
+    if (other == &program)
+      continue;
+
+    for (const auto &statement : other->statements) {
+      if (dynamic_cast<ast::Struct *>(statement))
+        declarations.push_back(statement);
+    }
+  }
+
+  return declarations;
+}
+
+// Every node adds a tag ahead of its fields, so differently shaped trees
+// can't hash the same
+class StructuralHasher : public ast::ExpressionVisitor,
+                         public ast::StatementVisitor {
+  CacheKey &key;
+  bool include_positions;
+
+  void add(const ast::Node &node, const char *tag) {
+    key.add(tag);
+    if (include_positions)
+      add(node.position);
+  }
+
+  void add(const std::vector<ast::Attribute> &attributes) {
+    key.add(std::to_string(attributes.size()));
+    for (const auto &attribute : attributes)
+      key.add(attribute.describe());
+  }
+
+  void add(const SourcePosition &position) {
+    key.add(std::to_string(position.line) + ":" +
+            std::to_string(position.column));
+  }
+
+public:
+  std::set<std::string> callees;
+
+  StructuralHasher(CacheKey &key, bool include_positions)
+      : key(key), include_positions(include_positions) {}
+
+  void add(const ast::FunctionPrototype &prototype, bool with_positions) {
+    key.add(prototype.name.lexeme);
+    for (const auto &parameter : prototype.parameter_list) {
+      key.add(parameter.name.lexeme).add(parameter.type.lexeme);
+      if (with_positions)
+        add(parameter.position);
+    }
+
+    key.add("->").add(prototype.return_type.lexeme);
+    key.add(prototype.is_const ? "const" : "");
+    add(prototype.attributes);
+  }
+
+  void *visit(ast::Variable &node) override {
+    add(node, "variable");
+    key.add(node.name.lexeme);
+    return nullptr;
+  }
+
+  void *visit(ast::LiteralValueExpression &node) override {
+    add(node, "literal");
+    key.add(node.describe());
+    return nullptr;
+  }
+
+  void *visit(ast::Binop &node) override {
+    add(node, "binop");
+    key.add(std::to_string((int)node.operation));
+    node.left->accept(*this);
+    node.right->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(ast::Condition &node) override {
+    add(node, "condition");
+    node.condition->accept(*this);
+    node.then->accept(*this);
+
+    key.add(node.otherwise ? "otherwise" : "");
+    if (node.otherwise)
+      node.otherwise->accept(*this);
+
+    return nullptr;
+  }
+
+  void *visit(ast::Call &node) override {
+    add(node, "call");
+    key.add(node.name.lexeme).add(std::to_string(node.arguments.size()));
+    for (const auto &argument : node.arguments)
+      argument->accept(*this);
+
+    callees.insert(node.name.lexeme);
+    return nullptr;
+  }
+
+  void *visit(ast::StringLiteral &node) override {
+    add(node, "string");
+    key.add(node.value);
+    return nullptr;
+  }
+
+  void *visit(ast::Index &node) override {
+    add(node, "index");
+    node.target->accept(*this);
+    node.index->accept(*this);
+
+    key.add(node.end ? "end" : "");
+    if (node.end)
+      node.end->accept(*this);
+
+    return nullptr;
+  }
+
+  void *visit(ast::Member &node) override {
+    add(node, "member");
+    key.add(node.field.lexeme);
+    node.target->accept(*this);
+    return nullptr;
+  }
+
+  void *visit(ast::ArrayLiteral &node) override {
+    add(node, "array");
+    key.add(std::to_string(node.elements.size()))
+        .add(std::to_string(node.repeat));
+    for (const auto &element : node.elements)
+      element->accept(*this);
+    return nullptr;
+  }
+
+  void visit(ast::VariableDeclaration &node) override {
+    add(node, node.is_const ? "const var" : "var");
+    key.add(node.name.lexeme).add(node.type.lexeme);
+    node.initializer->accept(*this);
+  }
+
+  void visit(ast::ExpressionStatement &node) override {
+    add(node, "expression");
+    node.expression->accept(*this);
+  }
+
+  void visit(ast::Function &node) override {
+    add(node, "func");
+    add(node.prototype, include_positions);
+    node.body->accept(*this);
+  }
+
+  void visit(ast::Block &node) override {
+    add(node, "block");
+    key.add(std::to_string(node.statements.size()));
+    for (const auto &statement : node.statements)
+      statement->accept(*this);
+  }
+
+  void visit(ast::Return &node) override {
+    add(node, "return");
+    key.add(node.return_value ? "value" : "");
+    if (node.return_value)
+      node.return_value->accept(*this);
+  }
+
+  void visit(ast::Assignment &node) override {
+    add(node, "assign");
+    node.target->accept(*this);
+    node.value->accept(*this);
+  }
+
+  void visit(ast::While &node) override {
+    add(node, "while");
+    add(node.attributes);
+    node.condition->accept(*this);
+    node.body->accept(*this);
+  }
+
+  void visit(ast::For &node) override {
+    add(node, "for");
+    add(node.attributes);
+    key.add(node.variable.lexeme);
+    node.start->accept(*this);
+    node.end->accept(*this);
+    node.body->accept(*this);
+  }
+
+  void visit(ast::Struct &node) override {
+    add(node, "struct");
+    add(node.attributes);
+    key.add(node.name.lexeme).add(std::to_string(node.fields.size()));
+    for (const auto &field : node.fields)
+      key.add(field.name.lexeme).add(field.type.lexeme);
+  }
+};
+
+std::string structural_hash(ast::Function &function,
+                            const Signatures &signatures,
+                            bool include_positions,
+                            const Declarations &declarations,
+                            bool flushes_output) {
+  CacheKey key;
+  StructuralHasher hasher(key, include_positions);
+  function.accept(hasher);
+
+  if (function.prototype.name.lexeme == "main")
+    key.add(flushes_output ? "flushes output" : "");
+
+  for (const auto &declaration : declarations)
+    declaration->accept(hasher);
+
+  // Callees are declared from their signatures, so a change to one changes
+  // how the call is generated. Unknown callees like printf are declared by
+  // the compiler itself.
+  for (const auto &callee : hasher.callees) {
+    key.add("callee").add(callee);
+
+    auto signature = signatures.find(callee);
+    if (signature != signatures.end())
+      hasher.add(*signature->second, false);
+  }
+
+  return key.digest();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The prototypes of every function a program can call, by name
+typedef std::unordered_map<std::string, const ast::FunctionPrototype *>
+    Signatures;
+
+Signatures collect_signatures(const std::vector<ast::Program *> &programs);
+
+// The const variables declared at the top of a program, which every module
+// compiled from it has a copy of, and the structs whose layout it uses: its
+// own, and those of the other programs
+typedef std::vector<ast::Statement *> Declarations;
+
+Declarations
+collect_declarations(const ast::Program &,
+                     const std::vector<ast::Program *> &others = {});
+
+// Hashes everything a function's compiled code depends on: its structure,
+// and the signatures of the functions it calls. Source positions end up in
+// debug info, so they're hashed when it's generated. Functions are compiled
+// one at a time without inlining across them, so callee bodies don't matter.
+// The program's consts are hashed after their initializers are evaluated,
+// and its structs with their layout attributes. main's code also depends on
+// whether anything prints, since it flushes the output when it does.
+std::string structural_hash(ast::Function &, const Signatures &,
+                            bool include_positions,
+                            const Declarations &declarations = {},
+                            bool flushes_output = false);
@@ -0,0 +1,496 @@
+#include "jit.hpp"
+#include "codegen.hpp"
+
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <chrono>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+// Collects the names of the functions a function calls directly
+class CallCollector : public ast::Walker {
+public:
+  using ast::Walker::visit;
+
+  std::vector<std::string> callees;
+
+  void *visit(ast::Call &call) override {
+    callees.push_back(call.name.lexeme);
+    return ast::Walker::visit(call);
+  }
+};
+
+class FunctionMaterializationUnit : public MaterializationUnit {
+  Jit &jit;
+  LazyFunction &function;
+
+public:
+  FunctionMaterializationUnit(Jit &jit, SymbolStringPtr name,
+                              LazyFunction &function)
+      : MaterializationUnit(Interface(
+            SymbolFlagsMap{{std::move(name), JITSymbolFlags::Exported |
+                                                 JITSymbolFlags::Callable}},
+            nullptr)),
+        jit(jit), function(function) {}
+
+  StringRef getName() const override {
+    return function.function->prototype.name.lexeme;
+  }
+
+  void materialize(
+      std::unique_ptr<MaterializationResponsibility> responsibility) override {
+    jit.materialize(std::move(responsibility), function);
+  }
+
+private:
+  void discard(const JITDylib &, const SymbolStringPtr &) override {}
+};
+
+static void report_lazy_compile_failure() {
+  report_fatal_error("Lazy compilation failed");
+}
+
+Jit::Jit(std::unique_ptr<LLJIT> jit, bool release, unsigned compile_threads)
+    : jit(std::move(jit)), release(release), compile_threads(compile_threads) {
+  if (compile_threads == 0)
+    return;
+
+  compile_pool = std::make_unique<ThreadPool>(
+      hardware_concurrency(compile_threads));
+  this->jit->getExecutionSession().setDispatchTask(
+      [pool = compile_pool.get()](std::unique_ptr<Task> task) {
+        pool->async([unowned = task.release()] {
+          std::unique_ptr<Task> owned(unowned);
+          owned->run();
+        });
+      });
+}
+
+Jit::~Jit() {
+  // Background compilation still refers to the rest of this object, so it
+  // finishes first. Tiering up waits on compile tasks, so it goes first.
+  if (tier_up_thread)
+    tier_up_thread->wait();
+  if (compile_pool)
+    compile_pool->wait();
+}
+
+Expected<std::unique_ptr<Jit>> Jit::create(bool release,
+                                           unsigned compile_threads) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  auto target_machine_builder = JITTargetMachineBuilder::detectHost();
+  if (!target_machine_builder)
+    return target_machine_builder.takeError();
+
+  target_machine_builder->setCodeGenOptLevel(release ? CodeGenOpt::Aggressive
+                                                     : CodeGenOpt::None);
+
+  auto jit = LLJITBuilder()
+                 .setJITTargetMachineBuilder(std::move(*target_machine_builder))
+                 .setNumCompileThreads(compile_threads)
+                 .create();
+  if (!jit)
+    return jit.takeError();
+
+  // printf and the rest of libc come from this process
+  auto &data_layout = (*jit)->getDataLayout();
+  auto generator = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      data_layout.getGlobalPrefix());
+  if (!generator)
+    return generator.takeError();
+
+  (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+  return std::unique_ptr<Jit>(
+      new Jit(std::move(*jit), release, compile_threads));
+}
+
+Error Jit::add_program(const std::filesystem::path &source_path,
+                       ast::Program *program,
+                       const std::vector<ast::Program *> &others) {
+  auto context = std::make_unique<LLVMContext>();
+
+  std::unique_ptr<Module> module;
+  {
+    CodeGen generator(context.get());
+    generator.options = codegen_options;
+    module.reset(
+        generator.compile_module(source_path, program, release, others));
+  }
+
+  return jit->addIRModule(
+      ThreadSafeModule(std::move(module), std::move(context)));
+}
+
+Error Jit::create_implementations() {
+  auto &session = jit->getExecutionSession();
+  const auto &triple = jit->getTargetTriple();
+
+  auto dylib = jit->createJITDylib("implementations");
+  if (!dylib)
+    return dylib.takeError();
+
+  auto manager = createLocalLazyCallThroughManager(
+      triple, session, pointerToJITTargetAddress(&report_lazy_compile_failure));
+  if (!manager)
+    return manager.takeError();
+
+  auto stubs_manager_builder = createLocalIndirectStubsManagerBuilder(triple);
+  if (!stubs_manager_builder)
+    return make_error<StringError>("No indirect stubs for " + triple.str(),
+                                   inconvertibleErrorCode());
+
+  implementations = &*dylib;
+  call_through_manager = std::move(*manager);
+  stubs_manager = stubs_manager_builder();
+
+  // Calls between implementations go through the main dylib's stubs,
+  // otherwise linking a function would compile all of its callees
+  implementations->setLinkOrder(
+      {{&jit->getMainJITDylib(), JITDylibLookupFlags::MatchAllSymbols}},
+      false);
+
+  // A function's module only defines the function, so the print runtime
+  // its module also has a copy of is shared from the main dylib
+  auto context = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> runtime;
+  {
+    CodeGen generator(context.get());
+    runtime.reset(generator.compile_output_runtime());
+  }
+
+  return jit->addIRModule(
+      ThreadSafeModule(std::move(runtime), std::move(context)));
+}
+
+std::string Jit::implementation_name(const std::string &name) const {
+  return tier_up_threshold ? name + ".baseline" : name;
+}
+
+Error Jit::add_program_lazily(const std::filesystem::path &source_path,
+                              ast::Program *program,
+                              const std::vector<ast::Program *> &others) {
+  if (!implementations) {
+    if (auto error = create_implementations())
+      return error;
+  }
+
+  SymbolAliasMap stubs;
+  for (const auto &statement : program->statements) {
+    auto function = dynamic_cast<ast::Function *>(statement);
+    if (!function)
+      continue;
+
+    const auto &name = function->prototype.name.lexeme;
+    auto implementation = jit->mangleAndIntern(implementation_name(name));
+    if (name == "main")
+      main_is_lazy = true;
+
+    stubs[jit->mangleAndIntern(name)] = SymbolAliasMapEntry(
+        implementation, JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+
+    auto &lazy_function =
+        lazy_functions.emplace_back(source_path, program, function, others);
+    auto unit = std::make_unique<FunctionMaterializationUnit>(
+        *this, implementation, lazy_function);
+    if (auto error = implementations->define(std::move(unit)))
+      return error;
+  }
+
+  return jit->getMainJITDylib().define(lazyReexports(
+      *call_through_manager, *stubs_manager, *implementations,
+      std::move(stubs)));
+}
+
+bool Jit::is_compiled(const std::string &name) const {
+  for (const auto &lazy_function : lazy_functions) {
+    if (lazy_function.function->prototype.name.lexeme == name)
+      return lazy_function.compiled;
+  }
+
+  return false;
+}
+
+void Jit::materialize(
+    std::unique_ptr<MaterializationResponsibility> responsibility,
+    LazyFunction &lazy_function) {
+  auto &function = *lazy_function.function;
+  auto context = std::make_unique<LLVMContext>();
+
+  std::unique_ptr<Module> module;
+  {
+    CodeGen generator(context.get());
+    generator.options = codegen_options;
+    module.reset(generator.compile_function(lazy_function.source_path,
+                                            lazy_function.program, function,
+                                            release, lazy_function.others));
+    for (const auto &warning : generator.warnings)
+      errs() << warning << "\n";
+  }
+  module->setDataLayout(jit->getDataLayout());
+
+  if (tier_up_threshold)
+    count_calls(*module, lazy_function);
+
+  baseline_compiles += 1;
+  lazy_function.compiled = true;
+
+  jit->getIRTransformLayer().emit(
+      std::move(responsibility),
+      ThreadSafeModule(std::move(module), std::move(context)));
+
+  if (compile_threads == 0)
+    return;
+
+  // Direct callees are likely to run soon, so they're compiled in the
+  // background. Speculatively compiled functions don't speculate further.
+  SymbolLookupSet callees;
+  {
+    std::lock_guard<std::mutex> lock(speculation_mutex);
+    if (speculated.count(function.prototype.name.lexeme))
+      return;
+
+    CallCollector collector;
+    function.accept(collector);
+    for (const auto &callee : collector.callees) {
+      if (callee == function.prototype.name.lexeme ||
+          !speculated.insert(callee).second)
+        continue;
+
+      // Builtins like len aren't defined anywhere, so they're looked up
+      // weakly
+      callees.add(jit->mangleAndIntern(implementation_name(callee)),
+                  SymbolLookupFlags::WeaklyReferencedSymbol);
+    }
+  }
+
+  if (callees.empty())
+    return;
+
+  jit->getExecutionSession().lookup(
+      LookupKind::Static,
+      {{implementations, JITDylibLookupFlags::MatchAllSymbols}},
+      std::move(callees), SymbolState::Ready,
+      [](Expected<SymbolMap> result) {
+        // Failures surface again when the function is actually called
+        consumeError(result.takeError());
+      },
+      NoDependenciesToRegister);
+}
+
+Error Jit::enable_tiering(uint64_t threshold) {
+  assert(lazy_functions.empty());
+
+  auto target_machine_builder = JITTargetMachineBuilder::detectHost();
+  if (!target_machine_builder)
+    return target_machine_builder.takeError();
+
+  target_machine_builder->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+
+  auto dylib = jit->createJITDylib("optimized");
+  if (!dylib)
+    return dylib.takeError();
+
+  // Like implementations, optimized code calls through the stubs
+  optimized = &*dylib;
+  optimized->setLinkOrder(
+      {{&jit->getMainJITDylib(), JITDylibLookupFlags::MatchAllSymbols}},
+      false);
+
+  optimizing_compile_layer = std::make_unique<IRCompileLayer>(
+      jit->getExecutionSession(), jit->getObjLinkingLayer(),
+      std::make_unique<ConcurrentIRCompiler>(
+          std::move(*target_machine_builder)));
+
+  tier_up_thread = std::make_unique<ThreadPool>(hardware_concurrency(1));
+  tier_up_threshold = threshold;
+  return Error::success();
+}
+
+void Jit::count_calls(Module &module, LazyFunction &lazy_function) {
+  auto &context = module.getContext();
+  const auto &name = lazy_function.function->prototype.name.lexeme;
+  auto function = module.getFunction(name);
+
+  // Recursive calls go through the stub too, otherwise a recursive function
+  // would never leave the baseline tier
+  function->setName(implementation_name(name));
+  auto stub = Function::Create(function->getFunctionType(),
+                               GlobalValue::ExternalLinkage, name, module);
+  function->replaceAllUsesWith(stub);
+
+  auto &entry = function->getEntryBlock();
+
+  // Allocas stay in the entry block so they remain static
+  auto insertion_point = entry.begin();
+  while (isa<AllocaInst>(*insertion_point))
+    ++insertion_point;
+
+  IRBuilder<> builder(&*insertion_point);
+
+  auto counter_type = Type::getInt64Ty(context);
+  auto counter = ConstantExpr::getIntToPtr(
+      ConstantInt::get(counter_type, (uintptr_t)&lazy_function.calls),
+      counter_type->getPointerTo());
+  auto previous_calls = builder.CreateAtomicRMW(
+      AtomicRMWInst::Add, counter, ConstantInt::get(counter_type, 1),
+      MaybeAlign(8), AtomicOrdering::Monotonic);
+  auto hot = builder.CreateICmpEQ(
+      previous_calls, ConstantInt::get(counter_type, tier_up_threshold - 1),
+      "hot");
+
+  auto tier_up_block =
+      SplitBlockAndInsertIfThen(hot, &*builder.GetInsertPoint(), false);
+  builder.SetInsertPoint(tier_up_block);
+
+  // The callback's address is baked in, it runs in this process
+  auto pointer_type = Type::getInt8PtrTy(context);
+  auto tier_up_type = FunctionType::get(Type::getVoidTy(context),
+                                        {pointer_type, pointer_type}, false);
+  auto tier_up_address = ConstantExpr::getIntToPtr(
+      ConstantInt::get(counter_type, (uintptr_t)&Jit::tier_up),
+      tier_up_type->getPointerTo());
+  builder.CreateCall(
+      tier_up_type, tier_up_address,
+      {ConstantExpr::getIntToPtr(
+           ConstantInt::get(counter_type, (uintptr_t)this), pointer_type),
+       ConstantExpr::getIntToPtr(
+           ConstantInt::get(counter_type, (uintptr_t)&lazy_function),
+           pointer_type)});
+}
+
+void Jit::tier_up(Jit *jit, LazyFunction *lazy_function) {
+  jit->tier_up_thread->async(
+      [jit, lazy_function]() { jit->compile_optimized(*lazy_function); });
+}
+
+void Jit::compile_optimized(LazyFunction &lazy_function) {
+  auto start = std::chrono::steady_clock::now();
+  const auto &name = lazy_function.function->prototype.name.lexeme;
+  auto optimized_name = name + ".optimized";
+
+  auto context = std::make_unique<LLVMContext>();
+
+  std::unique_ptr<Module> module;
+  {
+    CodeGen generator(context.get());
+    generator.options = codegen_options;
+    module.reset(generator.compile_function(
+        lazy_function.source_path, lazy_function.program,
+        *lazy_function.function, true, lazy_function.others));
+  }
+  module->setDataLayout(jit->getDataLayout());
+
+  // The baseline code keeps its name, so the optimized code gets its own
+  module->getFunction(name)->setName(optimized_name);
+
+  auto error = optimizing_compile_layer->add(
+      *optimized, ThreadSafeModule(std::move(module), std::move(context)));
+  if (error) {
+    logAllUnhandledErrors(std::move(error), errs(), "tier up failed: ");
+    return;
+  }
+
+  // Compilation finishes asynchronously, the stub is swapped once it's done.
+  // The stub itself is looked up too, in case it hasn't been created yet.
+  auto stub = jit->mangleAndIntern(name);
+  auto optimized_symbol = jit->mangleAndIntern(optimized_name);
+  SymbolLookupSet symbols;
+  symbols.add(stub);
+  symbols.add(optimized_symbol);
+
+  jit->getExecutionSession().lookup(
+      LookupKind::Static,
+      {{&jit->getMainJITDylib(), JITDylibLookupFlags::MatchAllSymbols},
+       {optimized, JITDylibLookupFlags::MatchAllSymbols}},
+      std::move(symbols), SymbolState::Ready,
+      [this, name, stub, optimized_symbol,
+       start](Expected<SymbolMap> result) {
+        if (!result) {
+          logAllUnhandledErrors(result.takeError(), errs(),
+                                "tier up failed: ");
+          return;
+        }
+
+        auto address = (*result)[optimized_symbol].getAddress();
+        if (auto error = stubs_manager->updatePointer(*stub, address)) {
+          logAllUnhandledErrors(std::move(error), errs(), "tier up failed: ");
+          return;
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::lock_guard<std::mutex> lock(tier_up_mutex);
+        tier_up_events.push_back(
+            {name,
+             std::chrono::duration<double, std::milli>(elapsed).count()});
+      },
+      NoDependenciesToRegister);
+}
+
+std::vector<TierUpEvent> Jit::finish_tier_ups() {
+  // The stub is swapped by a compile task the tier-up started
+  if (tier_up_thread)
+    tier_up_thread->wait();
+  if (compile_pool)
+    compile_pool->wait();
+
+  std::lock_guard<std::mutex> lock(tier_up_mutex);
+  return tier_up_events;
+}
+
+void Jit::print_stats(raw_ostream &stream) {
+  stream << "jit stats:\n";
+  stream << "  baseline compiles: " << baseline_compiles << "\n";
+
+  if (!tier_up_threshold)
+    return;
+
+  stream << "  tier-up threshold: " << tier_up_threshold << " calls\n";
+
+  std::lock_guard<std::mutex> lock(tier_up_mutex);
+  stream << "  tier-ups: " << tier_up_events.size() << "\n";
+  for (const auto &event : tier_up_events) {
+    stream << "    " << event.name << ": recompiled in "
+           << format("%.3f", event.compile_milliseconds) << " ms\n";
+  }
+
+  stream << "  baseline calls:\n";
+  for (const auto &lazy_function : lazy_functions) {
+    if (lazy_function.calls == 0)
+      continue;
+
+    stream << "    " << lazy_function.function->prototype.name.lexeme << ": "
+           << lazy_function.calls << "\n";
+  }
+}
+
+Expected<Jit::MainFunction> Jit::lookup_main() {
+  // A lazy main is compiled here rather than on its first call
+  auto main_symbol =
+      main_is_lazy ? jit->lookup(*implementations, implementation_name("main"))
+                   : jit->lookup("main");
+  if (!main_symbol)
+    return main_symbol.takeError();
+
+  return (MainFunction)(intptr_t)main_symbol->getAddress();
+}
+
+int Jit::run_main(MainFunction main_function,
+                  const std::vector<std::string> &arguments) {
+  std::vector<char *> argv;
+  for (const auto &argument : arguments) {
+    argv.push_back(const_cast<char *>(argument.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  return main_function((int)arguments.size(), argv.data());
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// A function added lazily, along with what's needed to generate it again
+struct LazyFunction {
+  std::filesystem::path source_path;
+  ast::Program *program;
+  ast::Function *function;
+  std::vector<ast::Program *> others;
+
+  // Entries into the baseline tier, only counted when tiering
+  std::atomic<uint64_t> calls{0};
+
+  // Set once the function has been generated and compiled
+  std::atomic<bool> compiled{false};
+
+  LazyFunction(std::filesystem::path source_path, ast::Program *program,
+               ast::Function *function, std::vector<ast::Program *> others)
+      : source_path(std::move(source_path)), program(program),
+        function(function), others(std::move(others)) {}
+};
+
+struct TierUpEvent {
+  std::string name;
+  double compile_milliseconds;
+};
+
+// Compiles solar programs in-process and runs them without writing objects
+// or invoking a linker
+class Jit {
+private:
+  // Declared first, so that the session outlives everything that refers to it
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+
+  // Runs the session's compile tasks in place of the JIT's own threads, so
+  // they can be waited for before the rest of this object is destroyed
+  std::unique_ptr<llvm::ThreadPool> compile_pool;
+
+  bool release;
+  unsigned compile_threads;
+
+  // Lazily added functions are defined in the implementation dylib and
+  // reached from the main dylib through stubs that compile them on their
+  // first call
+  llvm::orc::JITDylib *implementations = nullptr;
+  std::unique_ptr<llvm::orc::LazyCallThroughManager> call_through_manager;
+  std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_manager;
+  std::deque<LazyFunction> lazy_functions;
+  bool main_is_lazy = false;
+
+  std::mutex speculation_mutex;
+  std::unordered_set<std::string> speculated;
+
+  // Tiering counts entries into the unoptimized baseline code and recompiles
+  // hot functions with full optimization into their own dylib, then points
+  // the function's stub at the optimized code
+  uint64_t tier_up_threshold = 0;
+  llvm::orc::JITDylib *optimized = nullptr;
+  std::unique_ptr<llvm::orc::IRCompileLayer> optimizing_compile_layer;
+  std::unique_ptr<llvm::ThreadPool> tier_up_thread;
+  std::atomic<unsigned> baseline_compiles{0};
+  std::mutex tier_up_mutex;
+  std::vector<TierUpEvent> tier_up_events;
+
+  explicit Jit(std::unique_ptr<llvm::orc::LLJIT> jit, bool release,
+               unsigned compile_threads);
+
+  llvm::Error create_implementations();
+  std::string implementation_name(const std::string &) const;
+  void count_calls(llvm::Module &, LazyFunction &);
+  static void tier_up(Jit *, LazyFunction *);
+  void compile_optimized(LazyFunction &);
+
+public:
+  // Used for every function the JIT generates
+  CodeGenOptions codegen_options;
+
+  ~Jit();
+
+  // With compile threads, lazily compiled functions also compile their
+  // direct callees in the background before they're first called
+  static llvm::Expected<std::unique_ptr<Jit>>
+  create(bool release = false, unsigned compile_threads = 0);
+
+  // Calls into the other programs resolve to their functions once those
+  // programs are added too
+  llvm::Error add_program(const std::filesystem::path &, ast::Program *,
+                          const std::vector<ast::Program *> &others = {});
+
+  // Each function is generated and compiled the first time it's called
+  llvm::Error
+  add_program_lazily(const std::filesystem::path &, ast::Program *,
+                     const std::vector<ast::Program *> &others = {});
+
+  // Lazily added functions start unoptimized and are recompiled with
+  // optimizations in the background once they've been called threshold
+  // times. Must be enabled before functions are added.
+  llvm::Error enable_tiering(uint64_t threshold);
+
+  // Waits for the tier-ups in flight, and returns every one that finished
+  std::vector<TierUpEvent> finish_tier_ups();
+
+  // Whether a lazily added function has been compiled yet
+  bool is_compiled(const std::string &name) const;
+
+  // Generates and compiles a lazily added function
+  void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility>,
+                   LazyFunction &);
+
+  typedef int (*MainFunction)(int, char **);
+
+  // Looking main up compiles everything it depends on
+  llvm::Expected<MainFunction> lookup_main();
+
+  // Calls main the way the C runtime would, whether or not it declares
+  // argc and argv
+  static int run_main(MainFunction, const std::vector<std::string> &arguments);
+
+  void print_stats(llvm::raw_ostream &);
+};
@@ -12,9 +12,13 @@ static std::unordered_map<std::string, Token::Kind> reserved_words{
     // NOLINT(cert-err58-cpp)
     {"else", Token::Kind::ELSE}, {"func", Token::Kind::FUNC},
     {"if", Token::Kind::IF},     {"return", Token::Kind::RETURN},
-    {"var", Token::Kind::VAR},
+    {"var", Token::Kind::VAR},   {"while", Token::Kind::WHILE},
+    {"for", Token::Kind::FOR},   {"in", Token::Kind::IN},
+    {"const", Token::Kind::CONST}, {"struct", Token::Kind::STRUCT},
 };
 
+// Lexing is interleaved with parsing, so the parse phase's timer, started
+// once around parse_program, counts it too
 Token Lexer::next() {
   Token token; // NOLINT(cppcoreguidelines-pro-type-member-init)
 
@@ -45,6 +49,9 @@ Token Lexer::next() {
   case '/':
     token = {Token::Kind::SLASH, extractLexeme(1), position};
     break;
+  case '%':
+    token = {Token::Kind::PERCENT, extractLexeme(1), position};
+    break;
   case '=':
     if (match('=')) {
       token = {Token::Kind::EQUAL, extractLexeme(2), position};
@@ -78,12 +85,31 @@ Token Lexer::next() {
   case '}':
     token = {Token::Kind::RBRACE, extractLexeme(1), position};
     break;
+  case '[':
+    token = {Token::Kind::LBRACKET, extractLexeme(1), position};
+    break;
+  case ']':
+    token = {Token::Kind::RBRACKET, extractLexeme(1), position};
+    break;
+  case ';':
+    token = {Token::Kind::SEMICOLON, extractLexeme(1), position};
+    break;
   case ',':
     token = {Token::Kind::COMMA, extractLexeme(1), position};
     break;
   case ':':
     token = {Token::Kind::COLON, extractLexeme(1), position};
     break;
+  case '@':
+    token = {Token::Kind::AT, extractLexeme(1), position};
+    break;
+  case '.':
+    if (match('.')) {
+      token = {Token::Kind::DOT_DOT, extractLexeme(2), position};
+    } else {
+      token = {Token::Kind::DOT, extractLexeme(1), position};
+    }
+    break;
   case '!':
     if (match('=')) {
       token = {Token::Kind::NOT_EQUAL, extractLexeme(2), position};
@@ -146,9 +172,13 @@ Token Lexer::read_word() const {
 Token Lexer::read_number() const {
   auto position = get_position(*this);
 
+  // A range like 0..n ends the number before its dots
   auto length = 0;
   for (auto it = input->begin() + offset;
        it != input->end() && (isdigit(*it) || *it == '.'); ++it) {
+    if (*it == '.' && it + 1 != input->end() && *(it + 1) == '.')
+      break;
+
     length += 1;
   }
 
@@ -0,0 +1,256 @@
+#include "linker.hpp"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef SOLAR_HAVE_LLD
+#include "lld/Common/Driver.h"
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+// Linkers take objects as paths, so each object is given one that refers to
+// an anonymous in-memory file where the platform has them, and to a
+// temporary file that's removed afterwards where it doesn't
+class ObjectFiles {
+  std::vector<int> descriptors;
+  std::vector<std::string> temporary_files;
+
+public:
+  std::vector<std::string> paths;
+
+  ~ObjectFiles() {
+#ifdef __linux__
+    for (auto descriptor : descriptors)
+      close(descriptor);
+#endif
+
+    for (const auto &file : temporary_files)
+      sys::fs::remove(file);
+  }
+
+  Error add(const ObjectBuffer &object) {
+    int descriptor = -1;
+    auto is_temporary = false;
+    std::string path;
+
+#ifdef __linux__
+    // Linked children inherit the descriptor, so the path works for them too
+    descriptor = memfd_create("solar-object", 0);
+    if (descriptor >= 0) {
+      descriptors.push_back(descriptor);
+      path = "/proc/self/fd/" + std::to_string(descriptor);
+    }
+#endif
+
+    if (descriptor < 0) {
+      SmallString<128> temporary_path;
+      if (auto error = sys::fs::createTemporaryFile("solar", "o", descriptor,
+                                                    temporary_path))
+        return errorCodeToError(error);
+
+      path = temporary_path.str().str();
+      temporary_files.push_back(path);
+      is_temporary = true;
+    }
+
+    // Temporary files are closed once they're written
+    raw_fd_ostream stream(descriptor, is_temporary);
+    stream.write(object.data(), object.size());
+    stream.flush();
+
+    if (stream.has_error()) {
+      auto error = stream.error();
+      stream.clear_error();
+      return errorCodeToError(error);
+    }
+
+    paths.push_back(path);
+    return Error::success();
+  }
+};
+
+static Expected<std::string> dynamic_linker_for(const Triple &triple) {
+  switch (triple.getArch()) {
+  case Triple::x86_64:
+    return "/lib64/ld-linux-x86-64.so.2";
+  case Triple::aarch64:
+    return "/lib/ld-linux-aarch64.so.1";
+  case Triple::x86:
+    return "/lib/ld-linux.so.2";
+  default:
+    return make_error<StringError>("No known dynamic linker for " +
+                                       triple.str(),
+                                   inconvertibleErrorCode());
+  }
+}
+
+// Arguments for an ELF linker, which unlike a compiler driver has to be told
+// where the C runtime lives
+static Expected<std::vector<std::string>>
+elf_arguments(const std::vector<std::string> &objects,
+              const std::vector<std::string> &libraries,
+              const std::vector<std::string> &undefined,
+              const std::string &output, bool release,
+              bool fold_identical_code) {
+  Triple triple(sys::getProcessTriple());
+
+  auto dynamic_linker = dynamic_linker_for(triple);
+  if (!dynamic_linker)
+    return dynamic_linker.takeError();
+
+  auto multiarch = triple.getArchName().str() + "-linux-gnu";
+  const std::vector<std::string> library_paths{
+      "/usr/lib/" + multiarch, "/lib/" + multiarch, "/usr/lib64",
+      "/lib64",                "/usr/lib",          "/lib",
+  };
+
+  auto find_runtime_object = [&](const std::string &name) {
+    for (const auto &directory : library_paths) {
+      auto path = directory + "/" + name;
+      if (sys::fs::exists(path))
+        return path;
+    }
+
+    return name;
+  };
+
+  std::vector<std::string> arguments{
+      "-o",
+      output,
+      "--eh-frame-hdr",
+      "-dynamic-linker",
+      *dynamic_linker,
+      find_runtime_object("crt1.o"),
+      find_runtime_object("crti.o"),
+  };
+
+  for (const auto &symbol : undefined) {
+    arguments.emplace_back("-u");
+    arguments.push_back(symbol);
+  }
+
+  arguments.insert(arguments.end(), objects.begin(), objects.end());
+  arguments.insert(arguments.end(), libraries.begin(), libraries.end());
+
+  for (const auto &directory : library_paths) {
+    if (sys::fs::is_directory(directory))
+      arguments.push_back("-L" + directory);
+  }
+
+  // Float remainders, and some intrinsics on CPUs without an instruction for
+  // them, lower to libm calls. It's only a dependency of programs that use it.
+  arguments.emplace_back("--as-needed");
+  arguments.emplace_back("-lm");
+  arguments.emplace_back("--no-as-needed");
+  arguments.emplace_back("-lc");
+  arguments.push_back(find_runtime_object("crtn.o"));
+
+  if (release) {
+    arguments.emplace_back("--gc-sections");
+    if (fold_identical_code)
+      arguments.emplace_back("--icf=all");
+  }
+
+  return arguments;
+}
+
+static Error execute(const std::string &program,
+                     const std::vector<std::string> &arguments) {
+  std::vector<StringRef> argv{program};
+  argv.insert(argv.end(), arguments.begin(), arguments.end());
+
+  std::string message;
+  auto result = sys::ExecuteAndWait(program, argv, None, {}, 0, 0, &message);
+  if (result != 0) {
+    return make_error<StringError>(
+        program + " failed" + (message.empty() ? "" : ": " + message),
+        inconvertibleErrorCode());
+  }
+
+  return Error::success();
+}
+
+// Non-ELF platforms go through the compiler driver, which knows where their
+// system libraries are
+static Error link_with_driver(const std::vector<std::string> &objects,
+                              const std::vector<std::string> &libraries,
+                              const std::string &output, bool release) {
+  auto driver = sys::findProgramByName("cc");
+  if (!driver)
+    return errorCodeToError(driver.getError());
+
+  std::vector<std::string> arguments(objects);
+  arguments.insert(arguments.end(), libraries.begin(), libraries.end());
+  arguments.emplace_back("-o");
+  arguments.push_back(output);
+
+  if (release && Triple(sys::getProcessTriple()).isOSDarwin())
+    arguments.emplace_back("-Wl,-dead_strip");
+
+  return execute(*driver, arguments);
+}
+
+Error link_executable(const std::vector<ObjectBuffer> &objects,
+                      const std::string &output, bool release,
+                      const std::vector<std::string> &libraries,
+                      const std::vector<std::string> &undefined) {
+  ObjectFiles files;
+  for (const auto &object : objects) {
+    if (auto error = files.add(object))
+      return error;
+  }
+
+  // Only ELF objects leave runtimes for the linker to be told about; other
+  // formats' objects reference them directly
+  if (!Triple(sys::getProcessTriple()).isOSBinFormatELF())
+    return link_with_driver(files.paths, libraries, output, release);
+
+#ifdef SOLAR_HAVE_LLD
+  auto arguments =
+      elf_arguments(files.paths, libraries, undefined, output, release, true);
+  if (!arguments)
+    return arguments.takeError();
+
+  std::vector<const char *> argv{"ld.lld"};
+  for (const auto &argument : *arguments)
+    argv.push_back(argument.c_str());
+
+  std::string diagnostics;
+  raw_string_ostream diagnostics_stream(diagnostics);
+  if (!lld::elf::link(argv, outs(), diagnostics_stream, false, false))
+    return make_error<StringError>(diagnostics_stream.str(),
+                                   inconvertibleErrorCode());
+
+  return Error::success();
+#else
+  // Only lld and gold can fold identical code
+  std::string linker;
+  auto fold_identical_code = true;
+  if (auto lld = sys::findProgramByName("ld.lld")) {
+    linker = *lld;
+  } else if (auto gold = sys::findProgramByName("ld.gold")) {
+    linker = *gold;
+  } else if (auto bfd = sys::findProgramByName("ld")) {
+    linker = *bfd;
+    fold_identical_code = false;
+  } else {
+    return errorCodeToError(bfd.getError());
+  }
+
+  auto arguments = elf_arguments(files.paths, libraries, undefined, output,
+                                 release, fold_identical_code);
+  if (!arguments)
+    return arguments.takeError();
+
+  return execute(linker, *arguments);
+#endif
+}
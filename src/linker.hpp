@@ -0,0 +1,21 @@
+#pragma once
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+// An object file emitted into memory
+typedef llvm::SmallVector<char, 0> ObjectBuffer;
+
+// Links the objects into an executable without writing them out as files
+// next to the sources. ELF objects are linked in-process when solar was built
+// against lld, and by the system linker, without a shell, otherwise. Release
+// links drop unreferenced sections and fold identical functions. Libraries
+// are archives linked after the objects, and the undefined symbols are
+// pulled in from them even though no object refers to them.
+llvm::Error link_executable(const std::vector<ObjectBuffer> &objects,
+                            const std::string &output, bool release,
+                            const std::vector<std::string> &libraries = {},
+                            const std::vector<std::string> &undefined = {});
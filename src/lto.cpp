@@ -0,0 +1,227 @@
+#include "lto.hpp"
+
+#include "codegen.hpp"
+#include "timing.hpp"
+
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/FunctionImport.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/Utils/FunctionImportUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <mutex>
+#include <unordered_map>
+
+using namespace llvm;
+
+Expected<std::unique_ptr<Module>>
+link_whole_program(std::vector<std::unique_ptr<Module>> modules,
+                   const std::unordered_set<std::string> &exports,
+                   bool release, const ProfileOptions &profile) {
+  assert(!modules.empty());
+
+  auto program = std::move(modules.front());
+  Linker linker(*program);
+
+  // The linker reports what went wrong through the context's diagnostics
+  for (size_t i = 1; i < modules.size(); ++i) {
+    auto name = modules[i]->getModuleIdentifier();
+    if (linker.linkInModule(std::move(modules[i]))) {
+      return make_error<StringError>("Could not link " + name,
+                                     inconvertibleErrorCode());
+    }
+  }
+
+  internalizeModule(*program, [&](const GlobalValue &value) {
+    return value.getName() == "main" || exports.count(value.getName().str());
+  });
+
+  PhaseTimer timer("Optimize", program->getModuleIdentifier());
+
+  legacy::PassManager passes;
+  populate_module_passes(passes, release ? 3 : 0, profile);
+
+  // Internalized functions nothing calls anymore are dropped
+  passes.add(createGlobalDCEPass());
+  passes.run(*program);
+
+  std::string message;
+  raw_string_ostream message_stream(message);
+  if (verifyModule(*program, &message_stream)) {
+    return make_error<StringError>(message_stream.str(),
+                                   inconvertibleErrorCode());
+  }
+
+  return program;
+}
+
+void write_thin_lto_bitcode(Module &module, raw_ostream &stream) {
+  // Summaries refer to globals by name, so string constants need one
+  nameUnamedGlobals(module);
+
+  ProfileSummaryInfo profile_summary(module);
+  auto index = buildModuleSummaryIndex(module, nullptr, &profile_summary);
+  // Promoted locals are renamed after the module hash
+  WriteBitcodeToFile(module, stream, false, &index, true);
+}
+
+// Optimizes one module of the thin link, after importing what the thin link
+// chose for it, and compiles it to an object
+static Error thin_backend(const std::string &name,
+                          const std::unordered_map<std::string, MemoryBufferRef>
+                              &buffers,
+                          const ModuleSummaryIndex &index,
+                          const FunctionImporter::ImportMapTy &imports,
+                          const std::function<bool(const GlobalValue &)> &keep,
+                          const TargetMachineFactory &create_target_machine,
+                          unsigned optimization_level,
+                          const ProfileOptions &profile, ObjectBuffer &object) {
+  LLVMContext context;
+  auto module = parseBitcodeFile(buffers.at(name), context);
+  if (!module)
+    return module.takeError();
+
+  // Locals other modules import references to are promoted and renamed
+  if (renameModuleForThinLTO(**module, index, false)) {
+    return make_error<StringError>("Could not promote symbols in " + name,
+                                   inconvertibleErrorCode());
+  }
+
+  auto load = [&](StringRef identifier) {
+    return getLazyBitcodeModule(buffers.at(identifier.str()), context, true,
+                                true);
+  };
+
+  FunctionImporter importer(index, load, false);
+  auto imported = importer.importFunctions(**module, imports);
+  if (!imported)
+    return imported.takeError();
+
+  internalizeModule(**module, keep);
+
+  auto target_machine = create_target_machine();
+
+  // Imported bodies are available externally, so they're dropped once the
+  // inliner has used them
+  legacy::PassManager passes;
+  populate_module_passes(passes, optimization_level, profile);
+  passes.add(createGlobalDCEPass());
+
+  raw_svector_ostream stream(object);
+  if (target_machine->addPassesToEmitFile(passes, stream, nullptr,
+                                          CGFT_ObjectFile)) {
+    return make_error<StringError>("Can't emit an object file for " + name,
+                                   inconvertibleErrorCode());
+  }
+
+  passes.run(**module);
+  return Error::success();
+}
+
+Error thin_link(const std::vector<ObjectBuffer> &bitcode,
+                const std::vector<std::string> &names,
+                const std::unordered_set<std::string> &exports,
+                const TargetMachineFactory &create_target_machine,
+                unsigned optimization_level, const ProfileOptions &profile,
+                unsigned jobs, std::vector<ObjectBuffer> &objects) {
+  // Module identifiers key the summary index, so they must be unique
+  std::unordered_map<std::string, MemoryBufferRef> buffers;
+  ModuleSummaryIndex index(false);
+  for (size_t i = 0; i < bitcode.size(); ++i) {
+    MemoryBufferRef buffer(StringRef(bitcode[i].data(), bitcode[i].size()),
+                           names[i]);
+    if (!buffers.emplace(names[i], buffer).second) {
+      return make_error<StringError>("Duplicate module " + names[i],
+                                     inconvertibleErrorCode());
+    }
+
+    if (auto error = readModuleSummaryIndex(buffer, index, i))
+      return error;
+  }
+
+  // Every module that prints writes into the same buffer, which internalizing
+  // would give each module a copy of
+  DenseSet<GlobalValue::GUID> preserved{
+      GlobalValue::getGUID("main"), GlobalValue::getGUID(output_buffer_name)};
+  for (const auto &name : exports)
+    preserved.insert(GlobalValue::getGUID(name));
+
+  computeDeadSymbolsWithConstProp(
+      index, preserved,
+      [](GlobalValue::GUID) { return PrevailingType::Unknown; }, true);
+
+  StringMap<GVSummaryMapTy> definitions;
+  index.collectDefinedGVSummariesPerModule(definitions);
+
+  StringMap<FunctionImporter::ImportMapTy> import_lists;
+  StringMap<FunctionImporter::ExportSetTy> export_lists;
+  ComputeCrossModuleImport(index, definitions, import_lists, export_lists);
+
+  // Anything another module imports a reference to must stay visible to the
+  // system linker, and locals among them are promoted
+  std::unordered_set<GlobalValue::GUID> exported(preserved.begin(),
+                                                 preserved.end());
+  for (const auto &module : export_lists) {
+    for (const auto &value : module.second) {
+      auto guid = value.getGUID();
+      exported.insert(guid);
+
+      auto summary = index.findSummaryInModule(guid, module.first());
+      if (summary && GlobalValue::isLocalLinkage(summary->linkage()))
+        summary->setLinkage(GlobalValue::ExternalLinkage);
+    }
+  }
+
+  auto keep = [&](const GlobalValue &value) {
+    // Promoted locals have been renamed, so they're found by their original
+    // name's GUID, which the summary keeps
+    return exported.count(value.getGUID()) ||
+           value.getName().contains(".llvm.");
+  };
+
+  // Each backend has its own context and target machine, and writes only
+  // its own object, so they share nothing mutable but the error list
+  std::vector<ObjectBuffer> outputs(bitcode.size());
+  std::vector<std::string> errors;
+  std::mutex errors_mutex;
+
+  // Looking a module up in the import lists can insert it, so that's done
+  // before any backend runs
+  std::vector<const FunctionImporter::ImportMapTy *> imports;
+  for (const auto &name : names)
+    imports.push_back(&import_lists[name]);
+
+  ThreadPool pool(heavyweight_hardware_concurrency(jobs));
+  for (size_t i = 0; i < bitcode.size(); ++i) {
+    pool.async([&, i] {
+      auto error = thin_backend(names[i], buffers, index, *imports[i], keep,
+                                create_target_machine, optimization_level,
+                                profile, outputs[i]);
+      if (error) {
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        errors.push_back(toString(std::move(error)));
+      }
+    });
+  }
+
+  pool.wait();
+
+  if (!errors.empty()) {
+    return make_error<StringError>(join(errors, "\n"),
+                                   inconvertibleErrorCode());
+  }
+
+  for (auto &output : outputs)
+    objects.push_back(std::move(output));
+
+  return Error::success();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "linker.hpp"
+#include "profile.hpp"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <functional>
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Links every module of a program into one, so that calls across source files
+// can be inlined and specialized like calls within one. The modules must
+// share a context. Everything but main and the exported symbols is
+// internalized before the module level optimizations run.
+llvm::Expected<std::unique_ptr<llvm::Module>>
+link_whole_program(std::vector<std::unique_ptr<llvm::Module>> modules,
+                   const std::unordered_set<std::string> &exports,
+                   bool release, const ProfileOptions &profile = {});
+
+// Writes a module as bitcode carrying the summary index that ThinLTO's thin
+// link reads to decide what to import across modules
+void write_thin_lto_bitcode(llvm::Module &, llvm::raw_ostream &);
+
+// Target machines aren't thread safe, so each backend makes its own
+typedef std::function<std::unique_ptr<llvm::TargetMachine>()>
+    TargetMachineFactory;
+
+// Runs the thin link over bitcode written by write_thin_lto_bitcode, named by
+// module identifier. It imports callee bodies across modules, then runs each
+// module's backend on its own thread, up to jobs at once (0 for one per
+// core). Produces an object for every module. Like the whole program mode,
+// only main, the exported symbols and what other modules reference stay
+// visible outside each module.
+llvm::Error thin_link(const std::vector<ObjectBuffer> &bitcode,
+                      const std::vector<std::string> &names,
+                      const std::unordered_set<std::string> &exports,
+                      const TargetMachineFactory &create_target_machine,
+                      unsigned optimization_level,
+                      const ProfileOptions &profile, unsigned jobs,
+                      std::vector<ObjectBuffer> &objects);
@@ -1,37 +1,505 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <unordered_set>
 #include <vector>
 
+#include "cache.hpp"
 #include "codegen.hpp"
+#include "evaluator.hpp"
+#include "format.hpp"
+#include "generics.hpp"
+#include "incremental.hpp"
+#include "jit.hpp"
 #include "lexer.hpp"
+#include "linker.hpp"
+#include "lto.hpp"
+#include "memory.hpp"
 #include "parser.hpp"
+#include "purity.hpp"
+#include "profile.hpp"
+#include "timing.hpp"
+#include "vm.hpp"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/Host.h"
-#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
+
 using namespace llvm;
 
+static std::string host_cpu_features() {
+  SubtargetFeatures features;
+  StringMap<bool> host_features;
+
+  if (sys::getHostCPUFeatures(host_features)) {
+    for (const auto &feature : host_features) {
+      features.AddFeature(feature.first(), feature.second);
+    }
+  }
+
+  return features.getString();
+}
+
+static Optional<Reloc::Model> parse_relocation_model(const std::string &name,
+                                                     bool &valid) {
+  valid = true;
+  if (name == "static")
+    return Reloc::Static;
+  if (name == "pic")
+    return Reloc::PIC_;
+  if (name == "dynamic-no-pic")
+    return Reloc::DynamicNoPIC;
+  if (name == "default")
+    return None;
+
+  valid = false;
+  return None;
+}
+
+// A flag's count, which getAsInteger rejects if it isn't all digits or
+// doesn't fit
+template <typename T>
+static T parse_count(const std::string &text, bool &valid) {
+  T count = 0;
+  valid = !StringRef(text).getAsInteger(10, count);
+  return count;
+}
+
+static Optional<std::vector<char>>
+read_source(const std::filesystem::path &source_path) {
+  PhaseTimer timer("Read", source_path.string());
+
+  std::ifstream file(source_path);
+  file.ignore(std::numeric_limits<std::streamsize>::max());
+  auto length = file.gcount();
+  file.clear();
+  file.seekg(0, std::ios_base::beg);
+
+  std::vector<char> buffer(length);
+  if (!file.read(buffer.data(), length))
+    return None;
+
+  return buffer;
+}
+
+static ast::Program *parse_source(std::vector<char> buffer,
+                                  StringRef name) {
+  PhaseTimer timer("Parse", name);
+
+  // todo: is EOF _really_ necessary?
+  buffer.push_back((char)EOF);
+
+  Lexer lexer{&buffer, 0};
+  Parser parser(&lexer);
+
+  // Whatever parsing leaves allocated is the tree
+  auto before = allocation_counters();
+  auto program = parser.parse_program();
+  record_footprint("AST", name,
+                   allocation_counters().live_bytes - before.live_bytes,
+                   std::to_string(program->statements.size()) +
+                       " top level statements");
+
+  return program;
+}
+
+static ast::Program *parse_source(const std::filesystem::path &source_path) {
+  auto buffer = read_source(source_path);
+  if (!buffer)
+    return nullptr;
+
+  return parse_source(std::move(*buffer), source_path.string());
+}
+
+// Const variables are evaluated, and @pure and @memoize functions and prints
+// checked, before any backend sees the program
+static bool analyze_source(ast::Program &program, StringRef name) {
+  PhaseTimer timer("Analysis", name);
+
+  // Consts, purity and prints are checked on the specializations of generic
+  // functions, so those are made first
+  auto error = monomorphize(program);
+  if (!error) {
+    error = joinErrors(evaluate_constants(program), check_pure(program));
+    error = joinErrors(std::move(error), check_memoized(program));
+    error = joinErrors(std::move(error), check_prints(program));
+  }
+  if (error) {
+    errs() << toString(std::move(error));
+    return false;
+  }
+
+  return true;
+}
+
+// Analyzes every file once all of them are parsed, since calls from one file
+// into another are checked too
+static bool
+analyze_sources(const std::vector<ast::Program *> &programs,
+                const std::vector<std::filesystem::path> &source_inputs) {
+  if (auto error = check_generic_calls(programs)) {
+    errs() << toString(std::move(error));
+    return false;
+  }
+
+  for (size_t i = 0; i < programs.size(); ++i) {
+    if (!analyze_source(*programs[i], source_inputs[i].string()))
+      return false;
+  }
+
+  return true;
+}
+
+static int write_output(const std::filesystem::path &path,
+                        StringRef contents) {
+  std::error_code error_code;
+  raw_fd_ostream file(path.string(), error_code, sys::fs::OF_None);
+  if (error_code) {
+    errs() << "Could not open file: " << error_code.message();
+    return 1;
+  }
+
+  file << contents;
+  return 0;
+}
+
+// Timing reports are written however compilation ends, once every timer
+// has stopped
+class TimingReports {
+  bool time_report;
+  std::string trace_path;
+
+public:
+  TimingReports(bool time_report, std::string trace_path,
+                unsigned trace_granularity, StringRef process_name)
+      : time_report(time_report), trace_path(std::move(trace_path)) {
+    TimePassesIsEnabled = time_report;
+
+    if (!this->trace_path.empty())
+      timeTraceProfilerInitialize(trace_granularity, process_name);
+  }
+
+  ~TimingReports() {
+    // Includes LLVM's timing of each pass
+    if (time_report)
+      TimerGroup::printAll(errs());
+
+    if (trace_path.empty())
+      return;
+
+    if (auto error = timeTraceProfilerWrite(trace_path, "solar")) {
+      errs() << "Could not write the time trace: "
+             << toString(std::move(error)) << "\n";
+    }
+
+    timeTraceProfilerCleanup();
+  }
+};
+
+// Like timing reports, the memory report is written however compilation ends
+class MemoryReport {
+  bool enabled;
+
+public:
+  explicit MemoryReport(bool enabled) : enabled(enabled) {
+    if (enabled)
+      enable_memory_accounting();
+  }
+
+  ~MemoryReport() {
+    if (enabled)
+      print_memory_report(errs());
+  }
+};
+
+static void
+report_time_to_first_instruction(std::chrono::steady_clock::time_point start) {
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  errs() << "time to first instruction: "
+         << format("%.3f",
+                   std::chrono::duration<double, std::milli>(elapsed).count())
+         << " ms\n";
+}
+
+// Runs main on the bytecode interpreter, which skips LLVM entirely
+static int run_in_vm(const std::vector<std::filesystem::path> &source_inputs,
+                     bool report_startup,
+                     std::chrono::steady_clock::time_point start) {
+  std::vector<ast::Program *> sources;
+  for (const auto &source_path : source_inputs) {
+    auto source = parse_source(source_path);
+    if (!source)
+      return 66;
+
+    sources.push_back(source);
+  }
+
+  if (!analyze_sources(sources, source_inputs))
+    return 65;
+
+  ast::Program program;
+  for (const auto &source : sources) {
+    program.statements.insert(program.statements.end(),
+                              source->statements.begin(),
+                              source->statements.end());
+  }
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(program);
+  if (!bytecode) {
+    errs() << toString(bytecode.takeError());
+    return 1;
+  }
+
+  if (report_startup)
+    report_time_to_first_instruction(start);
+
+  vm::Interpreter interpreter;
+  auto exit_code = interpreter.run(**bytecode);
+  if (!exit_code) {
+    errs() << toString(exit_code.takeError()) << "\n";
+    return 70;
+  }
+
+  return (int)*exit_code;
+}
+
+static int run(const std::vector<std::filesystem::path> &source_inputs,
+               const std::vector<std::string> &program_arguments,
+               bool release, const CodeGenOptions &codegen_options,
+               bool lazy, unsigned compile_threads,
+               uint64_t tier_up_threshold, bool report_startup,
+               bool report_stats,
+               std::chrono::steady_clock::time_point start) {
+  auto jit = Jit::create(release, compile_threads);
+  if (!jit) {
+    errs() << toString(jit.takeError());
+    return 1;
+  }
+
+  (*jit)->codegen_options = codegen_options;
+
+  if (tier_up_threshold) {
+    if (auto error = (*jit)->enable_tiering(tier_up_threshold)) {
+      errs() << toString(std::move(error));
+      return 1;
+    }
+  }
+
+  // Every file is parsed up front so each can call functions of the others
+  std::vector<ast::Program *> programs;
+  for (const auto &source_path : source_inputs) {
+    auto program = parse_source(source_path);
+    if (!program)
+      return 66;
+
+    programs.push_back(program);
+  }
+
+  if (!analyze_sources(programs, source_inputs))
+    return 65;
+
+  for (size_t i = 0; i < source_inputs.size(); ++i) {
+    auto error =
+        lazy ? (*jit)->add_program_lazily(source_inputs[i], programs[i],
+                                          programs)
+             : (*jit)->add_program(source_inputs[i], programs[i], programs);
+    if (error) {
+      errs() << toString(std::move(error));
+      return 1;
+    }
+  }
+
+  std::vector<std::string> arguments{source_inputs.front().string()};
+  arguments.insert(arguments.end(), program_arguments.begin(),
+                   program_arguments.end());
+
+  auto main_function = (*jit)->lookup_main();
+  if (!main_function) {
+    errs() << toString(main_function.takeError());
+    return 1;
+  }
+
+  if (report_startup)
+    report_time_to_first_instruction(start);
+
+  auto exit_code = Jit::run_main(*main_function, arguments);
+
+  if (report_stats)
+    (*jit)->print_stats(errs());
+
+  return exit_code;
+}
+
 int main(int argc, char **argv) {
+  auto start = std::chrono::steady_clock::now();
   auto release = false;
+  CodeGenOptions codegen_options;
   auto dump = false;
+  auto compile_only = false;
+  auto whole_program = false;
+  auto thin_lto = false;
+  auto emit_bitcode = false;
+  unsigned link_jobs = 0;
+  auto use_cache = true;
+  auto report_cache_stats = false;
+  auto incremental = false;
+  ProfileOptions profile;
+  std::string profile_runtime;
+  auto time_report = false;
+  auto memory_report = false;
+  std::string time_trace_path;
+  unsigned time_trace_granularity = 500;
+  std::string cache_directory;
+  uint64_t cache_size_megabytes = 1024;
+  std::unordered_set<std::string> exports;
   std::string output;
+  std::string cpu = "generic";
+  std::string features;
+  auto relocation_model = Optional<Reloc::Model>();
   std::vector<std::filesystem::path> source_inputs;
 
+  // solar run <sources> [-- arguments] executes main in-process
+  auto run_mode = argc > 1 && std::string(argv[1]) == "run";
+  auto report_startup = false;
+  auto lazy = false;
+  unsigned compile_threads = 0;
+  auto tiered = false;
+  uint64_t tier_up_threshold = 1000;
+  auto report_stats = false;
+  auto use_vm = false;
+  std::vector<std::string> program_arguments;
+
   // todo: more robust argument parsing
   //  - forbid --dump and --output both being specified, etc
-  for (int i = 1; i < argc; ++i) {
+  for (int i = run_mode ? 2 : 1; i < argc; ++i) {
     std::string argument(argv[i]);
-    if (argument == "--dump") {
+    if (run_mode && argument == "--") {
+      program_arguments.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (argument == "--startup-time") {
+      report_startup = true;
+    } else if (argument == "--lazy") {
+      lazy = true;
+    } else if (argument.starts_with("--jit-threads=")) {
+      auto valid = false;
+      compile_threads = parse_count<unsigned>(
+          argument.substr(strlen("--jit-threads=")), valid);
+      if (!valid) {
+        errs() << "Expected a number of JIT threads";
+        return 64;
+      }
+    } else if (argument == "--tiered") {
+      tiered = true;
+    } else if (argument.starts_with("--tier-up-threshold=")) {
+      auto valid = false;
+      tier_up_threshold = parse_count<uint64_t>(
+          argument.substr(strlen("--tier-up-threshold=")), valid);
+      if (!valid) {
+        errs() << "Expected a number of calls to tier up after";
+        return 64;
+      }
+    } else if (argument == "--jit-stats") {
+      report_stats = true;
+    } else if (argument == "--vm") {
+      use_vm = true;
+    } else if (argument == "--dump") {
       dump = true;
+    } else if (argument == "--compile-only") {
+      compile_only = true;
+    } else if (argument == "--whole-program") {
+      whole_program = true;
+    } else if (argument == "--thin-lto") {
+      thin_lto = true;
+    } else if (argument.starts_with("--link-jobs=")) {
+      auto valid = false;
+      link_jobs =
+          parse_count<unsigned>(argument.substr(strlen("--link-jobs=")), valid);
+      if (!valid) {
+        errs() << "Expected a number of link jobs";
+        return 64;
+      }
+    } else if (argument == "--emit-bitcode") {
+      emit_bitcode = true;
+    } else if (argument == "--no-cache") {
+      use_cache = false;
+    } else if (argument == "--profile-generate") {
+      profile.generate = true;
+    } else if (argument.starts_with("--profile-generate=")) {
+      profile.generate = true;
+      profile.generate_path = argument.substr(strlen("--profile-generate="));
+    } else if (argument.starts_with("--profile-use=")) {
+      profile.use_path = argument.substr(strlen("--profile-use="));
+    } else if (argument.starts_with("--profile-runtime=")) {
+      profile_runtime = argument.substr(strlen("--profile-runtime="));
+    } else if (argument == "--time-report") {
+      time_report = true;
+    } else if (argument == "--mem-report") {
+      memory_report = true;
+    } else if (argument.starts_with("--time-trace=")) {
+      time_trace_path = argument.substr(strlen("--time-trace="));
+    } else if (argument.starts_with("--time-trace-granularity=")) {
+      // In microseconds, like clang's
+      auto valid = false;
+      time_trace_granularity = parse_count<unsigned>(
+          argument.substr(strlen("--time-trace-granularity=")), valid);
+      if (!valid) {
+        errs() << "Expected a time trace granularity in microseconds";
+        return 64;
+      }
+    } else if (argument == "--incremental") {
+      incremental = true;
+    } else if (argument == "--cache-stats") {
+      report_cache_stats = true;
+    } else if (argument.starts_with("--cache-dir=")) {
+      cache_directory = argument.substr(strlen("--cache-dir="));
+    } else if (argument.starts_with("--cache-size=")) {
+      // In megabytes
+      auto valid = false;
+      cache_size_megabytes = parse_count<uint64_t>(
+          argument.substr(strlen("--cache-size=")), valid);
+      if (!valid) {
+        errs() << "Expected a cache size in megabytes";
+        return 64;
+      }
+    } else if (argument.starts_with("--export=")) {
+      exports.insert(argument.substr(strlen("--export=")));
     } else if (argument == "--release") {
       release = true;
+    } else if (argument == "--no-bounds-checks") {
+      codegen_options.bounds_checks = false;
+    } else if (argument == "--wrapping-arithmetic") {
+      codegen_options.wrapping_arithmetic = true;
+    } else if (argument == "--fast-math") {
+      codegen_options.fast_math = true;
+    } else if (argument.starts_with("--fp-contract=")) {
+      auto mode = argument.substr(strlen("--fp-contract="));
+      if (mode != "fast" && mode != "off") {
+        errs() << "Expected an fp-contract mode of fast or off";
+        return 64;
+      }
+
+      codegen_options.fp_contract = mode == "fast";
+    } else if (argument == "--no-signed-zeros") {
+      codegen_options.no_signed_zeros = true;
+    } else if (argument == "--reassoc") {
+      codegen_options.reassociate = true;
+    } else if (argument == "--flush-denormals") {
+      codegen_options.flush_denormals = true;
     } else if (argument == "--output") {
       if (i + 1 == argc) {
         errs() << "Expected an output name";
@@ -40,6 +508,19 @@ int main(int argc, char **argv) {
 
       i += 1;
       output = std::string(argv[i]);
+    } else if (argument.starts_with("--target-cpu=")) {
+      cpu = argument.substr(strlen("--target-cpu="));
+    } else if (argument.starts_with("--target-features=")) {
+      features = argument.substr(strlen("--target-features="));
+    } else if (argument.starts_with("--reloc-model=")) {
+      auto valid = false;
+      relocation_model = parse_relocation_model(
+          argument.substr(strlen("--reloc-model=")), valid);
+      if (!valid) {
+        errs() << "Expected a relocation model of static, pic, "
+                  "dynamic-no-pic or default";
+        return 64;
+      }
     } else {
       source_inputs.emplace_back(argument);
     }
@@ -50,6 +531,37 @@ int main(int argc, char **argv) {
     return 64; //
   }
 
+  TimingReports timing_reports(time_report, time_trace_path,
+                               time_trace_granularity, argv[0]);
+  MemoryReport memory_reports(memory_report);
+
+  if (profile.generate && !profile.use_path.empty()) {
+    errs() << "Expected only one of --profile-generate and --profile-use";
+    return 64;
+  }
+
+  // The profile is part of every cache key, and read here once for them
+  std::string profile_contents;
+  if (!profile.use_path.empty()) {
+    auto profile_source = read_source(profile.use_path);
+    if (!profile_source) {
+      errs() << "Could not read profile " << profile.use_path;
+      return 66;
+    }
+
+    profile_contents.assign(profile_source->begin(), profile_source->end());
+  }
+
+  if (run_mode && use_vm)
+    return run_in_vm(source_inputs, report_startup, start);
+
+  if (run_mode)
+    // Tiering starts every function in the lazily compiled baseline tier
+    return run(source_inputs, program_arguments, release, codegen_options,
+               lazy || tiered, compile_threads,
+               tiered ? tier_up_threshold : 0, report_startup, report_stats,
+               start);
+
   // This could be more specific, which would be faster
   InitializeAllTargetInfos();
   InitializeAllTargets();
@@ -65,61 +577,112 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if (cpu == "native") {
+    cpu = sys::getHostCPUName().str();
+
+    // Explicit features are applied on top of the host's
+    auto host_features = host_cpu_features();
+    features = features.empty() ? host_features
+                                : host_features + "," + features;
+  }
+
+  // The backend optimizes as hard as the IR pipeline does
+  auto optimization_level =
+      release ? CodeGenOpt::Aggressive : CodeGenOpt::None;
+
   TargetOptions opt;
-  auto cpu = "generic";
-  auto features = "";
-  auto relocation_model = Optional<Reloc::Model>();
-  auto target_machine = target->createTargetMachine(
-      target_triple, cpu, features, opt, relocation_model);
 
-  std::ostringstream linker_command;
-  linker_command << "ld";
+  // Each function and global gets its own section so the linker can drop
+  // the unreferenced ones
+  opt.FunctionSections = release;
+  opt.DataSections = release;
 
-  for (const auto &source_path : source_inputs) {
-    std::ifstream file(source_path);
-    file.ignore(std::numeric_limits<std::streamsize>::max());
-    auto length = file.gcount();
-    file.clear();
-    file.seekg(0, std::ios_base::beg);
-
-    std::vector<char> buffer(length);
-    if (!file.read(buffer.data(), length))
-      return 66;
+  auto target_machine =
+      target->createTargetMachine(target_triple, cpu, features, opt,
+                                  relocation_model, None, optimization_level);
+
+  // LLVM only warns about a CPU it doesn't know, then generates code for
+  // the generic one
+  if (!target_machine->getMCSubtargetInfo()->isCPUStringValid(cpu)) {
+    errs() << "Expected a target CPU that " << target_triple
+           << " knows, not " << cpu;
+    return 64;
+  }
 
-    // todo: is EOF _really_ necessary?
-    buffer.push_back((char)EOF);
+  // Code generation sets the target on the functions it declares, so the
+  // function passes see it too. The rest, like print's routines, get it
+  // here, so it survives into anything else that reads the module.
+  codegen_options.target_cpu = cpu;
+  codegen_options.target_features = features;
+  auto prepare = [&](Module &module) {
+    module.setDataLayout(target_machine->createDataLayout());
+    module.setTargetTriple(target_triple);
+
+    for (auto &function : module) {
+      if (function.isDeclaration())
+        continue;
+
+      function.addFnAttr("target-cpu", cpu);
+      if (!features.empty())
+        function.addFnAttr("target-features", features);
+    }
+  };
 
-    Lexer lexer{&buffer, 0};
-    Parser parser(&lexer);
+  // Whatever code generation leaves allocated is the module, along with the
+  // types and constants its context keeps
+  auto record_module = [](const Module &module, int64_t live_before) {
+    record_footprint("Module", module.getModuleIdentifier(),
+                     allocation_counters().live_bytes - live_before,
+                     describe_size(module));
+  };
 
-    auto program = parser.parse_program();
+  // Files compiled on their own only get a module pipeline for profile
+  // guided optimization, which needs one to instrument or read profiles
+  auto optimize = [&](Module &module) {
+    if (!profile.enabled())
+      return;
 
-    CodeGen generator;
-    auto module = generator.compile_module(source_path, program, release);
+    PhaseTimer timer("Optimize", module.getModuleIdentifier());
 
-    module->setDataLayout(target_machine->createDataLayout());
-    module->setTargetTriple(target_triple);
+    legacy::PassManager passes;
+    populate_module_passes(passes, release ? 3 : 0, profile);
+    passes.run(module);
+  };
 
-    std::filesystem::path object_file_path(source_path);
-    object_file_path.replace_extension("o");
+  std::vector<ObjectBuffer> objects;
 
-    linker_command << " " << object_file_path.string();
+  // Bitcode is kept for the thin link, or written next to the sources
+  std::vector<ObjectBuffer> bitcode;
+  std::vector<std::string> bitcode_names;
 
+  auto emit = [&](Module &module, std::filesystem::path output_path) {
     if (dump) {
-      module->print(outs(), nullptr);
+      module.print(outs(), nullptr);
       outs() << "\n";
-      continue;
+      return 0;
     }
 
-    std::error_code error_code;
-    raw_fd_ostream dest(object_file_path.string(), error_code,
-                        sys::fs::OF_None);
+    PhaseTimer timer("Emit", module.getModuleIdentifier());
 
-    if (error_code) {
-      errs() << "Could not open file: " << error_code.message();
-      return 1;
+    if (thin_lto || emit_bitcode) {
+      bitcode.emplace_back();
+      bitcode_names.push_back(module.getModuleIdentifier());
+      raw_svector_ostream stream(bitcode.back());
+
+      if (thin_lto)
+        write_thin_lto_bitcode(module, stream);
+      else
+        WriteBitcodeToFile(module, stream);
+
+      if (!emit_bitcode)
+        return 0;
+
+      return write_output(output_path.replace_extension("bc"), stream.str());
     }
 
+    objects.emplace_back();
+    raw_svector_ostream dest(objects.back());
+
     legacy::PassManager pass;
     if (target_machine->addPassesToEmitFile(pass, dest, nullptr,
                                             CGFT_ObjectFile)) {
@@ -127,21 +690,269 @@ int main(int argc, char **argv) {
       return 1;
     }
 
-    pass.run(*module);
-    dest.flush();
+    pass.run(module);
+
+    // Objects are only written out when something else will link them
+    if (compile_only)
+      return write_output(output_path.replace_extension("o"), dest.str());
+
+    return 0;
+  };
+
+  std::vector<std::vector<char>> sources;
+  for (const auto &source_path : source_inputs) {
+    auto source = read_source(source_path);
+    if (!source)
+      return 66;
+
+    sources.push_back(std::move(*source));
+  }
+
+  // Only objects compiled a file at a time are cached
+  std::unique_ptr<CompilationCache> cache;
+  if (use_cache && !dump && !whole_program && !thin_lto && !emit_bitcode) {
+    cache = std::make_unique<CompilationCache>(
+        cache_directory.empty() ? CompilationCache::default_directory()
+                                : std::filesystem::path(cache_directory),
+        cache_size_megabytes * 1024 * 1024);
+  }
+
+  // Functions are compiled and cached one at a time, which only works when
+  // the objects go straight to the linker
+  incremental = incremental && cache && !compile_only;
+
+  std::string configuration_digest;
+  std::vector<std::string> cache_keys;
+  std::vector<Optional<ObjectBuffer>> cached_objects(source_inputs.size());
+  if (cache) {
+    CacheKey configuration;
+    configuration.add(CompilationCache::compiler_identity())
+        .add(target_triple)
+        .add(cpu)
+        .add(features)
+        .add(relocation_model ? std::to_string(*relocation_model) : "default")
+        .add(release ? "release" : "debug")
+        .add(codegen_options.bounds_checks ? "" : "no-bounds-checks")
+        .add(codegen_options.wrapping_arithmetic ? "wrapping-arithmetic" : "")
+        .add(codegen_options.fast_math ? "fast-math" : "")
+        .add(codegen_options.fp_contract ? "fp-contract=fast" : "")
+        .add(codegen_options.no_signed_zeros ? "no-signed-zeros" : "")
+        .add(codegen_options.reassociate ? "reassoc" : "")
+        .add(codegen_options.flush_denormals ? "flush-denormals" : "")
+        .add(profile.generate ? "generate:" + profile.generate_path : "")
+        .add(profile_contents);
+
+    configuration_digest = configuration.digest();
+
+    // A file's object also depends on the prototypes of the others, so
+    // every source is part of every key
+    CacheKey sources_key;
+    sources_key.add(configuration_digest);
+    for (const auto &source : sources)
+      sources_key.add(StringRef(source.data(), source.size()));
+
+    auto sources_digest = sources_key.digest();
+
+    for (size_t i = 0; i < source_inputs.size() && !incremental; ++i) {
+      CacheKey key;
+      cache_keys.push_back(
+          key.add(sources_digest).add(source_inputs[i].string()).digest());
+      cached_objects[i] = cache->lookup(cache_keys.back());
+    }
+  }
+
+  // Every file is parsed up front so each can call functions of the others,
+  // unless every object came from the cache
+  std::vector<ast::Program *> programs;
+  auto all_cached = cache && !incremental && std::all_of(cached_objects.begin(),
+                                         cached_objects.end(),
+                                         [](const auto &object) {
+                                           return object.hasValue();
+                                         });
+  if (!all_cached) {
+    for (size_t i = 0; i < sources.size(); ++i) {
+      programs.push_back(
+          parse_source(std::move(sources[i]), source_inputs[i].string()));
+    }
+
+    if (!analyze_sources(programs, source_inputs))
+      return 65;
+  }
+
+  // Each function gets its own object, which is reused for as long as its
+  // structural hash stays the same
+  auto signatures = collect_signatures(programs);
+  auto compile_functions = [&](size_t i) {
+    for (const auto &statement : programs[i]->statements) {
+      auto function = dynamic_cast<ast::Function *>(statement);
+      if (!function)
+        continue;
+
+      CacheKey key;
+      auto function_key =
+          key.add(configuration_digest)
+              .add(source_inputs[i].string())
+              .add(structural_hash(
+                  *function, signatures, !release,
+                  collect_declarations(*programs[i], programs),
+                  prints(programs[i], programs)))
+              .digest();
+
+      if (auto object = cache->lookup(function_key)) {
+        objects.push_back(std::move(*object));
+        continue;
+      }
+
+      auto live_before = allocation_counters().live_bytes;
+      CodeGen generator;
+      generator.options = codegen_options;
+      std::unique_ptr<Module> module(generator.compile_function(
+          source_inputs[i], programs[i], *function, release, programs));
+      for (const auto &warning : generator.warnings)
+        errs() << warning << "\n";
+      prepare(*module);
+      record_module(*module, live_before);
+      optimize(*module);
+
+      if (auto status = emit(*module, source_inputs[i]))
+        return status;
+
+      if (auto error = cache->store(function_key, objects.back())) {
+        errs() << "Could not cache " << function->prototype.name.lexeme
+               << ": " << toString(std::move(error)) << "\n";
+      }
+    }
+
+    return 0;
+  };
+
+  if (whole_program) {
+    // Linked modules have to share a context
+    LLVMContext context;
+    std::vector<std::unique_ptr<Module>> modules;
+
+    for (size_t i = 0; i < source_inputs.size(); ++i) {
+      auto live_before = allocation_counters().live_bytes;
+      CodeGen generator(&context);
+      generator.options = codegen_options;
+      modules.emplace_back(generator.compile_module(
+          source_inputs[i], programs[i], release, programs));
+      prepare(*modules.back());
+      record_module(*modules.back(), live_before);
+    }
+
+    auto module =
+        link_whole_program(std::move(modules), exports, release, profile);
+    if (!module) {
+      errs() << toString(module.takeError()) << "\n";
+      return 1;
+    }
+
+    if (auto status = emit(**module, output.empty() ? "program" : output))
+      return status;
+  } else {
+    for (size_t i = 0; i < source_inputs.size(); ++i) {
+      TimeTraceScope file_trace("CompileFile", source_inputs[i].string());
+
+      if (cached_objects[i]) {
+        objects.push_back(std::move(*cached_objects[i]));
+
+        if (!compile_only)
+          continue;
+
+        auto object_path = source_inputs[i];
+        auto status = write_output(object_path.replace_extension("o"),
+                                   StringRef(objects.back().data(),
+                                             objects.back().size()));
+        if (status)
+          return status;
+
+        continue;
+      }
+
+      if (incremental) {
+        if (auto status = compile_functions(i))
+          return status;
+
+        continue;
+      }
+
+      auto live_before = allocation_counters().live_bytes;
+      CodeGen generator;
+      generator.options = codegen_options;
+      std::unique_ptr<Module> module(generator.compile_module(
+          source_inputs[i], programs[i], release, programs));
+      prepare(*module);
+      record_module(*module, live_before);
+      optimize(*module);
+
+      if (auto status = emit(*module, source_inputs[i]))
+        return status;
+
+      // A cache that can't be written only costs a later rebuild
+      if (cache) {
+        if (auto error = cache->store(cache_keys[i], objects.back())) {
+          errs() << "Could not cache " << source_inputs[i].string() << ": "
+                 << toString(std::move(error)) << "\n";
+        }
+      }
+    }
   }
 
-  linker_command << " -o";
-  linker_command << " " << (output.empty() ? "program" : output);
-  linker_command << " -lSystem";
-  linker_command << " -L$(xcode-select -p)/SDKs/MacOSX.sdk/usr/lib";
+  if (cache) {
+    cache->evict();
 
-  if (dump) {
-    std::cout << "Linker line: " << linker_command.str() << std::endl;
+    if (report_cache_stats)
+      cache->print_stats(errs());
+  }
+
+  if (dump || compile_only || emit_bitcode)
     return 0;
+
+  if (thin_lto) {
+    PhaseTimer timer("ThinLink");
+
+    auto create_target_machine = [&] {
+      return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+          target_triple, cpu, features, opt, relocation_model, None,
+          optimization_level));
+    };
+
+    auto error = thin_link(bitcode, bitcode_names, exports,
+                           create_target_machine, release ? 3 : 0, profile,
+                           link_jobs, objects);
+    if (error) {
+      errs() << toString(std::move(error)) << "\n";
+      return 1;
+    }
   }
 
-  system(linker_command.str().c_str());
+  // Instrumented programs write their profile through compiler-rt
+  std::vector<std::string> libraries;
+  std::vector<std::string> undefined;
+  if (profile.generate) {
+    if (profile_runtime.empty()) {
+      auto runtime = find_profile_runtime();
+      if (!runtime) {
+        errs() << toString(runtime.takeError()) << "\n";
+        return 1;
+      }
+
+      profile_runtime = *runtime;
+    }
+
+    libraries.push_back(profile_runtime);
+    undefined.emplace_back(profile_runtime_symbol);
+  }
+
+  PhaseTimer link_timer("Link");
+
+  auto output_path = output.empty() ? "program" : output;
+  if (auto error = link_executable(objects, output_path, release, libraries,
+                                   undefined)) {
+    errs() << toString(std::move(error)) << "\n";
+    return 1;
+  }
 
   return 0;
 }
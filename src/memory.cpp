@@ -0,0 +1,200 @@
+#include "memory.hpp"
+
+#include "llvm/Support/Format.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define SOLAR_ALLOCATION_SIZE(pointer) malloc_size(pointer)
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define SOLAR_ALLOCATION_SIZE(pointer) malloc_usable_size(pointer)
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace llvm;
+
+// Relaxed loads of the flag keep the allocator fast when accounting is off
+static std::atomic<bool> accounting{false};
+static std::atomic<uint64_t> allocations{0};
+static std::atomic<uint64_t> allocated_bytes{0};
+static std::atomic<int64_t> live_bytes{0};
+
+void count_allocation(void *pointer, size_t size) {
+  if (!accounting.load(std::memory_order_relaxed) || !pointer)
+    return;
+
+#ifdef SOLAR_ALLOCATION_SIZE
+  size = SOLAR_ALLOCATION_SIZE(pointer);
+#endif
+
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+}
+
+void count_free(void *pointer) {
+#ifdef SOLAR_ALLOCATION_SIZE
+  if (accounting.load(std::memory_order_relaxed) && pointer) {
+    live_bytes.fetch_sub((int64_t)SOLAR_ALLOCATION_SIZE(pointer),
+                         std::memory_order_relaxed);
+  }
+#endif
+}
+
+void enable_memory_accounting() { accounting.store(true); }
+
+bool memory_accounting_enabled() {
+  return accounting.load(std::memory_order_relaxed);
+}
+
+AllocationCounters allocation_counters() {
+  AllocationCounters counters;
+  counters.allocations = allocations.load(std::memory_order_relaxed);
+  counters.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+  counters.live_bytes = live_bytes.load(std::memory_order_relaxed);
+  return counters;
+}
+
+uint64_t peak_resident_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+#if defined(__APPLE__)
+  return usage.ru_maxrss;
+#else
+  // Linux reports kilobytes
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+struct PhaseMemory {
+  std::string phase;
+  uint64_t entries = 0;
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  int64_t live_bytes = 0;
+
+  // How far the phase raised the peak, and where the peak stood after it
+  uint64_t peak_growth = 0;
+  uint64_t peak = 0;
+};
+
+struct Footprint {
+  std::string kind;
+  std::string name;
+  int64_t live_bytes;
+  std::string detail;
+};
+
+static std::mutex report_mutex;
+static std::vector<PhaseMemory> phases;
+static std::vector<Footprint> footprints;
+
+MemoryScope::MemoryScope(StringRef phase) : phase(phase) {
+  if (!memory_accounting_enabled())
+    return;
+
+  start = allocation_counters();
+  start_peak = peak_resident_bytes();
+}
+
+MemoryScope::~MemoryScope() {
+  if (!memory_accounting_enabled())
+    return;
+
+  auto end = allocation_counters();
+  auto end_peak = peak_resident_bytes();
+
+  std::lock_guard<std::mutex> lock(report_mutex);
+
+  auto entry = std::find_if(
+      phases.begin(), phases.end(),
+      [&](const PhaseMemory &memory) { return memory.phase == phase; });
+  if (entry == phases.end()) {
+    phases.push_back({phase.str()});
+    entry = phases.end() - 1;
+  }
+
+  entry->entries += 1;
+  entry->allocations += end.allocations - start.allocations;
+  entry->allocated_bytes += end.allocated_bytes - start.allocated_bytes;
+  entry->live_bytes += end.live_bytes - start.live_bytes;
+  entry->peak_growth += end_peak - start_peak;
+  entry->peak = std::max(entry->peak, end_peak);
+}
+
+void record_footprint(StringRef kind, StringRef name, int64_t live_bytes,
+                      const std::string &detail) {
+  if (!memory_accounting_enabled())
+    return;
+
+  std::lock_guard<std::mutex> lock(report_mutex);
+  footprints.push_back({kind.str(), name.str(), live_bytes, detail});
+}
+
+std::string describe_size(const Module &module) {
+  size_t functions = 0;
+  size_t blocks = 0;
+  size_t instructions = 0;
+  for (const auto &function : module) {
+    if (function.isDeclaration())
+      continue;
+
+    functions += 1;
+    blocks += function.size();
+    instructions += function.getInstructionCount();
+  }
+
+  return std::to_string(functions) + " functions, " + std::to_string(blocks) +
+         " blocks, " + std::to_string(instructions) + " instructions, " +
+         std::to_string(module.global_size()) + " globals";
+}
+
+static double mebibytes(int64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+void print_memory_report(raw_ostream &stream) {
+  std::lock_guard<std::mutex> lock(report_mutex);
+
+  stream << "===-------------------------------------------------------------"
+            "------------===\n";
+  stream << "                        Memory use by compiler phase\n";
+  stream << "===-------------------------------------------------------------"
+            "------------===\n";
+  stream << "  Peak resident: "
+         << format("%.2f", mebibytes(peak_resident_bytes())) << " MiB\n\n";
+
+  // Nested phases are included in the phases around them, so the columns
+  // don't add up to a total
+  stream << "  Phase            Allocs    Alloc MiB     Live MiB    Peak +MiB"
+            "     Peak MiB\n";
+  for (const auto &phase : phases) {
+    stream << format("  %-10s %12llu %12.2f %12.2f %12.2f %12.2f\n",
+                     phase.phase.c_str(),
+                     (unsigned long long)phase.allocations,
+                     mebibytes(phase.allocated_bytes),
+                     mebibytes(phase.live_bytes),
+                     mebibytes(phase.peak_growth), mebibytes(phase.peak));
+  }
+
+  if (footprints.empty())
+    return;
+
+  stream << "\n  Live after each phase:\n";
+  for (const auto &footprint : footprints) {
+    stream << format("  %-8s %10.1f KiB  ", footprint.kind.c_str(),
+                     footprint.live_bytes / 1024.0)
+           << footprint.name << " (" << footprint.detail << ")\n";
+  }
+}
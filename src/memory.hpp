@@ -0,0 +1,53 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+
+// The solar executable replaces the global operator new and delete to count
+// allocations (see allocator.cpp), which programs linking solar_lib are left
+// to do or not. Counting only starts once memory accounting is enabled, and
+// sizes come from the allocator itself, so it costs next to nothing until then.
+struct AllocationCounters {
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+
+  // Allocated less freed, since accounting was enabled
+  int64_t live_bytes = 0;
+};
+
+// Called by the replacement operator new and delete
+void count_allocation(void *pointer, size_t size);
+void count_free(void *pointer);
+
+void enable_memory_accounting();
+bool memory_accounting_enabled();
+AllocationCounters allocation_counters();
+
+// The most resident memory the process has used so far
+uint64_t peak_resident_bytes();
+
+// Accounts the allocations made during a phase of compilation, including
+// those of any phase nested in it, for --mem-report
+class MemoryScope {
+  llvm::StringRef phase;
+  AllocationCounters start;
+  uint64_t start_peak = 0;
+
+public:
+  explicit MemoryScope(llvm::StringRef phase);
+  ~MemoryScope();
+};
+
+// Records how much of the heap something built during compilation keeps
+// alive, like a source's AST or its module, for --mem-report
+void record_footprint(llvm::StringRef kind, llvm::StringRef name,
+                      int64_t live_bytes, const std::string &detail);
+
+// Counts what makes up a module, as a detail for its footprint
+std::string describe_size(const llvm::Module &);
+
+void print_memory_report(llvm::raw_ostream &);
@@ -1,5 +1,6 @@
 #include "parser.hpp"
 #include <cassert>
+#include <set>
 #include <sstream>
 
 using namespace ast;
@@ -17,12 +18,15 @@ Parser::Parser(Lexer* lexer)
         { Token::Kind::LESS, ParseRule { nullptr, &Parser::binary, Precedence::INEQUALITY } },
         { Token::Kind::LESS_EQUAL, ParseRule { nullptr, &Parser::binary, Precedence::INEQUALITY } },
         { Token::Kind::LPAREN, ParseRule { &Parser::grouping, &Parser::call, Precedence::CALL } },
+        { Token::Kind::LBRACKET, ParseRule { &Parser::array, &Parser::index, Precedence::CALL } },
+        { Token::Kind::DOT, ParseRule { nullptr, &Parser::member, Precedence::CALL } },
         { Token::Kind::MINUS, ParseRule { nullptr, &Parser::binary, Precedence::TERM } },
         { Token::Kind::NOT_EQUAL, ParseRule { nullptr, &Parser::binary, Precedence::EQUALS } },
         { Token::Kind::NUMBER, ParseRule { &Parser::number, nullptr, Precedence::NONE } },
         { Token::Kind::PLUS, ParseRule { nullptr, &Parser::binary, Precedence::TERM } },
         { Token::Kind::STAR, ParseRule { nullptr, &Parser::binary, Precedence::FACTOR } },
         { Token::Kind::SLASH, ParseRule { nullptr, &Parser::binary, Precedence::FACTOR } },
+        { Token::Kind::PERCENT, ParseRule { nullptr, &Parser::binary, Precedence::FACTOR } },
         { Token::Kind::STRING, ParseRule { &Parser::str, nullptr, Precedence::NONE } },
         { Token::Kind::RETURN, ParseRule { &Parser::ret, nullptr, Precedence::NONE } },
     }
@@ -36,8 +40,13 @@ Program *Parser::parse_program() {
 
   vector<Statement *> statements;
   while (current.kind != Token::Kind::END) {
-    statements.emplace_back((Statement *)statement());
-    advance();
+    auto parsed = (Statement *)statement();
+    statements.emplace_back(parsed);
+
+    // Functions stop at their closing brace, but declarations stop at the
+    // token after their initializer
+    if (!dynamic_cast<VariableDeclaration *>(parsed))
+      advance();
   }
 
   return new Program{statements};
@@ -192,6 +201,9 @@ Node *Parser::binary(Node *left) {
   case Token::Kind::SLASH:
     operation = Operation::DIVIDE;
     break;
+  case Token::Kind::PERCENT:
+    operation = Operation::REMAINDER;
+    break;
   case Token::Kind::LESS:
     operation = Operation::COMPARE_IS_LESS;
     break;
@@ -233,6 +245,17 @@ Node *Parser::function() {
   type.name = current;
   type.parameter_list = vector<Parameter>();
   advance();
+  if (current.kind == Token::Kind::LESS) {
+    advance();
+    do {
+      if (!type.type_parameters.empty())
+        consume(Token::Kind::COMMA, "Expected ',' between type parameters");
+      type.type_parameters.push_back(current);
+      consume(Token::Kind::IDENTIFIER, "Expected a type parameter name");
+    } while (current.kind != Token::Kind::GREATER &&
+             current.kind != Token::Kind::END);
+    consume(Token::Kind::GREATER, "Expected '>' after type parameters");
+  }
   consume(Token::Kind::LPAREN, "Expected '('");
   while (current.kind != Token::Kind::RPAREN) {
     if (!type.parameter_list.empty() && current.kind == Token::Kind::COMMA)
@@ -243,9 +266,7 @@ Node *Parser::function() {
             "Expected a name for a function parameter");
     consume(Token::Kind::COLON,
             "Expected a colon after function parameter name");
-    auto parameter_type = current;
-    consume(Token::Kind::IDENTIFIER,
-            "Expected a type name for a function parameter");
+    auto parameter_type = this->type();
     type.parameter_list.emplace_back(parameter_name, parameter_type);
   }
   consume(Token::Kind::RPAREN, "Expected ')'");
@@ -254,8 +275,7 @@ Node *Parser::function() {
   auto return_type = Token(Token::Kind::IDENTIFIER, "Void", current.position);
   if (current.kind == Token::Kind::ARROW) {
     advance();
-    return_type = current;
-    consume(Token::Kind::IDENTIFIER, "Expected a return type");
+    return_type = this->type();
   }
   type.return_type = return_type;
 
@@ -283,8 +303,21 @@ Node *Parser::statement() {
     return ret();
   case Token::Kind::VAR:
     return assignment();
+  case Token::Kind::WHILE:
+    return while_loop({});
+  case Token::Kind::FOR:
+    return for_loop({});
+  case Token::Kind::AT:
+    return annotated();
+  case Token::Kind::CONST:
+    return constant();
+  case Token::Kind::STRUCT:
+    return structure({});
   default:
     auto expr = (Expression *)expression(Precedence::ASSIGNMENT);
+    if (current.kind == Token::Kind::ASSIGN)
+      return reassignment(expr);
+
     return new ExpressionStatement(expr);
   }
 }
@@ -325,8 +358,7 @@ ast::Node *Parser::assignment() {
   consume(Token::Kind::IDENTIFIER, "Expected a variable name");
   consume(Token::Kind::COLON,
           "Expected a colon between variable name and type");
-  auto type = current;
-  consume(Token::Kind::IDENTIFIER, "Expected a type name");
+  auto type = this->type();
   consume(Token::Kind::ASSIGN, "Expected an initializer");
   auto initializer =
       dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
@@ -334,6 +366,364 @@ ast::Node *Parser::assignment() {
   return new VariableDeclaration(position, name, type, initializer);
 }
 
+ast::Node *Parser::reassignment(Expression *target) {
+  auto position = current.position;
+  consume(Token::Kind::ASSIGN, "Expected '=' for an assignment");
+
+  auto index = dynamic_cast<Index *>(target);
+  if (!dynamic_cast<Variable *>(target) && !(index && !index->end) &&
+      !dynamic_cast<Member *>(target)) {
+    error("Only variables, elements and fields can be assigned to");
+    delete target;
+    return nullptr;
+  }
+
+  auto value = dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
+  return new Assignment(position, target, value);
+}
+
+ast::Node *Parser::while_loop(std::vector<Attribute> attributes) {
+  auto position = current.position;
+  consume(Token::Kind::WHILE, "Expected a while keyword");
+
+  auto condition =
+      dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
+  auto loop = new While(position, condition);
+  loop->attributes = std::move(attributes);
+  loop->body = (Block *)block();
+  consume(Token::Kind::RBRACE, "'}' expected after while body.");
+
+  return loop;
+}
+
+ast::Node *Parser::for_loop(std::vector<Attribute> attributes) {
+  auto position = current.position;
+  consume(Token::Kind::FOR, "Expected a for keyword");
+
+  auto variable = current;
+  consume(Token::Kind::IDENTIFIER, "Expected a loop variable name");
+  consume(Token::Kind::IN, "Expected in after the loop variable");
+
+  auto start = dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
+  consume(Token::Kind::DOT_DOT, "Expected '..' between a range's bounds");
+  auto end = dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
+
+  auto loop = new For(position, variable, start, end);
+  loop->attributes = std::move(attributes);
+  loop->body = (Block *)block();
+  consume(Token::Kind::RBRACE, "'}' expected after for body.");
+
+  return loop;
+}
+
+// Attributes apply to loops, where they're hints, to functions and to
+// structs, where they control the layout
+ast::Node *Parser::annotated() {
+  auto attributes = this->attributes();
+
+  switch (current.kind) {
+  case Token::Kind::WHILE:
+    check_loop_hints(attributes);
+    return while_loop(std::move(attributes));
+  case Token::Kind::FOR:
+    check_loop_hints(attributes);
+    return for_loop(std::move(attributes));
+  case Token::Kind::FUNC:
+  case Token::Kind::CONST: {
+    check_function_attributes(attributes);
+    auto node = current.kind == Token::Kind::CONST ? constant() : function();
+    auto function = dynamic_cast<Function *>(node);
+    if (!function) {
+      error("Expected a loop, a function or a struct after attributes");
+      return node;
+    }
+
+    function->prototype.attributes = std::move(attributes);
+    return function;
+  }
+  case Token::Kind::STRUCT:
+    check_struct_attributes(attributes);
+    return structure(std::move(attributes));
+  default:
+    error("Expected a loop, a function or a struct after attributes");
+    return statement();
+  }
+}
+
+// const func and const var
+ast::Node *Parser::constant() {
+  consume(Token::Kind::CONST, "Expected a const keyword");
+
+  switch (current.kind) {
+  case Token::Kind::FUNC: {
+    auto function = (Function *)this->function();
+    function->prototype.is_const = true;
+    return function;
+  }
+  case Token::Kind::VAR: {
+    auto declaration = (VariableDeclaration *)assignment();
+    declaration->is_const = true;
+    return declaration;
+  }
+  default:
+    error("Expected func or var after const");
+    return statement();
+  }
+}
+
+std::vector<Attribute> Parser::attributes() {
+  std::vector<Attribute> attributes;
+  while (current.kind == Token::Kind::AT) {
+    Attribute attribute{current.position, Token(), {}};
+    advance();
+
+    attribute.name = current;
+    consume(Token::Kind::IDENTIFIER, "Expected an attribute name after '@'");
+
+    if (current.kind == Token::Kind::LPAREN) {
+      advance();
+      while (current.kind != Token::Kind::RPAREN &&
+             current.kind != Token::Kind::END) {
+        if (!attribute.arguments.empty() &&
+            current.kind == Token::Kind::COMMA)
+          advance();
+
+        attribute.arguments.push_back(current);
+        advance();
+      }
+      consume(Token::Kind::RPAREN, "Expected ')' after attribute arguments");
+    }
+
+    attributes.push_back(std::move(attribute));
+  }
+
+  return attributes;
+}
+
+// @unroll and @vectorize take an optional count, @unroll(1) and
+// @vectorize(1) turn them off
+void Parser::check_loop_hints(const std::vector<Attribute> &hints) {
+  for (const auto &hint : hints) {
+    if (hint.name.lexeme != "unroll" && hint.name.lexeme != "vectorize") {
+      error(hint.name, "Unknown loop hint @" + hint.name.lexeme);
+      continue;
+    }
+
+    if (hint.arguments.size() > 1 ||
+        (hint.arguments.size() == 1 &&
+         (hint.arguments[0].kind != Token::Kind::NUMBER ||
+          hint.arguments[0].lexeme.find_first_not_of("0123456789") !=
+              string::npos ||
+          stoul(hint.arguments[0].lexeme) == 0))) {
+      error(hint.name, "Expected a positive count for @" + hint.name.lexeme);
+    }
+  }
+}
+
+// @fastmath takes the fast math flags it allows (all of them when it has
+// none), and @memoize the number of results it caches and whether the cache
+// is thread safe. A function can't be both inlined and not, or both hot and
+// cold.
+void Parser::check_function_attributes(
+    const std::vector<Attribute> &attributes) {
+  const std::vector<std::pair<std::string, std::string>> conflicts{
+      {"inline", "noinline"}, {"hot", "cold"}};
+  const std::set<std::string> fast_math_flags{
+      "reassoc", "contract", "nsz", "nnan", "ninf", "arcp", "afn"};
+
+  for (const auto &attribute : attributes) {
+    const auto &name = attribute.name.lexeme;
+    if (name != "inline" && name != "noinline" && name != "hot" &&
+        name != "cold" && name != "pure" && name != "flatten" &&
+        name != "fastmath" && name != "memoize") {
+      error(attribute.name, "Unknown function attribute @" + name);
+      continue;
+    }
+
+    if (name == "fastmath") {
+      for (const auto &flag : attribute.arguments) {
+        if (!fast_math_flags.count(flag.lexeme))
+          error(flag, "Unknown fast math flag " + flag.lexeme);
+      }
+    } else if (name == "memoize") {
+      for (const auto &argument : attribute.arguments) {
+        auto is_count =
+            argument.lexeme.find_first_not_of("0123456789") == string::npos &&
+            stoull(argument.lexeme) != 0;
+        if (!is_count && argument.lexeme != "threadsafe")
+          error(argument, "Expected a positive count or threadsafe for "
+                          "@memoize");
+      }
+    } else if (!attribute.arguments.empty()) {
+      error(attribute.name, "Expected no arguments for @" + name);
+    }
+
+    for (const auto &[first, second] : conflicts) {
+      if (name != first)
+        continue;
+
+      for (const auto &other : attributes) {
+        if (other.name.lexeme == second)
+          error(other.name, "@" + first + " and @" + second + " conflict");
+      }
+    }
+  }
+}
+
+// @align takes a power of two number of bytes. Packed structs are aligned
+// to a byte, so they can't be @align'd too.
+void Parser::check_struct_attributes(
+    const std::vector<Attribute> &attributes) {
+  auto packed = false, aligned = false;
+  for (const auto &attribute : attributes) {
+    const auto &name = attribute.name.lexeme;
+    if (name != "packed" && name != "align" && name != "soa") {
+      error(attribute.name, "Unknown struct attribute @" + name);
+      continue;
+    }
+
+    packed |= name == "packed";
+    aligned |= name == "align";
+    if (name != "align") {
+      if (!attribute.arguments.empty())
+        error(attribute.name, "@" + name + " doesn't take arguments");
+      continue;
+    }
+
+    const auto &arguments = attribute.arguments;
+    auto is_number =
+        arguments.size() == 1 && arguments[0].lexeme.size() < 10 &&
+        arguments[0].lexeme.find_first_not_of("0123456789") == string::npos;
+    auto alignment = is_number ? stoul(arguments[0].lexeme) : 0;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+      error(attribute.name, "Expected a power of two alignment for @align");
+  }
+
+  if (packed && aligned)
+    error("A struct can't be both @packed and @align");
+}
+
+ast::Node *Parser::array() {
+  auto position = previous.position;
+
+  std::vector<Expression *> elements;
+  while (current.kind != Token::Kind::RBRACKET &&
+         current.kind != Token::Kind::END) {
+    if (!elements.empty() && current.kind == Token::Kind::COMMA)
+      advance();
+
+    elements.push_back(
+        dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT)));
+
+    if (current.kind == Token::Kind::SEMICOLON)
+      break;
+  }
+
+  auto literal = new ArrayLiteral(position, std::move(elements));
+
+  if (current.kind == Token::Kind::SEMICOLON) {
+    advance();
+    if (current.kind == Token::Kind::NUMBER &&
+        current.lexeme.find_first_not_of("0123456789") == string::npos) {
+      literal->repeat = stoull(current.lexeme);
+    }
+    consume(Token::Kind::NUMBER, "Expected a count after ';'");
+
+    if (literal->elements.size() != 1 || literal->repeat == 0)
+      error("Expected one element repeated a positive number of times");
+  }
+
+  consume(Token::Kind::RBRACKET, "Expected ']' after array elements");
+
+  if (literal->elements.empty())
+    error("Expected at least one array element");
+
+  return literal;
+}
+
+ast::Node *Parser::index(Node *target) {
+  auto position = previous.position;
+
+  auto index = new Index(position, dynamic_cast<Expression *>(target),
+                         dynamic_cast<Expression *>(
+                             expression(Precedence::ASSIGNMENT)));
+
+  if (current.kind == Token::Kind::DOT_DOT) {
+    advance();
+    index->end =
+        dynamic_cast<Expression *>(expression(Precedence::ASSIGNMENT));
+  }
+
+  consume(Token::Kind::RBRACKET, "Expected ']' after an index");
+  return index;
+}
+
+ast::Node *Parser::member(Node *target) {
+  auto position = previous.position;
+  auto field = current;
+  consume(Token::Kind::IDENTIFIER, "Expected a field name after '.'");
+  return new Member(position, dynamic_cast<Expression *>(target), field);
+}
+
+// Fields are separated by commas, like parameters. Like a block, the struct
+// ends at its closing brace.
+ast::Node *Parser::structure(std::vector<Attribute> attributes) {
+  auto position = current.position;
+  consume(Token::Kind::STRUCT, "Expected a struct keyword");
+
+  auto structure = new Struct(position, current);
+  structure->attributes = std::move(attributes);
+  consume(Token::Kind::IDENTIFIER, "Expected a name for a struct");
+  consume(Token::Kind::LBRACE, "Expected '{' after a struct's name");
+
+  while (current.kind != Token::Kind::RBRACE &&
+         current.kind != Token::Kind::END) {
+    if (!structure->fields.empty() && current.kind == Token::Kind::COMMA)
+      advance();
+    if (current.kind == Token::Kind::RBRACE)
+      break;
+
+    auto name = current;
+    consume(Token::Kind::IDENTIFIER, "Expected a name for a struct field");
+    consume(Token::Kind::COLON, "Expected a colon after a field's name");
+    structure->fields.emplace_back(name, type());
+  }
+
+  if (structure->fields.empty())
+    error(structure->name, "Expected at least one field in " +
+                               structure->name.lexeme);
+
+  return structure;
+}
+
+// Types are identifiers, or array and slice types built around them like
+// [4]i64 and []i64
+Token Parser::type() {
+  auto position = current.position;
+
+  if (current.kind == Token::Kind::LBRACKET) {
+    advance();
+
+    std::string length;
+    if (current.kind == Token::Kind::NUMBER) {
+      length = current.lexeme;
+      if (length.find_first_not_of("0123456789") != string::npos ||
+          stoull(length) == 0)
+        error("Expected a positive array length");
+      advance();
+    }
+
+    consume(Token::Kind::RBRACKET, "Expected ']' in an array or slice type");
+    auto element = type();
+    return {Token::Kind::IDENTIFIER, "[" + length + "]" + element.lexeme,
+            position};
+  }
+
+  auto name = current;
+  consume(Token::Kind::IDENTIFIER, "Expected a type name");
+  return name;
+}
+
 ast::Node *Parser::grouping() {
   auto expr = expression(Precedence::ASSIGNMENT);
   consume(Token::Kind::RPAREN, "Expected ')' after expression");
@@ -47,7 +47,21 @@ class Parser {
   ast::Node *call(ast::Node *);
   ast::Node *str();
   ast::Node *assignment();
+  ast::Node *reassignment(ast::Expression *);
   ast::Node *grouping();
+  ast::Node *array();
+  ast::Node *index(ast::Node *);
+  ast::Node *member(ast::Node *);
+  ast::Node *structure(std::vector<ast::Attribute>);
+  Token type();
+  ast::Node *while_loop(std::vector<ast::Attribute>);
+  ast::Node *for_loop(std::vector<ast::Attribute>);
+  ast::Node *annotated();
+  ast::Node *constant();
+  std::vector<ast::Attribute> attributes();
+  void check_loop_hints(const std::vector<ast::Attribute> &);
+  void check_function_attributes(const std::vector<ast::Attribute> &);
+  void check_struct_attributes(const std::vector<ast::Attribute> &);
 
   void advance();
   void consume(Token::Kind kind, const std::string &message);
@@ -0,0 +1,75 @@
+#include "profile.hpp"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include <vector>
+
+using namespace llvm;
+
+const char *const profile_runtime_symbol = "__llvm_profile_runtime";
+
+void populate_module_passes(legacy::PassManagerBase &passes,
+                            unsigned optimization_level,
+                            const ProfileOptions &profile) {
+  PassManagerBuilder builder;
+  builder.OptLevel = optimization_level;
+  builder.Inliner = optimization_level > 0
+                        ? createFunctionInliningPass(optimization_level, 0,
+                                                     false)
+                        : createAlwaysInlinerLegacyPass();
+
+  // Instrumentation goes in before the inliner, so that counts are kept
+  // for each function rather than for each place it's inlined into
+  builder.EnablePGOInstrGen = profile.generate;
+  builder.PGOInstrGen = profile.generate_path;
+  builder.PGOInstrUse = profile.use_path;
+
+  builder.populateModulePassManager(passes);
+}
+
+Expected<std::string> find_profile_runtime() {
+  Triple triple(sys::getProcessTriple());
+  auto architecture = triple.getArchName().str();
+
+  // compiler-rt installs runtimes under a directory named for either the
+  // full or the major version, and lays them out by os or by triple
+  const std::vector<std::string> versions{
+      LLVM_VERSION_STRING, std::to_string(LLVM_VERSION_MAJOR)};
+
+  std::vector<std::string> resource_directories;
+  for (const auto &version : versions) {
+    SmallString<128> path(SOLAR_LLVM_LIBRARY_DIR);
+    sys::path::append(path, "clang", version, "lib");
+    resource_directories.push_back(path.str().str());
+  }
+
+  std::vector<std::string> candidates;
+  for (const auto &directory : resource_directories) {
+    if (triple.isOSDarwin()) {
+      candidates.push_back(directory + "/darwin/libclang_rt.profile_osx.a");
+    } else {
+      candidates.push_back(directory + "/" + triple.str() +
+                           "/libclang_rt.profile.a");
+      candidates.push_back(directory + "/linux/libclang_rt.profile-" +
+                           architecture + ".a");
+    }
+  }
+
+  for (const auto &candidate : candidates) {
+    if (sys::fs::exists(candidate))
+      return candidate;
+  }
+
+  return make_error<StringError>(
+      "Could not find the profile runtime (compiler-rt's "
+      "libclang_rt.profile) under " +
+          resource_directories.front() + ", use --profile-runtime=<path>",
+      inconvertibleErrorCode());
+}
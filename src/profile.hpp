@@ -0,0 +1,39 @@
+#pragma once
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+// Profile guided optimization happens in two builds. An instrumented build
+// counts how often each branch and function runs and writes the counts out
+// when the program exits. Once the raw profiles are merged with
+// llvm-profdata, a second build reads them to weight branches, place hot and
+// cold functions and make inlining decisions.
+struct ProfileOptions {
+  bool generate = false;
+
+  // Where instrumented programs write their raw profile. The runtime's
+  // default, default.profraw, is used when empty. LLVM_PROFILE_FILE
+  // overrides either.
+  std::string generate_path;
+
+  // An indexed profile, read by the optimizing build
+  std::string use_path;
+
+  [[nodiscard]] bool enabled() const { return generate || !use_path.empty(); }
+};
+
+// Adds the module pipeline, including the inliner, instrumentation or
+// profile use, for the optimization level (0 to 3)
+void populate_module_passes(llvm::legacy::PassManagerBase &,
+                            unsigned optimization_level,
+                            const ProfileOptions &);
+
+// Finds compiler-rt's profile runtime, which instrumented programs link
+// against, next to the LLVM solar was built with
+llvm::Expected<std::string> find_profile_runtime();
+
+// Instrumented code reaches the runtime only through this symbol, which the
+// linker has to be told to pull in on ELF platforms
+extern const char *const profile_runtime_symbol;
@@ -0,0 +1,214 @@
+#include "purity.hpp"
+
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace llvm;
+using ast::Type;
+
+// The calls a function makes, wherever they are in its body, and whether it
+// writes through a slice, which is the only memory its callers can see
+class CallFinder : public ast::Walker {
+  std::unordered_set<std::string> slices;
+
+  // The variable an assignment writes into, through its indexes and fields
+  static const ast::Variable *root_of(const ast::Expression *target) {
+    for (;;) {
+      if (auto index = dynamic_cast<const ast::Index *>(target))
+        target = index->target;
+      else if (auto member = dynamic_cast<const ast::Member *>(target))
+        target = member->target;
+      else
+        return dynamic_cast<const ast::Variable *>(target);
+    }
+  }
+
+public:
+  using ast::Walker::visit;
+
+  std::vector<const ast::Call *> calls;
+  const ast::Assignment *slice_write = nullptr;
+
+  void *visit(ast::Call &call) override {
+    calls.push_back(&call);
+    return ast::Walker::visit(call);
+  }
+
+  void visit(ast::VariableDeclaration &declaration) override {
+    ast::Walker::visit(declaration);
+    if (Type::is_slice(declaration.type))
+      slices.insert(declaration.name.lexeme);
+    else
+      slices.erase(declaration.name.lexeme);
+  }
+
+  void visit(ast::Function &function) override {
+    for (const auto &parameter : function.prototype.parameter_list) {
+      if (Type::is_slice(parameter.type))
+        slices.insert(parameter.name.lexeme);
+    }
+
+    ast::Walker::visit(function);
+  }
+
+  void visit(ast::Assignment &assignment) override {
+    auto root = root_of(assignment.target);
+    if (!slice_write && root && root != assignment.target &&
+        slices.count(root->name.lexeme))
+      slice_write = &assignment;
+
+    ast::Walker::visit(assignment);
+  }
+};
+
+static bool is_builtin(const Token &name) {
+  const auto &lexeme = name.lexeme;
+  return lexeme == "len" || lexeme == "select" || lexeme == "shuffle" ||
+         lexeme.starts_with("reduce_") || Type::is_vector(name);
+}
+
+static bool is_scalar(const Token &type) {
+  return type == Type::Primitive::INT32 || type == Type::Primitive::INT64 ||
+         type == Type::Primitive::UINT32 || type == Type::Primitive::UINT64 ||
+         type == Type::Primitive::FLOAT32 ||
+         type == Type::Primitive::FLOAT64 || type == Type::Primitive::BOOL;
+}
+
+// Works out which functions are pure. A function is pure unless it calls
+// something that isn't, so functions that only call each other are pure.
+class Purity {
+  // Why a function isn't pure, empty when it is
+  std::unordered_map<std::string, std::string> impurities;
+
+public:
+  explicit Purity(const ast::Program &program) {
+    std::unordered_map<std::string, std::vector<const ast::Call *>> calls;
+    std::unordered_set<std::string> writers;
+    for (const auto &statement : program.statements) {
+      // Constructing a struct only gathers its fields
+      if (auto structure = dynamic_cast<ast::Struct *>(statement)) {
+        calls.emplace(structure->name.lexeme,
+                      std::vector<const ast::Call *>{});
+        continue;
+      }
+
+      if (auto function = dynamic_cast<ast::Function *>(statement)) {
+        CallFinder finder;
+        function->accept(finder);
+        calls.emplace(function->prototype.name.lexeme,
+                      std::move(finder.calls));
+        if (finder.slice_write)
+          writers.insert(function->prototype.name.lexeme);
+      }
+    }
+
+    for (const auto &[name, made] : calls) {
+      auto &impurity = impurities[name];
+      if (writers.count(name)) {
+        impurity = "writes through a slice";
+        continue;
+      }
+
+      for (const auto &call : made) {
+        if (!calls.count(call->name.lexeme) && !is_builtin(call->name)) {
+          impurity =
+              "calls " + call->name.lexeme + ", which isn't known to be pure";
+          break;
+        }
+      }
+    }
+
+    // Impurity spreads to callers until it stops changing
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (const auto &[name, made] : calls) {
+        auto &impurity = impurities[name];
+        for (const auto &call : made) {
+          const auto &callee = call->name.lexeme;
+          if (!impurity.empty())
+            break;
+
+          auto callee_impurity = impurities.find(callee);
+          if (callee_impurity != impurities.end() &&
+              !callee_impurity->second.empty()) {
+            impurity = "calls " + callee + ", which isn't pure";
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Empty when the function is pure
+  const std::string &impurity_of(const std::string &name) {
+    return impurities[name];
+  }
+};
+
+static Error to_error(const std::ostringstream &errors) {
+  auto message = errors.str();
+  if (message.empty())
+    return Error::success();
+
+  return make_error<StringError>(message, inconvertibleErrorCode());
+}
+
+Error check_memoized(const ast::Program &program) {
+  Purity purity(program);
+  std::ostringstream errors;
+
+  auto error = [&](const SourcePosition &position, const std::string &name,
+                   const std::string &message) {
+    errors << "[position " << position.line << ':' << position.column
+           << "] Error: @memoize function " << name << " " << message
+           << std::endl;
+  };
+
+  for (const auto &statement : program.statements) {
+    auto function = dynamic_cast<ast::Function *>(statement);
+    if (!function || !function->prototype.has_attribute("memoize"))
+      continue;
+
+    const auto &prototype = function->prototype;
+    const auto &name = prototype.name.lexeme;
+    for (const auto &parameter : prototype.parameter_list) {
+      if (!is_scalar(parameter.type))
+        error(parameter.position, name,
+              "takes " + parameter.type.lexeme +
+                  ", but only scalars can be cached");
+    }
+
+    if (!is_scalar(prototype.return_type))
+      error(function->position, name,
+            "returns " + prototype.return_type.lexeme +
+                ", but only scalars can be cached");
+
+    auto impurity = purity.impurity_of(name);
+    if (!impurity.empty())
+      error(function->position, name, impurity);
+  }
+
+  return to_error(errors);
+}
+
+Error check_pure(const ast::Program &program) {
+  Purity purity(program);
+  std::ostringstream errors;
+
+  for (const auto &statement : program.statements) {
+    auto function = dynamic_cast<ast::Function *>(statement);
+    if (!function || !function->prototype.has_attribute("pure"))
+      continue;
+
+    const auto &name = function->prototype.name.lexeme;
+    auto impurity = purity.impurity_of(name);
+    if (!impurity.empty())
+      errors << "[position " << function->position.line << ':'
+             << function->position.column << "] Error: @pure function "
+             << name << " " << impurity << std::endl;
+  }
+
+  return to_error(errors);
+}
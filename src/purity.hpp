@@ -0,0 +1,15 @@
+#pragma once
+
+#include "ast.hpp"
+#include "llvm/Support/Error.h"
+
+// Checks that every @memoize function of the program can be cached: it takes
+// and returns scalars, and it only calls builtins and functions of the
+// program that are pure themselves. printf and print, which write output,
+// and functions defined elsewhere aren't known to be pure.
+llvm::Error check_memoized(const ast::Program &);
+
+// Checks that every @pure function of the program is pure by the same rules,
+// since codegen tells LLVM that calls to it can be combined or dropped. A
+// pure function can read its slices, but not write through them.
+llvm::Error check_pure(const ast::Program &);
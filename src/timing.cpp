@@ -0,0 +1,14 @@
+#include "timing.hpp"
+
+#include "llvm/Pass.h"
+
+using namespace llvm;
+
+PhaseTimer::PhaseTimer(StringRef phase, StringRef detail)
+    : timer(phase, phase, "solar", "Compiler phases", TimePassesIsEnabled),
+      trace(phase, detail), memory(phase) {}
+
+FunctionTimer::FunctionTimer(StringRef function)
+    : timer(function, function, "solar-functions",
+            "Code generation by function", TimePassesIsEnabled),
+      trace("CodeGenFunction", function) {}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "memory.hpp"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+// Times a phase of compilation for --time-report, alongside LLVM's timing of
+// each pass, and traces it for --time-trace. Like LLVM's own timers, they're
+// enabled by TimePassesIsEnabled, and cost next to nothing when off. Phases
+// also account their memory for --mem-report.
+class PhaseTimer {
+  llvm::NamedRegionTimer timer;
+  llvm::TimeTraceScope trace;
+  MemoryScope memory;
+
+public:
+  // Details, like a source's path, only show up in the trace
+  explicit PhaseTimer(llvm::StringRef phase, llvm::StringRef detail = "");
+};
+
+// Times generating a single function, reported by the function's name
+class FunctionTimer {
+  llvm::NamedRegionTimer timer;
+  llvm::TimeTraceScope trace;
+
+public:
+  explicit FunctionTimer(llvm::StringRef function);
+};
@@ -24,23 +24,35 @@ struct Token {
     STRING,
 
     FUNC,
+    CONST,
+    STRUCT,
     IF,
     ELSE,
     VAR,
+    WHILE,
+    FOR,
+    IN,
 
     PLUS,
     MINUS,
     STAR,
     SLASH,
+    PERCENT,
 
     LPAREN,
     RPAREN,
     LBRACE,
     RBRACE,
+    LBRACKET,
+    RBRACKET,
     COMMA,
     COLON,
+    SEMICOLON,
+    AT,
 
     ARROW,
+    DOT,
+    DOT_DOT,
 
     LESS,
     GREATER,
@@ -85,10 +97,20 @@ static auto name(Token::Kind kind) -> const char * {
     return "IDENTIFIER\0";
   case Token::Kind::FUNC:
     return "FUNC\0";
+  case Token::Kind::CONST:
+    return "CONST\0";
+  case Token::Kind::STRUCT:
+    return "STRUCT\0";
   case Token::Kind::IF:
     return "IF\0";
   case Token::Kind::ELSE:
     return "ELSE\0";
+  case Token::Kind::WHILE:
+    return "WHILE\0";
+  case Token::Kind::FOR:
+    return "FOR\0";
+  case Token::Kind::IN:
+    return "IN\0";
   case Token::Kind::PLUS:
     return "ADD\0";
   case Token::Kind::MINUS:
@@ -97,6 +119,8 @@ static auto name(Token::Kind kind) -> const char * {
     return "STAR\0";
   case Token::Kind::SLASH:
     return "SLASH\0";
+  case Token::Kind::PERCENT:
+    return "PERCENT\0";
   case Token::Kind::LPAREN:
     return "LPAREN\0";
   case Token::Kind::RPAREN:
@@ -105,8 +129,22 @@ static auto name(Token::Kind kind) -> const char * {
     return "LBRACE\0";
   case Token::Kind::RBRACE:
     return "RBRACE\0";
+  case Token::Kind::LBRACKET:
+    return "LBRACKET\0";
+  case Token::Kind::RBRACKET:
+    return "RBRACKET\0";
+  case Token::Kind::SEMICOLON:
+    return "SEMICOLON\0";
   case Token::Kind::ARROW:
     return "ARROW\0";
+  case Token::Kind::DOT:
+    return "DOT\0";
+  case Token::Kind::DOT_DOT:
+    return "DOT_DOT\0";
+  case Token::Kind::AT:
+    return "AT\0";
+  case Token::Kind::ASSIGN:
+    return "ASSIGN\0";
   case Token::Kind::LESS:
     return "LESS\0";
   case Token::Kind::GREATER:
@@ -0,0 +1,117 @@
+#include "typer.hpp"
+
+using ast::Type;
+
+static Token type_named(const std::string &lexeme,
+                        const SourcePosition &position) {
+  return {Token::Kind::IDENTIFIER, lexeme, position};
+}
+
+static bool is_comparison(ast::Operation operation) {
+  return operation != ast::Operation::ADD &&
+         operation != ast::Operation::SUBTRACT &&
+         operation != ast::Operation::MULTIPLY &&
+         operation != ast::Operation::DIVIDE &&
+         operation != ast::Operation::REMAINDER;
+}
+
+Token Typer::operand_type(ast::Binop &binop) {
+  auto left = type_of(*binop.left);
+  auto right = type_of(*binop.right);
+  auto left_is_literal =
+      dynamic_cast<ast::LiteralValueExpression *>(binop.left) != nullptr;
+
+  if (Type::is_vector(right) || (left_is_literal && !Type::is_vector(left)))
+    return right;
+
+  return left;
+}
+
+Token Typer::type_of(ast::Expression &expression) {
+  const auto &position = expression.position;
+
+  if (auto literal = dynamic_cast<ast::LiteralValueExpression *>(&expression))
+    return literal->type.name;
+
+  if (auto variable = dynamic_cast<ast::Variable *>(&expression))
+    return type_of_variable(variable->name.lexeme);
+
+  if (auto binop = dynamic_cast<ast::Binop *>(&expression)) {
+    auto type = operand_type(*binop);
+    if (!is_comparison(binop->operation))
+      return type;
+
+    if (Type::is_vector(type))
+      return type_named("boolx" + std::to_string(Type::lane_count(type)),
+                        position);
+
+    return Type::Primitive::BOOL;
+  }
+
+  if (auto condition = dynamic_cast<ast::Condition *>(&expression))
+    return type_of(*condition->then);
+
+  if (auto call = dynamic_cast<ast::Call *>(&expression)) {
+    const auto &name = call->name.lexeme;
+    Token return_type;
+    if (type_returned_by(name, return_type))
+      return return_type;
+
+    // Constructing a struct
+    if (struct_named(name))
+      return call->name;
+
+    // Builtins
+    if (name == "len")
+      return Type::Primitive::INT64;
+    if (Type::is_vector(call->name))
+      return call->name;
+    if (call->arguments.empty())
+      return Token();
+
+    auto argument = type_of(*call->arguments[0]);
+    if (name == "select" && call->arguments.size() == 3)
+      return type_of(*call->arguments[1]);
+    if (name.starts_with("reduce_") && Type::is_vector(argument))
+      return Type::lane_type(argument);
+
+    auto lanes = dynamic_cast<ast::ArrayLiteral *>(call->arguments.back());
+    if (name == "shuffle" && lanes && Type::is_vector(argument))
+      return type_named(Type::lane_type(argument).lexeme + "x" +
+                            std::to_string(lanes->elements.size()),
+                        position);
+
+    return Token();
+  }
+
+  if (auto index = dynamic_cast<ast::Index *>(&expression)) {
+    auto target = type_of(*index->target);
+    auto element = Type::is_vector(target) ? Type::lane_type(target)
+                                           : Type::element_type(target);
+
+    return index->end ? type_named("[]" + element.lexeme, position) : element;
+  }
+
+  if (auto member = dynamic_cast<ast::Member *>(&expression)) {
+    auto structure = struct_named(type_of(*member->target).lexeme);
+    if (!structure)
+      return Token();
+
+    for (const auto &field : structure->fields) {
+      if (field.name.lexeme == member->field.lexeme)
+        return field.type;
+    }
+
+    return Token();
+  }
+
+  if (auto array = dynamic_cast<ast::ArrayLiteral *>(&expression)) {
+    auto count = array->repeat ? array->repeat : array->elements.size();
+    auto element =
+        array->elements.empty() ? Token() : type_of(*array->elements[0]);
+    return type_named("[" + std::to_string(count) + "]" + element.lexeme,
+                      position);
+  }
+
+  return Token();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <string>
+
+// Works out the type of an expression as a declaration would spell it, or an
+// empty token when it has none (like a string). What a name stands for
+// depends on the pass asking, so passes derive from it and look names up in
+// the scopes they track.
+class Typer {
+protected:
+  // The type of the variable or const in scope, or an empty token
+  virtual Token type_of_variable(const std::string &name) = 0;
+
+  // Whether a function of this name is known, and the type it returns
+  virtual bool type_returned_by(const std::string &name, Token &type) = 0;
+
+  virtual const ast::Struct *struct_named(const std::string &name) = 0;
+
+public:
+  virtual ~Typer() = default;
+
+  Token type_of(ast::Expression &);
+
+  // Integer literals take the type of the other side, and scalars that of
+  // the vector they're splatted across
+  Token operand_type(ast::Binop &);
+};
@@ -0,0 +1,1193 @@
+#include "vm.hpp"
+
+#include "format.hpp"
+#include "llvm/ADT/Optional.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace llvm;
+
+namespace vm {
+
+// Natives read their arguments straight out of the register file
+typedef int64_t (*NativeFunction)(const Register *arguments, uint8_t count);
+
+struct Native {
+  const char *name;
+  NativeFunction function;
+  std::vector<Kind> parameter_kinds;
+  bool variadic;
+  Kind return_kind;
+};
+
+template <typename T>
+static void append_formatted(std::string &output,
+                             const std::string &specification, T value) {
+  auto length = snprintf(nullptr, 0, specification.c_str(), value);
+  if (length <= 0)
+    return;
+
+  auto offset = output.size();
+  output.resize(offset + length + 1);
+  snprintf(&output[offset], length + 1, specification.c_str(), value);
+  output.resize(offset + length);
+}
+
+// Where printf expects each argument depends on its C type, so rather than
+// build a native call frame, every conversion is formatted on its own with
+// its argument converted to the type the conversion expects
+static int64_t native_printf(const Register *arguments, uint8_t count) {
+  if (count == 0)
+    return 0;
+
+  std::string output;
+  uint8_t next = 1;
+
+  for (auto p = arguments[0].string; *p;) {
+    if (*p != '%') {
+      output.push_back(*p++);
+      continue;
+    }
+
+    if (p[1] == '%') {
+      output.push_back('%');
+      p += 2;
+      continue;
+    }
+
+    std::string specification(1, *p++);
+    while (*p && strchr("-+ #0", *p))
+      specification.push_back(*p++);
+    while (isdigit(*p) || *p == '.')
+      specification.push_back(*p++);
+
+    // Integers are all 64 bits wide in registers, so length modifiers only
+    // decide whether they're truncated to an int first
+    auto is_long = false;
+    while (*p && strchr("hlLjzt", *p))
+      is_long |= *p++ != 'h';
+
+    auto conversion = *p;
+    if (!conversion || next == count) {
+      output += specification;
+      continue;
+    }
+
+    ++p;
+    const auto &argument = arguments[next++];
+
+    switch (conversion) {
+    case 'd':
+    case 'i':
+      if (is_long)
+        append_formatted(output, specification + "ll" + conversion,
+                         (long long)argument.integer);
+      else
+        append_formatted(output, specification + conversion,
+                         (int)argument.integer);
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      if (is_long)
+        append_formatted(output, specification + "ll" + conversion,
+                         (unsigned long long)argument.integer);
+      else
+        append_formatted(output, specification + conversion,
+                         (unsigned int)argument.integer);
+      break;
+    case 'c':
+      append_formatted(output, specification + conversion,
+                       (int)argument.integer);
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      append_formatted(output, specification + conversion, argument.number);
+      break;
+    case 's':
+      append_formatted(output, specification + conversion, argument.string);
+      break;
+    case 'p':
+      append_formatted(output, specification + conversion,
+                       (const void *)argument.string);
+      break;
+    default:
+      output += specification;
+      output.push_back(conversion);
+      --next;
+    }
+  }
+
+  fwrite(output.data(), 1, output.size(), stdout);
+  return (int32_t)output.size();
+}
+
+// Analysis has checked print's format and its arguments, and integers are
+// kept sign or zero extended by their kind, so each conversion only needs to
+// be widened to 64 bits
+static int64_t native_print(const Register *arguments, uint8_t count) {
+  std::vector<FormatSegment> segments;
+  if (count == 0 || !parse_format(arguments[0].string, segments).empty())
+    return 0;
+
+  std::string output;
+  uint8_t next = 1;
+  for (const auto &segment : segments) {
+    output += segment.text;
+    if (!segment.conversion || next == count)
+      continue;
+
+    std::string specification("%");
+    if (segment.left_justify)
+      specification.push_back('-');
+    if (segment.zero_pad)
+      specification.push_back('0');
+    if (segment.width)
+      specification += std::to_string(segment.width);
+
+    const auto &argument = arguments[next++];
+    switch (segment.conversion) {
+    case 'd':
+    case 'i':
+      append_formatted(output, specification + "lld",
+                       (long long)argument.integer);
+      break;
+    case 'u':
+    case 'x':
+      append_formatted(output, specification + "ll" + segment.conversion,
+                       (unsigned long long)argument.integer);
+      break;
+    case 'f': {
+      // printf's digits differ from compiled code's past 2^53, so they're
+      // worked out the same way and only padded here
+      auto digits = float_digits(std::fabs(argument.number), segment.precision);
+      auto sign = std::signbit(argument.number) && !std::isnan(argument.number)
+                      ? "-"
+                      : "";
+      auto padding = segment.width > digits.size() + strlen(sign)
+                         ? segment.width - digits.size() - strlen(sign)
+                         : 0;
+      if (segment.left_justify)
+        output += sign + digits + std::string(padding, ' ');
+      else if (segment.zero_pad && std::isfinite(argument.number))
+        output += sign + std::string(padding, '0') + digits;
+      else
+        output += std::string(padding, ' ') + sign + digits;
+      break;
+    }
+    default:
+      append_formatted(output, specification + 's', argument.string);
+    }
+  }
+
+  fwrite(output.data(), 1, output.size(), stdout);
+  return 0;
+}
+
+static const Native natives[] = {
+    {"printf", native_printf, {Kind::STRING}, true, Kind::INT32},
+    {"print", native_print, {Kind::STRING}, true, Kind::VOID},
+};
+
+static const Native *find_native(const std::string &name, uint8_t &index) {
+  for (index = 0; index < std::size(natives); ++index) {
+    if (name == natives[index].name)
+      return &natives[index];
+  }
+
+  return nullptr;
+}
+
+static Kind kind_for(const Token &type_token, bool &valid) {
+  valid = true;
+  if (type_token == ast::Type::Primitive::INT64) {
+    return Kind::INT64;
+  } else if (type_token == ast::Type::Primitive::INT32) {
+    return Kind::INT32;
+  } else if (type_token == ast::Type::Primitive::UINT64) {
+    return Kind::UINT64;
+  } else if (type_token == ast::Type::Primitive::UINT32) {
+    return Kind::UINT32;
+  } else if (type_token == ast::Type::Primitive::FLOAT64) {
+    return Kind::FLOAT64;
+  } else if (type_token == ast::Type::Primitive::FLOAT32) {
+    return Kind::FLOAT32;
+  } else if (type_token == ast::Type::Primitive::BOOL) {
+    return Kind::BOOL;
+  } else if (type_token.lexeme == "Void") {
+    return Kind::VOID;
+  }
+
+  valid = false;
+  return Kind::VOID;
+}
+
+static const char *name(Kind kind) {
+  switch (kind) {
+  case Kind::VOID:
+    return "Void";
+  case Kind::BOOL:
+    return "bool";
+  case Kind::INT32:
+    return "i32";
+  case Kind::INT64:
+    return "i64";
+  case Kind::UINT32:
+    return "u32";
+  case Kind::UINT64:
+    return "u64";
+  case Kind::FLOAT32:
+    return "f32";
+  case Kind::FLOAT64:
+    return "f64";
+  case Kind::STRING:
+    return "string";
+  }
+
+  return "unknown";
+}
+
+static bool is_unsigned(Kind kind) {
+  return kind == Kind::UINT32 || kind == Kind::UINT64;
+}
+
+static bool is_integer(Kind kind) {
+  return kind == Kind::INT32 || kind == Kind::INT64 || is_unsigned(kind);
+}
+
+static bool is_float(Kind kind) {
+  return kind == Kind::FLOAT32 || kind == Kind::FLOAT64;
+}
+
+// The kind both sides of an operation or both arms of a condition end up as
+static Kind common_kind(Kind left, Kind right, bool &valid) {
+  valid = true;
+  if (left == right)
+    return left;
+  if (is_integer(left) && is_integer(right))
+    return is_unsigned(left) || is_unsigned(right) ? Kind::UINT64
+                                                   : Kind::INT64;
+  if (is_float(left) && is_float(right))
+    return Kind::FLOAT64;
+
+  valid = false;
+  return left;
+}
+
+Expected<std::unique_ptr<Program>> Compiler::compile(ast::Program &source) {
+  auto result = std::make_unique<Program>();
+  program = result.get();
+  errors.clear();
+
+  // Functions can be called before they're defined
+  for (const auto &statement : source.statements) {
+    auto declaration = dynamic_cast<ast::Function *>(statement);
+    if (!declaration)
+      continue;
+
+    const auto &prototype = declaration->prototype;
+    if (program->function_indexes.count(prototype.name.lexeme)) {
+      error(*declaration, "Redefinition of " + prototype.name.lexeme);
+      continue;
+    }
+
+    if (program->functions.size() > UINT16_MAX) {
+      error(*declaration, "Too many functions");
+      break;
+    }
+
+    Function function{prototype.name.lexeme};
+
+    bool valid;
+    for (const auto &parameter : prototype.parameter_list) {
+      function.parameter_kinds.push_back(kind_for(parameter.type, valid));
+      if (!valid)
+        error(*declaration, "Unknown type " + parameter.type.lexeme);
+    }
+
+    function.return_kind = kind_for(prototype.return_type, valid);
+    if (!valid)
+      error(*declaration, "Unknown type " + prototype.return_type.lexeme);
+
+    program->function_indexes[function.name] = program->functions.size();
+    program->functions.push_back(std::move(function));
+  }
+
+  constants.clear();
+  for (const auto &statement : source.statements) {
+    auto constant = dynamic_cast<ast::VariableDeclaration *>(statement);
+    if (constant && constant->is_const)
+      constants.insert_or_assign(constant->name.lexeme, constant);
+  }
+
+  for (const auto &statement : source.statements) {
+    auto constant = dynamic_cast<ast::VariableDeclaration *>(statement);
+    if (dynamic_cast<ast::Function *>(statement) ||
+        dynamic_cast<ast::Struct *>(statement))
+      statement->accept(*this);
+    else if (!constant || !constant->is_const)
+      error(*statement, "Only functions and consts are allowed at the top "
+                        "level");
+  }
+
+  program = nullptr;
+  function = nullptr;
+
+  if (!errors.empty()) {
+    std::ostringstream message;
+    for (const auto &error : errors)
+      message << error;
+
+    return make_error<StringError>(message.str(), inconvertibleErrorCode());
+  }
+
+  return result;
+}
+
+void Compiler::error(const ast::Node &node, const std::string &message) {
+  std::ostringstream builder;
+  builder << "[position " << node.position.line << ':' << node.position.column
+          << "] Error: " << message << std::endl;
+
+  errors.emplace_back(builder.str());
+}
+
+uint8_t Compiler::allocate() {
+  // Registers are addressed by a byte
+  if (next_register > UINT8_MAX) {
+    if (errors.empty() || errors.back().find("registers") == std::string::npos)
+      errors.emplace_back("Error: " + function->name +
+                          " needs more than 256 registers\n");
+    return UINT8_MAX;
+  }
+
+  auto index = next_register++;
+  if (next_register > function->register_count)
+    function->register_count = next_register;
+
+  return index;
+}
+
+Kind Compiler::compile(ast::Expression &expression, uint8_t destination) {
+  target = destination;
+  kind = Kind::VOID;
+  expression.accept(*this);
+  return kind;
+}
+
+// Variables are read where they live instead of being copied to a temporary
+uint8_t Compiler::operand(ast::Expression &expression, Kind &operand_kind) {
+  if (auto variable = dynamic_cast<ast::Variable *>(&expression)) {
+    auto local = locals.find(variable->name.lexeme);
+    if (local != locals.end()) {
+      operand_kind = local->second.kind;
+      return local->second.index;
+    }
+  }
+
+  auto index = allocate();
+  operand_kind = compile(expression, index);
+  return index;
+}
+
+void Compiler::coerce(uint8_t index, Kind from, Kind to,
+                      const ast::Node &node) {
+  if (from == to || to == Kind::VOID)
+    return;
+
+  if (is_integer(from) && is_integer(to)) {
+    if (to == Kind::INT32)
+      emit(Opcode::WRAP_INT32, index);
+    else if (to == Kind::UINT32)
+      emit(Opcode::WRAP_UINT32, index);
+  } else if (is_float(from) && is_float(to)) {
+    if (to == Kind::FLOAT32)
+      emit(Opcode::WRAP_FLOAT32, index);
+  } else {
+    error(node, std::string("Expected a value of type ") + name(to) +
+                    ", but got " + name(from));
+  }
+}
+
+size_t Compiler::emit(Opcode opcode, uint8_t a, uint8_t b, uint8_t c) {
+  function->code.push_back({opcode, a, b, c});
+  return function->code.size() - 1;
+}
+
+size_t Compiler::emit_wide(Opcode opcode, uint8_t a, uint16_t bx) {
+  return emit(opcode, a, bx >> 8, bx & 0xFF);
+}
+
+// Points a forward jump at the next instruction to be emitted
+void Compiler::patch_jump(size_t jump) {
+  auto offset = function->code.size() - (jump + 1);
+  if (offset > INT16_MAX) {
+    errors.emplace_back("Error: " + function->name + " is too large\n");
+    return;
+  }
+
+  function->code[jump].b = offset >> 8;
+  function->code[jump].c = offset & 0xFF;
+}
+
+// Jumps back to the start of a loop
+void Compiler::emit_loop(size_t start) {
+  auto offset = (int64_t)start - (int64_t)(function->code.size() + 1);
+  if (offset < INT16_MIN) {
+    errors.emplace_back("Error: " + function->name + " is too large\n");
+    return;
+  }
+
+  emit_wide(Opcode::JUMP, 0, (uint16_t)(int16_t)offset);
+}
+
+void Compiler::compile_arguments(const ast::Call &call, uint8_t base,
+                                 const std::vector<Kind> &parameter_kinds,
+                                 bool variadic) {
+  if (call.arguments.size() < parameter_kinds.size() ||
+      (!variadic && call.arguments.size() > parameter_kinds.size())) {
+    error(call, "Wrong number of arguments to " + call.name.lexeme);
+    return;
+  }
+
+  // Arguments go in consecutive registers, which become the callee's first
+  for (size_t i = 0; i < call.arguments.size(); ++i) {
+    auto index = i == 0 ? base : allocate();
+    auto argument_kind = compile(*call.arguments[i], index);
+
+    if (i < parameter_kinds.size())
+      coerce(index, argument_kind, parameter_kinds[i], *call.arguments[i]);
+  }
+}
+
+void *Compiler::visit(ast::Variable &variable) {
+  auto destination = target;
+  auto local = locals.find(variable.name.lexeme);
+  auto constant = constants.find(variable.name.lexeme);
+  if (local == locals.end() && constant != constants.end()) {
+    compile(*constant->second->initializer, destination);
+    return nullptr;
+  }
+
+  if (local == locals.end()) {
+    error(variable, "Unknown variable " + variable.name.lexeme);
+    return nullptr;
+  }
+
+  if (local->second.index != destination)
+    emit(Opcode::MOVE, destination, local->second.index);
+
+  kind = local->second.kind;
+  return nullptr;
+}
+
+void *Compiler::visit(ast::LiteralValueExpression &literal) {
+  auto destination = target;
+  const auto &type = literal.type.name;
+  Register value{};
+
+  if (type == ast::Type::Primitive::INT64) {
+    kind = Kind::INT64;
+    value.integer = literal.value.int64;
+  } else if (type == ast::Type::Primitive::UINT64) {
+    kind = Kind::UINT64;
+    value.unsigned_integer = literal.value.uint64;
+  } else if (type == ast::Type::Primitive::INT32) {
+    kind = Kind::INT32;
+    value.integer = literal.value.int32;
+  } else if (type == ast::Type::Primitive::UINT32) {
+    kind = Kind::UINT32;
+    value.unsigned_integer = literal.value.uint32;
+  } else if (type == ast::Type::Primitive::FLOAT64) {
+    kind = Kind::FLOAT64;
+    value.number = literal.value.float64;
+  } else if (type == ast::Type::Primitive::FLOAT32) {
+    kind = Kind::FLOAT32;
+    value.number = literal.value.float32;
+  } else if (type == ast::Type::Primitive::BOOL) {
+    kind = Kind::BOOL;
+    value.integer = literal.value.boolean;
+  } else {
+    error(literal, "Unknown type " + type.lexeme);
+    return nullptr;
+  }
+
+  if (function->constants.size() > UINT16_MAX) {
+    errors.emplace_back("Error: " + function->name + " is too large\n");
+    return nullptr;
+  }
+
+  emit_wide(Opcode::LOAD_CONSTANT, destination, function->constants.size());
+  function->constants.push_back(value);
+  return nullptr;
+}
+
+void *Compiler::visit(ast::StringLiteral &literal) {
+  auto destination = target;
+  program->strings.push_back(literal.value);
+
+  Register value{};
+  value.string = program->strings.back().c_str();
+
+  emit_wide(Opcode::LOAD_CONSTANT, destination, function->constants.size());
+  function->constants.push_back(value);
+
+  kind = Kind::STRING;
+  return nullptr;
+}
+
+// Registers only hold scalars
+void *Compiler::visit(ast::Index &index) {
+  error(index, "Arrays and slices aren't supported by the bytecode VM");
+  return nullptr;
+}
+
+void *Compiler::visit(ast::ArrayLiteral &literal) {
+  error(literal, "Arrays and slices aren't supported by the bytecode VM");
+  return nullptr;
+}
+
+void *Compiler::visit(ast::Member &member) {
+  error(member, "Structs aren't supported by the bytecode VM");
+  return nullptr;
+}
+
+void *Compiler::visit(ast::Binop &binop) {
+  auto destination = target;
+  auto saved_register = next_register;
+
+  Kind left_kind, right_kind;
+  auto left = operand(*binop.left, left_kind);
+  auto right = operand(*binop.right, right_kind);
+
+  // The operands are read before the result is written
+  next_register = saved_register;
+
+  bool valid;
+  auto operand_kind = common_kind(left_kind, right_kind, valid);
+  auto is_comparison = binop.operation != ast::Operation::ADD &&
+                       binop.operation != ast::Operation::SUBTRACT &&
+                       binop.operation != ast::Operation::MULTIPLY &&
+                       binop.operation != ast::Operation::DIVIDE &&
+                       binop.operation != ast::Operation::REMAINDER;
+  auto is_equality = binop.operation == ast::Operation::COMPARE_IS_EQUAL ||
+                     binop.operation == ast::Operation::COMPARE_IS_NOT_EQUAL;
+
+  if (!valid || !(is_integer(operand_kind) || is_float(operand_kind) ||
+                  (operand_kind == Kind::BOOL && is_equality))) {
+    error(binop, std::string("Unsupported operand types ") + name(left_kind) +
+                     " and " + name(right_kind));
+    return nullptr;
+  }
+
+  // Float opcodes follow their integer counterparts in the same order
+  Opcode opcode;
+  switch (binop.operation) {
+  case ast::Operation::ADD:
+    opcode = Opcode::ADD_INTEGER;
+    break;
+  case ast::Operation::SUBTRACT:
+    opcode = Opcode::SUBTRACT_INTEGER;
+    break;
+  case ast::Operation::MULTIPLY:
+    opcode = Opcode::MULTIPLY_INTEGER;
+    break;
+  case ast::Operation::DIVIDE:
+    opcode = Opcode::DIVIDE_INTEGER;
+    break;
+  case ast::Operation::REMAINDER:
+    opcode = Opcode::REMAINDER_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_EQUAL:
+    opcode = Opcode::EQUAL_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_NOT_EQUAL:
+    opcode = Opcode::NOT_EQUAL_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_LESS:
+    opcode = Opcode::LESS_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_LESS_OR_EQUAL:
+    opcode = Opcode::LESS_EQUAL_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_GREATER:
+    opcode = Opcode::GREATER_INTEGER;
+    break;
+  case ast::Operation::COMPARE_IS_GREATER_OR_EQUAL:
+    opcode = Opcode::GREATER_EQUAL_INTEGER;
+    break;
+  }
+
+  if (is_float(operand_kind)) {
+    opcode = (Opcode)((uint8_t)opcode + (uint8_t)Opcode::ADD_FLOAT -
+                      (uint8_t)Opcode::ADD_INTEGER);
+  } else if (is_unsigned(operand_kind)) {
+    // Addition, subtraction, multiplication and equality don't depend on
+    // the sign
+    switch (opcode) {
+    case Opcode::DIVIDE_INTEGER:
+      opcode = Opcode::DIVIDE_UNSIGNED;
+      break;
+    case Opcode::REMAINDER_INTEGER:
+      opcode = Opcode::REMAINDER_UNSIGNED;
+      break;
+    case Opcode::LESS_INTEGER:
+      opcode = Opcode::LESS_UNSIGNED;
+      break;
+    case Opcode::LESS_EQUAL_INTEGER:
+      opcode = Opcode::LESS_EQUAL_UNSIGNED;
+      break;
+    case Opcode::GREATER_INTEGER:
+      opcode = Opcode::GREATER_UNSIGNED;
+      break;
+    case Opcode::GREATER_EQUAL_INTEGER:
+      opcode = Opcode::GREATER_EQUAL_UNSIGNED;
+      break;
+    default:
+      break;
+    }
+  }
+
+  emit(opcode, destination, left, right);
+
+  if (is_comparison) {
+    kind = Kind::BOOL;
+  } else {
+    kind = operand_kind;
+    if (kind == Kind::INT32)
+      emit(Opcode::WRAP_INT32, destination);
+    else if (kind == Kind::UINT32)
+      emit(Opcode::WRAP_UINT32, destination);
+    else if (kind == Kind::FLOAT32)
+      emit(Opcode::WRAP_FLOAT32, destination);
+  }
+
+  return nullptr;
+}
+
+void *Compiler::visit(ast::Condition &condition) {
+  auto destination = target;
+  auto saved_register = next_register;
+
+  Kind condition_kind;
+  auto condition_register = operand(*condition.condition, condition_kind);
+  next_register = saved_register;
+
+  if (condition_kind != Kind::BOOL)
+    error(*condition.condition, "Expected a bool condition");
+
+  auto skip_then = emit_wide(Opcode::JUMP_IF_FALSE, condition_register, 0);
+  auto then_kind = compile(*condition.then, destination);
+
+  if (!condition.otherwise) {
+    patch_jump(skip_then);
+    kind = Kind::VOID;
+    return nullptr;
+  }
+
+  auto skip_otherwise = emit_wide(Opcode::JUMP, 0, 0);
+  patch_jump(skip_then);
+  auto otherwise_kind = compile(*condition.otherwise, destination);
+  patch_jump(skip_otherwise);
+
+  bool valid;
+  kind = common_kind(then_kind, otherwise_kind, valid);
+  if (!valid)
+    error(condition, "Both arms of a condition must have the same type");
+
+  return nullptr;
+}
+
+void *Compiler::visit(ast::Call &call) {
+  auto destination = target;
+  auto saved_register = next_register;
+
+  // A temporary on top of the frame can hold the call's frame itself
+  auto base = destination + 1 == next_register ? destination : allocate();
+
+  auto found = program->function_indexes.find(call.name.lexeme);
+  if (found != program->function_indexes.end()) {
+    const auto &callee = program->functions[found->second];
+
+    compile_arguments(call, base, callee.parameter_kinds, false);
+    emit_wide(Opcode::CALL, base, found->second);
+    kind = callee.return_kind;
+  } else {
+    uint8_t index;
+    auto native = find_native(call.name.lexeme, index);
+    if (!native) {
+      error(call, "Unknown function " + call.name.lexeme);
+      next_register = saved_register;
+      return nullptr;
+    }
+
+    compile_arguments(call, base, native->parameter_kinds, native->variadic);
+    emit(Opcode::CALL_NATIVE, base, index, call.arguments.size());
+    kind = native->return_kind;
+  }
+
+  if (destination != base)
+    emit(Opcode::MOVE, destination, base);
+
+  next_register = saved_register;
+  return nullptr;
+}
+
+void Compiler::visit(ast::VariableDeclaration &declaration) {
+  bool valid;
+  auto declared_kind = kind_for(declaration.type, valid);
+  if (!valid) {
+    error(declaration, "Unknown type " + declaration.type.lexeme);
+    return;
+  }
+
+  auto index = allocate();
+  auto initializer_kind = compile(*declaration.initializer, index);
+  coerce(index, initializer_kind, declared_kind, declaration);
+
+  locals.insert_or_assign(declaration.name.lexeme,
+                          Local{index, declared_kind});
+}
+
+void Compiler::visit(ast::ExpressionStatement &statement) {
+  auto saved_register = next_register;
+  compile(*statement.expression, allocate());
+  next_register = saved_register;
+}
+
+void Compiler::visit(ast::Block &block) {
+  for (const auto &statement : block.statements) {
+    statement->accept(*this);
+  }
+}
+
+void Compiler::visit(ast::Function &declaration) {
+  auto index = program->function_indexes.at(declaration.prototype.name.lexeme);
+  function = &program->functions[index];
+
+  locals.clear();
+  next_register = 0;
+
+  // Parameters are the first registers of the frame
+  for (size_t i = 0; i < function->parameter_kinds.size(); ++i) {
+    const auto &parameter = declaration.prototype.parameter_list[i];
+    locals.insert_or_assign(parameter.name.lexeme,
+                            Local{allocate(), function->parameter_kinds[i]});
+  }
+
+  declaration.body->accept(*this);
+
+  auto &code = function->code;
+  if (code.empty() || (code.back().opcode != Opcode::RETURN &&
+                       code.back().opcode != Opcode::TAIL_CALL)) {
+    emit(Opcode::RETURN_VOID);
+  }
+}
+
+void Compiler::visit(ast::Return &statement) {
+  auto saved_register = next_register;
+  compile_return(*statement.return_value);
+  next_register = saved_register;
+}
+
+// Variables live in their registers, so values are compiled straight into
+// them. Operands are all read before the result is written.
+void Compiler::visit(ast::Assignment &assignment) {
+  auto variable = dynamic_cast<ast::Variable *>(assignment.target);
+  if (!variable) {
+    error(assignment, "Arrays and slices aren't supported by the bytecode VM");
+    return;
+  }
+
+  auto local = locals.find(variable->name.lexeme);
+  if (local == locals.end()) {
+    error(assignment, "Unknown variable " + variable->name.lexeme);
+    return;
+  }
+
+  auto saved_register = next_register;
+  auto value_kind = compile(*assignment.value, local->second.index);
+  coerce(local->second.index, value_kind, local->second.kind, assignment);
+  next_register = saved_register;
+}
+
+// Loop hints only mean something to LLVM's loop passes
+void Compiler::visit(ast::While &loop) {
+  auto start = function->code.size();
+
+  Kind condition_kind;
+  auto saved_register = next_register;
+  auto condition_register = operand(*loop.condition, condition_kind);
+  next_register = saved_register;
+
+  if (condition_kind != Kind::BOOL)
+    error(*loop.condition, "Expected a bool condition");
+
+  auto exit = emit_wide(Opcode::JUMP_IF_FALSE, condition_register, 0);
+  loop.body->accept(*this);
+  emit_loop(start);
+  patch_jump(exit);
+}
+
+void Compiler::visit(ast::For &loop) {
+  // The variable takes the kind of the end of the range, which is evaluated
+  // once into a register of its own
+  auto variable = allocate();
+  auto end = allocate();
+  auto end_kind = compile(*loop.end, end);
+  auto start_kind = compile(*loop.start, variable);
+
+  if (!is_integer(end_kind) || !is_integer(start_kind)) {
+    error(loop, "Expected integer bounds for a range");
+    return;
+  }
+
+  coerce(variable, start_kind, end_kind, loop);
+
+  auto step = allocate();
+  Register one{};
+  one.integer = 1;
+  emit_wide(Opcode::LOAD_CONSTANT, step, function->constants.size());
+  function->constants.push_back(one);
+
+  // The variable is only in scope for the loop's body
+  auto shadowed = locals.find(loop.variable.lexeme);
+  auto previous = shadowed == locals.end() ? Optional<Local>()
+                                           : Optional<Local>(shadowed->second);
+  locals.insert_or_assign(loop.variable.lexeme, Local{variable, end_kind});
+
+  auto condition = allocate();
+  auto start = function->code.size();
+  emit(is_unsigned(end_kind) ? Opcode::LESS_UNSIGNED : Opcode::LESS_INTEGER,
+       condition, variable, end);
+  auto exit = emit_wide(Opcode::JUMP_IF_FALSE, condition, 0);
+
+  loop.body->accept(*this);
+
+  emit(Opcode::ADD_INTEGER, variable, variable, step);
+  emit_loop(start);
+  patch_jump(exit);
+
+  if (previous)
+    locals.insert_or_assign(loop.variable.lexeme, *previous);
+  else
+    locals.erase(loop.variable.lexeme);
+}
+
+void Compiler::visit(ast::Struct &structure) {
+  error(structure, "Structs aren't supported by the bytecode VM");
+}
+
+// Like the LLVM backend, each arm of a condition returns on its own so calls
+// in either arm are in tail position
+void Compiler::compile_return(ast::Expression &expression) {
+  auto condition = dynamic_cast<ast::Condition *>(&expression);
+  if (condition && condition->otherwise) {
+    Kind condition_kind;
+    auto saved_register = next_register;
+    auto condition_register = operand(*condition->condition, condition_kind);
+    next_register = saved_register;
+
+    if (condition_kind != Kind::BOOL)
+      error(*condition->condition, "Expected a bool condition");
+
+    auto skip_then = emit_wide(Opcode::JUMP_IF_FALSE, condition_register, 0);
+    compile_return(*condition->then);
+    patch_jump(skip_then);
+    compile_return(*condition->otherwise);
+    return;
+  }
+
+  // A call returning what this function returns reuses this frame
+  if (auto call = dynamic_cast<ast::Call *>(&expression)) {
+    auto found = program->function_indexes.find(call->name.lexeme);
+    if (found != program->function_indexes.end() &&
+        program->functions[found->second].return_kind ==
+            function->return_kind) {
+      auto base = allocate();
+      compile_arguments(*call, base,
+                        program->functions[found->second].parameter_kinds,
+                        false);
+      emit_wide(Opcode::TAIL_CALL, base, found->second);
+      return;
+    }
+  }
+
+  auto index = allocate();
+  auto value_kind = compile(expression, index);
+  coerce(index, value_kind, function->return_kind, expression);
+  emit(function->return_kind == Kind::VOID ? Opcode::RETURN_VOID
+                                           : Opcode::RETURN,
+       index);
+}
+
+Interpreter::Interpreter(size_t stack_size) : registers(stack_size) {
+  frames.reserve(1024);
+}
+
+// Computed gotos give every opcode its own indirect branch, which predicts
+// far better than the single shared one a switch compiles to
+#if defined(__GNUC__)
+#define SOLAR_COMPUTED_GOTO
+#endif
+
+Expected<int64_t> Interpreter::run(const Program &program) {
+  auto found = program.function_indexes.find("main");
+  if (found == program.function_indexes.end())
+    return make_error<StringError>("No main function",
+                                   inconvertibleErrorCode());
+
+  const auto *function = &program.functions[found->second];
+  if (!function->parameter_kinds.empty())
+    return make_error<StringError>("main can't take parameters in the vm",
+                                   inconvertibleErrorCode());
+
+  frames.clear();
+
+  const auto stack_end = registers.data() + registers.size();
+  auto r = registers.data();
+  auto k = function->constants.data();
+  auto ip = function->code.data();
+  Instruction instruction{};
+
+  if (r + function->register_count > stack_end)
+    return make_error<StringError>("Stack overflow", inconvertibleErrorCode());
+
+#ifdef SOLAR_COMPUTED_GOTO
+  static const void *const labels[] = {
+#define SOLAR_OPCODE_LABEL(name) &&op_##name,
+      SOLAR_OPCODES(SOLAR_OPCODE_LABEL)
+#undef SOLAR_OPCODE_LABEL
+  };
+
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    instruction = *ip++;                                                       \
+    goto *labels[(uint8_t)instruction.opcode];                                 \
+  } while (0)
+#define OPCODE(name) op_##name:
+
+  DISPATCH();
+#else
+#define DISPATCH() continue
+#define OPCODE(name) case Opcode::name:
+
+  for (;;) {
+    instruction = *ip++;
+    switch (instruction.opcode) {
+#endif
+
+#define A r[instruction.a]
+#define B r[instruction.b]
+#define C r[instruction.c]
+
+  // Integer arithmetic wraps rather than being undefined
+#define INTEGER_OPERATION(name, operator)                                      \
+  OPCODE(name) {                                                               \
+    A.integer = (int64_t)((uint64_t)B.integer operator(uint64_t) C.integer);   \
+    DISPATCH();                                                                \
+  }
+#define COMPARISON(name, member, operator)                                     \
+  OPCODE(name) {                                                               \
+    A.integer = B.member operator C.member;                                    \
+    DISPATCH();                                                                \
+  }
+#define FLOAT_OPERATION(name, operator)                                        \
+  OPCODE(name) {                                                               \
+    A.number = B.number operator C.number;                                     \
+    DISPATCH();                                                                \
+  }
+
+  OPCODE(LOAD_CONSTANT) {
+    A = k[instruction.bx()];
+    DISPATCH();
+  }
+  OPCODE(MOVE) {
+    A = B;
+    DISPATCH();
+  }
+
+  INTEGER_OPERATION(ADD_INTEGER, +)
+  INTEGER_OPERATION(SUBTRACT_INTEGER, -)
+  INTEGER_OPERATION(MULTIPLY_INTEGER, *)
+
+  OPCODE(DIVIDE_INTEGER) {
+    if (C.integer == 0)
+      return make_error<StringError>("Division by zero in " + function->name,
+                                     inconvertibleErrorCode());
+
+    A.integer = C.integer == -1 ? (int64_t)(0 - (uint64_t)B.integer)
+                                : B.integer / C.integer;
+    DISPATCH();
+  }
+  OPCODE(REMAINDER_INTEGER) {
+    if (C.integer == 0)
+      return make_error<StringError>("Division by zero in " + function->name,
+                                     inconvertibleErrorCode());
+
+    A.integer = C.integer == -1 ? 0 : B.integer % C.integer;
+    DISPATCH();
+  }
+
+  COMPARISON(EQUAL_INTEGER, integer, ==)
+  COMPARISON(NOT_EQUAL_INTEGER, integer, !=)
+  COMPARISON(LESS_INTEGER, integer, <)
+  COMPARISON(LESS_EQUAL_INTEGER, integer, <=)
+  COMPARISON(GREATER_INTEGER, integer, >)
+  COMPARISON(GREATER_EQUAL_INTEGER, integer, >=)
+
+  FLOAT_OPERATION(ADD_FLOAT, +)
+  FLOAT_OPERATION(SUBTRACT_FLOAT, -)
+  FLOAT_OPERATION(MULTIPLY_FLOAT, *)
+  FLOAT_OPERATION(DIVIDE_FLOAT, /)
+
+  OPCODE(REMAINDER_FLOAT) {
+    A.number = std::fmod(B.number, C.number);
+    DISPATCH();
+  }
+
+  COMPARISON(EQUAL_FLOAT, number, ==)
+  COMPARISON(NOT_EQUAL_FLOAT, number, !=)
+  COMPARISON(LESS_FLOAT, number, <)
+  COMPARISON(LESS_EQUAL_FLOAT, number, <=)
+  COMPARISON(GREATER_FLOAT, number, >)
+  COMPARISON(GREATER_EQUAL_FLOAT, number, >=)
+
+  OPCODE(WRAP_INT32) {
+    A.integer = (int32_t)A.integer;
+    DISPATCH();
+  }
+  OPCODE(WRAP_FLOAT32) {
+    A.number = (float)A.number;
+    DISPATCH();
+  }
+
+  OPCODE(DIVIDE_UNSIGNED) {
+    if (C.unsigned_integer == 0)
+      return make_error<StringError>("Division by zero in " + function->name,
+                                     inconvertibleErrorCode());
+
+    A.unsigned_integer = B.unsigned_integer / C.unsigned_integer;
+    DISPATCH();
+  }
+  OPCODE(REMAINDER_UNSIGNED) {
+    if (C.unsigned_integer == 0)
+      return make_error<StringError>("Division by zero in " + function->name,
+                                     inconvertibleErrorCode());
+
+    A.unsigned_integer = B.unsigned_integer % C.unsigned_integer;
+    DISPATCH();
+  }
+
+  COMPARISON(LESS_UNSIGNED, unsigned_integer, <)
+  COMPARISON(LESS_EQUAL_UNSIGNED, unsigned_integer, <=)
+  COMPARISON(GREATER_UNSIGNED, unsigned_integer, >)
+  COMPARISON(GREATER_EQUAL_UNSIGNED, unsigned_integer, >=)
+
+  OPCODE(WRAP_UINT32) {
+    A.unsigned_integer = (uint32_t)A.unsigned_integer;
+    DISPATCH();
+  }
+
+  OPCODE(JUMP) {
+    ip += instruction.sbx();
+    DISPATCH();
+  }
+  OPCODE(JUMP_IF_FALSE) {
+    if (!A.integer)
+      ip += instruction.sbx();
+    DISPATCH();
+  }
+
+  OPCODE(CALL) {
+    auto callee = &program.functions[instruction.bx()];
+    auto callee_base = r + instruction.a;
+    if (callee_base + callee->register_count > stack_end ||
+        frames.size() == registers.size())
+      return make_error<StringError>("Stack overflow in " + callee->name,
+                                     inconvertibleErrorCode());
+
+    frames.push_back({function, ip, r});
+
+    function = callee;
+    r = callee_base;
+    k = callee->constants.data();
+    ip = callee->code.data();
+    DISPATCH();
+  }
+  OPCODE(TAIL_CALL) {
+    auto callee = &program.functions[instruction.bx()];
+    if (r + callee->register_count > stack_end)
+      return make_error<StringError>("Stack overflow in " + callee->name,
+                                     inconvertibleErrorCode());
+
+    // Arguments are always above the registers they're moved down to
+    for (size_t i = 0; i < callee->parameter_kinds.size(); ++i)
+      r[i] = r[instruction.a + i];
+
+    function = callee;
+    k = callee->constants.data();
+    ip = callee->code.data();
+    DISPATCH();
+  }
+  OPCODE(CALL_NATIVE) {
+    A.integer = natives[instruction.b].function(&A, instruction.c);
+    DISPATCH();
+  }
+
+  OPCODE(RETURN) {
+    auto value = A;
+    if (frames.empty())
+      return value.integer;
+
+    const auto &frame = frames.back();
+    function = frame.function;
+    ip = frame.return_address;
+    r = frame.base;
+    k = function->constants.data();
+    frames.pop_back();
+
+    // The call's a operand is both its frame and where its result goes
+    r[ip[-1].a] = value;
+    DISPATCH();
+  }
+  OPCODE(RETURN_VOID) {
+    if (frames.empty())
+      return 0;
+
+    const auto &frame = frames.back();
+    function = frame.function;
+    ip = frame.return_address;
+    r = frame.base;
+    k = function->constants.data();
+    frames.pop_back();
+    DISPATCH();
+  }
+
+#ifndef SOLAR_COMPUTED_GOTO
+    }
+  }
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef INTEGER_OPERATION
+#undef COMPARISON
+#undef FLOAT_OPERATION
+#undef DISPATCH
+#undef OPCODE
+}
+
+} // namespace vm
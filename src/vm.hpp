@@ -0,0 +1,196 @@
+#pragma once
+
+#include "ast.hpp"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A register bytecode backend for programs that run for less time than an
+// LLVM compile would take
+namespace vm {
+
+// a, b and c are registers in the current frame, bx is a 16 bit operand
+// made of b and c and sbx is its signed form
+#define SOLAR_OPCODES(X)                                                       \
+  X(LOAD_CONSTANT)    /* a = constants[bx] */                                  \
+  X(MOVE)             /* a = b */                                              \
+  X(ADD_INTEGER)      /* a = b + c */                                          \
+  X(SUBTRACT_INTEGER) /* a = b - c */                                          \
+  X(MULTIPLY_INTEGER) /* a = b * c */                                          \
+  X(DIVIDE_INTEGER)   /* a = b / c */                                          \
+  X(REMAINDER_INTEGER) /* a = b % c */                                         \
+  X(EQUAL_INTEGER)    /* a = b == c */                                         \
+  X(NOT_EQUAL_INTEGER)                                                         \
+  X(LESS_INTEGER)                                                              \
+  X(LESS_EQUAL_INTEGER)                                                        \
+  X(GREATER_INTEGER)                                                           \
+  X(GREATER_EQUAL_INTEGER)                                                     \
+  X(ADD_FLOAT)                                                                 \
+  X(SUBTRACT_FLOAT)                                                            \
+  X(MULTIPLY_FLOAT)                                                            \
+  X(DIVIDE_FLOAT)                                                              \
+  X(REMAINDER_FLOAT)                                                           \
+  X(EQUAL_FLOAT)                                                               \
+  X(NOT_EQUAL_FLOAT)                                                           \
+  X(LESS_FLOAT)                                                                \
+  X(LESS_EQUAL_FLOAT)                                                          \
+  X(GREATER_FLOAT)                                                             \
+  X(GREATER_EQUAL_FLOAT)                                                       \
+  X(WRAP_INT32)      /* a = (i32)a */                                          \
+  X(WRAP_FLOAT32)    /* a = (f32)a */                                          \
+  X(DIVIDE_UNSIGNED)                                                           \
+  X(REMAINDER_UNSIGNED)                                                        \
+  X(LESS_UNSIGNED)                                                             \
+  X(LESS_EQUAL_UNSIGNED)                                                       \
+  X(GREATER_UNSIGNED)                                                          \
+  X(GREATER_EQUAL_UNSIGNED)                                                    \
+  X(WRAP_UINT32)     /* a = (u32)a */                                          \
+  X(JUMP)            /* ip += sbx */                                           \
+  X(JUMP_IF_FALSE)   /* if !a: ip += sbx */                                    \
+  X(CALL)            /* a = functions[bx](a, a + 1, ...) */                    \
+  X(TAIL_CALL)       /* return functions[bx](a, a + 1, ...) */                 \
+  X(CALL_NATIVE)     /* a = natives[b](a, ..., a + c - 1) */                   \
+  X(RETURN)          /* return a */                                            \
+  X(RETURN_VOID)
+
+enum class Opcode : uint8_t {
+#define SOLAR_OPCODE_ENUM(name) name,
+  SOLAR_OPCODES(SOLAR_OPCODE_ENUM)
+#undef SOLAR_OPCODE_ENUM
+};
+
+struct Instruction {
+  Opcode opcode;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+
+  [[nodiscard]] uint16_t bx() const { return b << 8 | c; }
+  [[nodiscard]] int16_t sbx() const { return (int16_t)bx(); }
+};
+
+static_assert(sizeof(Instruction) == 4);
+
+// Values are unboxed, the compiler knows which member is live
+union Register {
+  int64_t integer;
+  uint64_t unsigned_integer;
+  double number;
+  const char *string;
+};
+
+// Signed integers are kept sign extended to 64 bits, unsigned ones zero
+// extended and floats are kept as doubles, the 32 bit kinds are rounded after
+// each operation
+enum class Kind {
+  VOID,
+  BOOL,
+  INT32,
+  INT64,
+  UINT32,
+  UINT64,
+  FLOAT32,
+  FLOAT64,
+  STRING
+};
+
+struct Function {
+  std::string name;
+  std::vector<Kind> parameter_kinds{};
+  Kind return_kind = Kind::VOID;
+  uint16_t register_count = 0;
+  std::vector<Instruction> code{};
+  std::vector<Register> constants{};
+};
+
+struct Program {
+  std::vector<Function> functions;
+  std::unordered_map<std::string, uint16_t> function_indexes;
+
+  // String constants point in here, so it must not move its elements
+  std::deque<std::string> strings;
+};
+
+class Compiler : public ast::ExpressionVisitor, public ast::StatementVisitor {
+private:
+  struct Local {
+    uint8_t index;
+    Kind kind;
+  };
+
+  Program *program = nullptr;
+  Function *function = nullptr;
+  std::unordered_map<std::string, Local> locals;
+  uint16_t next_register = 0;
+
+  // Evaluated consts are literals, which are compiled wherever they're used
+  std::unordered_map<std::string, ast::VariableDeclaration *> constants;
+
+  // Expressions are compiled into the target register and report their kind
+  uint8_t target = 0;
+  Kind kind = Kind::VOID;
+
+  std::vector<std::string> errors;
+
+  uint8_t allocate();
+  Kind compile(ast::Expression &, uint8_t target);
+  uint8_t operand(ast::Expression &, Kind &);
+  void coerce(uint8_t, Kind from, Kind to, const ast::Node &);
+  void compile_arguments(const ast::Call &, uint8_t base,
+                         const std::vector<Kind> &parameter_kinds,
+                         bool variadic);
+  void compile_return(ast::Expression &);
+  size_t emit(Opcode, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0);
+  size_t emit_wide(Opcode, uint8_t a, uint16_t bx);
+  void patch_jump(size_t jump);
+  void emit_loop(size_t start);
+  void error(const ast::Node &, const std::string &);
+
+public:
+  llvm::Expected<std::unique_ptr<Program>> compile(ast::Program &);
+
+  void *visit(ast::Variable &) override;
+  void *visit(ast::LiteralValueExpression &) override;
+  void *visit(ast::Binop &) override;
+  void *visit(ast::Condition &) override;
+  void *visit(ast::Call &) override;
+  void *visit(ast::StringLiteral &) override;
+  void *visit(ast::Index &) override;
+  void *visit(ast::ArrayLiteral &) override;
+  void *visit(ast::Member &) override;
+
+  void visit(ast::VariableDeclaration &) override;
+  void visit(ast::ExpressionStatement &) override;
+  void visit(ast::Function &) override;
+  void visit(ast::Block &) override;
+  void visit(ast::Return &) override;
+  void visit(ast::Assignment &) override;
+  void visit(ast::While &) override;
+  void visit(ast::For &) override;
+  void visit(ast::Struct &) override;
+};
+
+class Interpreter {
+private:
+  struct Frame {
+    const Function *function;
+    const Instruction *return_address;
+    Register *base;
+  };
+
+  std::vector<Register> registers;
+  std::vector<Frame> frames;
+
+public:
+  explicit Interpreter(size_t stack_size = 1 << 20);
+
+  // Runs main, returning what it returned
+  llvm::Expected<int64_t> run(const Program &);
+};
+
+} // namespace vm
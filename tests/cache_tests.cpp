@@ -0,0 +1,64 @@
+#include "catch/catch.hpp"
+
+#include "../src/cache.hpp"
+#include "llvm/Support/FileSystem.h"
+
+#include <thread>
+
+using namespace llvm;
+
+static std::filesystem::path temporary_cache() {
+  SmallString<128> path;
+  REQUIRE(!sys::fs::createUniqueDirectory("solar-cache-test", path));
+  return path.str().str();
+}
+
+static ObjectBuffer object_of_size(size_t size) {
+  return ObjectBuffer(size, 'o');
+}
+
+TEST_CASE("keys depend on every field and where it ends", "[cache]") {
+  auto key = [](StringRef first, StringRef second) {
+    CacheKey key;
+    return key.add(first).add(second).digest();
+  };
+
+  REQUIRE(key("ab", "c") == key("ab", "c"));
+  REQUIRE(key("ab", "c") != key("a", "bc"));
+  REQUIRE(key("ab", "c") != key("ab", "d"));
+}
+
+TEST_CASE("stored objects are found by their key", "[cache]") {
+  auto directory = temporary_cache();
+  CompilationCache cache(directory, 1024 * 1024);
+
+  REQUIRE(!cache.lookup("0123456789abcdef"));
+  REQUIRE(!cache.store("0123456789abcdef", object_of_size(16)));
+
+  auto object = cache.lookup("0123456789abcdef");
+  REQUIRE(object);
+  REQUIRE(object->size() == 16);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("the least recently used objects are evicted", "[cache]") {
+  auto directory = temporary_cache();
+  CompilationCache cache(directory, 2048);
+
+  REQUIRE(!cache.store("aa00", object_of_size(1024)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(!cache.store("bb00", object_of_size(1024)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  // Using the older object makes the newer one the least recently used
+  REQUIRE(cache.lookup("aa00"));
+  REQUIRE(!cache.store("cc00", object_of_size(1024)));
+  cache.evict();
+
+  REQUIRE(cache.lookup("aa00"));
+  REQUIRE(!cache.lookup("bb00"));
+  REQUIRE(cache.lookup("cc00"));
+
+  std::filesystem::remove_all(directory);
+}
@@ -1,21 +1,15 @@
 #include "catch/catch.hpp"
 
 #include "../src/codegen.hpp"
-#include "../src/lexer.hpp"
-#include "../src/parser.hpp"
+#include "../src/generics.hpp"
+#include "helpers.hpp"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Verifier.h"
 
 using namespace ast;
 using namespace llvm;
 
-static ast::Program *parse_program(std::string source) {
-  source += (char)EOF;
-  std::vector<char> input(source.begin(), source.end());
-  Lexer lexer{&input, 0};
-  Parser parser(&lexer);
-
-  return parser.parse_program();
-}
-
 TEST_CASE("add_two function is generated", "[codegen]") {
   auto program = parse_program("func add_two(n: i32) -> i32 { return n + 2 }");
 
@@ -95,3 +89,687 @@ TEST_CASE("debug info is generated", "[codegen]") {
   REQUIRE(debug_subprogram->getName() == "greater_than");
   REQUIRE(debug_subprogram->getType()->getTypeArray()[0]->getName() == "i32");
 }
+
+TEST_CASE("self recursive call in tail position is musttail", "[codegen]") {
+  auto program = parse_program("func sum(n: i64, acc: i64) -> i64 {"
+                               "return if n == 0 { acc } else {"
+                               "sum(n - 1, acc + n) }"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("sum");
+
+  auto calls = 0;
+  for (const auto &block : *function) {
+    REQUIRE(block.getTerminator() != nullptr);
+    for (const auto &instruction : block) {
+      if (auto call = dyn_cast<CallInst>(&instruction)) {
+        if (call->getCalledFunction() == function) {
+          REQUIRE(call->isMustTailCall());
+          calls += 1;
+        }
+      }
+    }
+  }
+
+  REQUIRE(calls == 1);
+}
+
+TEST_CASE("calls outside tail position are not tail calls", "[codegen]") {
+  auto program = parse_program("func fib(n: i64) -> i64 {"
+                               "return if n < 3 { 1 } else {"
+                               "fib(n - 1) + fib(n - 2) }"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("fib");
+
+  for (const auto &block : *function) {
+    for (const auto &instruction : block) {
+      if (auto call = dyn_cast<CallInst>(&instruction)) {
+        REQUIRE(!call->isTailCall());
+      }
+    }
+  }
+}
+
+TEST_CASE("tail recursion becomes a loop in release", "[codegen]") {
+  auto program = parse_program("func sum(n: i64, acc: i64) -> i64 {"
+                               "return if n == 0 { acc } else {"
+                               "sum(n - 1, acc + n) }"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program, true);
+  const auto function = module->getFunction("sum");
+
+  for (const auto &block : *function) {
+    for (const auto &instruction : block) {
+      REQUIRE(!isa<CallInst>(instruction));
+    }
+  }
+}
+
+TEST_CASE("loop hints become loop metadata", "[codegen]") {
+  auto program = parse_program("func sum(n: i64) -> i64 {"
+                               "var total: i64 = 0 "
+                               "@unroll(4) @vectorize(8) "
+                               "for i in 0..n { total = total + i }"
+                               "return total"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("sum");
+
+  // The latch is the only block that branches back to the header
+  const auto header = std::find_if(
+      function->begin(), function->end(),
+      [](const BasicBlock &block) { return block.getName() == "for.header"; });
+  REQUIRE(header != function->end());
+  REQUIRE(header->hasNPredecessors(2));
+
+  auto latch = header->getUniquePredecessor();
+  for (const auto predecessor : predecessors(&*header)) {
+    if (predecessor->getName() == "for.latch")
+      latch = predecessor;
+  }
+  REQUIRE(latch);
+
+  auto loop_id = latch->getTerminator()->getMetadata(LLVMContext::MD_loop);
+  REQUIRE(loop_id);
+  REQUIRE(loop_id->getOperand(0) == loop_id);
+
+  std::vector<std::string> hints;
+  for (const auto &operand : drop_begin(loop_id->operands())) {
+    auto hint = cast<MDNode>(operand);
+    hints.push_back(cast<MDString>(hint->getOperand(0))->getString().str());
+  }
+
+  REQUIRE(hints == std::vector<std::string>{"llvm.loop.unroll.count",
+                                            "llvm.loop.vectorize.enable",
+                                            "llvm.loop.vectorize.width"});
+}
+
+static bool traps(const llvm::Function &function) {
+  for (const auto &block : function) {
+    for (const auto &instruction : block) {
+      auto call = dyn_cast<CallInst>(&instruction);
+      if (call && call->getIntrinsicID() == Intrinsic::trap)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+static bool has_instruction(const llvm::Function &function,
+                            unsigned opcode) {
+  for (const auto &instruction : instructions(function)) {
+    if (instruction.getOpcode() == opcode)
+      return true;
+  }
+
+  return false;
+}
+
+static bool has_predicate(const llvm::Function &function,
+                          CmpInst::Predicate predicate) {
+  for (const auto &instruction : instructions(function)) {
+    auto compare = dyn_cast<CmpInst>(&instruction);
+    if (compare && compare->getPredicate() == predicate)
+      return true;
+  }
+
+  return false;
+}
+
+TEST_CASE("unsigned operands divide and compare unsigned", "[codegen]") {
+  auto program = parse_program("func f(a: u64, b: u64) -> u64 {"
+                               "return if a < b { a / b } else { a % b }"
+                               "}"
+                               "func g(a: i64, b: i64) -> i64 {"
+                               "return if a < b { a / b } else { a % b }"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto f = module->getFunction("f");
+  const auto g = module->getFunction("g");
+
+  REQUIRE(has_instruction(*f, Instruction::UDiv));
+  REQUIRE(has_instruction(*f, Instruction::URem));
+  REQUIRE(has_predicate(*f, CmpInst::ICMP_ULT));
+  REQUIRE(!has_instruction(*f, Instruction::SDiv));
+
+  REQUIRE(has_instruction(*g, Instruction::SDiv));
+  REQUIRE(has_instruction(*g, Instruction::SRem));
+  REQUIRE(has_predicate(*g, CmpInst::ICMP_SLT));
+}
+
+static bool adds_without_signed_wrap(const llvm::Function &function) {
+  for (const auto &instruction : instructions(function)) {
+    if (instruction.getOpcode() == Instruction::Add)
+      return instruction.hasNoSignedWrap();
+  }
+
+  return false;
+}
+
+TEST_CASE("signed arithmetic doesn't wrap unless asked to", "[codegen]") {
+  auto source = "func f(a: i64, b: i64) -> i64 { return a + b }"
+                "func g(a: u64, b: u64) -> u64 { return a + b }";
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", parse_program(source));
+  REQUIRE(adds_without_signed_wrap(*module->getFunction("f")));
+  REQUIRE(!adds_without_signed_wrap(*module->getFunction("g")));
+
+  CodeGen wrapping;
+  wrapping.options.wrapping_arithmetic = true;
+  module = wrapping.compile_module("test_module", parse_program(source));
+  REQUIRE(!adds_without_signed_wrap(*module->getFunction("f")));
+}
+
+TEST_CASE("indexing is bounds checked", "[codegen]") {
+  auto program = parse_program("func get(s: []i64, i: i64) -> i64 {"
+                               "return s[i]"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  REQUIRE(traps(*module->getFunction("get")));
+}
+
+TEST_CASE("bounds checks can be turned off", "[codegen]") {
+  auto program = parse_program("func get(s: []i64, i: i64) -> i64 {"
+                               "return s[i]"
+                               "}");
+
+  CodeGen codegen;
+  codegen.options.bounds_checks = false;
+  auto module = codegen.compile_module("test_module", program);
+  REQUIRE(!traps(*module->getFunction("get")));
+}
+
+TEST_CASE("indexes proven in range are not checked", "[codegen]") {
+  auto program = parse_program("func sum(s: []i64) -> i64 {"
+                               "var total: i64 = 0 "
+                               "for i in 0..len(s) { total = total + s[i] }"
+                               "var a: [4]i64 = [0; 4] "
+                               "for j in 0..4 { a[j] = j }"
+                               "return total + a[3]"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  REQUIRE(!traps(*module->getFunction("sum")));
+}
+
+TEST_CASE("a lone slice parameter is noalias", "[codegen]") {
+  auto program = parse_program("func scale(s: []f64, k: f64) -> i64 {"
+                               "for i in 0..len(s) { s[i] = s[i] * k }"
+                               "return 0"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("scale");
+
+  REQUIRE(function->arg_size() == 3);
+  REQUIRE(function->hasParamAttribute(0, llvm::Attribute::NoAlias));
+  REQUIRE(!function->hasParamAttribute(1, llvm::Attribute::NoAlias));
+}
+
+TEST_CASE("slices that are written may alias", "[codegen]") {
+  auto program = parse_program("func copy(to: []i64, from: []i64) -> i64 {"
+                               "for i in 0..len(to) { to[i] = from[i] }"
+                               "return 0"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("copy");
+
+  REQUIRE(!function->hasParamAttribute(0, llvm::Attribute::NoAlias));
+  REQUIRE(!function->hasParamAttribute(2, llvm::Attribute::NoAlias));
+}
+
+TEST_CASE("vector arithmetic is lane-wise", "[codegen]") {
+  auto program = parse_program("func axpy(a: f32, x: f32x4, y: f32x4) "
+                               "-> f32x4 {"
+                               "return x * a + y"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program, true);
+  const auto function = module->getFunction("axpy");
+
+  auto f32 = llvm::Type::getFloatTy(module->getContext());
+  auto vector = FixedVectorType::get(f32, 4);
+  REQUIRE(function->getReturnType() == vector);
+  REQUIRE(function->getArg(1)->getType() == vector);
+
+  std::vector<unsigned> opcodes;
+  for (const auto &instruction : function->getEntryBlock()) {
+    if (instruction.isBinaryOp()) {
+      REQUIRE(instruction.getType() == vector);
+      opcodes.push_back(instruction.getOpcode());
+    }
+  }
+
+  REQUIRE(opcodes ==
+          std::vector<unsigned>{Instruction::FMul, Instruction::FAdd});
+}
+
+TEST_CASE("masks select, shuffle and reduce", "[codegen]") {
+  auto program = parse_program("func f(v: i32x4) -> i32 {"
+                               "var mask: boolx4 = v > 0 "
+                               "var kept: i32x4 = select(mask, v, i32x4(0)) "
+                               "return reduce_add(shuffle(kept, [3, 2, 1, 0]))"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  const auto function = module->getFunction("f");
+
+  auto shuffles = 0;
+  auto selects = 0;
+  auto reductions = 0;
+  for (const auto &instruction : function->getEntryBlock()) {
+    if (auto compare = dyn_cast<ICmpInst>(&instruction))
+      REQUIRE(compare->getType()->isVectorTy());
+
+    shuffles += isa<ShuffleVectorInst>(instruction);
+    selects += isa<SelectInst>(instruction);
+
+    auto call = dyn_cast<CallInst>(&instruction);
+    reductions += call && call->getIntrinsicID() != Intrinsic::not_intrinsic &&
+                  call->getIntrinsicID() != Intrinsic::dbg_declare;
+  }
+
+  REQUIRE(shuffles >= 1);
+  REQUIRE(selects == 1);
+  REQUIRE(reductions == 1);
+}
+
+TEST_CASE("function attributes become LLVM attributes", "[codegen]") {
+  auto program = parse_program("@pure func square(x: i64) -> i64 {"
+                               "return x * x"
+                               "}"
+                               "@cold @noinline func fail() -> i32 {"
+                               "return printf(\"failed\")"
+                               "}"
+                               "@hot func run(s: []i64) -> i64 { return 0 }");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+
+  const auto square = module->getFunction("square");
+  REQUIRE(square->doesNotAccessMemory());
+  REQUIRE(!square->hasFnAttribute(llvm::Attribute::WillReturn));
+
+  const auto fail = module->getFunction("fail");
+  REQUIRE(fail->hasFnAttribute(llvm::Attribute::Cold));
+  REQUIRE(fail->hasFnAttribute(llvm::Attribute::NoInline));
+  REQUIRE(fail->getSectionPrefix() == StringRef("unlikely"));
+
+  const auto run = module->getFunction("run");
+  REQUIRE(run->getSectionPrefix() == StringRef("hot"));
+}
+
+static FastMathFlags fast_math_flags(const llvm::Function &function) {
+  for (const auto &instruction : instructions(function)) {
+    if (instruction.getOpcode() == Instruction::FAdd)
+      return instruction.getFastMathFlags();
+  }
+
+  return {};
+}
+
+TEST_CASE("fast math flags are scoped to functions", "[codegen]") {
+  auto source = "func strict(a: f64, b: f64) -> f64 { return a * b + a }"
+                "@fastmath func fast(a: f64, b: f64) -> f64 {"
+                "return a * b + a"
+                "}"
+                "@fastmath(contract) func fused(a: f64, b: f64) -> f64 {"
+                "return a * b + a"
+                "}";
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", parse_program(source));
+
+  const auto strict = module->getFunction("strict");
+  REQUIRE(!fast_math_flags(*strict).any());
+  REQUIRE(!strict->hasFnAttribute("unsafe-fp-math"));
+
+  const auto fast = module->getFunction("fast");
+  REQUIRE(fast_math_flags(*fast).isFast());
+  REQUIRE(fast->getFnAttribute("unsafe-fp-math").getValueAsString() == "true");
+
+  const auto fused = fast_math_flags(*module->getFunction("fused"));
+  REQUIRE(fused.allowContract());
+  REQUIRE(!fused.allowReassoc());
+
+  CodeGen reassociating;
+  reassociating.options.reassociate = true;
+  reassociating.options.no_signed_zeros = true;
+  reassociating.options.flush_denormals = true;
+  module =
+      reassociating.compile_module("test_module", parse_program(source));
+
+  const auto flags = fast_math_flags(*module->getFunction("strict"));
+  REQUIRE(flags.allowReassoc());
+  REQUIRE(flags.noSignedZeros());
+  REQUIRE(!flags.allowContract());
+  REQUIRE(module->getFunction("strict")
+              ->getFnAttribute("denormal-fp-math")
+              .getValueAsString() == "preserve-sign,preserve-sign");
+}
+
+TEST_CASE("functions are declared for the target", "[codegen]") {
+  auto source = "func square(n: i64) -> i64 { return n * n }";
+
+  CodeGen portable;
+  auto module = portable.compile_module("test_module", parse_program(source));
+  REQUIRE(!module->getFunction("square")->hasFnAttribute("target-cpu"));
+
+  CodeGen codegen;
+  codegen.options.target_cpu = "skylake";
+  codegen.options.target_features = "+avx2";
+  module = codegen.compile_module("test_module", parse_program(source));
+
+  const auto square = module->getFunction("square");
+  REQUIRE(square->getFnAttribute("target-cpu").getValueAsString() ==
+          "skylake");
+  REQUIRE(square->getFnAttribute("target-features").getValueAsString() ==
+          "+avx2");
+}
+
+TEST_CASE("inline and flatten inline calls without optimizations",
+          "[codegen]") {
+  auto program = parse_program("func main() -> i64 { return twice(3) }"
+                               "@flatten func twice(x: i64) -> i64 {"
+                               "return one(x) + one(x)"
+                               "}"
+                               "@inline func one(x: i64) -> i64 {"
+                               "return x"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+
+  for (const auto &instruction : instructions(module->getFunction("twice"))) {
+    auto call = dyn_cast<CallInst>(&instruction);
+    REQUIRE((!call || call->getIntrinsicID() != Intrinsic::not_intrinsic));
+  }
+}
+
+TEST_CASE("functions compiled alone warn about calls left uninlined",
+          "[codegen]") {
+  auto program = parse_program("func main() -> i64 { return twice(3) }"
+                               "@flatten func twice(x: i64) -> i64 {"
+                               "return one(x) + one(x)"
+                               "}"
+                               "@inline func one(x: i64) -> i64 {"
+                               "return x"
+                               "}");
+  auto twice = dynamic_cast<ast::Function *>(program->statements[1]);
+  REQUIRE(twice);
+
+  CodeGen codegen;
+  delete codegen.compile_module("test_module", program);
+  REQUIRE(codegen.warnings.empty());
+
+  delete codegen.compile_function("test_module", program, *twice);
+  REQUIRE(codegen.warnings.size() == 1);
+  REQUIRE(codegen.warnings[0].find("Calls from twice to one aren't inlined") !=
+          std::string::npos);
+}
+
+TEST_CASE("consts are read only globals", "[codegen]") {
+  auto source = "const var table: [4]i32 = [1i32, 2i32, 3i32, 4i32]"
+                "func lookup(i: i64) -> f64 {"
+                "const var scale: f64 = 2.5 "
+                "return if table[i] > 2i32 { scale } else { 0.0 }"
+                "}";
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", parse_program(source));
+
+  auto table = module->getGlobalVariable("table", true);
+  REQUIRE(table);
+  REQUIRE(table->isConstant());
+  REQUIRE(table->hasPrivateLinkage());
+  REQUIRE(table->hasGlobalUnnamedAddr());
+  REQUIRE(isa<ConstantDataArray>(table->getInitializer()));
+
+  auto scale = module->getGlobalVariable("scale", true);
+  REQUIRE(scale);
+  REQUIRE(cast<ConstantFP>(scale->getInitializer())->isExactlyValue(2.5));
+
+  for (auto &instruction : instructions(*module->getFunction("lookup"))) {
+    auto store = dyn_cast<StoreInst>(&instruction);
+    REQUIRE((!store || !isa<GlobalVariable>(store->getPointerOperand())));
+  }
+}
+
+TEST_CASE("memoized functions are a cache in front of their body",
+          "[codegen]") {
+  auto source = "@memoize(100) @pure func fib(n: i64) -> i64 {"
+                "return if n < 3 { 1 } else { fib(n - 1) + fib(n - 2) }"
+                "}"
+                "@memoize(threadsafe) func grid(x: i64, y: f32) -> f32 {"
+                "return if x == 0 { y } else { grid(x - 1, y) }"
+                "}";
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", parse_program(source));
+  REQUIRE(!verifyModule(*module, &errs()));
+
+  // A direct table of 100 entries, each a state and a result
+  auto table = module->getGlobalVariable("fib.cache", true);
+  REQUIRE(table);
+  REQUIRE(table->getValueType()->getArrayNumElements() == 100);
+
+  // The body's recursive calls go through the cache, and the cache calls
+  // the body. Writing the cache means neither can be readnone.
+  auto fib = module->getFunction("fib");
+  auto uncached = module->getFunction("fib.uncached");
+  REQUIRE(uncached->hasPrivateLinkage());
+  REQUIRE(!fib->doesNotAccessMemory());
+  REQUIRE(!uncached->doesNotAccessMemory());
+
+  auto calls = [](llvm::Function *caller, llvm::Function *callee) {
+    for (auto &instruction : instructions(*caller)) {
+      auto call = dyn_cast<CallInst>(&instruction);
+      if (call && call->getCalledFunction() == callee)
+        return true;
+    }
+    return false;
+  };
+  REQUIRE(calls(fib, uncached));
+  REQUIRE(calls(uncached, fib));
+  REQUIRE(!calls(uncached, uncached));
+
+  // Thread safe caches are read and written atomically, and a writer's
+  // claim on an entry is released before it writes the entry's fields
+  auto atomics = 0;
+  auto claim_released = false;
+  for (auto &instruction : instructions(*module->getFunction("grid"))) {
+    atomics += instruction.isAtomic();
+
+    auto fence = dyn_cast<FenceInst>(&instruction);
+    auto claim = fence ? fence->getParent()->getSinglePredecessor() : nullptr;
+    claim_released |= claim && fence == &fence->getParent()->front() &&
+                      fence->getOrdering() == AtomicOrdering::Release &&
+                      std::any_of(claim->begin(), claim->end(),
+                                  [](const Instruction &instruction) {
+                                    return isa<AtomicCmpXchgInst>(instruction);
+                                  });
+  }
+  REQUIRE(atomics > 0);
+  REQUIRE(claim_released);
+  REQUIRE(module->getGlobalVariable("grid.cache", true)
+              ->getValueType()
+              ->getArrayNumElements() == 1024);
+}
+
+TEST_CASE("generic functions are compiled as their specializations",
+          "[codegen]") {
+  auto program = parse_program("func sum<T>(values: []T) -> T {"
+                               "var total: T = 0"
+                               "for i in 0..len(values) {"
+                               "total = total + values[i]"
+                               "}"
+                               "return total"
+                               "}"
+                               "func main(a: [64]i32, b: [64]f64) -> f64 {"
+                               "var small: i32 = sum(a)"
+                               "return sum(b)"
+                               "}");
+  REQUIRE(!monomorphize(*program));
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program, true);
+  REQUIRE(!verifyModule(*module, &errs()));
+  REQUIRE(!module->getFunction("sum"));
+
+  auto &context = module->getContext();
+  auto integers = module->getFunction("sum<i32>");
+  auto doubles = module->getFunction("sum<f64>");
+  REQUIRE(integers->getReturnType() == llvm::Type::getInt32Ty(context));
+  REQUIRE(doubles->getReturnType() == llvm::Type::getDoubleTy(context));
+
+  // Each is compiled as if it had been written for its type
+  auto adds = [](llvm::Function *function, unsigned opcode) {
+    for (auto &instruction : instructions(*function)) {
+      if (instruction.getOpcode() == opcode)
+        return true;
+    }
+    return false;
+  };
+  REQUIRE(adds(integers, Instruction::Add));
+  REQUIRE(!adds(integers, Instruction::FAdd));
+  REQUIRE(adds(doubles, Instruction::FAdd));
+}
+
+static StructType *struct_named(const Module &module, StringRef name) {
+  return StructType::getTypeByName(module.getContext(), name);
+}
+
+TEST_CASE("structs are laid out as their attributes ask", "[codegen]") {
+  auto program = parse_program("struct Point { x: f64, y: f64 }"
+                               "@packed struct Header { tag: i64, size: i32 }"
+                               "@align(64) struct Counter { hits: i64 }"
+                               "func scale(p: Point, k: f64) -> Point {"
+                               "return Point(p.x * k, p.y * k)"
+                               "}"
+                               "func size(h: Header) -> i32 { return h.size }"
+                               "func main() -> i64 {"
+                               "var counters: [4]Counter = [Counter(0); 4]"
+                               "counters[1].hits = 7 "
+                               "return counters[1].hits"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  REQUIRE(!verifyModule(*module, &errs()));
+
+  // Structs are passed and returned by value
+  auto point = struct_named(*module, "Point");
+  auto scale = module->getFunction("scale");
+  REQUIRE(point);
+  REQUIRE(point->getNumElements() == 2);
+  REQUIRE(scale->getReturnType() == point);
+  REQUIRE(scale->getArg(0)->getType() == point);
+
+  DataLayout layout(module);
+  auto header = struct_named(*module, "Header");
+  REQUIRE(header->isPacked());
+  REQUIRE(layout.getTypeAllocSize(header) == 12);
+
+  // Each counter is on a cache line of its own
+  auto counter = struct_named(*module, "Counter");
+  REQUIRE(layout.getTypeAllocSize(counter) == 64);
+  REQUIRE(layout.getABITypeAlignment(counter) == 64);
+  REQUIRE(layout.getTypeAllocSize(ArrayType::get(counter, 4)) == 256);
+}
+
+TEST_CASE("arrays of @soa structs are stored as a column per field",
+          "[codegen]") {
+  auto program = parse_program("@soa struct Particle { x: f64, alive: bool }"
+                               "func sum(ps: []Particle) -> f64 {"
+                               "var total: f64 = 0.0 "
+                               "for i in 0..len(ps) {"
+                               "total = total + ps[i].x"
+                               "}"
+                               "return total"
+                               "}"
+                               "func main() -> f64 {"
+                               "var ps: [8]Particle = [Particle(1, 1 == 1); 8]"
+                               "ps[2] = Particle(3.5, 1 == 0)"
+                               "return sum(ps[1..4])"
+                               "}");
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", program);
+  REQUIRE(!verifyModule(*module, &errs()));
+
+  auto &context = module->getContext();
+  auto array = struct_named(*module, "[8]Particle");
+  REQUIRE(array);
+  REQUIRE(array->getElementType(0) ==
+          ArrayType::get(llvm::Type::getDoubleTy(context), 8));
+  REQUIRE(array->getElementType(1) ==
+          ArrayType::get(llvm::Type::getInt1Ty(context), 8));
+
+  // Slices are passed as a pointer to each column, which can't alias each
+  // other, and their length
+  auto sum = module->getFunction("sum");
+  REQUIRE(sum->arg_size() == 3);
+  REQUIRE(sum->getArg(0)->getType() ==
+          PointerType::getUnqual(llvm::Type::getDoubleTy(context)));
+  REQUIRE(sum->getArg(0)->hasNoAliasAttr());
+  REQUIRE(sum->getArg(1)->hasNoAliasAttr());
+  REQUIRE(sum->getArg(2)->getType()->isIntegerTy(64));
+
+  // Reading a field only loads from its column
+  for (auto &instruction : instructions(*sum)) {
+    if (auto load = dyn_cast<LoadInst>(&instruction))
+      REQUIRE(!load->getType()->isIntegerTy(1));
+  }
+}
+
+TEST_CASE("print calls the output runtime instead of printf", "[codegen]") {
+  auto source = "func main() -> i32 {"
+                "var n: i32 = 42 "
+                "print(\"%s %-4d|%x %.2f\\n\", \"n\", n, 255u64, 1.5)"
+                "return 0"
+                "}";
+
+  CodeGen codegen;
+  auto module = codegen.compile_module("test_module", parse_program(source));
+  REQUIRE(!verifyModule(*module, &errs()));
+
+  std::vector<std::string> callees;
+  for (auto &instruction : instructions(*module->getFunction("main"))) {
+    auto call = dyn_cast<CallInst>(&instruction);
+    if (call && !isa<IntrinsicInst>(call))
+      callees.push_back(call->getCalledFunction()->getName().str());
+  }
+
+  // The string is folded into the text in front of the integer
+  REQUIRE(callees == std::vector<std::string>{
+                         "solar.write", "solar.print_integer", "solar.write",
+                         "solar.print_integer", "solar.write",
+                         "solar.print_float", "solar.write", "solar.end_line",
+                         "solar.flush"});
+
+  // The runtime is linked once however many modules print
+  REQUIRE(module->getFunction("solar.write")->hasLinkOnceODRLinkage());
+  REQUIRE(module->getGlobalVariable(output_buffer_name)
+              ->hasLinkOnceODRLinkage());
+}
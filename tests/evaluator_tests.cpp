@@ -0,0 +1,119 @@
+#include "catch/catch.hpp"
+
+#include "../src/evaluator.hpp"
+#include "helpers.hpp"
+
+// The initializer of the program's first const, after evaluation
+static std::string evaluate(const std::string &source) {
+  auto program = parse_program(source);
+  auto error = evaluate_constants(*program);
+  REQUIRE(!error);
+
+  for (const auto &statement : program->statements) {
+    auto constant = dynamic_cast<ast::VariableDeclaration *>(statement);
+    if (constant && constant->is_const)
+      return constant->initializer->describe();
+  }
+
+  FAIL("No const in the program");
+  return "";
+}
+
+// Why the program's consts couldn't be evaluated
+static std::string failure(const std::string &source,
+                           const EvaluationLimits &limits = {}) {
+  auto program = parse_program(source);
+  auto error = evaluate_constants(*program, limits);
+  REQUIRE((bool)error);
+
+  return toString(std::move(error));
+}
+
+TEST_CASE("const funcs are called at compile time", "[evaluator]") {
+  REQUIRE(evaluate("const func fib(n: i64) -> i64 {"
+                   "return if n < 2 { n } else { fib(n - 1) + fib(n - 2) }"
+                   "}"
+                   "const var fib20: i64 = fib(20)") == "(i64<6765>)");
+}
+
+TEST_CASE("const tables are evaluated into array literals", "[evaluator]") {
+  REQUIRE(evaluate("const func squares() -> [5]u32 {"
+                   "var table: [5]u32 = [0u32; 5]"
+                   "for i in 0..5 { table[i] = i * i }"
+                   "return table"
+                   "}"
+                   "const var table: [5]u32 = squares()") ==
+          "(array (u32<0>), (u32<1>), (u32<4>), (u32<9>), "
+          "(u32<16>))");
+
+  REQUIRE(evaluate("const var zeros: [4]i64 = [0; 4]") ==
+          "(array (i64<0>); 4)");
+}
+
+TEST_CASE("consts can use the consts declared ahead of them",
+          "[evaluator]") {
+  REQUIRE(evaluate("const var base: i64 = 40"
+                   "func main() -> i64 {"
+                   "const var answer: i64 = base + 2"
+                   "return answer"
+                   "}"
+                   "const var unused: i64 = 0") == "(i64<40>)");
+
+  auto program = parse_program("const var base: i64 = 40"
+                               "func main() -> i64 {"
+                               "const var answer: i64 = base + 2"
+                               "return answer"
+                               "}");
+  REQUIRE(!evaluate_constants(*program));
+
+  auto main = dynamic_cast<ast::Function *>(program->statements[1]);
+  auto answer = dynamic_cast<ast::VariableDeclaration *>(
+      main->body->statements[0]);
+  REQUIRE(answer->initializer->describe() == "(i64<42>)");
+}
+
+TEST_CASE("what can't be evaluated is reported", "[evaluator]") {
+  REQUIRE(failure("func now() -> i64 { return 0 }"
+                  "const var start: i64 = now()")
+              .find("now isn't a const func") != std::string::npos);
+
+  REQUIRE(failure("func main(n: i64) -> i64 {"
+                  "const var twice: i64 = n * 2"
+                  "return twice"
+                  "}")
+              .find("n isn't known at compile time, evaluating const twice") !=
+          std::string::npos);
+
+  REQUIRE(failure("const var table: [2]i64 = [1, 2]"
+                  "func main() -> i64 { table[0] = 3 return 0 }")
+              .find("table is const") != std::string::npos);
+
+  REQUIRE(failure("const var table: [2]i64 = [1, 2]"
+                  "const var past: i64 = table[2]")
+              .find("out of bounds") != std::string::npos);
+}
+
+TEST_CASE("evaluation stops at its limits", "[evaluator]") {
+  EvaluationLimits limits;
+  limits.steps = 1000;
+  REQUIRE(failure("const func forever() -> i64 {"
+                  "var i: i64 = 0"
+                  "while i >= 0 { i = i + 1 }"
+                  "return i"
+                  "}"
+                  "const var never: i64 = forever()",
+                  limits)
+              .find("Took more than 1000 steps") != std::string::npos);
+
+  limits = {};
+  limits.memory = 1024;
+  REQUIRE(failure("const var big: [100000]i64 = [0; 100000]", limits)
+              .find("Used more than 1024 bytes") != std::string::npos);
+
+  limits = {};
+  limits.call_depth = 16;
+  REQUIRE(failure("const func deep(n: i64) -> i64 { return deep(n + 1) }"
+                  "const var never: i64 = deep(0)",
+                  limits)
+              .find("Calls nest more than 16 deep") != std::string::npos);
+}
@@ -0,0 +1,73 @@
+#include "catch/catch.hpp"
+
+#include "../src/format.hpp"
+#include "helpers.hpp"
+
+// Why the program's prints can't be compiled, or nothing
+static std::string check(const std::string &source) {
+  auto error = check_prints(*parse_program(source));
+  return error ? toString(std::move(error)) : "";
+}
+
+TEST_CASE("formats are split into text and conversions", "[format]") {
+  std::vector<FormatSegment> segments;
+  REQUIRE(parse_format("x = %-8d, 100%% %08.3f\n", segments).empty());
+  REQUIRE(segments.size() == 3);
+
+  REQUIRE(segments[0].text == "x = ");
+  REQUIRE(segments[0].conversion == 'd');
+  REQUIRE(segments[0].left_justify);
+  REQUIRE(segments[0].width == 8);
+
+  REQUIRE(segments[1].text == ", 100% ");
+  REQUIRE(segments[1].conversion == 'f');
+  REQUIRE(segments[1].zero_pad);
+  REQUIRE(segments[1].width == 8);
+  REQUIRE(segments[1].precision == 3);
+
+  REQUIRE(segments[2].text == "\n");
+  REQUIRE(segments[2].conversion == 0);
+}
+
+TEST_CASE("formats print can't handle are rejected", "[format]") {
+  std::vector<FormatSegment> segments;
+  REQUIRE(parse_format("%", segments) ==
+          "The format ends in the middle of a conversion");
+  REQUIRE(parse_format("%g", segments) == "%g isn't a conversion print knows");
+  REQUIRE(parse_format("%ld", segments) ==
+          "%l isn't a conversion print knows");
+  REQUIRE(parse_format("%.2d", segments) ==
+          "Only %f takes a precision, not %d");
+}
+
+TEST_CASE("print's arguments match its conversions", "[format]") {
+  REQUIRE(check("func show(n: i32, count: u64, ratio: f32) {"
+                "print(\"%s %d %u %x %.2f\\n\", \"n\", n, count, 255, ratio)"
+                "}")
+              .empty());
+
+  REQUIRE(check("func show(n: i64) { print(\"%f\\n\", n) }")
+              .find("%f prints f32 or f64, not i64") != std::string::npos);
+  REQUIRE(check("func show(n: i64) { print(\"%u\\n\", n) }")
+              .find("%u prints u32 or u64, not i64") != std::string::npos);
+  REQUIRE(check("func show(n: i64) { print(\"%d %d\\n\", n) }")
+              .find("There's no argument for %d") != std::string::npos);
+  REQUIRE(check("func show() { print(\"%d\\n\", [1.5, 2.5][0]) }")
+              .find("not f64") != std::string::npos);
+  REQUIRE(check("func show(n: i64) { print(\"\\n\", n) }")
+              .find("print has more arguments than its format has "
+                    "conversions") != std::string::npos);
+}
+
+TEST_CASE("print's format must be known at compile time", "[format]") {
+  REQUIRE(check("func show() { print(5) }")
+              .find("print's format must be a string literal") !=
+          std::string::npos);
+  REQUIRE(check("func show() { print(\"%y\") }")
+              .find("%y isn't a conversion print knows") != std::string::npos);
+
+  // A program's own print is left alone
+  REQUIRE(check("func print(n: i64) {}"
+                "func main() -> i32 { print(5) return 0 }")
+              .empty());
+}
@@ -0,0 +1,145 @@
+#include "catch/catch.hpp"
+
+#include "../src/generics.hpp"
+#include "helpers.hpp"
+
+static ast::Function *function_named(const ast::Program &program,
+                                     const std::string &name) {
+  for (const auto &statement : program.statements) {
+    auto function = dynamic_cast<ast::Function *>(statement);
+    if (function && function->prototype.name.lexeme == name)
+      return function;
+  }
+
+  return nullptr;
+}
+
+// Why the program's generic functions couldn't be specialized
+static std::string failure(const std::string &source) {
+  auto program = parse_program(source);
+  auto error = monomorphize(*program);
+  REQUIRE((bool)error);
+
+  return toString(std::move(error));
+}
+
+TEST_CASE("generic functions are specialized once for each list of types",
+          "[generics]") {
+  auto program = parse_program("func max<T>(a: T, b: T) -> T {"
+                               "return if a > b { a } else { b }"
+                               "}"
+                               "func pick<T, U>(a: T, b: U) -> T { return a }"
+                               "func main(x: i32, y: f64) -> i32 {"
+                               "var a: i32 = max(x, x)"
+                               "var b: f64 = max(y, 2.5)"
+                               "var c: i32 = max(x, max(a, x))"
+                               "return pick(c, y)"
+                               "}");
+  REQUIRE(!monomorphize(*program));
+
+  // The generic functions are replaced by their specializations
+  REQUIRE(program->statements.size() == 4);
+  REQUIRE(!function_named(*program, "max"));
+  REQUIRE(!function_named(*program, "pick"));
+
+  auto max = function_named(*program, "max<i32>");
+  REQUIRE(max);
+  REQUIRE(max->prototype.describe() == "(fn-type max<i32>(a:i32, b:i32) ");
+  REQUIRE(function_named(*program, "max<f64>"));
+  REQUIRE(function_named(*program, "pick<i32,f64>"));
+
+  auto main = function_named(*program, "main");
+  REQUIRE(main->body->statements[2]->describe() ==
+          "(var-decl i32<c> (fn-call max<i32>: (var x), "
+          "(fn-call max<i32>: (var a), (var x))))");
+}
+
+TEST_CASE("literals in a specialization take the type they're used as",
+          "[generics]") {
+  auto program = parse_program("func sum<T>(values: []T) -> T {"
+                               "var total: T = 0"
+                               "for i in 0..len(values) {"
+                               "total = total + values[i] * 2"
+                               "}"
+                               "return total"
+                               "}"
+                               "func main(values: [8]f32) -> f32 {"
+                               "return sum(values)"
+                               "}");
+  REQUIRE(!monomorphize(*program));
+
+  auto sum = function_named(*program, "sum<f32>");
+  REQUIRE(sum);
+  REQUIRE(sum->prototype.describe() == "(fn-type sum<f32>(values:[]f32) ");
+  REQUIRE(sum->body->statements[0]->describe() ==
+          "(var-decl f32<total> (f32<0>))");
+
+  auto loop = dynamic_cast<ast::For *>(sum->body->statements[1]);
+  REQUIRE(loop->body->describe().find("(f32<2>)") != std::string::npos);
+}
+
+TEST_CASE("generic functions can call themselves and each other",
+          "[generics]") {
+  auto program = parse_program("func square<T>(x: T) -> T { return x * x }"
+                               "func power<T>(x: T, n: i64) -> T {"
+                               "return if n == 0 { 1 } else {"
+                               "if n % 2 == 0 { square(power(x, n / 2)) }"
+                               "else { x * power(x, n - 1) }"
+                               "}"
+                               "}"
+                               "func main() -> f64 { return power(1.5, 20) }");
+  REQUIRE(!monomorphize(*program));
+
+  auto power = function_named(*program, "power<f64>");
+  REQUIRE(power);
+  REQUIRE(function_named(*program, "square<f64>"));
+  REQUIRE(program->statements.size() == 3);
+
+  auto body = power->body->describe();
+  REQUIRE(body.find("(fn-call power<f64>:") != std::string::npos);
+  REQUIRE(body.find("(fn-call square<f64>:") != std::string::npos);
+  REQUIRE(body.find("(f64<1>)") != std::string::npos);
+}
+
+TEST_CASE("type arguments that can't be inferred are reported",
+          "[generics]") {
+  REQUIRE(failure("func zero<T>() -> T { return 0 }")
+              .find("T of zero isn't in the type of any of its parameters") !=
+          std::string::npos);
+
+  REQUIRE(failure("func max<T>(a: T, b: T) -> T { return a }"
+                  "func main(x: i32, y: f64) -> i32 { return max(x, y) }")
+              .find("In a call to max, T is both i32 and f64") !=
+          std::string::npos);
+
+  REQUIRE(failure("func first<T>(values: []T) -> T { return values[0] }"
+                  "func main() -> i64 { return first(\"text\") }")
+              .find("Can't infer T for a call to first") != std::string::npos);
+}
+
+TEST_CASE("generic functions of other files are reported", "[generics]") {
+  auto generic = parse_program("func max<T>(a: T, b: T) -> T {"
+                               "return if a > b { a } else { b }"
+                               "}"
+                               "func larger(a: i64, b: i64) -> i64 {"
+                               "return max(a, b)"
+                               "}");
+  auto caller = parse_program("func main() -> i64 {"
+                              "return larger(3, 4) + max(3, 4)"
+                              "}");
+
+  auto error = check_generic_calls({generic, caller});
+  REQUIRE((bool)error);
+  auto message = toString(std::move(error));
+  REQUIRE(message.find("Generic function max is defined in another file") !=
+          std::string::npos);
+  REQUIRE(message.find("larger") == std::string::npos);
+
+  // A file's own generic functions, and concrete ones of other files, can
+  // be called
+  auto own = parse_program("func max<T>(a: T, b: T) -> T { return a }"
+                           "func main() -> i64 {"
+                           "return larger(3, max(1, 2))"
+                           "}");
+  REQUIRE(!check_generic_calls({generic, own}));
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+
+#include <string>
+#include <vector>
+
+// Parses source the way the compiler parses a file, which ends with EOF
+inline ast::Program *parse_program(std::string source) {
+  source += (char)EOF;
+  std::vector<char> input(source.begin(), source.end());
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  return parser.parse_program();
+}
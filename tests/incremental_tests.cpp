@@ -0,0 +1,83 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/incremental.hpp"
+#include "helpers.hpp"
+
+// Hashes the last function of the program
+static std::string hash_last(const std::string &source,
+                             bool include_positions = false) {
+  auto program = parse_program(source);
+  auto signatures = collect_signatures({program});
+  auto function = dynamic_cast<ast::Function *>(program->statements.back());
+  REQUIRE(function);
+
+  return structural_hash(*function, signatures, include_positions,
+                         collect_declarations(*program),
+                         prints(program, {}));
+}
+
+TEST_CASE("unchanged functions hash the same", "[incremental]") {
+  REQUIRE(hash_last("func main() -> i32 { return 1 + 2 }") ==
+          hash_last("func main() -> i32 { return 1 + 2 }"));
+}
+
+TEST_CASE("edits to the body change the hash", "[incremental]") {
+  REQUIRE(hash_last("func main() -> i32 { return 1 + 2 }") !=
+          hash_last("func main() -> i32 { return 1 - 2 }"));
+}
+
+TEST_CASE("callee signatures are part of the hash", "[incremental]") {
+  auto caller = std::string("func main() -> i32 { return add(1, 2) }");
+
+  auto original = hash_last("func add(a: i32, b: i32) -> i32 { return a }" +
+                            caller);
+  auto new_body = hash_last("func add(a: i32, b: i32) -> i32 { return b }" +
+                            caller);
+  auto new_signature =
+      hash_last("func add(a: i64, b: i64) -> i32 { return a }" + caller);
+
+  REQUIRE(original == new_body);
+  REQUIRE(original != new_signature);
+}
+
+TEST_CASE("positions only matter with debug info", "[incremental]") {
+  auto original = std::string("func main() -> i32 { return 1 }");
+  auto moved = std::string("\n\nfunc main() -> i32 { return 1 }");
+
+  REQUIRE(hash_last(original) == hash_last(moved));
+  REQUIRE(hash_last(original, true) != hash_last(moved, true));
+}
+
+TEST_CASE("the program's consts are part of the hash", "[incremental]") {
+  auto main = std::string("func main() -> i64 { return 1 }");
+
+  REQUIRE(hash_last("const var limit: i64 = 10" + main) !=
+          hash_last("const var limit: i64 = 20" + main));
+  REQUIRE(hash_last("const func f() -> i64 { return 1 }") !=
+          hash_last("func f() -> i64 { return 1 }"));
+}
+
+TEST_CASE("struct layouts are part of the hash", "[incremental]") {
+  auto main = std::string("func main(p: Point) -> f64 { return p.x }");
+
+  REQUIRE(hash_last("struct Point { x: f64, y: f64 }" + main) ==
+          hash_last("struct Point { x: f64, y: f64 }" + main));
+  REQUIRE(hash_last("struct Point { x: f64, y: f64 }" + main) !=
+          hash_last("struct Point { y: f64, x: f64 }" + main));
+  REQUIRE(hash_last("struct Point { x: f64, y: f64 }" + main) !=
+          hash_last("@align(64) struct Point { x: f64, y: f64 }" + main));
+}
+
+TEST_CASE("whether anything prints is part of main's hash", "[incremental]") {
+  auto quiet = std::string("func greet() -> i32 { return 0 }");
+  auto loud = std::string("func greet() -> i32 { print(\"hi\\n\") return 0 }");
+
+  // main flushes the output once greet starts printing, though main itself
+  // is unchanged. Other functions don't care.
+  auto main = std::string("func main() -> i32 { greet() return 0 }");
+  REQUIRE(hash_last(quiet + main) != hash_last(loud + main));
+
+  auto other = std::string("func other() -> i32 { return greet() }");
+  REQUIRE(hash_last(quiet + other) == hash_last(loud + other));
+}
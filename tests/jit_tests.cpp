@@ -0,0 +1,384 @@
+#include "catch/catch.hpp"
+
+#include "../src/evaluator.hpp"
+#include "../src/generics.hpp"
+#include "../src/jit.hpp"
+#include "helpers.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+
+TEST_CASE("main runs in-process", "[jit]") {
+  auto program = parse_program("func add(a: i32, b: i32) -> i32 {"
+                               "return a + b"
+                               "}"
+                               "func main() -> i32 { return add(40, 2) }");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 42);
+}
+
+TEST_CASE("comparisons returned as integers are 0 or 1", "[jit]") {
+  auto program = parse_program("func less(a: i64, b: i64) -> i64 {"
+                               "return a < b"
+                               "}"
+                               "func main() -> i32 {"
+                               "return less(1, 2) * 2 + less(2, 1)"
+                               "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 2);
+}
+
+TEST_CASE("printf resolves from the process", "[jit]") {
+  auto program = parse_program("func main() -> i32 { return printf(\"\") }");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 0);
+}
+
+TEST_CASE("arrays are passed as slices", "[jit]") {
+  auto program = parse_program("func sum(s: []i64) -> i64 {"
+                               "var total: i64 = 0 "
+                               "for i in 0..len(s) { total = total + s[i] }"
+                               "return total"
+                               "}"
+                               "func main() -> i64 {"
+                               "var a: [4]i64 = [1, 2, 3, 4] "
+                               "a[0] = 10 "
+                               "return sum(a) + sum(a[1..3])"
+                               "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 24);
+}
+
+TEST_CASE("slices of local arrays outlive returned calls", "[jit]") {
+  auto program = parse_program("func total(s: []i64) -> i64 {"
+                               "var sum: i64 = 0 "
+                               "for i in 0..len(s) { sum = sum + s[i] }"
+                               "return sum"
+                               "}"
+                               "func first(s: []i64) -> i64 { return s[0] }"
+                               "func sum<T>(values: []T) -> T {"
+                               "var total: T = 0"
+                               "for i in 0..len(values) {"
+                               "total = total + values[i]"
+                               "}"
+                               "return total"
+                               "}"
+                               "func of_total() -> i64 {"
+                               "var a: [4]i64 = [1, 2, 3, 4] "
+                               "return total(a)"
+                               "}"
+                               "func of_first() -> i64 {"
+                               "var a: [2]i64 = [9, 1] "
+                               "return first(a)"
+                               "}"
+                               "func of_sum() -> i64 {"
+                               "var a: [3]i64 = [20, 30, 50] "
+                               "return sum(a)"
+                               "}"
+                               "func main() -> i64 {"
+                               "return of_total() + of_first() + of_sum()"
+                               "}");
+  REQUIRE(!monomorphize(*program));
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 10 + 9 + 100);
+}
+
+TEST_CASE("vector kernels run", "[jit]") {
+  auto program = parse_program("func main() -> i32 {"
+                               "var v: i32x4 = i32x4(1i32, 2i32, 3i32, 4i32) "
+                               "var w: i32x4 = shuffle(v * 2, [3, 2, 1, 0]) "
+                               "w[0] = w[0] + 1 "
+                               "return reduce_add(select(w > 4, w, v))"
+                               "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 22);
+}
+
+TEST_CASE("lazily added functions compile on their first call", "[jit]") {
+  auto program = parse_program("func main() -> i32 { return twice(21) }"
+                               "func twice(n: i32) -> i32 { return n * 2 }"
+                               "func unused(n: i32) -> i32 { return n }");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program_lazily("test_module", program));
+  REQUIRE(!(*jit)->is_compiled("twice"));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 42);
+
+  // Nothing ever calls unused, so it's never compiled
+  REQUIRE((*jit)->is_compiled("main"));
+  REQUIRE((*jit)->is_compiled("twice"));
+  REQUIRE(!(*jit)->is_compiled("unused"));
+}
+
+TEST_CASE("programs call functions of the other files", "[jit]") {
+  std::vector<ast::Program *> programs{
+      parse_program("func main() -> i32 { return twice(21) }"),
+      parse_program("func twice(n: i32) -> i32 { return n * 2 }"),
+  };
+
+  for (auto lazy : {false, true}) {
+    auto jit = Jit::create();
+    REQUIRE((bool)jit);
+    for (auto program : programs) {
+      auto error = lazy ? (*jit)->add_program_lazily("test_module", program,
+                                                     programs)
+                        : (*jit)->add_program("test_module", program, programs);
+      REQUIRE(!error);
+    }
+
+    auto main_function = (*jit)->lookup_main();
+    REQUIRE((bool)main_function);
+    REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 42);
+  }
+}
+
+TEST_CASE("callees compile in the background", "[jit]") {
+  auto program = parse_program("func main() -> i32 { return twice(21) }"
+                               "func twice(n: i32) -> i32 { return n * 2 }");
+
+  auto jit = Jit::create(false, 2);
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program_lazily("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 42);
+}
+
+TEST_CASE("callees are compiled before they're called", "[jit]") {
+  auto program = parse_program("func main() -> i32 {"
+                               "var n: i32 = 0 "
+                               "return if n > 0 { later(n) } else { 0i32 }"
+                               "}"
+                               "func later(n: i32) -> i32 { return n }");
+
+  for (auto tiered : {false, true}) {
+    auto jit = Jit::create(false, 2);
+    REQUIRE((bool)jit);
+    if (tiered)
+      REQUIRE(!(*jit)->enable_tiering(100));
+    REQUIRE(!(*jit)->add_program_lazily("test_module", program));
+
+    auto main_function = (*jit)->lookup_main();
+    REQUIRE((bool)main_function);
+    REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 0);
+
+    // main never calls later, it's only compiled speculatively
+    (*jit)->finish_tier_ups();
+    REQUIRE((*jit)->is_compiled("later"));
+  }
+}
+
+TEST_CASE("hot functions keep working after tiering up", "[jit]") {
+  auto program = parse_program(
+      "func main() -> i64 { return fib(10) }"
+      "func fib(n: i64) -> i64 { return if n < 3 { 1 } else { fib(n-1) + "
+      "fib(n-2) } }");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->enable_tiering(2));
+  REQUIRE(!(*jit)->add_program_lazily("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 55);
+
+  // main is only called once, so fib is the only function hot enough
+  auto tier_ups = (*jit)->finish_tier_ups();
+  REQUIRE(tier_ups.size() == 1);
+  REQUIRE(tier_ups[0].name == "fib");
+
+  // Calls now go through the stub to the optimized code
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 55);
+}
+
+TEST_CASE("const tables are read from constant memory", "[jit]") {
+  auto program = parse_program("const func squares() -> [8]i64 {"
+                               "var table: [8]i64 = [0; 8]"
+                               "for i in 0..8 { table[i] = i * i }"
+                               "return table"
+                               "}"
+                               "const var table: [8]i64 = squares()"
+                               "func clear(s: []i64) -> i64 {"
+                               "s[0] = 100 "
+                               "return s[0]"
+                               "}"
+                               "func main() -> i64 {"
+                               "const var offset: i64 = table[7] - 40 "
+                               "return clear(table) + clear(table[0..2]) +"
+                               "table[5] + offset + len(table)"
+                               "}");
+  REQUIRE(!evaluate_constants(*program));
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  // Slices of a const are of a copy, so writing through them is harmless
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 242);
+}
+
+TEST_CASE("memoized functions return cached results", "[jit]") {
+  // Both would take far too long without their caches
+  auto program = parse_program(
+      "@memoize(100) func fib(n: i64) -> i64 {"
+      "return if n < 3 { 1 } else { fib(n - 1) + fib(n - 2) }"
+      "}"
+      "@memoize(threadsafe) func paths(x: i64, y: i32) -> i64 {"
+      "return if x == 0 { 1 } else {"
+      "if y == 0i32 { 1 } else { paths(x - 1, y) + paths(x, y - 1i32) }"
+      "}"
+      "}"
+      "func main() -> i64 {"
+      "var a: i64 = fib(90) - 2880067194370816000 "
+      "var b: i64 = paths(20, 20i32) - 137846528800 "
+      "return a + b"
+      "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 120 + 20);
+}
+
+TEST_CASE("generic functions run as their specializations", "[jit]") {
+  auto program = parse_program(
+      "func max<T>(a: T, b: T) -> T {"
+      "return if a > b { a } else { b }"
+      "}"
+      "func sum<T>(values: []T) -> T {"
+      "var total: T = 0"
+      "for i in 0..len(values) { total = total + values[i] }"
+      "return total"
+      "}"
+      "func main() -> i32 {"
+      "var small: [3]i32 = [10i32, 20i32, 12i32]"
+      "var halves: [2]f64 = [0.5, 1.5]"
+      "var whole: f64 = max(sum(halves), 1)"
+      "var three: i32 = if whole == 2.0 { 3i32 } else { 0i32 }"
+      "return max(sum(small), 2) + max(7i32, 9) / three"
+      "}");
+  REQUIRE(!monomorphize(*program));
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 42 + 3);
+}
+
+TEST_CASE("structs are passed, returned and stored by value", "[jit]") {
+  auto program = parse_program(
+      "struct Point { x: i64, y: i64 }"
+      "@soa struct Body { position: Point, mass: i64 }"
+      "func add(a: Point, b: Point) -> Point {"
+      "return Point(a.x + b.x, a.y + b.y)"
+      "}"
+      "func weigh(bodies: []Body) -> i64 {"
+      "var total: i64 = 0 "
+      "for i in 0..len(bodies) {"
+      "total = total + bodies[i].mass * bodies[i].position.y"
+      "}"
+      "return total"
+      "}"
+      "func main() -> i64 {"
+      "var origin: Point = Point(1, 2)"
+      "var bodies: [4]Body = [Body(origin, 1); 4]"
+      "bodies[1].position = add(origin, Point(2, 3))"
+      "bodies[3] = Body(Point(0, 10), 2)"
+      "var heaviest: Body = bodies[3]"
+      "return weigh(bodies) + weigh(bodies[1..2]) + heaviest.mass"
+      "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+  REQUIRE(Jit::run_main(*main_function, {"test_module"}) == 29 + 5 + 2);
+}
+
+TEST_CASE("print writes its output when main returns", "[jit]") {
+  auto program = parse_program("func main() -> i32 {"
+                               "var n: i64 = 0 - 42 "
+                               "var zero: f64 = 0.0 "
+                               "print(\"[%5d|%-5u|%05.1f|%s]\\n\", n, 7u32, "
+                               "2.25, \"ok\")"
+                               "print(\"%f\\n\", zero / zero)"
+                               "return 0"
+                               "}");
+
+  auto jit = Jit::create();
+  REQUIRE((bool)jit);
+  REQUIRE(!(*jit)->add_program("test_module", program));
+
+  auto main_function = (*jit)->lookup_main();
+  REQUIRE((bool)main_function);
+
+  // print writes to the file descriptor, past stdio
+  auto captured = tmpfile();
+  fflush(stdout);
+  auto saved = dup(STDOUT_FILENO);
+  dup2(fileno(captured), STDOUT_FILENO);
+  auto result = Jit::run_main(*main_function, {"test_module"});
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  char output[64] = {};
+  rewind(captured);
+  fread(output, 1, sizeof(output) - 1, captured);
+  fclose(captured);
+
+  REQUIRE(result == 0);
+  // The CPU's NaN is negative, but NaNs are printed without a sign
+  REQUIRE(std::string(output) == "[  -42|7    |002.2|ok]\nnan\n");
+}
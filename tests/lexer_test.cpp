@@ -136,3 +136,61 @@ TEST_CASE("Less strings are lexed", "[lexer]") {
   REQUIRE(token.kind == Token::Kind::STRING);
   REQUIRE(token.lexeme == "\"hi\"");
 }
+
+TEST_CASE("Ranges end the number before them", "[lexer]") {
+  std::vector<char> input{'0', '.', '.', 'n', EOF};
+  Lexer lexer{&input, 0};
+
+  auto start = lexer.next();
+  auto dots = lexer.next();
+  auto end = lexer.next();
+
+  REQUIRE(start.kind == Token::Kind::NUMBER);
+  REQUIRE(start.lexeme == "0");
+  REQUIRE(dots.kind == Token::Kind::DOT_DOT);
+  REQUIRE(end.kind == Token::Kind::IDENTIFIER);
+}
+
+TEST_CASE("Brackets and semicolons are lexed", "[lexer]") {
+  std::vector<char> input{'[', '0', ';', '4', ']', EOF};
+  Lexer lexer{&input, 0};
+
+  REQUIRE(lexer.next().kind == Token::Kind::LBRACKET);
+  REQUIRE(lexer.next().kind == Token::Kind::NUMBER);
+  REQUIRE(lexer.next().kind == Token::Kind::SEMICOLON);
+  REQUIRE(lexer.next().kind == Token::Kind::NUMBER);
+  REQUIRE(lexer.next().kind == Token::Kind::RBRACKET);
+}
+
+TEST_CASE("Percent is given the appropriate kind", "[lexer]") {
+  std::vector<char> input{'7', '%', '2', EOF};
+  Lexer lexer{&input, 0};
+
+  REQUIRE(lexer.next().kind == Token::Kind::NUMBER);
+  REQUIRE(lexer.next().kind == Token::Kind::PERCENT);
+  REQUIRE(lexer.next().kind == Token::Kind::NUMBER);
+}
+
+TEST_CASE("Const is a keyword", "[lexer]") {
+  std::string source = "const constant";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+
+  REQUIRE(lexer.next().kind == Token::Kind::CONST);
+  REQUIRE(lexer.next().kind == Token::Kind::IDENTIFIER);
+}
+
+TEST_CASE("Struct is a keyword, and members follow a dot", "[lexer]") {
+  std::string source = "struct p.x 0..n";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+
+  REQUIRE(lexer.next().kind == Token::Kind::STRUCT);
+  REQUIRE(lexer.next().kind == Token::Kind::IDENTIFIER);
+  REQUIRE(lexer.next().kind == Token::Kind::DOT);
+  REQUIRE(lexer.next().kind == Token::Kind::IDENTIFIER);
+  REQUIRE(lexer.next().kind == Token::Kind::NUMBER);
+  REQUIRE(lexer.next().kind == Token::Kind::DOT_DOT);
+}
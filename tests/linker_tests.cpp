@@ -0,0 +1,97 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/linker.hpp"
+#include "helpers.hpp"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+using namespace llvm;
+
+// Compiles the program for this machine, links it and runs it, returning its
+// exit status
+static int run_executable(ast::Program *program, bool release) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  CodeGen generator;
+  auto module = generator.compile_module("test_module", program, release);
+
+  auto triple = sys::getProcessTriple();
+  std::string error;
+  auto target = TargetRegistry::lookupTarget(triple, error);
+  REQUIRE(target);
+
+  TargetOptions options;
+  options.FunctionSections = true;
+  auto machine = target->createTargetMachine(triple, "generic", "", options,
+                                             None);
+  module->setDataLayout(machine->createDataLayout());
+  module->setTargetTriple(triple);
+
+  std::vector<ObjectBuffer> objects(1);
+  raw_svector_ostream stream(objects.front());
+  legacy::PassManager pass;
+  REQUIRE(!machine->addPassesToEmitFile(pass, stream, nullptr,
+                                        CGFT_ObjectFile));
+  pass.run(*module);
+
+  SmallString<128> output;
+  REQUIRE(!sys::fs::createTemporaryFile("solar-test", "", output));
+
+  REQUIRE(!link_executable(objects, output.str().str(), release));
+  auto status = sys::ExecuteAndWait(output, {output});
+
+  sys::fs::remove(output);
+  delete machine;
+  delete module;
+  return status;
+}
+
+TEST_CASE("objects in memory link into an executable", "[linker]") {
+  auto program = parse_program("func unused() -> i32 { return 4 }"
+                               "func main() -> i32 { return 3 }");
+
+  REQUIRE(run_executable(program, true) == 3);
+}
+
+TEST_CASE("slices of local arrays outlive returned calls in executables",
+          "[linker]") {
+  auto program = parse_program("func total(s: []i64) -> i64 {"
+                               "var sum: i64 = 0 "
+                               "for i in 0..len(s) { sum = sum + s[i] }"
+                               "return sum"
+                               "}"
+                               "func first(s: []i64) -> i64 { return s[0] }"
+                               "func of_first() -> i64 {"
+                               "var a: [2]i64 = [9, 1] "
+                               "return first(a)"
+                               "}"
+                               "func main() -> i64 {"
+                               "var a: [4]i64 = [1, 2, 3, 4] "
+                               "a[0] = a[0] + of_first() "
+                               "return total(a)"
+                               "}");
+
+  REQUIRE(run_executable(program, false) == 9 + 10);
+}
+
+TEST_CASE("float remainders link into an executable", "[linker]") {
+  auto program = parse_program("func main() -> i32 {"
+                               "var x: f64 = 7.5 "
+                               "var y: f64 = 2.0 "
+                               "var a: f32 = 7.5f32 "
+                               "var b: f32 = 2.0f32 "
+                               "var wide: i32 = if x % y == 1.5 { 1i32 } "
+                               "else { 0i32 }"
+                               "var narrow: i32 = if a % b == 1.5f32 { 2i32 } "
+                               "else { 0i32 }"
+                               "return wide + narrow"
+                               "}");
+
+  REQUIRE(run_executable(program, false) == 3);
+}
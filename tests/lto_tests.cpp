@@ -0,0 +1,120 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/lto.hpp"
+#include "helpers.hpp"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+
+static std::unique_ptr<Module>
+link_programs(LLVMContext &context,
+              const std::unordered_set<std::string> &exports) {
+  std::vector<ast::Program *> programs{
+      parse_program("func main() -> i32 { return add(40, 2) }"),
+      parse_program("func add(a: i32, b: i32) -> i32 { return a + b }"
+                    "func unused(a: i32) -> i32 { return a }"),
+  };
+
+  std::vector<std::unique_ptr<Module>> modules;
+  for (auto program : programs) {
+    CodeGen generator(&context);
+    modules.emplace_back(
+        generator.compile_module("test_module", program, true, programs));
+  }
+
+  auto module = link_whole_program(std::move(modules), exports, true);
+  REQUIRE((bool)module);
+  return std::move(*module);
+}
+
+TEST_CASE("calls across files are inlined", "[lto]") {
+  LLVMContext context;
+  auto module = link_programs(context, {});
+
+  REQUIRE(!module->getFunction("add"));
+  REQUIRE(!module->getFunction("unused"));
+
+  auto main_function = module->getFunction("main");
+  REQUIRE(main_function->hasExternalLinkage());
+  REQUIRE(std::none_of(main_function->getEntryBlock().begin(),
+                       main_function->getEntryBlock().end(),
+                       [](const Instruction &instruction) {
+                         return isa<CallInst>(instruction);
+                       }));
+}
+
+TEST_CASE("exported functions stay external", "[lto]") {
+  LLVMContext context;
+  auto module = link_programs(context, {"unused"});
+
+  REQUIRE(module->getFunction("unused"));
+  REQUIRE(module->getFunction("unused")->hasExternalLinkage());
+}
+
+TEST_CASE("thin linked modules link into an executable", "[lto]") {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::vector<ast::Program *> programs{
+      parse_program("func main() -> i32 { return add(40, 2) }"),
+      parse_program("func add(a: i32, b: i32) -> i32 { return a + b }"),
+  };
+
+  auto triple = sys::getProcessTriple();
+  std::string error;
+  auto target = TargetRegistry::lookupTarget(triple, error);
+  REQUIRE(target);
+
+  auto create_target_machine = [&] {
+    return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+        triple, "generic", "", TargetOptions(), None));
+  };
+
+  // Thin link inputs are independent, like separate compiler invocations
+  std::vector<ObjectBuffer> bitcode;
+  std::vector<std::string> names;
+  for (size_t i = 0; i < programs.size(); ++i) {
+    LLVMContext context;
+    CodeGen generator(&context);
+    std::unique_ptr<Module> module(generator.compile_module(
+        "module" + std::to_string(i), programs[i], true, programs));
+    module->setDataLayout(create_target_machine()->createDataLayout());
+    module->setTargetTriple(triple);
+
+    bitcode.emplace_back();
+    names.push_back(module->getModuleIdentifier());
+    raw_svector_ostream stream(bitcode.back());
+    write_thin_lto_bitcode(*module, stream);
+  }
+
+  std::vector<ObjectBuffer> objects;
+  REQUIRE(!thin_link(bitcode, names, {}, create_target_machine, 3,
+                     ProfileOptions(), 2, objects));
+  REQUIRE(objects.size() == 2);
+
+  // add is imported into main's module and inlined there, so main's object
+  // no longer refers to it
+  auto main_object = object::ObjectFile::createObjectFile(
+      MemoryBufferRef(StringRef(objects[0].data(), objects[0].size()),
+                      names[0]));
+  REQUIRE((bool)main_object);
+  for (const auto &symbol : (*main_object)->symbols()) {
+    auto name = symbol.getName();
+    REQUIRE((bool)name);
+    REQUIRE(*name != "add");
+  }
+
+  SmallString<128> output;
+  REQUIRE(!sys::fs::createTemporaryFile("solar-test", "", output));
+
+  REQUIRE(!link_executable(objects, output.str().str(), true));
+  REQUIRE(sys::ExecuteAndWait(output, {output}) == 42);
+
+  sys::fs::remove(output);
+}
@@ -0,0 +1,53 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/memory.hpp"
+#include "helpers.hpp"
+
+using namespace llvm;
+
+TEST_CASE("allocations are counted once enabled", "[memory]") {
+  enable_memory_accounting();
+  REQUIRE(memory_accounting_enabled());
+
+  auto before = allocation_counters();
+  auto values = new std::vector<int>(1000);
+  auto during = allocation_counters();
+  delete values;
+  auto after = allocation_counters();
+
+  REQUIRE(during.allocations >= before.allocations + 2);
+  REQUIRE(during.allocated_bytes >= before.allocated_bytes + 4000);
+  REQUIRE(during.live_bytes >= before.live_bytes + 4000);
+  REQUIRE(after.live_bytes < during.live_bytes);
+}
+
+TEST_CASE("peak resident memory is reported", "[memory]") {
+  REQUIRE(peak_resident_bytes() > 0);
+}
+
+TEST_CASE("phases and footprints are reported", "[memory]") {
+  enable_memory_accounting();
+
+  LLVMContext context;
+  std::unique_ptr<Module> module;
+  {
+    MemoryScope memory("TestPhase");
+    auto program = parse_program("func main() -> i64 { return 1 }");
+    CodeGen generator(&context);
+    module.reset(generator.compile_module("test_module", program));
+  }
+
+  REQUIRE(describe_size(*module) ==
+          "1 functions, 1 blocks, 1 instructions, 0 globals");
+
+  record_footprint("Module", "test_module", 1024, describe_size(*module));
+
+  std::string report;
+  raw_string_ostream stream(report);
+  print_memory_report(stream);
+  stream.flush();
+
+  REQUIRE(report.find("TestPhase") != std::string::npos);
+  REQUIRE(report.find("test_module") != std::string::npos);
+}
@@ -65,6 +65,16 @@ TEST_CASE("Parse integer division expression. ", "[parser]") {
   REQUIRE(statement->expression->describe() == "(/ (i64<1>) (i64<2>))");
 }
 
+TEST_CASE("Parse integer remainder expression. ", "[parser]") {
+  std::vector<char> input{'1', '+', '7', '%', '2', EOF};
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+  auto program = parser.parse_program();
+  auto statement = (ast::ExpressionStatement *)program->statements.front();
+  REQUIRE(statement->expression->describe() ==
+          "(+ (i64<1>) (% (i64<7>) (i64<2>)))");
+}
+
 TEST_CASE("Parse multiple integer addition expression. ", "[parser]") {
   std::vector<char> input{'1', '+', '2', '+', '3', EOF};
   Lexer lexer{&input, 0};
@@ -200,3 +210,180 @@ TEST_CASE("Parse string literal escape sequences. ", "[parser]") {
   auto statement = program->statements.front();
   REQUIRE(statement->describe() == "(string-literal<tab\tme>)");
 }
+
+TEST_CASE("Parse while loops. ", "[parser]") {
+  std::string source = "while n > 0 { n = n - 1 }";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto statement = program->statements.front();
+  REQUIRE(statement->describe() ==
+          "(while (> (var n) (i64<0>)) (block \n"
+          "(assign (var n) (- (var n) (i64<1>)))\n"
+          "))");
+}
+
+TEST_CASE("Parse for loops with hints. ", "[parser]") {
+  std::string source = "@unroll(4) @vectorize for i in 0..n { f(i) }";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto statement = program->statements.front();
+  REQUIRE(statement->describe() ==
+          "(@unroll(4) @vectorize for i (i64<0>)..(var n) (block \n"
+          "(fn-call f: (var i))\n"
+          "))");
+}
+
+TEST_CASE("Parse array and slice types. ", "[parser]") {
+  std::string source = "func sum(s: []i64, a: [4]i32) -> i64 { return 0 }";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto function = dynamic_cast<ast::Function *>(program->statements.front());
+  REQUIRE(function);
+  REQUIRE(function->prototype.parameter_list[0].type.lexeme == "[]i64");
+  REQUIRE(function->prototype.parameter_list[1].type.lexeme == "[4]i32");
+}
+
+TEST_CASE("Parse indexing, slicing and array literals. ", "[parser]") {
+  std::string source = "a[i] = s[1..n][0] + [1, 2][0] + [0; 8][i]";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto statement = program->statements.front();
+  REQUIRE(statement->describe() ==
+          "(assign (index (var a) (var i)) "
+          "(+ (+ (index (index (var s) (i64<1>)..(var n)) (i64<0>)) "
+          "(index (array (i64<1>), (i64<2>)) (i64<0>))) "
+          "(index (array (i64<0>); 8) (var i))))");
+}
+
+TEST_CASE("Parse function attributes. ", "[parser]") {
+  std::string source = "@pure @inline func f(x: i64) -> i64 { return x }";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto function = dynamic_cast<ast::Function *>(program->statements.front());
+  REQUIRE(function);
+  REQUIRE(function->prototype.describe() == "(fn-type @pure @inline f(x:i64) ");
+  REQUIRE(function->prototype.has_attribute("pure"));
+  REQUIRE(!function->prototype.has_attribute("cold"));
+}
+
+TEST_CASE("Parse fast math flags. ", "[parser]") {
+  std::string source = "@fastmath(contract, reassoc) func f(x: f64) -> f64 {"
+                       "return x"
+                       "}";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto function = dynamic_cast<ast::Function *>(program->statements.front());
+  REQUIRE(function);
+  REQUIRE(function->prototype.describe() ==
+          "(fn-type @fastmath(contract, reassoc) f(x:f64) ");
+}
+
+TEST_CASE("Parse const functions and variables. ", "[parser]") {
+  std::string source = "const func square(x: i64) -> i64 { return x * x }"
+                       "const var four: i64 = square(2)"
+                       "const var nine: i64 = square(3)";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+  REQUIRE(program->statements.size() == 3);
+
+  auto function = dynamic_cast<ast::Function *>(program->statements[0]);
+  REQUIRE(function);
+  REQUIRE(function->prototype.describe() == "(fn-type const square(x:i64) ");
+
+  REQUIRE(program->statements[1]->describe() ==
+          "(const-decl i64<four> (fn-call square: (i64<2>)))");
+  REQUIRE(program->statements[2]->describe() ==
+          "(const-decl i64<nine> (fn-call square: (i64<3>)))");
+}
+
+TEST_CASE("Parse memoize options. ", "[parser]") {
+  std::string source = "@memoize(threadsafe, 64) func f(x: i64) -> i64 {"
+                       "return x"
+                       "}";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto function = dynamic_cast<ast::Function *>(program->statements.front());
+  REQUIRE(function);
+  REQUIRE(function->prototype.describe() ==
+          "(fn-type @memoize(threadsafe, 64) f(x:i64) ");
+}
+
+TEST_CASE("Parse generic functions. ", "[parser]") {
+  std::string source = "func pick<T, U>(a: T, b: []U) -> T { return a }";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+
+  auto function = dynamic_cast<ast::Function *>(program->statements.front());
+  REQUIRE(function);
+  REQUIRE(function->prototype.type_parameters.size() == 2);
+  REQUIRE(function->prototype.describe() ==
+          "(fn-type pick<T, U>(a:T, b:[]U) ");
+}
+
+TEST_CASE("Parse structs. ", "[parser]") {
+  std::string source = "@align(64) struct Counter { hits: i64, total: f64, }"
+                       "func bump(c: Counter) -> i64 {"
+                       "c.hits = c.hits + 1 "
+                       "return c.hits"
+                       "}";
+  std::vector<char> input(source.begin(), source.end());
+  input.push_back(EOF);
+  Lexer lexer{&input, 0};
+  Parser parser(&lexer);
+
+  auto program = parser.parse_program();
+  REQUIRE(program->statements.size() == 2);
+
+  auto structure = dynamic_cast<ast::Struct *>(program->statements[0]);
+  REQUIRE(structure);
+  REQUIRE(structure->has_attribute("align"));
+  REQUIRE(structure->describe() ==
+          "(struct @align(64) Counter(hits:i64, total:f64))");
+
+  auto function = dynamic_cast<ast::Function *>(program->statements[1]);
+  REQUIRE(function->body->statements[0]->describe() ==
+          "(assign (member (var c) hits) (+ (member (var c) hits) (i64<1>)))");
+}
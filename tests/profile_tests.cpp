@@ -0,0 +1,43 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/profile.hpp"
+#include "helpers.hpp"
+
+using namespace llvm;
+
+static std::unique_ptr<Module> optimize(LLVMContext &context,
+                                        const ProfileOptions &profile) {
+  auto program = parse_program("func pick(n: i64) -> i64 {"
+                               "return if n < 10 { n * 2 } else { n - 1 }"
+                               "}"
+                               "func main() -> i64 { return pick(5) }");
+
+  CodeGen generator(&context);
+  std::unique_ptr<Module> module(
+      generator.compile_module("test_module", program, true));
+
+  legacy::PassManager passes;
+  populate_module_passes(passes, 3, profile);
+  passes.run(*module);
+
+  return module;
+}
+
+TEST_CASE("instrumented functions get counters", "[profile]") {
+  ProfileOptions profile;
+  profile.generate = true;
+
+  LLVMContext context;
+  auto module = optimize(context, profile);
+
+  REQUIRE(module->getGlobalVariable("__profc_pick", true));
+  REQUIRE(module->getGlobalVariable("__profc_main", true));
+}
+
+TEST_CASE("uninstrumented functions get no counters", "[profile]") {
+  LLVMContext context;
+  auto module = optimize(context, ProfileOptions());
+
+  REQUIRE(!module->getGlobalVariable("__profc_pick", true));
+}
@@ -0,0 +1,92 @@
+#include "catch/catch.hpp"
+
+#include "../src/purity.hpp"
+#include "helpers.hpp"
+
+// Why the program's @memoize functions can't be cached, or nothing
+static std::string check(const std::string &source) {
+  auto error = check_memoized(*parse_program(source));
+  return error ? toString(std::move(error)) : "";
+}
+
+TEST_CASE("pure recursive functions can be memoized", "[purity]") {
+  REQUIRE(check("@memoize func fib(n: i64) -> i64 {"
+                "return if n < 3 { 1 } else { fib(n - 1) + fib(n - 2) }"
+                "}")
+              .empty());
+
+  // Functions that only call each other are pure together
+  REQUIRE(check("@memoize func even(n: u64) -> bool {"
+                "return if n == 0u64 { true } else { odd(n - 1u64) }"
+                "}"
+                "func odd(n: u64) -> bool {"
+                "return if n == 0u64 { false } else { even(n - 1u64) }"
+                "}")
+              .empty());
+}
+
+TEST_CASE("impure functions can't be memoized", "[purity]") {
+  REQUIRE(check("@memoize func noisy(n: i64) -> i64 {"
+                "printf(\"%d\", n) "
+                "return n"
+                "}")
+              .find("noisy calls printf, which isn't known to be pure") !=
+          std::string::npos);
+
+  REQUIRE(check("func log(n: i64) -> i64 { return printf(\"%d\", n) }"
+                "func twice(n: i64) -> i64 { return log(n) + log(n) }"
+                "@memoize func quiet(n: i64) -> i64 { return twice(n) }")
+              .find("quiet calls twice, which isn't pure") !=
+          std::string::npos);
+}
+
+TEST_CASE("only scalars can be memoized", "[purity]") {
+  REQUIRE(check("@memoize func sum(s: []i64) -> i64 { return len(s) }")
+              .find("sum takes []i64, but only scalars can be cached") !=
+          std::string::npos);
+
+  REQUIRE(check("@memoize func wide(n: i64) -> f64x4 { return f64x4(1.0) }")
+              .find("wide returns f64x4") != std::string::npos);
+}
+
+// Why the program's @pure functions aren't pure, or nothing
+static std::string check_pure_functions(const std::string &source) {
+  auto error = check_pure(*parse_program(source));
+  return error ? toString(std::move(error)) : "";
+}
+
+TEST_CASE("pure functions can read their slices", "[purity]") {
+  REQUIRE(check_pure_functions("@pure func sum(s: []i64) -> i64 {"
+                               "var total: i64 = 0 "
+                               "for i in 0..len(s) { total = total + s[i] }"
+                               "return total"
+                               "}")
+              .empty());
+}
+
+TEST_CASE("impure functions can't be marked pure", "[purity]") {
+  REQUIRE(check_pure_functions("@pure func noisy(n: i64) -> i64 {"
+                               "print(\"%d\", n) "
+                               "return n"
+                               "}")
+              .find("@pure function noisy calls print, which isn't known to "
+                    "be pure") != std::string::npos);
+
+  REQUIRE(check_pure_functions("func clear(s: []i64) { s[0] = 0 }"
+                               "@pure func reset(s: []i64) -> i64 {"
+                               "clear(s) "
+                               "return 0"
+                               "}")
+              .find("reset calls clear, which isn't pure") !=
+          std::string::npos);
+
+  // Writing a local array is fine, but not writing through a slice
+  REQUIRE(check_pure_functions("@pure func first(s: []i64) -> i64 {"
+                               "var copy: [2]i64 = [0, 0] "
+                               "copy[0] = s[0] "
+                               "var rest: []i64 = s[1..2] "
+                               "rest[0] = 1 "
+                               "return copy[0]"
+                               "}")
+              .find("first writes through a slice") != std::string::npos);
+}
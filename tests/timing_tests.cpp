@@ -0,0 +1,30 @@
+#include "catch/catch.hpp"
+
+#include "../src/codegen.hpp"
+#include "../src/timing.hpp"
+#include "helpers.hpp"
+#include "llvm/ADT/SmallString.h"
+
+using namespace llvm;
+
+TEST_CASE("code generation is traced by function", "[timing]") {
+  timeTraceProfilerInitialize(0, "solar-tests");
+
+  {
+    PhaseTimer timer("Parse");
+    auto program = parse_program("func answer() -> i32 { return 42 }");
+
+    CodeGen generator;
+    delete generator.compile_module("test_module", program, true);
+  }
+
+  SmallString<1024> trace;
+  raw_svector_ostream stream(trace);
+  timeTraceProfilerWrite(stream);
+  timeTraceProfilerCleanup();
+
+  REQUIRE(trace.str().contains("\"Parse\""));
+  REQUIRE(trace.str().contains("\"CodeGen\""));
+  REQUIRE(trace.str().contains("\"CodeGenFunction\""));
+  REQUIRE(trace.str().contains("\"answer\""));
+}
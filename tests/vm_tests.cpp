@@ -0,0 +1,170 @@
+#include "catch/catch.hpp"
+
+#include "../src/evaluator.hpp"
+#include "../src/vm.hpp"
+#include "helpers.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+
+static int64_t run(const std::string &source) {
+  auto program = parse_program(source);
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(*program);
+  REQUIRE((bool)bytecode);
+
+  vm::Interpreter interpreter;
+  auto result = interpreter.run(**bytecode);
+  REQUIRE((bool)result);
+
+  return *result;
+}
+
+TEST_CASE("main's result is returned", "[vm]") {
+  REQUIRE(run("func add(a: i32, b: i32) -> i32 { return a + b }"
+              "func main() -> i32 { return add(40, 2) }") == 42);
+}
+
+TEST_CASE("recursive calls return through their frames", "[vm]") {
+  REQUIRE(run("func fib(n: i64) -> i64 {"
+              "return if n < 3 { 1 } else { fib(n-1) + fib(n-2) }"
+              "}"
+              "func main() -> i64 { return fib(20) }") == 6765);
+}
+
+TEST_CASE("i32 arithmetic wraps", "[vm]") {
+  REQUIRE(run("func main() -> i32 {"
+              "var a: i32 = 2147483647"
+              "return a + 1i32"
+              "}") == -2147483648LL);
+}
+
+TEST_CASE("calls in tail position reuse the frame", "[vm]") {
+  // Deeper than the register stack, so it only finishes if frames are reused
+  REQUIRE(run("func count(n: i64, total: i64) -> i64 {"
+              "return if n == 0 { total } else { count(n - 1, total + 1) }"
+              "}"
+              "func main() -> i64 { return count(2000000, 0) }") == 2000000);
+}
+
+TEST_CASE("printf returns the number of characters written", "[vm]") {
+  REQUIRE(run("func main() -> i32 { return printf(\"\") }") == 0);
+}
+
+// What running the program writes to stdout
+static std::string printed(const std::string &source) {
+  auto captured = tmpfile();
+  fflush(stdout);
+  auto saved = dup(STDOUT_FILENO);
+  dup2(fileno(captured), STDOUT_FILENO);
+  auto result = run(source);
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  char output[64] = {};
+  rewind(captured);
+  fread(output, 1, sizeof(output) - 1, captured);
+  fclose(captured);
+
+  REQUIRE(result == 0);
+  return output;
+}
+
+TEST_CASE("print formats like compiled code", "[vm]") {
+  REQUIRE(printed("func main() -> i32 {"
+                  "var n: i32 = 0i32 - 42i32 "
+                  "print(\"[%5d|%-5x|%05.1f|%s]\\n\", n, 255u64, 2.25, "
+                  "\"ok\")"
+                  "return 0"
+                  "}") == "[  -42|ff   |002.2|ok]\n");
+}
+
+TEST_CASE("print's floats have compiled code's digits", "[vm]") {
+  // printf would print 0.10000000000000001 and 1180591620717411303424.0
+  REQUIRE(printed("func main() -> i32 {"
+                  "print(\"%.17f %.1f\\n\", 0.1, "
+                  "1180591620717411303424.0)"
+                  "return 0"
+                  "}") == "0.10000000000000000 1180591620717411328000.0\n");
+
+  // A NaN's sign depends on whether it was folded, so it isn't printed
+  REQUIRE(printed("func main() -> i32 {"
+                  "var zero: f64 = 0.0 "
+                  "print(\"%f %f\\n\", zero / zero, zero * (0.0 - 1.0))"
+                  "return 0"
+                  "}") == "nan -0.000000\n");
+}
+
+TEST_CASE("unknown functions are compile errors", "[vm]") {
+  auto program = parse_program("func main() -> i32 { return missing() }");
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(*program);
+  REQUIRE(!bytecode);
+  REQUIRE(toString(bytecode.takeError()).find("missing") != std::string::npos);
+}
+
+TEST_CASE("division by zero is a runtime error", "[vm]") {
+  auto program = parse_program("func main() -> i64 { return 1 / 0 }");
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(*program);
+  REQUIRE((bool)bytecode);
+
+  vm::Interpreter interpreter;
+  auto result = interpreter.run(**bytecode);
+  REQUIRE(!result);
+  consumeError(result.takeError());
+}
+
+TEST_CASE("unsigned integers divide and compare unsigned", "[vm]") {
+  REQUIRE(run("func main() -> i64 {"
+              "var big: u64 = 18446744073709551615u64 "
+              "var total: i64 = if big > 1u64 { 1 } else { 0 } "
+              "total = total + big / 8u64 % 10u64 "
+              "var small: u32 = 0u32 - 1u32 "
+              "return total + small / 1000000000u32"
+              "}") == 6);
+}
+
+TEST_CASE("loops run until their condition fails", "[vm]") {
+  REQUIRE(run("func main() -> i64 {"
+              "var total: i64 = 0 "
+              "var n: i64 = 10 "
+              "while n > 0 { total = total + n n = n - 1 }"
+              "for i in 0..5 { total = total + i }"
+              "return total"
+              "}") == 65);
+}
+
+TEST_CASE("arrays are compile errors", "[vm]") {
+  auto program = parse_program("func main() -> i64 {"
+                               "var a: [2]i64 = [1, 2] "
+                               "return a[0]"
+                               "}");
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(*program);
+  REQUIRE(!bytecode);
+  consumeError(bytecode.takeError());
+}
+
+TEST_CASE("consts are compiled where they're used", "[vm]") {
+  auto program = parse_program("const func cube(n: i64) -> i64 {"
+                               "return n * n * n"
+                               "}"
+                               "const var limit: i32 = cube(3)"
+                               "func main() -> i64 { return limit + 15i32 }");
+  REQUIRE(!evaluate_constants(*program));
+
+  vm::Compiler compiler;
+  auto bytecode = compiler.compile(*program);
+  REQUIRE((bool)bytecode);
+
+  vm::Interpreter interpreter;
+  auto result = interpreter.run(**bytecode);
+  REQUIRE((bool)result);
+  REQUIRE(*result == 42);
+}